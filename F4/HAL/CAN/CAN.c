@@ -7,16 +7,286 @@
  */
 
 #include "CAN.h"
+#include <string.h>
+#ifdef CAN_SIMULATION
+#include "CAN_Sim.h"
+#endif
 
 #define CAN_IDE_32            0b00000100
 #define CAN_FREE_LEVEL		  3
+#define CAN_LEC_ERRORS		  (HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | HAL_CAN_ERROR_ACK | \
+							   HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD | HAL_CAN_ERROR_CRC)
+
+/*!
+ * Software transmit queue of the instance
+ */
+typedef struct CAN_TxQueue_s
+{
+	CAN_Frame_t Frames[CAN_TX_QUEUE_SIZE];
+	uint32_t Head;
+	uint32_t Count;
+	uint8_t IsDraining;
+}CAN_TxQueue_t;
+
+#if (CAN_RX_IN_RAM == 1)
+/*!
+ * Receive queue filled by the RAM interrupt handler and emptied by CAN_Process
+ */
+typedef struct CAN_RxRamQueue_s
+{
+	CAN_Frame_t Frames[CAN_RX_RAM_QUEUE_SIZE];
+	uint8_t FilterMatchIndex[CAN_RX_RAM_QUEUE_SIZE];
+	volatile uint32_t Head;
+	volatile uint32_t Tail;
+	volatile uint32_t Lost;
+}CAN_RxRamQueue_t;
+
+static CAN_RxRamQueue_t RxRamQueue[2];
+#endif
 
 static uint32_t RCC_CAN1_CLK_ENABLED = 0;
-static CAN_TxHeaderTypeDef TxHeader;
 static CAN_RxHeaderTypeDef RxHeader;
-static uint32_t TxMailbox;
+static CAN_DeltaStats_t DeltaStats[2];
+static CAN_ErrorStats_t ErrorStats[2];
+static CAN_FilterStats_t FilterStats[CAN_FILTER_BANKS];
+static CAN_TxQueue_t TxQueue[2];
+static uint8_t FilterIndexMap[2][CAN_FILTER_BANKS * 4];
+static uint8_t IsFilterTuning;
 CAN_Message_t Msg;
 
+/*!
+ * @brief Get error statistics of the instance
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CAN_ErrorStats_t
+ */
+static CAN_ErrorStats_t* CAN_GetStats(CAN_HandleTypeDef *pCanHandle)
+{
+	return &ErrorStats[(pCanHandle->Instance == CAN2) ? 1 : 0];
+}
+
+/*!
+ * @brief Read fault confinement state from the error status register
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					State of the node
+ */
+static CAN_BusState_t CAN_ReadBusState(CAN_HandleTypeDef *pCanHandle)
+{
+	uint32_t Esr = pCanHandle->Instance->ESR;
+
+	if(Esr & CAN_ESR_BOFF)
+		return CAN_BUS_STATE_OFF;
+	if(Esr & CAN_ESR_EPVF)
+		return CAN_BUS_STATE_PASSIVE;
+	if(Esr & CAN_ESR_EWGF)
+		return CAN_BUS_STATE_WARNING;
+
+	return CAN_BUS_STATE_ACTIVE;
+}
+
+/*!
+ * @brief Check that the transmission is allowed (the node is not bus-off). The error-passive node keeps
+ *        sending: the controller itself waits the suspend transmission time between its frames
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					1 - transmission is allowed, 0 - node is bus-off
+ */
+static uint8_t CAN_IsTxAllowed(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_ErrorStats_t *pStats = CAN_GetStats(pCanHandle);
+
+	if(pStats->State == CAN_BUS_STATE_OFF)
+	{
+		pStats->Throttled++;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*!
+ * @brief Request transmission of the frame (mailbox must be free)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is placed in a mailbox, 0 - error
+ */
+static uint8_t CAN_AddFrame(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	CAN_TxHeaderTypeDef FrameHeader;
+	uint32_t FrameMailbox;
+
+	FrameHeader.StdId = (pFrame->IDE == CAN_ID_STD) ? pFrame->Id : 0x00;
+	FrameHeader.ExtId = (pFrame->IDE == CAN_ID_EXT) ? pFrame->Id : 0x00;
+	FrameHeader.IDE = pFrame->IDE;
+	FrameHeader.RTR = pFrame->RTR;
+	FrameHeader.DLC = pFrame->Dlc;
+	FrameHeader.TransmitGlobalTime = DISABLE;
+
+	return HAL_CAN_AddTxMessage(pCanHandle, &FrameHeader, (uint8_t*)pFrame->Data, &FrameMailbox) == HAL_OK;
+}
+
+/*!
+ * @brief Move queued frames to the free mailboxes (TX interrupt or locked context)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+static void CAN_DrainTxQueue(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_TxQueue_t *pQueue = &TxQueue[(pCanHandle->Instance == CAN2) ? 1 : 0];
+
+	if(pQueue->IsDraining)
+		return;
+
+	pQueue->IsDraining = 1;
+	while(pQueue->Count > 0 && HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) > 0 &&
+		  CAN_IsTxAllowed(pCanHandle) && CAN_AddFrame(pCanHandle, &pQueue->Frames[pQueue->Head]))
+	{
+		pQueue->Head = (pQueue->Head + 1) % CAN_TX_QUEUE_SIZE;
+		pQueue->Count--;
+	}
+	pQueue->IsDraining = 0;
+}
+
+/*!
+ * @brief Drop the frames of the mailboxes and of the queue, they are stale after the restart
+ *        (TX interrupt must be off or locked)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+static void CAN_FlushTx(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_TxQueue_t *pQueue = &TxQueue[(pCanHandle->Instance == CAN2) ? 1 : 0];
+
+	if(HAL_CAN_AbortTxRequest(pCanHandle, CAN_TX_MAILBOX0 | CAN_TX_MAILBOX1 | CAN_TX_MAILBOX2) != HAL_OK)
+	{
+		/* Abort transmission Error */
+		CAN_ErrorHandler(pCanHandle);
+	}
+	pQueue->Head = 0;
+	pQueue->Count = 0;
+}
+
+/*!
+ * @brief Get filter banks of the instance
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFirst			Pointer to the first bank
+ * @param pEnd				Pointer to the bank after the last one
+ */
+static void CAN_GetFilterRange(CAN_HandleTypeDef *pCanHandle, uint32_t *pFirst, uint32_t *pEnd)
+{
+	*pFirst = (pCanHandle->Instance == CAN2) ? CAN_FILTER_SLAVE_START : 0;
+	*pEnd = (pCanHandle->Instance == CAN2) ? CAN_FILTER_BANKS : CAN_FILTER_SLAVE_START;
+}
+
+/*!
+ * @brief Rebuild the table from the filter match index to the bank
+ *        (filters are numbered per instance, inactive banks included)
+ */
+static void CAN_UpdateFilterMap(void)
+{
+	for(uint32_t Instance = 0; Instance < 2; Instance++)
+	{
+		uint32_t First = Instance ? CAN_FILTER_SLAVE_START : 0;
+		uint32_t End = Instance ? CAN_FILTER_BANKS : CAN_FILTER_SLAVE_START;
+		uint32_t Index = 0;
+
+		for(uint32_t Bank = First; Bank < End; Bank++)
+		{
+			uint32_t Count = (FilterStats[Bank].Scale == CAN_FILTERSCALE_32BIT) ? 1 : 2;
+
+			if(FilterStats[Bank].Mode == CAN_FILTERMODE_IDLIST)
+				Count *= 2;
+
+			while(Count-- && Index < sizeof(FilterIndexMap[0]))
+				FilterIndexMap[Instance][Index++] = (uint8_t)Bank;
+		}
+	}
+}
+
+/*!
+ * @brief Save configuration of the filter bank for the statistics and the tuning
+ *
+ * @param pCanFilterConfig	Pointer to the CAN_FilterTypeDef description
+ * @param RangeType			1 - standard range filter, 2 - extended range filter, 0 - other
+ * @param Id				ID of the range filter
+ * @param Mask				Mask of the range filter
+ */
+static void CAN_SaveFilter(const CAN_FilterTypeDef *pCanFilterConfig, uint8_t RangeType, uint32_t Id, uint32_t Mask)
+{
+	CAN_FilterStats_t *pStats;
+	uint32_t Primask;
+
+	if(pCanFilterConfig->FilterBank >= CAN_FILTER_BANKS)
+		return;
+
+	pStats = &FilterStats[pCanFilterConfig->FilterBank];
+	Primask = __get_PRIMASK();
+	__disable_irq();
+	pStats->Scale = (uint8_t)pCanFilterConfig->FilterScale;
+	pStats->Mode = (uint8_t)pCanFilterConfig->FilterMode;
+	pStats->RangeType = (pCanFilterConfig->FilterScale == CAN_FILTERSCALE_32BIT) ? RangeType : 0;
+	pStats->Id = Id;
+	pStats->Mask = Mask;
+	pStats->IsTuned = IsFilterTuning;
+	if(!IsFilterTuning)
+	{
+		pStats->UserId = Id;
+		pStats->UserMask = Mask;
+	}
+	pStats->Accepted = 0;
+	pStats->Unwanted = 0;
+	CAN_UpdateFilterMap();
+	__set_PRIMASK(Primask);
+}
+
+/*!
+ * @brief Count the received frame on its filter bank
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param FilterMatchIndex	Filter match index of the frame
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param IsWanted			Result of CAN_RxFilterCallback
+ */
+static void CAN_CountFilter(CAN_HandleTypeDef *pCanHandle, uint32_t FilterMatchIndex, const CAN_Frame_t *pFrame, uint8_t IsWanted)
+{
+	CAN_FilterStats_t *pStats;
+
+	if(FilterMatchIndex >= sizeof(FilterIndexMap[0]))
+		return;
+
+	pStats = &FilterStats[FilterIndexMap[(pCanHandle->Instance == CAN2) ? 1 : 0][FilterMatchIndex]];
+	pStats->Accepted++;
+	if(!IsWanted)
+	{
+		pStats->Unwanted++;
+	}
+	else if(pStats->Accepted - pStats->Unwanted == 1)
+	{
+		pStats->WantedAnd = pFrame->Id;
+		pStats->WantedOr = pFrame->Id;
+	}
+	else
+	{
+		pStats->WantedAnd &= pFrame->Id;
+		pStats->WantedOr |= pFrame->Id;
+	}
+}
+
+/*!
+ * @brief Check the share of the unwanted frames of the bank
+ *
+ * @param pStats			Pointer to the CAN_FilterStats_t
+ * @return					1 - bank leaks, 0 - bank is fine or has too few frames
+ */
+static uint8_t CAN_IsFilterLeaky(const CAN_FilterStats_t *pStats)
+{
+	return pStats->Accepted >= CAN_FILTER_MIN_FRAMES &&
+		   (uint64_t)pStats->Unwanted * 100 > (uint64_t)pStats->Accepted * CAN_FILTER_LEAK_PERCENT;
+}
+
 /*!
  * @brief Initial CAN bus
  *
@@ -87,8 +357,10 @@ void CAN_Init(CAN_HandleTypeDef *pCanHandle)
 
 	if (HAL_CAN_Init(pCanHandle) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	CAN_UpdateFilterMap();
 }
 
 /*!
@@ -142,7 +414,7 @@ void CAN_DeInit(CAN_HandleTypeDef *pCanHandle)
 
 	if (HAL_CAN_DeInit(pCanHandle) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
 }
 
@@ -153,15 +425,23 @@ void CAN_DeInit(CAN_HandleTypeDef *pCanHandle)
  */
 void CAN_Start(CAN_HandleTypeDef *pCanHandle)
 {
+	CAN_ErrorStats_t *pStats = CAN_GetStats(pCanHandle);
+
+	pStats->State = CAN_BUS_STATE_ACTIVE;
+	pStats->BackoffMs = CAN_RECOVERY_MIN_MS;
+	pStats->LecErrors = 0;
+	pStats->IsLecMasked = 0;
+	CAN_ResetDeltaStats(pCanHandle);
+
 	if(HAL_CAN_Start(pCanHandle) != HAL_OK)
 	{
 		/* Start CAN Error */
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
-	if(HAL_CAN_ActivateNotification(pCanHandle, CAN_IT_RX_FIFO0_MSG_PENDING) != HAL_OK)
+	if(HAL_CAN_ActivateNotification(pCanHandle, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY | CAN_ERROR_NOTIFICATIONS) != HAL_OK)
 	{
 		/* Activate notification CAN Error */
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
 }
 
@@ -175,13 +455,16 @@ void CAN_Stop(CAN_HandleTypeDef *pCanHandle)
 	if(HAL_CAN_Stop(pCanHandle) != HAL_OK)
 	{
 		/* Start CAN Error */
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
-	if(HAL_CAN_DeactivateNotification(pCanHandle, CAN_IT_RX_FIFO0_MSG_PENDING) != HAL_OK)
+	if(HAL_CAN_DeactivateNotification(pCanHandle, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY | CAN_ERROR_NOTIFICATIONS) != HAL_OK)
 	{
 		/* Activate notification CAN Error */
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	/* TX interrupt is off, no lock needed */
+	CAN_FlushTx(pCanHandle);
 }
 
 /*!
@@ -238,13 +521,15 @@ void CAN_AddRangeFilterStdID(CAN_HandleTypeDef *pCanHandle, CAN_FilterStdId_t *p
 
 	/* Filter activation */
 	CanFilterConfig.FilterActivation = ENABLE;
-	CanFilterConfig.SlaveStartFilterBank = 14;
+	CanFilterConfig.SlaveStartFilterBank = CAN_FILTER_SLAVE_START;
 
 	/* Configuration filter */
 	if(HAL_CAN_ConfigFilter(pCanHandle, &CanFilterConfig) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	CAN_SaveFilter(&CanFilterConfig, 1, pCanFilter->IdHigh, pCanFilter->IdHighMask);
 }
 
 /*!
@@ -283,13 +568,16 @@ void CAN_AddRangeFilterExtID(CAN_HandleTypeDef *pCanHandle, CAN_FilterExtId_t *p
 
 	/* Filter activation */
 	CanFilterConfig.FilterActivation = ENABLE;
-	CanFilterConfig.SlaveStartFilterBank = 14;
+	CanFilterConfig.SlaveStartFilterBank = CAN_FILTER_SLAVE_START;
 
 	/* Configuration filter */
 	if(HAL_CAN_ConfigFilter(pCanHandle, &CanFilterConfig) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	CAN_SaveFilter(&CanFilterConfig, 2, (pCanFilter->IdHigh & 0x1FFFE000) | (pCanFilter->IdLow & 0x1FFF),
+				   (pCanFilter->IdHighMask & 0x1FFFE000) | (pCanFilter->IdLowMask & 0x1FFF));
 }
 
 /*!
@@ -346,13 +634,15 @@ void CAN_AddFilterStdID(CAN_HandleTypeDef *pCanHandle, CAN_FilterStdId_t *pCanFi
 
 	/* Filter activation */
 	CanFilterConfig.FilterActivation = ENABLE;
-	CanFilterConfig.SlaveStartFilterBank = 14;
+	CanFilterConfig.SlaveStartFilterBank = CAN_FILTER_SLAVE_START;
 
 	/* Configuration filter */
 	if(HAL_CAN_ConfigFilter(pCanHandle, &CanFilterConfig) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	CAN_SaveFilter(&CanFilterConfig, 0, 0, 0);
 }
 
 /*!
@@ -391,81 +681,726 @@ void CAN_AddFilterExtID(CAN_HandleTypeDef *pCanHandle, CAN_FilterStdId_t *pCanFi
 
 	/* Filter activation */
 	CanFilterConfig.FilterActivation = ENABLE;
-	CanFilterConfig.SlaveStartFilterBank = 14;
+	CanFilterConfig.SlaveStartFilterBank = CAN_FILTER_SLAVE_START;
 
 	/* Configuration filter */
 	if(HAL_CAN_ConfigFilter(pCanHandle, &CanFilterConfig) != HAL_OK)
 	{
-		CAN_ErrorHandler();
+		CAN_ErrorHandler(pCanHandle);
 	}
+
+	CAN_SaveFilter(&CanFilterConfig, 0, 0, 0);
 }
 
 /*!
- * @brief Send message with standard ID
+ * @brief Send frame and wait for transmission complete. The frame goes through the TX queue,
+ *        so it keeps its order after the frames of CAN_SendBatch
  *
  * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is sent, 0 - node is bus-off
  */
-void CAN_StdSendMessage(CAN_HandleTypeDef *pCanHandle)
+static uint8_t CAN_SendFrameWait(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
 {
-	TxHeader.StdId = Msg.StdID;
-	TxHeader.ExtId = 0x00;
-	TxHeader.IDE = CAN_ID_STD;
-	TxHeader.RTR = CAN_RTR_DATA;
-	TxHeader.DLC = Msg.SizeMsgTx;
-	TxHeader.TransmitGlobalTime = DISABLE;
+	CAN_TxQueue_t *pQueue = &TxQueue[(pCanHandle->Instance == CAN2) ? 1 : 0];
+	CAN_ErrorStats_t *pStats = CAN_GetStats(pCanHandle);
 
-	/* Request transmission */
-	if(HAL_CAN_AddTxMessage(pCanHandle, &TxHeader, Msg.TxData, &TxMailbox) != HAL_OK)
+	/* The queue is full: the TX interrupt frees it */
+	while(CAN_SendBatch(pCanHandle, pFrame, 1) == 0)
 	{
-		/* Transmission request Error */
-		CAN_ErrorHandler();
+		if(pStats->State == CAN_BUS_STATE_OFF)
+			return 0;
+		CAN_WAIT_TICK();
 	}
 
-	/* Wait transmission complete */
-	while(HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) != CAN_FREE_LEVEL) {}
+	/* Wait transmission complete of the queue and the mailboxes (they are frozen while the node is bus-off) */
+	while((pQueue->Count > 0 || HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) != CAN_FREE_LEVEL) &&
+		  pStats->State != CAN_BUS_STATE_OFF)
+		CAN_WAIT_TICK();
+
+	return (pQueue->Count == 0 && HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) == CAN_FREE_LEVEL);
+}
+
+/*!
+ * @brief Send message with standard ID
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					1 - message is sent, 0 - node is bus-off or the frame is rejected
+ */
+uint8_t CAN_StdSendMessage(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_Frame_t Frame;
+
+	Frame.Id = Msg.StdID;
+	Frame.IDE = CAN_ID_STD;
+	Frame.RTR = CAN_RTR_DATA;
+	Frame.Dlc = Msg.SizeMsgTx;
+	memcpy(Frame.Data, Msg.TxData, sizeof(Frame.Data));
+
+	return CAN_SendFrameWait(pCanHandle, &Frame);
 }
 
 /*!
  * @brief Send message with extended ID
  *
  * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					1 - message is sent, 0 - node is bus-off or the frame is rejected
+ */
+uint8_t CAN_ExtSendMessage(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_Frame_t Frame;
+
+	Frame.Id = Msg.ExtID;
+	Frame.IDE = CAN_ID_EXT;
+	Frame.RTR = CAN_RTR_DATA;
+	Frame.Dlc = Msg.SizeMsgTx;
+	memcpy(Frame.Data, Msg.TxData, sizeof(Frame.Data));
+
+	return CAN_SendFrameWait(pCanHandle, &Frame);
+}
+
+/*!
+ * @brief Send frame without waiting for transmission complete
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is placed in a mailbox, 0 - no free mailbox
+ */
+uint8_t CAN_SendFrame(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	uint8_t IsSent = 0;
+	uint32_t Primask;
+
+	/* The TX interrupt may load the queued frames into the same mailboxes */
+	Primask = __get_PRIMASK();
+	__disable_irq();
+	if(HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) > 0 && CAN_IsTxAllowed(pCanHandle))
+		IsSent = CAN_AddFrame(pCanHandle, pFrame);
+	__set_PRIMASK(Primask);
+
+	return IsSent;
+}
+
+/*!
+ * @brief Send array of frames: free mailboxes are loaded at once, the rest is queued and sent
+ *        from the TX interrupt in order
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrames			Pointer to the array of CAN_Frame_t
+ * @param Count				Number of frames
+ * @return					Number of accepted frames (loaded or queued), 0 - node is bus-off
  */
-void CAN_ExtSendMessage(CAN_HandleTypeDef *pCanHandle)
+uint32_t CAN_SendBatch(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrames, uint32_t Count)
 {
-	TxHeader.StdId = 0x00;
-	TxHeader.ExtId = Msg.ExtID;
-	TxHeader.IDE = CAN_ID_EXT;
-	TxHeader.RTR = CAN_RTR_DATA;
-	TxHeader.DLC = Msg.SizeMsgTx;
-	TxHeader.TransmitGlobalTime = DISABLE;
+	CAN_TxQueue_t *pQueue = &TxQueue[(pCanHandle->Instance == CAN2) ? 1 : 0];
+	uint32_t Accepted = 0;
+	uint32_t FreeLevel;
+	uint32_t Primask;
 
-	/* Request transmission */
-	if(HAL_CAN_AddTxMessage(pCanHandle, &TxHeader, Msg.TxData, &TxMailbox) != HAL_OK)
+	/* One lock for the whole batch */
+	Primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* Frames queued while bus-off would go out stale after the recovery */
+	if(!CAN_IsTxAllowed(pCanHandle))
+	{
+		__set_PRIMASK(Primask);
+		return 0;
+	}
+
+	/* Mailboxes are loaded directly only if no older frame is waiting */
+	if(pQueue->Count == 0)
+	{
+		FreeLevel = HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle);
+		while(Accepted < Count && FreeLevel > 0 && CAN_IsTxAllowed(pCanHandle) &&
+			  CAN_AddFrame(pCanHandle, &pFrames[Accepted]))
+		{
+			Accepted++;
+			FreeLevel--;
+		}
+	}
+
+	while(Accepted < Count && pQueue->Count < CAN_TX_QUEUE_SIZE)
+	{
+		pQueue->Frames[(pQueue->Head + pQueue->Count) % CAN_TX_QUEUE_SIZE] = pFrames[Accepted++];
+		pQueue->Count++;
+	}
+
+	__set_PRIMASK(Primask);
+
+	return Accepted;
+}
+
+/*!
+ * @brief Send cyclic message only if the data changed or the keep-alive interval expired
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pCyclicMsg		Pointer to the CAN_CyclicMsg_t description
+ * @return					1 - frame is sent, 0 - frame is suppressed or no free mailbox
+ */
+uint8_t CAN_SendOnChange(CAN_HandleTypeDef *pCanHandle, CAN_CyclicMsg_t *pCyclicMsg)
+{
+	CAN_DeltaStats_t *pStats = &DeltaStats[(pCanHandle->Instance == CAN2) ? 1 : 0];
+	const CAN_Frame_t *pFrame = &pCyclicMsg->Frame;
+	const CAN_Frame_t *pLast = &pCyclicMsg->LastFrame;
+	uint32_t Tick = HAL_GetTick();
+	uint8_t Size = (pFrame->Dlc > 8) ? 8 : pFrame->Dlc;
+
+	/* The whole frame is compared: a new ID or type is a change even with the same data */
+	if(pCyclicMsg->IsSent &&
+	   pFrame->Id == pLast->Id && pFrame->IDE == pLast->IDE && pFrame->RTR == pLast->RTR &&
+	   pFrame->Dlc == pLast->Dlc &&
+	   (pFrame->RTR == CAN_RTR_REMOTE || memcmp(pFrame->Data, pLast->Data, Size) == 0) &&
+	   (Tick - pCyclicMsg->LastTick) < pCyclicMsg->KeepAliveMs)
 	{
-		/* Transmission request Error */
-		CAN_ErrorHandler();
+		pStats->SuppressedFrames++;
+		pStats->SavedBits += CAN_FRAME_BITS(pFrame);
+		return 0;
 	}
 
-	/* Wait transmission complete */
-	while(HAL_CAN_GetTxMailboxesFreeLevel(pCanHandle) != CAN_FREE_LEVEL) {}
+	/* Last copy is kept unchanged if there is no free mailbox, so the frame is retried */
+	if(!CAN_SendFrame(pCanHandle, pFrame))
+		return 0;
+
+	pCyclicMsg->LastFrame = *pFrame;
+	pCyclicMsg->LastTick = Tick;
+	pCyclicMsg->IsSent = 1;
+	pStats->SentFrames++;
+
+	return 1;
+}
+
+/*!
+ * @brief Get statistics of the change-only transmission of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CAN_DeltaStats_t
+ */
+const CAN_DeltaStats_t* CAN_GetDeltaStats(CAN_HandleTypeDef *pCanHandle)
+{
+	return &DeltaStats[(pCanHandle->Instance == CAN2) ? 1 : 0];
+}
+
+/*!
+ * @brief Restart of the statistics of the change-only transmission of the node (new time base)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_ResetDeltaStats(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_DeltaStats_t *pStats = &DeltaStats[(pCanHandle->Instance == CAN2) ? 1 : 0];
+
+	memset(pStats, 0, sizeof(*pStats));
+	pStats->StartTick = HAL_GetTick();
+}
+
+/*!
+ * @brief Bus load saved by the change-only transmission since the start of the statistics
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param BitRate			Bit rate of the bus (bit/s)
+ * @return					Saved share of the bus capacity (0.01 %), 0 - no time has passed
+ */
+uint32_t CAN_GetSavedLoad(CAN_HandleTypeDef *pCanHandle, uint32_t BitRate)
+{
+	const CAN_DeltaStats_t *pStats = CAN_GetDeltaStats(pCanHandle);
+	uint64_t CapacityBits = (uint64_t)BitRate * (HAL_GetTick() - pStats->StartTick) / 1000;
+
+	if(CapacityBits == 0)
+		return 0;
+
+	return (uint32_t)(pStats->SavedBits * 10000 / CapacityBits);
+}
+
+/*!
+ * @brief Number of bits of the frame on the bus (worst case bit stuffing, with interframe space)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					Number of bits
+ */
+uint32_t CAN_FrameBits(const CAN_Frame_t *pFrame)
+{
+	uint32_t DataBits = (pFrame->RTR == CAN_RTR_REMOTE) ? 0 : 8 * (uint32_t)pFrame->Dlc;
+
+	/* Stuffed part: SOF..CRC (34 or 54 bits + data), fixed part: CRC delimiter, ACK, EOF, IFS (13 bits) */
+	if(pFrame->IDE == CAN_ID_EXT)
+		return 54 + DataBits + (54 + DataBits - 1) / 4 + 13;
+
+	return 34 + DataBits + (34 + DataBits - 1) / 4 + 13;
+}
+
+/*!
+ * @brief Get statistics of the acceptance filter bank
+ *
+ * @param FilterBank		Number of the bank (0 - 27)
+ * @return					Pointer to the CAN_FilterStats_t, NULL - invalid bank
+ */
+const CAN_FilterStats_t* CAN_GetFilterStats(uint32_t FilterBank)
+{
+	return (FilterBank < CAN_FILTER_BANKS) ? &FilterStats[FilterBank] : NULL;
+}
+
+/*!
+ * @brief Get banks passing too many unwanted frames
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Bit mask of the leaking banks (bit N - bank N)
+ */
+uint32_t CAN_GetLeakyFilters(CAN_HandleTypeDef *pCanHandle)
+{
+	uint32_t First, End, Leaky = 0;
+
+	CAN_GetFilterRange(pCanHandle, &First, &End);
+	for(uint32_t Bank = First; Bank < End; Bank++)
+	{
+		if(CAN_IsFilterLeaky(&FilterStats[Bank]))
+			Leaky |= 1UL << Bank;
+	}
+	return Leaky;
+}
+
+/*!
+ * @brief Tighten leaking range filters to the IDs wanted so far (IDs not seen yet may be lost)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Bit mask of the reprogrammed banks (bit N - bank N)
+ */
+uint32_t CAN_TuneFilters(CAN_HandleTypeDef *pCanHandle)
+{
+	uint32_t First, End, Tuned = 0;
+	uint32_t Primask;
+
+	CAN_GetFilterRange(pCanHandle, &First, &End);
+	for(uint32_t Bank = First; Bank < End; Bank++)
+	{
+		CAN_FilterStats_t *pStats = &FilterStats[Bank];
+		uint32_t ValidBits = (pStats->RangeType == 1) ? 0x7FF : 0x1FFFFFFF;
+		uint32_t Id, Mask;
+
+		if(pStats->RangeType == 0 || !CAN_IsFilterLeaky(pStats) || pStats->Accepted == pStats->Unwanted)
+			continue;
+
+		/* Match only the bits all wanted IDs agree on */
+		Primask = __get_PRIMASK();
+		__disable_irq();
+		Mask = (pStats->Mask | ~(pStats->WantedAnd ^ pStats->WantedOr)) & ValidBits;
+		Id = pStats->WantedAnd & Mask;
+		__set_PRIMASK(Primask);
+
+		if(Mask == (pStats->Mask & ValidBits))
+			continue;
+
+		IsFilterTuning = 1;
+		if(pStats->RangeType == 1)
+		{
+			CAN_FilterStdId_t Filter = {Bank, CAN_FILTERSCALE_32BIT, (uint16_t)Id, (uint16_t)Mask, 0, 0};
+			CAN_AddRangeFilterStdID(pCanHandle, &Filter);
+		}
+		else
+		{
+			CAN_FilterExtId_t Filter = {Bank, Id, Mask, Id, Mask};
+			CAN_AddRangeFilterExtID(pCanHandle, &Filter);
+		}
+		IsFilterTuning = 0;
+		Tuned |= 1UL << Bank;
+	}
+	return Tuned;
+}
+
+/*!
+ * @brief Restore the tightened filters to the user configuration
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_RestoreFilters(CAN_HandleTypeDef *pCanHandle)
+{
+	uint32_t First, End;
+
+	CAN_GetFilterRange(pCanHandle, &First, &End);
+	for(uint32_t Bank = First; Bank < End; Bank++)
+	{
+		CAN_FilterStats_t *pStats = &FilterStats[Bank];
+
+		if(!pStats->IsTuned)
+			continue;
+
+		if(pStats->RangeType == 1)
+		{
+			CAN_FilterStdId_t Filter = {Bank, CAN_FILTERSCALE_32BIT, (uint16_t)pStats->UserId, (uint16_t)pStats->UserMask, 0, 0};
+			CAN_AddRangeFilterStdID(pCanHandle, &Filter);
+		}
+		else
+		{
+			CAN_FilterExtId_t Filter = {Bank, pStats->UserId, pStats->UserMask, pStats->UserId, pStats->UserMask};
+			CAN_AddRangeFilterExtID(pCanHandle, &Filter);
+		}
+	}
+}
+
+/*!
+ * @brief Reset statistics of the acceptance filters
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_ResetFilterStats(CAN_HandleTypeDef *pCanHandle)
+{
+	uint32_t First, End;
+	uint32_t Primask;
+
+	CAN_GetFilterRange(pCanHandle, &First, &End);
+	Primask = __get_PRIMASK();
+	__disable_irq();
+	for(uint32_t Bank = First; Bank < End; Bank++)
+	{
+		FilterStats[Bank].Accepted = 0;
+		FilterStats[Bank].Unwanted = 0;
+	}
+	__set_PRIMASK(Primask);
+}
+
+/*!
+ * @brief Software filter of the received frame (called from the RX interrupt)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is wanted, 0 - frame is dropped and counted as unwanted
+ */
+__weak uint8_t CAN_RxFilterCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	(void)pCanHandle;
+	(void)pFrame;
+	return 1;
+}
+
+/*!
+ * @brief Callback of the received frame (called from the RX interrupt)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+__weak void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	(void)pCanHandle;
+	(void)pFrame;
+}
+
+/*!
+ * @brief Passing of the received frame to the software filter and the user
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param FilterMatchIndex	Filter match index of the frame
+ */
+static void CAN_DispatchFrame(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame, uint32_t FilterMatchIndex)
+{
+	if (pFrame->IDE == CAN_ID_EXT)
+	{
+		Msg.ExtID = pFrame->Id;
+	}
+	else
+	{
+		Msg.StdID = pFrame->Id;
+	}
+	Msg.SizeMsgRx = pFrame->Dlc;
+	memcpy(Msg.RxData, pFrame->Data, sizeof(Msg.RxData));
+
+	/* Frames dropped by the software filter are counted against their bank */
+	if(CAN_RxFilterCallback(pCanHandle, pFrame))
+	{
+		CAN_CountFilter(pCanHandle, FilterMatchIndex, pFrame, 1);
+		CAN_RxFrameCallback(pCanHandle, pFrame);
+	}
+	else
+	{
+		CAN_CountFilter(pCanHandle, FilterMatchIndex, pFrame, 0);
+	}
 }
 
 // Callback
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
 {
+	CAN_Frame_t Frame;
+
 	/* Get message from mailbox */
-	HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &RxHeader, Msg.RxData);
-	if (RxHeader.IDE == CAN_ID_EXT)
+	HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &RxHeader, Frame.Data);
+
+	Frame.Id = (RxHeader.IDE == CAN_ID_EXT) ? RxHeader.ExtId : RxHeader.StdId;
+	Frame.IDE = RxHeader.IDE;
+	Frame.RTR = RxHeader.RTR;
+	Frame.Dlc = RxHeader.DLC;
+
+	CAN_DispatchFrame(hcan, &Frame, RxHeader.FilterMatchIndex);
+}
+
+#if (CAN_RX_IN_RAM == 1)
+/*!
+ * @brief Reading of RX FIFO 0 on the registers into the RAM queue (runs from RAM, no flash access)
+ *
+ * @param pInstance			CAN registers
+ * @param pQueue			Receive queue of the instance
+ */
+CAN_RAM_FUNC static void CAN_RxRamRead(CAN_TypeDef *pInstance, CAN_RxRamQueue_t *pQueue)
+{
+	while(pInstance->RF0R & CAN_RF0R_FMP0)
 	{
-		Msg.ExtID = RxHeader.ExtId;
+		CAN_FIFOMailBox_TypeDef *pMailBox = &pInstance->sFIFOMailBox[0];
+
+		if(pQueue->Head - pQueue->Tail < CAN_RX_RAM_QUEUE_SIZE)
+		{
+			uint32_t Index = pQueue->Head % CAN_RX_RAM_QUEUE_SIZE;
+			CAN_Frame_t *pFrame = &pQueue->Frames[Index];
+			uint32_t Rir = pMailBox->RIR;
+			uint32_t Rdtr = pMailBox->RDTR;
+			uint32_t Rdlr = pMailBox->RDLR;
+			uint32_t Rdhr = pMailBox->RDHR;
+
+			pFrame->IDE = Rir & CAN_RI0R_IDE;
+			pFrame->RTR = Rir & CAN_RI0R_RTR;
+			pFrame->Id = (pFrame->IDE == CAN_ID_EXT) ? ((Rir & (CAN_RI0R_EXID | CAN_RI0R_STID)) >> CAN_RI0R_EXID_Pos) :
+													   ((Rir & CAN_RI0R_STID) >> CAN_RI0R_STID_Pos);
+			pFrame->Dlc = (Rdtr & CAN_RDT0R_DLC) >> CAN_RDT0R_DLC_Pos;
+			for(uint32_t i = 0; i < 4; i++)
+			{
+				pFrame->Data[i] = (uint8_t)(Rdlr >> (8 * i));
+				pFrame->Data[4 + i] = (uint8_t)(Rdhr >> (8 * i));
+			}
+			pQueue->FilterMatchIndex[Index] = (Rdtr & CAN_RDT0R_FMI) >> CAN_RDT0R_FMI_Pos;
+
+			/* The frame is complete before the consumer sees it */
+			__DMB();
+			pQueue->Head++;
+		}
+		else
+		{
+			pQueue->Lost++;
+		}
+
+		/* Release the output mailbox */
+		pInstance->RF0R |= CAN_RF0R_RFOM0;
 	}
-	else
+}
+
+CAN_RAM_FUNC void CAN1_RxRamIRQHandler(void)
+{
+	CAN_RxRamRead(CAN1, &RxRamQueue[0]);
+}
+
+CAN_RAM_FUNC void CAN2_RxRamIRQHandler(void)
+{
+	CAN_RxRamRead(CAN2, &RxRamQueue[1]);
+}
+
+/*!
+ * @brief Passing of the frames of the RAM receive queue to the user
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+static void CAN_DrainRxRamQueue(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_RxRamQueue_t *pQueue = &RxRamQueue[(pCanHandle->Instance == CAN2) ? 1 : 0];
+	CAN_ErrorStats_t *pStats = CAN_GetStats(pCanHandle);
+	uint32_t Lost = pQueue->Lost;
+
+	if(pQueue->Head - pQueue->Tail > pStats->RxRamPeak)
+		pStats->RxRamPeak = pQueue->Head - pQueue->Tail;
+
+	while(pQueue->Tail != pQueue->Head)
 	{
-		Msg.StdID = RxHeader.StdId;
+		uint32_t Index = pQueue->Tail % CAN_RX_RAM_QUEUE_SIZE;
+
+		__DMB();
+		CAN_DispatchFrame(pCanHandle, &pQueue->Frames[Index], pQueue->FilterMatchIndex[Index]);
+		pQueue->Tail++;
+	}
+
+	/* The queue is too small for the longest stall of the main loop (see CAN_RX_RAM_QUEUE_SIZE) */
+	if(Lost != pStats->RxLost)
+	{
+		pStats->RxLost = Lost;
+		CAN_ErrorCallback(pCanHandle, pStats->State, HAL_CAN_ERROR_RX_FOV0);
 	}
 }
+#endif
 
-void CAN_ErrorHandler(void)
+// Callbacks of the free mailboxes, the queued frames are loaded
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
 {
+	CAN_DrainTxQueue(hcan);
+}
+
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+	CAN_DrainTxQueue(hcan);
+}
+
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+	CAN_DrainTxQueue(hcan);
+}
+
+/*!
+ * @brief Error state processing, bus-off recovery and frames of the RAM receive queue (call from the main loop)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_Process(CAN_HandleTypeDef *pCanHandle)
+{
+	CAN_ErrorStats_t *pStats = CAN_GetStats(pCanHandle);
+	CAN_BusState_t State = CAN_ReadBusState(pCanHandle);
+	uint32_t Primask;
+
+#if (CAN_RX_IN_RAM == 1)
+	CAN_DrainRxRamQueue(pCanHandle);
+#endif
+
+	/* The bus error interrupt is back after the window of the mask */
+	if(pStats->IsLecMasked && (HAL_GetTick() - pStats->LecWindowTick) >= CAN_LEC_WINDOW_MS)
+	{
+		Primask = __get_PRIMASK();
+		__disable_irq();
+		pStats->LecErrors = 0;
+		pStats->LecWindowTick = HAL_GetTick();
+		pStats->IsLecMasked = 0;
+		HAL_CAN_ActivateNotification(pCanHandle, CAN_IT_LAST_ERROR_CODE);
+		__set_PRIMASK(Primask);
+	}
+
+	if(pStats->State == CAN_BUS_STATE_OFF && State == CAN_BUS_STATE_OFF)
+	{
+		/* With AutoBusOff the hardware recovers by itself */
+		if(pCanHandle->Init.AutoBusOff == ENABLE || (int32_t)(HAL_GetTick() - pStats->RecoveryTick) < 0)
+			return;
+
+		/* Re-entering normal mode starts the 128 x 11 recessive bits recovery sequence,
+		   the frames held since the bus-off are stale */
+		pStats->Recoveries++;
+		Primask = __get_PRIMASK();
+		__disable_irq();
+		CAN_FlushTx(pCanHandle);
+		__set_PRIMASK(Primask);
+		HAL_CAN_Stop(pCanHandle);
+		HAL_CAN_Start(pCanHandle);
+
+		pStats->RecoveryTick = HAL_GetTick() + pStats->BackoffMs;
+		pStats->BackoffMs = (pStats->BackoffMs * 2 > CAN_RECOVERY_MAX_MS) ? CAN_RECOVERY_MAX_MS : pStats->BackoffMs * 2;
+		return;
+	}
+
+	/* Leaving of the error states is not signalled by the interrupts, the bus-off interrupt may be missed */
+	if(State != pStats->State)
+	{
+		if(State == CAN_BUS_STATE_OFF)
+		{
+			pStats->BusOffs++;
+			pStats->RecoveryTick = HAL_GetTick() + pStats->BackoffMs;
+		}
+		pStats->State = State;
+		if(State == CAN_BUS_STATE_ACTIVE)
+			pStats->BackoffMs = CAN_RECOVERY_MIN_MS;
+		CAN_ErrorCallback(pCanHandle, State, HAL_CAN_ERROR_NONE);
+	}
+
+	/* Queued frames held in bus-off state get no TX interrupt to restart them */
+	Primask = __get_PRIMASK();
+	__disable_irq();
+	CAN_DrainTxQueue(pCanHandle);
+	__set_PRIMASK(Primask);
+}
+
+/*!
+ * @brief Get fault confinement state of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					State of the node
+ */
+CAN_BusState_t CAN_GetBusState(CAN_HandleTypeDef *pCanHandle)
+{
+	return CAN_GetStats(pCanHandle)->State;
+}
+
+/*!
+ * @brief Get error statistics of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CAN_ErrorStats_t
+ */
+const CAN_ErrorStats_t* CAN_GetErrorStats(CAN_HandleTypeDef *pCanHandle)
+{
+	return CAN_GetStats(pCanHandle);
+}
+
+/*!
+ * @brief Callback of the error state change and the bus errors
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param State				State of the node
+ * @param ErrorCode			HAL error code (HAL_CAN_ERROR_xxx)
+ */
+__weak void CAN_ErrorCallback(CAN_HandleTypeDef *pCanHandle, CAN_BusState_t State, uint32_t ErrorCode)
+{
+	(void)pCanHandle;
+	(void)State;
+	(void)ErrorCode;
+}
+
+// Callback of the status change and error interrupt
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+	CAN_ErrorStats_t *pStats = CAN_GetStats(hcan);
+	CAN_BusState_t State = CAN_ReadBusState(hcan);
+
+	pStats->Errors++;
+	pStats->LastErrorCode = HAL_CAN_GetError(hcan);
+
+	/* A broken bus raises the bus error interrupt for every frame, it is masked for the rest of the window */
+	if(pStats->LastErrorCode & CAN_LEC_ERRORS)
+	{
+		uint32_t Tick = HAL_GetTick();
+
+		if((Tick - pStats->LecWindowTick) >= CAN_LEC_WINDOW_MS)
+		{
+			pStats->LecWindowTick = Tick;
+			pStats->LecErrors = 0;
+		}
+
+		if(++pStats->LecErrors >= CAN_LEC_IRQ_LIMIT && !pStats->IsLecMasked)
+		{
+			HAL_CAN_DeactivateNotification(hcan, CAN_IT_LAST_ERROR_CODE);
+			pStats->LecWindowTick = Tick;
+			pStats->LecMasks++;
+			pStats->IsLecMasked = 1;
+		}
+	}
+
+	if(State == CAN_BUS_STATE_OFF && pStats->State != CAN_BUS_STATE_OFF)
+	{
+		/* First recovery attempt after the current backoff */
+		pStats->BusOffs++;
+		pStats->RecoveryTick = HAL_GetTick() + pStats->BackoffMs;
+	}
+	pStats->State = State;
+
+	CAN_ErrorCallback(hcan, State, pStats->LastErrorCode);
+	HAL_CAN_ResetError(hcan);
+}
+
+/*!
+ * @brief Handler of the failed HAL calls of the module
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_ErrorHandler(CAN_HandleTypeDef *pCanHandle)
+{
+#if CAN_RESET_ON_ERROR == 1
+	(void)pCanHandle;
 	NVIC_SystemReset();
+#else
+	/* HAL error code of the failed call, never HAL_CAN_ERROR_NONE (it means a recovery) */
+	uint32_t ErrorCode = HAL_CAN_GetError(pCanHandle);
+
+	if(ErrorCode == HAL_CAN_ERROR_NONE)
+		ErrorCode = HAL_CAN_ERROR_NOT_READY;
+
+	CAN_ErrorCallback(pCanHandle, CAN_GetStats(pCanHandle)->State, ErrorCode);
+#endif
 }
@@ -15,6 +15,185 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx.h"
 
+/*!
+ * Error handling configuration
+ */
+#define CAN_RESET_ON_ERROR					0		/* 1 - NVIC_SystemReset on HAL errors (old behaviour) */
+#define CAN_RECOVERY_MIN_MS					10		/* First bus-off recovery attempt */
+#define CAN_RECOVERY_MAX_MS					1000	/* Backoff limit of the recovery attempts */
+#define CAN_LEC_IRQ_LIMIT					16		/* Bus error interrupts in the window before they are masked */
+#define CAN_LEC_WINDOW_MS					100		/* Window of CAN_LEC_IRQ_LIMIT, the mask is lifted after it */
+#define CAN_ERROR_NOTIFICATIONS				(CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF | \
+											 CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR)
+
+/*!
+ * Software transmit queue (frames of CAN_SendBatch waiting for a free mailbox)
+ */
+#define CAN_TX_QUEUE_SIZE					32
+
+/*!
+ * One pass of the busy waits of the blocking send: the host build runs the simulated bus for one frame
+ * (time moves only here and in the CanSim calls of the program), the target may feed a watchdog
+ */
+#ifndef CAN_WAIT_TICK
+#ifdef CAN_SIMULATION
+#define CAN_WAIT_TICK()						CanSimStep()
+#else
+#define CAN_WAIT_TICK()
+#endif
+#endif
+
+/*!
+ * Bits of the frame on the bus counted by the change-only transmission: the host build takes the exact
+ * stuffed length of the simulated bus, the target the worst case of CAN_FrameBits
+ */
+#ifndef CAN_FRAME_BITS
+#ifdef CAN_SIMULATION
+#define CAN_FRAME_BITS(pFrame)				CanSimFrameBits(pFrame)
+#else
+#define CAN_FRAME_BITS(pFrame)				CAN_FrameBits(pFrame)
+#endif
+#endif
+
+/*!
+ * Acceptance filter tuning configuration
+ */
+#define CAN_FILTER_BANKS					28
+#define CAN_FILTER_SLAVE_START				14		/* First bank of CAN2 */
+#define CAN_FILTER_MIN_FRAMES				100		/* Frames on the bank before it is judged */
+#define CAN_FILTER_LEAK_PERCENT				10		/* Bank leaks above this share of unwanted frames */
+
+/*!
+ * Receive interrupt in RAM (1 - CANx_RxRamIRQHandler is installed to the RAM vector table by the user,
+ * e.g. FlashSetIRQHandler). The frames are queued by the interrupt and passed to the callbacks from
+ * CAN_Process, so reception keeps going while the flash is erased or programmed
+ */
+#ifndef CAN_RX_IN_RAM
+#define CAN_RX_IN_RAM						0
+#endif
+
+/*!
+ * Frames of the RAM receive queue, a power of two. The queue is emptied by CAN_Process only, so it must hold
+ * all frames of the longest stall of the main loop: max frame rate x worst-case erase time of the largest
+ * sector written at run time (128 KB: up to 4 s at x8, 2 s at x32 by the datasheet), e.g. 200 frames/s x 2 s
+ * = 400 -> 512. Overflows are counted in RxLost and reported to CAN_ErrorCallback as HAL_CAN_ERROR_RX_FOV0,
+ * RxRamPeak shows the fill level reached
+ */
+#ifndef CAN_RX_RAM_QUEUE_SIZE
+#define CAN_RX_RAM_QUEUE_SIZE				32
+#endif
+
+#if (CAN_RX_RAM_QUEUE_SIZE == 0) || ((CAN_RX_RAM_QUEUE_SIZE & (CAN_RX_RAM_QUEUE_SIZE - 1)) != 0)
+#error "CAN_RX_RAM_QUEUE_SIZE must be a power of two"
+#endif
+
+#ifndef CAN_RAM_FUNC
+#define CAN_RAM_FUNC						__attribute__((section(".RamFunc"), noinline))
+#endif
+
+/*!
+ * Fault confinement state of the node
+ */
+typedef enum CAN_BusState_e
+{
+	/*!
+	 * Error active (TEC and REC < 96)
+	 */
+	CAN_BUS_STATE_ACTIVE = 0,
+
+	/*!
+	 * Error warning (TEC or REC >= 96)
+	 */
+	CAN_BUS_STATE_WARNING,
+
+	/*!
+	 * Error passive (TEC or REC > 127)
+	 */
+	CAN_BUS_STATE_PASSIVE,
+
+	/*!
+	 * Bus-off (TEC > 255), transmission is blocked until recovery
+	 */
+	CAN_BUS_STATE_OFF
+
+}CAN_BusState_t;
+
+/*!
+ * Error statistics of the node
+ */
+typedef struct CAN_ErrorStats_s
+{
+	/*!
+	 * Current fault confinement state
+	 */
+	volatile CAN_BusState_t State;
+
+	/*!
+	 * Last HAL error code (HAL_CAN_ERROR_xxx)
+	 */
+	uint32_t LastErrorCode;
+
+	/*!
+	 * Number of the error interrupts
+	 */
+	uint32_t Errors;
+
+	/*!
+	 * Number of the bus-off events
+	 */
+	uint32_t BusOffs;
+
+	/*!
+	 * Number of the recovery attempts
+	 */
+	uint32_t Recoveries;
+
+	/*!
+	 * Frames rejected in bus-off state
+	 */
+	uint32_t Throttled;
+
+	/*!
+	 * Current backoff of the recovery (ms)
+	 */
+	uint32_t BackoffMs;
+
+	/*!
+	 * Tick of the next recovery attempt
+	 */
+	uint32_t RecoveryTick;
+
+	/*!
+	 * Bus error interrupts (CAN_IT_LAST_ERROR_CODE) in the current window
+	 */
+	uint32_t LecErrors;
+
+	/*!
+	 * Tick of the start of the window of the bus error interrupts
+	 */
+	uint32_t LecWindowTick;
+
+	/*!
+	 * Number of the masks of the bus error interrupt (CAN_LEC_IRQ_LIMIT reached)
+	 */
+	uint32_t LecMasks;
+
+	/*!
+	 * Bus error interrupt is masked until the end of the window
+	 */
+	volatile uint8_t IsLecMasked;
+
+	/*!
+	 * Frames lost by the overflow of the RAM receive queue (CAN_RX_IN_RAM)
+	 */
+	uint32_t RxLost;
+
+	/*!
+	 * Max number of frames waiting in the RAM receive queue (CAN_RX_IN_RAM)
+	 */
+	uint32_t RxRamPeak;
+}CAN_ErrorStats_t;
+
 /*!
  * Standard filter description
  */
@@ -118,6 +297,148 @@ typedef struct CAN_Message_s
 	uint8_t SizeMsgRx;
 }CAN_Message_t;
 
+/*!
+ * Frame description
+ */
+typedef struct CAN_Frame_s
+{
+	/*!
+	 * Standard (11 bits) or extended (29 bits) ID
+	 */
+	uint32_t Id;
+
+	/*!
+	 * Type of ID (@arg CAN_ID_STD, @arg CAN_ID_EXT)
+	 */
+	uint8_t IDE;
+
+	/*!
+	 * Type of frame (@arg CAN_RTR_DATA, @arg CAN_RTR_REMOTE)
+	 */
+	uint8_t RTR;
+
+	/*!
+	 * Data size (0 - 8)
+	 */
+	uint8_t Dlc;
+
+	/*!
+	 * Data buffer
+	 */
+	uint8_t Data[8];
+}CAN_Frame_t;
+
+/*!
+ * Cyclic message transmitted only on change
+ */
+typedef struct CAN_CyclicMsg_s
+{
+	/*!
+	 * Frame to send (updated by the user)
+	 */
+	CAN_Frame_t Frame;
+
+	/*!
+	 * Max interval between two transmissions (ms), the frame is sent even if unchanged
+	 */
+	uint32_t KeepAliveMs;
+
+	/*!
+	 * Last transmitted frame
+	 */
+	CAN_Frame_t LastFrame;
+
+	/*!
+	 * Frame was transmitted at least once
+	 */
+	uint8_t IsSent;
+
+	/*!
+	 * Tick of the last transmission
+	 */
+	uint32_t LastTick;
+}CAN_CyclicMsg_t;
+
+/*!
+ * Statistics of the change-only transmission
+ */
+typedef struct CAN_DeltaStats_s
+{
+	/*!
+	 * Transmitted frames
+	 */
+	uint64_t SentFrames;
+
+	/*!
+	 * Suppressed (unchanged) frames
+	 */
+	uint64_t SuppressedFrames;
+
+	/*!
+	 * Bus bits saved by the suppressed frames (CAN_FRAME_BITS)
+	 */
+	uint64_t SavedBits;
+
+	/*!
+	 * Tick of the start of the statistics (time base of the saved load)
+	 */
+	uint32_t StartTick;
+}CAN_DeltaStats_t;
+
+/*!
+ * Statistics of the acceptance filter bank
+ */
+typedef struct CAN_FilterStats_s
+{
+	/*!
+	 * Frames accepted by the bank (RX interrupts)
+	 */
+	uint32_t Accepted;
+
+	/*!
+	 * Accepted frames rejected by CAN_RxFilterCallback
+	 */
+	uint32_t Unwanted;
+
+	/*!
+	 * AND of the wanted IDs (bits common to all of them are set)
+	 */
+	uint32_t WantedAnd;
+
+	/*!
+	 * OR of the wanted IDs (bits common to none of them are cleared)
+	 */
+	uint32_t WantedOr;
+
+	/*!
+	 * ID and mask of the range filter (32-bit mask banks)
+	 */
+	uint32_t Id;
+	uint32_t Mask;
+
+	/*!
+	 * ID and mask set by the user (restored by CAN_RestoreFilters)
+	 */
+	uint32_t UserId;
+	uint32_t UserMask;
+
+	/*!
+	 * Filter scale and mode of the bank
+	 */
+	uint8_t Scale;
+	uint8_t Mode;
+
+	/*!
+	 * Bank is a range filter (1 - standard IDs, 2 - extended IDs), 0 - not tunable
+	 */
+	uint8_t RangeType;
+
+	/*!
+	 * Bank was tightened by CAN_TuneFilters
+	 */
+	uint8_t IsTuned;
+}CAN_FilterStats_t;
+
 /*!
  * @brief Initial CAN bus
  *
@@ -182,15 +503,184 @@ void CAN_AddFilterExtID(CAN_HandleTypeDef *pCanHandle, CAN_FilterStdId_t *pCanFi
  * @brief Send message with standard ID
  *
  * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					1 - message is sent, 0 - node is bus-off or the frame is rejected
  */
-void CAN_StdSendMessage(CAN_HandleTypeDef *pCanHandle);
+uint8_t CAN_StdSendMessage(CAN_HandleTypeDef *pCanHandle);
 
 /*!
  * @brief Send message with extended ID
  *
  * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					1 - message is sent, 0 - node is bus-off or the frame is rejected
+ */
+uint8_t CAN_ExtSendMessage(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Send frame without waiting for transmission complete
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is placed in a mailbox, 0 - no free mailbox
+ */
+uint8_t CAN_SendFrame(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Send array of frames: free mailboxes are loaded at once, the rest is queued and sent
+ *        from the TX interrupt in order
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrames			Pointer to the array of CAN_Frame_t
+ * @param Count				Number of frames
+ * @return					Number of accepted frames (loaded or queued), 0 - node is bus-off
+ */
+uint32_t CAN_SendBatch(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrames, uint32_t Count);
+
+/*!
+ * @brief Send cyclic message only if the data changed or the keep-alive interval expired
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pCyclicMsg		Pointer to the CAN_CyclicMsg_t description
+ * @return					1 - frame is sent, 0 - frame is suppressed or no free mailbox
+ */
+uint8_t CAN_SendOnChange(CAN_HandleTypeDef *pCanHandle, CAN_CyclicMsg_t *pCyclicMsg);
+
+/*!
+ * @brief Get statistics of the change-only transmission of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CAN_DeltaStats_t
+ */
+const CAN_DeltaStats_t* CAN_GetDeltaStats(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Restart of the statistics of the change-only transmission of the node (new time base)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_ResetDeltaStats(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Bus load saved by the change-only transmission since the start of the statistics
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param BitRate			Bit rate of the bus (bit/s)
+ * @return					Saved share of the bus capacity (0.01 %), 0 - no time has passed
+ */
+uint32_t CAN_GetSavedLoad(CAN_HandleTypeDef *pCanHandle, uint32_t BitRate);
+
+/*!
+ * @brief Number of bits of the frame on the bus (worst case bit stuffing, with interframe space)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					Number of bits
+ */
+uint32_t CAN_FrameBits(const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Get statistics of the acceptance filter bank
+ *
+ * @param FilterBank		Number of the bank (0 - 27)
+ * @return					Pointer to the CAN_FilterStats_t, NULL - invalid bank
+ */
+const CAN_FilterStats_t* CAN_GetFilterStats(uint32_t FilterBank);
+
+/*!
+ * @brief Get banks passing too many unwanted frames
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Bit mask of the leaking banks (bit N - bank N)
+ */
+uint32_t CAN_GetLeakyFilters(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Tighten leaking range filters to the IDs wanted so far (IDs not seen yet may be lost)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Bit mask of the reprogrammed banks (bit N - bank N)
+ */
+uint32_t CAN_TuneFilters(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Restore the tightened filters to the user configuration
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_RestoreFilters(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Reset statistics of the acceptance filters
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_ResetFilterStats(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Error state processing, bus-off recovery and frames of the RAM receive queue (call from the main loop)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ */
+void CAN_Process(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Get fault confinement state of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					State of the node
+ */
+CAN_BusState_t CAN_GetBusState(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Get error statistics of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CAN_ErrorStats_t
+ */
+const CAN_ErrorStats_t* CAN_GetErrorStats(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Callback of the error state change and the bus errors
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param State				State of the node
+ * @param ErrorCode			HAL error code (HAL_CAN_ERROR_xxx)
+ */
+void CAN_ErrorCallback(CAN_HandleTypeDef *pCanHandle, CAN_BusState_t State, uint32_t ErrorCode);
+
+/*!
+ * @brief Handler of the failed HAL calls of the module
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
  */
-void CAN_ExtSendMessage(CAN_HandleTypeDef *pCanHandle);
+void CAN_ErrorHandler(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Software filter of the received frame (called from the RX interrupt)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					1 - frame is wanted, 0 - frame is dropped and counted as unwanted
+ */
+uint8_t CAN_RxFilterCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Callback of the received frame (called from the RX interrupt)
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame);
+
+#if (CAN_RX_IN_RAM == 1)
+/*!
+ * @brief RX FIFO 0 interrupt handler of CAN1 running from RAM (install instead of CAN1_RX0_IRQHandler)
+ */
+void CAN1_RxRamIRQHandler(void);
+
+/*!
+ * @brief RX FIFO 0 interrupt handler of CAN2 running from RAM (install instead of CAN2_RX0_IRQHandler)
+ */
+void CAN2_RxRamIRQHandler(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,130 @@
+/*!
+ * @file      CAN_Batch_Bench.c
+ *
+ * @brief     CAN_SendBatch against the blocking CAN_StdSendMessage on the simulated bus: the application
+ *            sends a burst of frames every period (and back to back), the frame rate and the time
+ *            the sender is blocked are measured (host build, CAN_BATCH_BENCH)
+ *
+ * Build:     gcc -O2 -DCAN_SIMULATION -DCAN_BATCH_BENCH -I../Host -I. CAN_Batch_Bench.c CAN.c CAN_Sim.c
+ *            ../Host/Host_Core.c -o can_batch_bench
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef CAN_BATCH_BENCH
+
+#include "CAN_Sim.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_BIT_RATE				1000000
+#define BENCH_PERIODS				2000
+#define BENCH_BATCH					16
+#define BENCH_PERIOD_NS				2500000ULL	/* 16 frames of 8 bytes load the bus at about 75 % */
+
+/*!
+ * Message of CAN_StdSendMessage (CAN.c)
+ */
+extern CAN_Message_t Msg;
+
+static uint32_t RxFrames;
+
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	(void)pCanHandle;
+	(void)pFrame;
+	RxFrames++;
+}
+
+/*!
+ * @brief Run of the periodic bursts
+ *
+ * @param pName				Name of the run
+ * @param pTx				Pointer to the CAN_HandleTypeDef of the sender
+ * @param pFrames			Pointer to the burst of frames
+ * @param IsBatch			1 - CAN_SendBatch, 0 - CAN_StdSendMessage for each frame
+ * @param PeriodNs			Period of the bursts, 0 - back to back
+ */
+static void BenchRun(const char *pName, CAN_HandleTypeDef *pTx, const CAN_Frame_t *pFrames, uint8_t IsBatch, uint64_t PeriodNs)
+{
+	const CanSimNodeStats_t *pNode = CanSimGetNodeStats(pTx);
+	uint64_t StartNs = CanSimGetTimeNs();
+	uint64_t StartBusyNs = CanSimGetStats()->BusyNs;
+	uint64_t StartLatencyNs = pNode->LatencySumNs;
+	uint32_t StartTxFrames = pNode->TxFrames;
+	uint64_t BlockedNs = 0, Ns;
+	uint32_t TxFrames;
+
+	RxFrames = 0;
+	for(uint32_t Period = 0; Period < BENCH_PERIODS; Period++)
+	{
+		uint64_t PeriodStartNs = CanSimGetTimeNs();
+		uint32_t Sent = 0;
+
+		if(IsBatch)
+		{
+			while(Sent < BENCH_BATCH)
+			{
+				Sent += CAN_SendBatch(pTx, &pFrames[Sent], BENCH_BATCH - Sent);
+				if(Sent < BENCH_BATCH)
+					CanSimStep();
+			}
+		}
+		else
+		{
+			for(; Sent < BENCH_BATCH; Sent++)
+			{
+				Msg.StdID = pFrames[Sent].Id;
+				Msg.SizeMsgTx = pFrames[Sent].Dlc;
+				memcpy(Msg.TxData, pFrames[Sent].Data, sizeof(Msg.TxData));
+				CAN_StdSendMessage(pTx);
+			}
+		}
+
+		/* The simulated time runs only in the waits of the sender, the rest of the period is free */
+		BlockedNs += CanSimGetTimeNs() - PeriodStartNs;
+		if(CanSimGetTimeNs() - PeriodStartNs < PeriodNs)
+			CanSimAdvance(PeriodNs - (CanSimGetTimeNs() - PeriodStartNs));
+	}
+	CanSimRunUntilIdle();
+
+	Ns = CanSimGetTimeNs() - StartNs;
+	TxFrames = pNode->TxFrames - StartTxFrames;
+	printf("%-32s %6u frames received, %6.0f frames/s, bus load %5.1f %%, sender blocked %5.1f %%, mean latency %6.1f us\n",
+		   pName, RxFrames, (double)TxFrames * 1e9 / (double)Ns, 100.0 * (double)(CanSimGetStats()->BusyNs - StartBusyNs) / (double)Ns,
+		   100.0 * (double)BlockedNs / (double)Ns, (double)(pNode->LatencySumNs - StartLatencyNs) / 1000.0 / (double)TxFrames);
+}
+
+int main(void)
+{
+	CAN_HandleTypeDef Tx = {0}, Rx = {0};
+	CAN_FilterStdId_t Filter = {14, CAN_FILTERSCALE_32BIT, 0, 0, 0, 0};
+	CAN_Frame_t Frames[BENCH_BATCH];
+
+	CanSimInit(BENCH_BIT_RATE);
+	Tx.Instance = CAN1;
+	Rx.Instance = CAN2;
+	CAN_Init(&Tx);
+	CAN_Init(&Rx);
+	CAN_AddRangeFilterStdID(&Rx, &Filter);
+	CAN_Start(&Tx);
+	CAN_Start(&Rx);
+
+	for(uint32_t i = 0; i < BENCH_BATCH; i++)
+	{
+		Frames[i].Id = 0x100 + i;
+		Frames[i].IDE = CAN_ID_STD;
+		Frames[i].RTR = CAN_RTR_DATA;
+		Frames[i].Dlc = 8;
+		memset(Frames[i].Data, (int)i, sizeof(Frames[i].Data));
+	}
+
+	BenchRun("CAN_StdSendMessage (periodic)", &Tx, Frames, 0, BENCH_PERIOD_NS);
+	BenchRun("CAN_SendBatch (periodic)", &Tx, Frames, 1, BENCH_PERIOD_NS);
+	BenchRun("CAN_StdSendMessage (full load)", &Tx, Frames, 0, 0);
+	BenchRun("CAN_SendBatch (full load)", &Tx, Frames, 1, 0);
+
+	return 0;
+}
+
+#endif /* CAN_BATCH_BENCH */
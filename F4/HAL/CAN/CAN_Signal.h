@@ -0,0 +1,259 @@
+/*!
+ * @file      CAN_Signal.h
+ *
+ * @brief     CAN signal packing/unpacking (DBC-like message description)
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef CAN_SIGNAL_H_
+#define CAN_SIGNAL_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+/*!
+ * Byte order of the signal
+ */
+#define CAN_SIGNAL_LITTLE_ENDIAN			0	/* Intel */
+#define CAN_SIGNAL_BIG_ENDIAN				1	/* Motorola */
+
+/*!
+ * Signal description (fields as in a DBC file)
+ */
+typedef struct CAN_Signal_s
+{
+	/*!
+	 * Start bit (DBC numbering: LSB for Intel, MSB for Motorola)
+	 */
+	uint8_t StartBit;
+
+	/*!
+	 * Signal length in bits (1 - 64)
+	 */
+	uint8_t Length;
+
+	/*!
+	 * Byte order (@arg CAN_SIGNAL_LITTLE_ENDIAN, @arg CAN_SIGNAL_BIG_ENDIAN)
+	 */
+	uint8_t ByteOrder;
+
+	/*!
+	 * Signed raw value (two's complement)
+	 */
+	uint8_t IsSigned;
+
+	/*!
+	 * Physical value = Raw * Scale + Offset
+	 */
+	float Scale;
+
+	/*!
+	 * Physical offset
+	 */
+	float Offset;
+}CAN_Signal_t;
+
+/*!
+ * @brief Load the 8 data bytes of the frame as one 64-bit word
+ *
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param ByteOrder			Byte order of the word
+ * @return					Frame word
+ */
+static inline uint64_t CAN_SignalLoad(const uint8_t *pData, uint8_t ByteOrder)
+{
+	uint64_t Word;
+
+	/* Cortex-M is little endian, one unaligned 64-bit copy */
+	memcpy(&Word, pData, sizeof(Word));
+	if(ByteOrder == CAN_SIGNAL_BIG_ENDIAN)
+		Word = __builtin_bswap64(Word);
+
+	return Word;
+}
+
+/*!
+ * @brief Store the 64-bit frame word into the 8 data bytes
+ *
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param Word				Frame word
+ * @param ByteOrder			Byte order of the word
+ */
+static inline void CAN_SignalStore(uint8_t *pData, uint64_t Word, uint8_t ByteOrder)
+{
+	if(ByteOrder == CAN_SIGNAL_BIG_ENDIAN)
+		Word = __builtin_bswap64(Word);
+	memcpy(pData, &Word, sizeof(Word));
+}
+
+/*!
+ * @brief Mask of the signal length
+ *
+ * @param Length			Signal length in bits
+ * @return					Mask
+ */
+static inline uint64_t CAN_SignalMask(uint8_t Length)
+{
+	return (Length >= 64) ? UINT64_MAX : ((1ULL << Length) - 1);
+}
+
+/*!
+ * @brief Shift of the signal LSB inside the frame word
+ *
+ * @param StartBit			Start bit
+ * @param Length			Signal length in bits
+ * @param ByteOrder			Byte order
+ * @return					Shift
+ */
+static inline uint8_t CAN_SignalShift(uint8_t StartBit, uint8_t Length, uint8_t ByteOrder)
+{
+	if(ByteOrder == CAN_SIGNAL_BIG_ENDIAN)
+	{
+		/* Position of the MSB counted from the MSB of the big endian word */
+		uint8_t Msb = (StartBit & ~7) + (7 - (StartBit & 7));
+		return (uint8_t)(64 - (Msb + Length));
+	}
+
+	return StartBit;
+}
+
+/*!
+ * @brief Extract raw value of the signal
+ *
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param StartBit			Start bit
+ * @param Length			Signal length in bits
+ * @param ByteOrder			Byte order
+ * @return					Raw value
+ */
+static inline uint64_t CAN_SignalGetRaw(const uint8_t *pData, uint8_t StartBit, uint8_t Length, uint8_t ByteOrder)
+{
+	return (CAN_SignalLoad(pData, ByteOrder) >> CAN_SignalShift(StartBit, Length, ByteOrder)) & CAN_SignalMask(Length);
+}
+
+/*!
+ * @brief Insert raw value of the signal
+ *
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param StartBit			Start bit
+ * @param Length			Signal length in bits
+ * @param ByteOrder			Byte order
+ * @param Raw				Raw value
+ */
+static inline void CAN_SignalSetRaw(uint8_t *pData, uint8_t StartBit, uint8_t Length, uint8_t ByteOrder, uint64_t Raw)
+{
+	uint64_t Word = CAN_SignalLoad(pData, ByteOrder);
+	uint8_t Shift = CAN_SignalShift(StartBit, Length, ByteOrder);
+	uint64_t Mask = CAN_SignalMask(Length) << Shift;
+
+	Word = (Word & ~Mask) | ((Raw << Shift) & Mask);
+	CAN_SignalStore(pData, Word, ByteOrder);
+}
+
+/*!
+ * @brief Sign extension of the raw value
+ *
+ * @param Raw				Raw value
+ * @param Length			Signal length in bits
+ * @return					Signed value
+ */
+static inline int64_t CAN_SignalSignExtend(uint64_t Raw, uint8_t Length)
+{
+	uint8_t Shift = 64 - Length;
+	return (int64_t)(Raw << Shift) >> Shift;
+}
+
+/*!
+ * @brief Unpack physical value of the signal
+ *
+ * @param pSignal			Pointer to the CAN_Signal_t description
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @return					Physical value
+ */
+static inline float CAN_SignalUnpack(const CAN_Signal_t *pSignal, const uint8_t *pData)
+{
+	uint64_t Raw = CAN_SignalGetRaw(pData, pSignal->StartBit, pSignal->Length, pSignal->ByteOrder);
+
+	if(pSignal->IsSigned)
+		return (float)CAN_SignalSignExtend(Raw, pSignal->Length) * pSignal->Scale + pSignal->Offset;
+
+	return (float)Raw * pSignal->Scale + pSignal->Offset;
+}
+
+/*!
+ * @brief Pack physical value of the signal (values out of the raw range saturate)
+ *
+ * @param pSignal			Pointer to the CAN_Signal_t description
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param Value				Physical value
+ */
+static inline void CAN_SignalPack(const CAN_Signal_t *pSignal, uint8_t *pData, float Value)
+{
+	float Raw = (Value - pSignal->Offset) / pSignal->Scale;
+	uint64_t Mask = CAN_SignalMask(pSignal->Length);
+	uint64_t RawBits;
+
+	/* Limits are compared as float before the conversion, round to nearest inside them */
+	if(pSignal->IsSigned)
+	{
+		int64_t Max = (int64_t)(Mask >> 1);
+
+		if(Raw <= -(float)Max - 1.0f)
+			RawBits = (uint64_t)(-Max - 1);
+		else if(Raw >= (float)Max)
+			RawBits = (uint64_t)Max;
+		else
+			RawBits = (uint64_t)(int64_t)((Raw >= 0.0f) ? (Raw + 0.5f) : (Raw - 0.5f));
+	}
+	else
+	{
+		if(Raw <= 0.0f)
+			RawBits = 0;
+		else if(Raw >= (float)Mask)
+			RawBits = Mask;
+		else
+			RawBits = (uint64_t)(Raw + 0.5f);
+	}
+
+	CAN_SignalSetRaw(pData, pSignal->StartBit, pSignal->Length, pSignal->ByteOrder, RawBits);
+}
+
+/*!
+ * Generates specialized accessors for a signal known at compile time.
+ * All shifts and masks become constants, so each accessor is a single
+ * 64-bit load, shift and mask.
+ *
+ * Example:
+ *   CAN_SIGNAL_DEFINE(EngineSpeed, 24, 16, CAN_SIGNAL_LITTLE_ENDIAN, 0, 0.125f, 0.0f)
+ *   float Rpm = EngineSpeed_Unpack(Msg.RxData);
+ *   EngineSpeed_Pack(Msg.TxData, 1500.0f);
+ */
+#define CAN_SIGNAL_DEFINE(NAME, START, LEN, ORDER, SIGNED, SCALE, OFFSET)						\
+	static inline uint64_t NAME##_GetRaw(const uint8_t *pData)								\
+	{																						\
+		return CAN_SignalGetRaw(pData, (START), (LEN), (ORDER));							\
+	}																						\
+	static inline void NAME##_SetRaw(uint8_t *pData, uint64_t Raw)							\
+	{																						\
+		CAN_SignalSetRaw(pData, (START), (LEN), (ORDER), Raw);								\
+	}																						\
+	static inline float NAME##_Unpack(const uint8_t *pData)									\
+	{																						\
+		static const CAN_Signal_t Signal = {(START), (LEN), (ORDER), (SIGNED), (SCALE), (OFFSET)};	\
+		return CAN_SignalUnpack(&Signal, pData);											\
+	}																						\
+	static inline void NAME##_Pack(uint8_t *pData, float Value)								\
+	{																						\
+		static const CAN_Signal_t Signal = {(START), (LEN), (ORDER), (SIGNED), (SCALE), (OFFSET)};	\
+		CAN_SignalPack(&Signal, pData, Value);												\
+	}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CAN_SIGNAL_H_ */
@@ -0,0 +1,133 @@
+/*!
+ * @file      CAN_Signal_Bench.c
+ *
+ * @brief     Benchmark of the CAN signal accessors against a bit-by-bit reference (host build, CAN_SIGNAL_BENCH)
+ *
+ * Build:     gcc -O2 -DCAN_SIGNAL_BENCH CAN_Signal_Bench.c -o can_signal_bench
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef CAN_SIGNAL_BENCH
+
+#include "CAN_Signal.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_FRAMES				4096
+#define BENCH_ROUNDS				2000
+
+CAN_SIGNAL_DEFINE(BenchIntel, 12, 20, CAN_SIGNAL_LITTLE_ENDIAN, 0, 0.5f, 0.0f)
+CAN_SIGNAL_DEFINE(BenchMotorola, 27, 20, CAN_SIGNAL_BIG_ENDIAN, 0, 0.5f, 0.0f)
+
+static uint8_t Frames[BENCH_FRAMES][8];
+
+/*!
+ * @brief Reference raw value of the signal, one bit at a time in the DBC numbering
+ *
+ * @param pData				Pointer to the frame data (8 bytes)
+ * @param StartBit			Start bit
+ * @param Length			Signal length in bits
+ * @param ByteOrder			Byte order
+ * @return					Raw value
+ */
+static uint64_t BenchRefGetRaw(const uint8_t *pData, uint8_t StartBit, uint8_t Length, uint8_t ByteOrder)
+{
+	uint64_t Raw = 0;
+	uint8_t Bit = StartBit;
+
+	for(uint8_t i = 0; i < Length; i++)
+	{
+		if(ByteOrder == CAN_SIGNAL_LITTLE_ENDIAN)
+		{
+			Bit = StartBit + i;
+			Raw |= (uint64_t)((pData[Bit / 8] >> (Bit % 8)) & 1) << i;
+		}
+		else
+		{
+			/* MSB first, to the next byte after bit 0 of the byte */
+			Raw = (Raw << 1) | ((pData[Bit / 8] >> (Bit % 8)) & 1);
+			Bit = (Bit % 8 == 0) ? (uint8_t)(Bit + 15) : (uint8_t)(Bit - 1);
+		}
+	}
+
+	return Raw;
+}
+
+/*!
+ * @brief Time in ns
+ *
+ * @return					Monotonic time (ns)
+ */
+static uint64_t BenchNs(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+	return (uint64_t)Ts.tv_sec * 1000000000ULL + (uint64_t)Ts.tv_nsec;
+}
+
+int main(void)
+{
+	volatile uint64_t Sink = 0;
+	uint32_t Seed = 12345, Errors = 0;
+	uint64_t Start, RefNs, FastNs;
+
+	for(uint32_t i = 0; i < BENCH_FRAMES; i++)
+	{
+		for(uint32_t j = 0; j < 8; j++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			Frames[i][j] = (uint8_t)(Seed >> 16);
+		}
+	}
+
+	/* Bit-exact results of all positions and lengths */
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		for(uint8_t Length = 1; Length <= 64; Length++)
+		{
+			for(uint8_t StartBit = 0; StartBit < 64; StartBit++)
+			{
+				uint8_t MsbShift = CAN_SignalShift(StartBit, Length, CAN_SIGNAL_BIG_ENDIAN);
+
+				if(StartBit + Length <= 64 &&
+				   CAN_SignalGetRaw(Frames[i], StartBit, Length, CAN_SIGNAL_LITTLE_ENDIAN) !=
+				   BenchRefGetRaw(Frames[i], StartBit, Length, CAN_SIGNAL_LITTLE_ENDIAN))
+					Errors++;
+
+				/* The Motorola signal must stay inside the frame */
+				if(MsbShift <= 64 - Length &&
+				   CAN_SignalGetRaw(Frames[i], StartBit, Length, CAN_SIGNAL_BIG_ENDIAN) !=
+				   BenchRefGetRaw(Frames[i], StartBit, Length, CAN_SIGNAL_BIG_ENDIAN))
+					Errors++;
+			}
+		}
+	}
+	printf("Bit-exact check: %u errors\n", Errors);
+
+	Start = BenchNs();
+	for(uint32_t r = 0; r < BENCH_ROUNDS; r++)
+	{
+		for(uint32_t i = 0; i < BENCH_FRAMES; i++)
+			Sink += BenchRefGetRaw(Frames[i], 12, 20, CAN_SIGNAL_LITTLE_ENDIAN) + BenchRefGetRaw(Frames[i], 27, 20, CAN_SIGNAL_BIG_ENDIAN);
+	}
+	RefNs = BenchNs() - Start;
+
+	Start = BenchNs();
+	for(uint32_t r = 0; r < BENCH_ROUNDS; r++)
+	{
+		for(uint32_t i = 0; i < BENCH_FRAMES; i++)
+			Sink += BenchIntel_GetRaw(Frames[i]) + BenchMotorola_GetRaw(Frames[i]);
+	}
+	FastNs = BenchNs() - Start;
+
+	printf("Bit-by-bit reference: %.2f ns/signal\n", (double)RefNs / (2.0 * BENCH_ROUNDS * BENCH_FRAMES));
+	printf("CAN_SIGNAL_DEFINE:    %.2f ns/signal (x%.1f)\n", (double)FastNs / (2.0 * BENCH_ROUNDS * BENCH_FRAMES),
+		   (double)RefNs / (double)FastNs);
+
+	(void)Sink;
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* CAN_SIGNAL_BENCH */
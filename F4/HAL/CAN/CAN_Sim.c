@@ -0,0 +1,690 @@
+/*!
+ * @file      CAN_Sim.c
+ *
+ * @brief     Simulated CAN bus behind the bxCAN HAL calls (host build, CAN_SIMULATION)
+ *
+ * @author    Anosov Anton
+ */
+
+#include "CAN_Sim.h"
+
+#ifdef CAN_SIMULATION
+
+#include <string.h>
+
+// Max number of frame bits from SOF to the end of CRC without stuffing
+#define CANSIM_MAX_FRAME_BITS		(1 + 32 + 6 + 64 + 15)
+
+// CRC delimiter, ACK slot and delimiter, EOF, interframe space
+#define CANSIM_TAIL_BITS			(1 + 2 + 7 + 3)
+
+// CRC-15 polynomial of CAN
+#define CANSIM_CRC15_POLY			0x4599
+
+/*!
+ * Transmit mailbox of the node
+ */
+typedef struct CanSimMailbox_s
+{
+	CAN_Frame_t Frame;
+	uint8_t IsPending;
+	uint64_t EnqueueNs;
+	uint32_t Sequence;
+}CanSimMailbox_t;
+
+/*!
+ * Received frame in the FIFO of the node
+ */
+typedef struct CanSimRxFrame_s
+{
+	CAN_Frame_t Frame;
+	uint32_t FilterMatchIndex;
+}CanSimRxFrame_t;
+
+/*!
+ * Node of the bus
+ */
+typedef struct CanSimNode_s
+{
+	CAN_HandleTypeDef *pHandle;
+	CanSimMailbox_t Mailbox[CANSIM_TX_MAILBOXES];
+	CanSimRxFrame_t Fifo[CANSIM_RX_FIFO_DEPTH];
+	uint8_t FifoHead;
+	uint8_t FifoCount;
+	CAN_FilterTypeDef Filter[CANSIM_FILTER_BANKS];
+	uint32_t ActiveIt;
+	uint8_t IsStarted;
+	CanSimNodeStats_t Stats;
+}CanSimNode_t;
+
+static CanSimNode_t Nodes[CANSIM_MAX_NODES];
+static uint8_t NodesCount;
+static uint64_t BitNs;
+static uint64_t NowNs;
+static uint32_t TxSequence;
+static CanSimStats_t BusStats;
+
+/*!
+ * @brief Find the node of the handle
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param IsCreate			Create the node if it is not on the bus
+ * @return					Pointer to the node, NULL - node is not found
+ */
+static CanSimNode_t* CanSimGetNode(CAN_HandleTypeDef *pCanHandle, uint8_t IsCreate)
+{
+	for(uint8_t i = 0; i < NodesCount; i++)
+	{
+		if(Nodes[i].pHandle == pCanHandle)
+			return &Nodes[i];
+	}
+
+	if(!IsCreate || NodesCount >= CANSIM_MAX_NODES)
+		return NULL;
+
+	memset(&Nodes[NodesCount], 0, sizeof(CanSimNode_t));
+	Nodes[NodesCount].pHandle = pCanHandle;
+	return &Nodes[NodesCount++];
+}
+
+/*!
+ * @brief Put bits of the value to the bit stream (MSB first)
+ *
+ * @param pBits				Pointer to the bit stream
+ * @param Pos				Position in the bit stream
+ * @param Value				Value
+ * @param Count				Number of bits
+ * @return					New position in the bit stream
+ */
+static uint8_t CanSimPutBits(uint8_t *pBits, uint8_t Pos, uint32_t Value, uint8_t Count)
+{
+	while(Count--)
+	{
+		pBits[Pos++] = (Value >> Count) & 1;
+	}
+	return Pos;
+}
+
+/*!
+ * @brief Build bit stream of the frame from SOF to the end of CRC (without stuffing)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param pBits				Pointer to the bit stream
+ * @return					Number of bits
+ */
+static uint8_t CanSimBuildBits(const CAN_Frame_t *pFrame, uint8_t *pBits)
+{
+	uint8_t Rtr = (pFrame->RTR == CAN_RTR_REMOTE) ? 1 : 0;
+	uint8_t Pos = 0;
+	uint16_t Crc = 0;
+
+	Pos = CanSimPutBits(pBits, Pos, 0, 1);											/* SOF */
+	if(pFrame->IDE == CAN_ID_EXT)
+	{
+		Pos = CanSimPutBits(pBits, Pos, pFrame->Id >> 18, 11);						/* Base ID */
+		Pos = CanSimPutBits(pBits, Pos, 1, 1);										/* SRR */
+		Pos = CanSimPutBits(pBits, Pos, 1, 1);										/* IDE */
+		Pos = CanSimPutBits(pBits, Pos, pFrame->Id & 0x3FFFF, 18);					/* Extended ID */
+		Pos = CanSimPutBits(pBits, Pos, Rtr, 1);									/* RTR */
+		Pos = CanSimPutBits(pBits, Pos, 0, 2);										/* r1, r0 */
+	}
+	else
+	{
+		Pos = CanSimPutBits(pBits, Pos, pFrame->Id, 11);							/* ID */
+		Pos = CanSimPutBits(pBits, Pos, Rtr, 1);									/* RTR */
+		Pos = CanSimPutBits(pBits, Pos, 0, 2);										/* IDE, r0 */
+	}
+	Pos = CanSimPutBits(pBits, Pos, pFrame->Dlc, 4);								/* DLC */
+	if(!Rtr)
+	{
+		for(uint8_t i = 0; i < pFrame->Dlc && i < 8; i++)
+			Pos = CanSimPutBits(pBits, Pos, pFrame->Data[i], 8);					/* Data */
+	}
+
+	for(uint8_t i = 0; i < Pos; i++)
+	{
+		uint8_t Next = pBits[i] ^ ((Crc >> 14) & 1);
+		Crc = (Crc << 1) & 0x7FFF;
+		if(Next)
+			Crc ^= CANSIM_CRC15_POLY;
+	}
+	Pos = CanSimPutBits(pBits, Pos, Crc, 15);										/* CRC */
+
+	return Pos;
+}
+
+/*!
+ * @brief Bitwise arbitration of two frames
+ *
+ * @param pA				Pointer to the first frame
+ * @param pB				Pointer to the second frame
+ * @return					1 - first frame wins, 0 - second frame wins
+ */
+static uint8_t CanSimArbitrate(const CAN_Frame_t *pA, const CAN_Frame_t *pB)
+{
+	uint8_t BitsA[CANSIM_MAX_FRAME_BITS], BitsB[CANSIM_MAX_FRAME_BITS];
+	uint8_t LenA = (pA->IDE == CAN_ID_EXT) ? 32 : 13;
+	uint8_t LenB = (pB->IDE == CAN_ID_EXT) ? 32 : 13;
+
+	CanSimBuildBits(pA, BitsA);
+	CanSimBuildBits(pB, BitsB);
+
+	/* Dominant (0) bit wins, SOF is skipped */
+	for(uint8_t i = 1; i <= LenA && i <= LenB; i++)
+	{
+		if(BitsA[i] != BitsB[i])
+			return BitsA[i] == 0;
+	}
+	return 1;
+}
+
+/*!
+ * @brief Check acceptance filters of the node (bxCAN filter bank semantics)
+ *
+ * @param pNode				Pointer to the node
+ * @param pFrame			Pointer to the frame
+ * @param pMatchIndex		Pointer to the filter match index
+ * @return					1 - frame is accepted, 0 - frame is rejected
+ */
+static uint8_t CanSimFilter(const CanSimNode_t *pNode, const CAN_Frame_t *pFrame, uint32_t *pMatchIndex)
+{
+	uint32_t Rtr = (pFrame->RTR == CAN_RTR_REMOTE) ? 0x2 : 0x0;
+	uint32_t Ide = (pFrame->IDE == CAN_ID_EXT) ? 0x4 : 0x0;
+	uint32_t Reg32, Reg16;
+	uint32_t Index = 0;
+
+	/* Register layout of the identifier (STID, EXID, IDE, RTR) */
+	if(pFrame->IDE == CAN_ID_EXT)
+		Reg32 = (pFrame->Id << 3) | Ide | Rtr;
+	else
+		Reg32 = (pFrame->Id << 21) | Rtr;
+	Reg16 = ((Reg32 >> 16) & 0xFFE0) | (Rtr << 3) | (Ide << 1) | ((Reg32 >> 15) & 0x7);
+
+	/* Filters are numbered from the first bank of the instance, inactive banks included */
+	uint8_t First = (pNode->pHandle->Instance == CAN2) ? CAN_FILTER_SLAVE_START : 0;
+	uint8_t End = (pNode->pHandle->Instance == CAN2) ? CANSIM_FILTER_BANKS : CAN_FILTER_SLAVE_START;
+
+	for(uint8_t Bank = First; Bank < End; Bank++)
+	{
+		const CAN_FilterTypeDef *pFilter = &pNode->Filter[Bank];
+		uint32_t Fr1 = (pFilter->FilterIdHigh << 16) | pFilter->FilterIdLow;
+		uint32_t Fr2 = (pFilter->FilterMaskIdHigh << 16) | pFilter->FilterMaskIdLow;
+		uint8_t IsActive = (pFilter->FilterActivation == ENABLE);
+
+		if(pFilter->FilterFIFOAssignment != CAN_RX_FIFO0)
+			continue;
+
+		if(pFilter->FilterScale == CAN_FILTERSCALE_32BIT)
+		{
+			if(pFilter->FilterMode == CAN_FILTERMODE_IDMASK)
+			{
+				if(IsActive && ((Reg32 ^ Fr1) & Fr2) == 0)
+					return *pMatchIndex = Index, 1;
+				Index += 1;
+			}
+			else
+			{
+				if(IsActive && Reg32 == Fr1)
+					return *pMatchIndex = Index, 1;
+				if(IsActive && Reg32 == Fr2)
+					return *pMatchIndex = Index + 1, 1;
+				Index += 2;
+			}
+		}
+		else
+		{
+			if(pFilter->FilterMode == CAN_FILTERMODE_IDMASK)
+			{
+				if(IsActive && ((Reg16 ^ pFilter->FilterIdLow) & pFilter->FilterMaskIdLow & 0xFFFF) == 0)
+					return *pMatchIndex = Index, 1;
+				if(IsActive && ((Reg16 ^ pFilter->FilterIdHigh) & pFilter->FilterMaskIdHigh & 0xFFFF) == 0)
+					return *pMatchIndex = Index + 1, 1;
+				Index += 2;
+			}
+			else
+			{
+				const uint32_t List[4] = {pFilter->FilterIdLow, pFilter->FilterMaskIdLow,
+										  pFilter->FilterIdHigh, pFilter->FilterMaskIdHigh};
+				for(uint8_t i = 0; i < 4; i++)
+				{
+					if(IsActive && Reg16 == (List[i] & 0xFFFF))
+						return *pMatchIndex = Index + i, 1;
+				}
+				Index += 4;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief Deliver frame to the receiving node
+ *
+ * @param pNode				Pointer to the node
+ * @param pFrame			Pointer to the frame
+ */
+static void CanSimDeliver(CanSimNode_t *pNode, const CAN_Frame_t *pFrame)
+{
+	uint32_t MatchIndex;
+
+	if(!CanSimFilter(pNode, pFrame, &MatchIndex))
+	{
+		pNode->Stats.RxFiltered++;
+		return;
+	}
+
+	if(pNode->FifoCount >= CANSIM_RX_FIFO_DEPTH)
+	{
+		/* FIFO overrun, the new frame is lost */
+		pNode->Stats.RxLost++;
+		pNode->pHandle->ErrorCode |= HAL_CAN_ERROR_RX_FOV0;
+		return;
+	}
+
+	CanSimRxFrame_t *pRx = &pNode->Fifo[(pNode->FifoHead + pNode->FifoCount) % CANSIM_RX_FIFO_DEPTH];
+	pRx->Frame = *pFrame;
+	pRx->FilterMatchIndex = MatchIndex;
+	pNode->FifoCount++;
+	pNode->Stats.RxFrames++;
+
+	/* The RX interrupt stays pending while the FIFO is not empty */
+	while((pNode->ActiveIt & CAN_IT_RX_FIFO0_MSG_PENDING) && pNode->FifoCount > 0)
+	{
+		uint8_t Count = pNode->FifoCount;
+		HAL_CAN_RxFifo0MsgPendingCallback(pNode->pHandle);
+		if(pNode->FifoCount == Count)
+			break;
+	}
+}
+
+/*!
+ * @brief Initialization of the bus, removes all nodes
+ *
+ * @param BitRate			Bit rate of the bus (bit/s)
+ */
+void CanSimInit(uint32_t BitRate)
+{
+	memset(Nodes, 0, sizeof(Nodes));
+	memset(&BusStats, 0, sizeof(BusStats));
+	NodesCount = 0;
+	NowNs = 0;
+	BitNs = 1000000000ULL / BitRate;
+}
+
+/*!
+ * @brief Number of bits of the frame on the bus (real bit stuffing, with interframe space)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					Number of bits
+ */
+uint32_t CanSimFrameBits(const CAN_Frame_t *pFrame)
+{
+	uint8_t Bits[CANSIM_MAX_FRAME_BITS];
+	uint8_t Len = CanSimBuildBits(pFrame, Bits);
+	uint32_t Stuffed = 0;
+	uint8_t Run = 1;
+	uint8_t Last = Bits[0];
+
+	/* After 5 equal bits a complementary bit is inserted, it starts a new run */
+	for(uint8_t i = 1; i < Len; i++)
+	{
+		if(Bits[i] == Last)
+		{
+			Run++;
+		}
+		else
+		{
+			Last = Bits[i];
+			Run = 1;
+		}
+		if(Run == 5)
+		{
+			Stuffed++;
+			Last = !Last;
+			Run = 1;
+		}
+	}
+
+	return Len + Stuffed + CANSIM_TAIL_BITS;
+}
+
+/*!
+ * @brief Transmits one frame if any mailbox is pending (the tick of the bus: time moves only here,
+ *        never in the HAL calls)
+ *
+ * @return					1 - frame is transmitted, 0 - bus is idle
+ */
+uint8_t CanSimStep(void)
+{
+	CanSimNode_t *pWinNode = NULL;
+	CanSimMailbox_t *pWin = NULL;
+	uint8_t WinIndex = 0;
+	uint32_t Contenders = 0;
+	uint32_t Bits;
+
+	for(uint8_t n = 0; n < NodesCount; n++)
+	{
+		/* Mailboxes of the bus-off node are frozen until the recovery (the test sets ESR) */
+		if(!Nodes[n].IsStarted || (Nodes[n].pHandle->Instance != NULL && (Nodes[n].pHandle->Instance->ESR & CAN_ESR_BOFF)))
+			continue;
+
+		/* The node offers one mailbox: the oldest request with TXFP, else the highest priority
+		   identifier (the lower mailbox number on the same identifier) */
+		CanSimMailbox_t *pNext = NULL;
+		uint8_t NextIndex = 0;
+		for(uint8_t m = 0; m < CANSIM_TX_MAILBOXES; m++)
+		{
+			CanSimMailbox_t *pMailbox = &Nodes[n].Mailbox[m];
+			if(!pMailbox->IsPending)
+				continue;
+			if(pNext == NULL ||
+			   ((Nodes[n].pHandle->Init.TransmitFifoPriority == ENABLE) ? (int32_t)(pMailbox->Sequence - pNext->Sequence) < 0 :
+																		  !CanSimArbitrate(&pNext->Frame, &pMailbox->Frame)))
+			{
+				pNext = pMailbox;
+				NextIndex = m;
+			}
+		}
+		if(pNext == NULL)
+			continue;
+
+		Contenders++;
+		if(pWin == NULL || !CanSimArbitrate(&pWin->Frame, &pNext->Frame))
+		{
+			pWin = pNext;
+			pWinNode = &Nodes[n];
+			WinIndex = NextIndex;
+		}
+	}
+
+	if(pWin == NULL)
+		return 0;
+
+	BusStats.ArbitrationLosses += Contenders - 1;
+
+	Bits = CanSimFrameBits(&pWin->Frame);
+	NowNs += Bits * BitNs;
+	BusStats.Frames++;
+	BusStats.Bits += Bits;
+	BusStats.BusyNs += Bits * BitNs;
+
+	pWin->IsPending = 0;
+	pWinNode->Stats.TxFrames++;
+	pWinNode->Stats.LatencySumNs += NowNs - pWin->EnqueueNs;
+	if(NowNs - pWin->EnqueueNs > pWinNode->Stats.LatencyMaxNs)
+		pWinNode->Stats.LatencyMaxNs = NowNs - pWin->EnqueueNs;
+
+	for(uint8_t n = 0; n < NodesCount; n++)
+	{
+		if(&Nodes[n] != pWinNode && Nodes[n].IsStarted)
+			CanSimDeliver(&Nodes[n], &pWin->Frame);
+	}
+
+	if(pWinNode->ActiveIt & CAN_IT_TX_MAILBOX_EMPTY)
+	{
+		if(WinIndex == 0)
+			HAL_CAN_TxMailbox0CompleteCallback(pWinNode->pHandle);
+		else if(WinIndex == 1)
+			HAL_CAN_TxMailbox1CompleteCallback(pWinNode->pHandle);
+		else
+			HAL_CAN_TxMailbox2CompleteCallback(pWinNode->pHandle);
+	}
+
+	return 1;
+}
+
+/*!
+ * @brief Runs the bus for the specified time
+ *
+ * @param Ns				Time (ns)
+ */
+void CanSimAdvance(uint64_t Ns)
+{
+	uint64_t EndNs = NowNs + Ns;
+
+	while(NowNs < EndNs && CanSimStep()) {}
+
+	if(NowNs < EndNs)
+		NowNs = EndNs;
+}
+
+/*!
+ * @brief Runs the bus until all mailboxes are empty
+ */
+void CanSimRunUntilIdle(void)
+{
+	while(CanSimStep()) {}
+}
+
+/*!
+ * @brief Get time of the simulation
+ *
+ * @return					Time (ns)
+ */
+uint64_t CanSimGetTimeNs(void)
+{
+	return NowNs;
+}
+
+/*!
+ * @brief Get statistics of the bus
+ *
+ * @return					Pointer to the CanSimStats_t
+ */
+const CanSimStats_t* CanSimGetStats(void)
+{
+	return &BusStats;
+}
+
+/*!
+ * @brief Get statistics of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CanSimNodeStats_t, NULL - node is not on the bus
+ */
+const CanSimNodeStats_t* CanSimGetNodeStats(CAN_HandleTypeDef *pCanHandle)
+{
+	CanSimNode_t *pNode = CanSimGetNode(pCanHandle, 0);
+
+	return pNode ? &pNode->Stats : NULL;
+}
+
+/* bxCAN HAL calls -----------------------------------------------------------*/
+
+__weak uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(NowNs / 1000000ULL);
+}
+
+__weak void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__weak void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__weak void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__weak void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__weak void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan)
+{
+	if(CanSimGetNode(hcan, 1) == NULL)
+		return HAL_ERROR;
+
+	hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+	hcan->State = HAL_CAN_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeInit(CAN_HandleTypeDef *hcan)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL)
+		return HAL_ERROR;
+
+	pNode->IsStarted = 0;
+	hcan->State = HAL_CAN_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL || hcan->State != HAL_CAN_STATE_READY)
+		return HAL_ERROR;
+
+	pNode->IsStarted = 1;
+	hcan->State = HAL_CAN_STATE_LISTENING;
+	if(hcan->Instance != NULL)
+		hcan->Instance->ESR = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL || hcan->State != HAL_CAN_STATE_LISTENING)
+		return HAL_ERROR;
+
+	pNode->IsStarted = 0;
+	hcan->State = HAL_CAN_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL || sFilterConfig->FilterBank >= CANSIM_FILTER_BANKS)
+		return HAL_ERROR;
+
+	pNode->Filter[sFilterConfig->FilterBank] = *sFilterConfig;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL)
+		return HAL_ERROR;
+
+	pNode->ActiveIt |= ActiveITs;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t InactiveITs)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL)
+		return HAL_ERROR;
+
+	pNode->ActiveIt &= ~InactiveITs;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL || !pNode->IsStarted)
+		return HAL_ERROR;
+
+	for(uint8_t m = 0; m < CANSIM_TX_MAILBOXES; m++)
+	{
+		CanSimMailbox_t *pMailbox = &pNode->Mailbox[m];
+
+		if(pMailbox->IsPending)
+			continue;
+
+		pMailbox->Frame.IDE = (uint8_t)pHeader->IDE;
+		pMailbox->Frame.Id = (pHeader->IDE == CAN_ID_EXT) ? (pHeader->ExtId & 0x1FFFFFFF) : (pHeader->StdId & 0x7FF);
+		pMailbox->Frame.RTR = (uint8_t)pHeader->RTR;
+		pMailbox->Frame.Dlc = (uint8_t)((pHeader->DLC > 8) ? 8 : pHeader->DLC);
+		memcpy(pMailbox->Frame.Data, aData, pMailbox->Frame.Dlc);
+		pMailbox->EnqueueNs = NowNs;
+		pMailbox->Sequence = TxSequence++;
+		pMailbox->IsPending = 1;
+		*pTxMailbox = (uint32_t)CAN_TX_MAILBOX0 << m;
+		return HAL_OK;
+	}
+
+	hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+	return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	if(pNode == NULL)
+		return HAL_ERROR;
+
+	for(uint8_t m = 0; m < CANSIM_TX_MAILBOXES; m++)
+	{
+		if(TxMailboxes & ((uint32_t)CAN_TX_MAILBOX0 << m))
+			pNode->Mailbox[m].IsPending = 0;
+	}
+	return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+	uint32_t FreeLevel = 0;
+
+	if(pNode == NULL)
+		return 0;
+
+	for(uint8_t m = 0; m < CANSIM_TX_MAILBOXES; m++)
+	{
+		if(!pNode->Mailbox[m].IsPending)
+			FreeLevel++;
+	}
+
+	return FreeLevel;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[])
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+	CanSimRxFrame_t *pRx;
+
+	if(pNode == NULL || RxFifo != CAN_RX_FIFO0 || pNode->FifoCount == 0)
+		return HAL_ERROR;
+
+	pRx = &pNode->Fifo[pNode->FifoHead];
+	pHeader->IDE = pRx->Frame.IDE;
+	pHeader->StdId = (pRx->Frame.IDE == CAN_ID_STD) ? pRx->Frame.Id : (pRx->Frame.Id >> 18);
+	pHeader->ExtId = (pRx->Frame.IDE == CAN_ID_EXT) ? pRx->Frame.Id : 0;
+	pHeader->RTR = pRx->Frame.RTR;
+	pHeader->DLC = pRx->Frame.Dlc;
+	pHeader->Timestamp = 0;
+	pHeader->FilterMatchIndex = pRx->FilterMatchIndex;
+	memcpy(aData, pRx->Frame.Data, pRx->Frame.Dlc);
+
+	pNode->FifoHead = (pNode->FifoHead + 1) % CANSIM_RX_FIFO_DEPTH;
+	pNode->FifoCount--;
+	return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+	CanSimNode_t *pNode = CanSimGetNode(hcan, 0);
+
+	return (pNode == NULL || RxFifo != CAN_RX_FIFO0) ? 0 : pNode->FifoCount;
+}
+
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef *hcan)
+{
+	return hcan->ErrorCode;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan)
+{
+	hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+	return HAL_OK;
+}
+
+#endif /* CAN_SIMULATION */
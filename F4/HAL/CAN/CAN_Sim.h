@@ -0,0 +1,151 @@
+/*!
+ * @file      CAN_Sim.h
+ *
+ * @brief     Simulated CAN bus behind the bxCAN HAL calls (host build, CAN_SIMULATION)
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef CAN_SIM_H_
+#define CAN_SIM_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include "CAN.h"
+
+/*!
+ * Simulation limits
+ */
+#define CANSIM_MAX_NODES					8
+#define CANSIM_FILTER_BANKS					28
+#define CANSIM_TX_MAILBOXES					3
+#define CANSIM_RX_FIFO_DEPTH				3
+
+/*!
+ * Statistics of the bus
+ */
+typedef struct CanSimStats_s
+{
+	/*!
+	 * Frames transmitted on the bus
+	 */
+	uint32_t Frames;
+
+	/*!
+	 * Bits transmitted on the bus (with stuffing and interframe space)
+	 */
+	uint64_t Bits;
+
+	/*!
+	 * Time the bus was busy (ns)
+	 */
+	uint64_t BusyNs;
+
+	/*!
+	 * Arbitrations lost by the nodes
+	 */
+	uint32_t ArbitrationLosses;
+
+}CanSimStats_t;
+
+/*!
+ * Statistics of the node
+ */
+typedef struct CanSimNodeStats_s
+{
+	/*!
+	 * Transmitted frames
+	 */
+	uint32_t TxFrames;
+
+	/*!
+	 * Received frames (passed the filters)
+	 */
+	uint32_t RxFrames;
+
+	/*!
+	 * Received frames lost by the FIFO overrun
+	 */
+	uint32_t RxLost;
+
+	/*!
+	 * Frames rejected by the filters
+	 */
+	uint32_t RxFiltered;
+
+	/*!
+	 * Sum of the latency from AddTxMessage to the end of the frame (ns)
+	 */
+	uint64_t LatencySumNs;
+
+	/*!
+	 * Max latency from AddTxMessage to the end of the frame (ns)
+	 */
+	uint64_t LatencyMaxNs;
+
+}CanSimNodeStats_t;
+
+/*!
+ * @brief Initialization of the bus, removes all nodes
+ *
+ * @param BitRate			Bit rate of the bus (bit/s)
+ */
+void CanSimInit(uint32_t BitRate);
+
+/*!
+ * @brief Transmits one frame if any mailbox is pending (the tick of the bus: time moves only here,
+ *        never in the HAL calls)
+ *
+ * @return					1 - frame is transmitted, 0 - bus is idle
+ */
+uint8_t CanSimStep(void);
+
+/*!
+ * @brief Runs the bus for the specified time
+ *
+ * @param Ns				Time (ns)
+ */
+void CanSimAdvance(uint64_t Ns);
+
+/*!
+ * @brief Runs the bus until all mailboxes are empty
+ */
+void CanSimRunUntilIdle(void);
+
+/*!
+ * @brief Get time of the simulation
+ *
+ * @return					Time (ns)
+ */
+uint64_t CanSimGetTimeNs(void);
+
+/*!
+ * @brief Get statistics of the bus
+ *
+ * @return					Pointer to the CanSimStats_t
+ */
+const CanSimStats_t* CanSimGetStats(void);
+
+/*!
+ * @brief Get statistics of the node
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @return					Pointer to the CanSimNodeStats_t, NULL - node is not on the bus
+ */
+const CanSimNodeStats_t* CanSimGetNodeStats(CAN_HandleTypeDef *pCanHandle);
+
+/*!
+ * @brief Number of bits of the frame on the bus (real bit stuffing, with interframe space)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @return					Number of bits
+ */
+uint32_t CanSimFrameBits(const CAN_Frame_t *pFrame);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CAN_SIM_H_ */
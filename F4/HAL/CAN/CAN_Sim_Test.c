@@ -0,0 +1,219 @@
+/*!
+ * @file      CAN_Sim_Test.c
+ *
+ * @brief     Checks of the simulated bus: timing, arbitration, filters, side-effect free queries,
+ *            the blocking send, the error states and the change-only send of CAN.c (host build, CAN_SIM_TEST)
+ *
+ * Build:     gcc -O2 -DCAN_SIMULATION -DCAN_SIM_TEST -I../Host -I. CAN_Sim_Test.c CAN.c CAN_Sim.c
+ *            ../Host/Host_Core.c -o can_sim_test
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef CAN_SIM_TEST
+
+#include "CAN_Sim.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BIT_RATE				500000
+#define TEST_BIT_NS					(1000000000ULL / TEST_BIT_RATE)
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+/*!
+ * Message of CAN_StdSendMessage (CAN.c)
+ */
+extern CAN_Message_t Msg;
+
+static uint32_t Errors;
+static CAN_Frame_t RxFrames[16];
+static uint32_t RxCount;
+
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	(void)pCanHandle;
+	if(RxCount < sizeof(RxFrames) / sizeof(RxFrames[0]))
+		RxFrames[RxCount] = *pFrame;
+	RxCount++;
+}
+
+/*!
+ * @brief Frame of the test
+ *
+ * @param Id				Standard ID
+ * @param Dlc				Data length
+ * @return					Frame
+ */
+static CAN_Frame_t TestFrame(uint32_t Id, uint8_t Dlc)
+{
+	CAN_Frame_t Frame = {Id, CAN_ID_STD, CAN_RTR_DATA, Dlc, {0}};
+
+	for(uint8_t i = 0; i < Dlc; i++)
+		Frame.Data[i] = (uint8_t)(Id + i);
+	return Frame;
+}
+
+int main(void)
+{
+	CAN_HandleTypeDef Tx = {0}, Tx2 = {0}, Rx = {0};
+	CAN_TypeDef Tx2Regs = {0};
+	CAN_FilterStdId_t Filter = {14, CAN_FILTERSCALE_32BIT, 0x100, 0x700, 0, 0};
+	CAN_Frame_t Frame, Batch[8];
+	CAN_CyclicMsg_t Cyclic = {0};
+	uint64_t Ns;
+	uint32_t Bits, Mailbox;
+
+	CanSimInit(TEST_BIT_RATE);
+	Tx.Instance = CAN1;
+	Tx2.Instance = &Tx2Regs;
+	Rx.Instance = CAN2;
+	CAN_Init(&Tx);
+	CAN_Init(&Rx);
+	HAL_CAN_Init(&Tx2);
+
+	/* Receiver accepts 0x100 - 0x1FF */
+	CAN_AddRangeFilterStdID(&Rx, &Filter);
+	CAN_Start(&Tx);
+	CAN_Start(&Rx);
+	HAL_CAN_Start(&Tx2);
+
+	/* Queries of the mailboxes do not move the bus */
+	Frame = TestFrame(0x123, 8);
+	TEST_CHECK(CAN_SendFrame(&Tx, &Frame) == 1);
+	for(uint32_t i = 0; i < 100; i++)
+		TEST_CHECK(HAL_CAN_GetTxMailboxesFreeLevel(&Tx) == 2);
+	TEST_CHECK(CanSimGetTimeNs() == 0);
+	TEST_CHECK(CanSimGetNodeStats(&Tx)->TxFrames == 0 && RxCount == 0);
+
+	/* The frame takes its stuffed length on the bus */
+	Bits = CanSimFrameBits(&Frame);
+	TEST_CHECK(Bits >= 111 && Bits <= 111 + 24);
+	TEST_CHECK(CanSimStep() == 1);
+	TEST_CHECK(CanSimGetTimeNs() == Bits * TEST_BIT_NS);
+	TEST_CHECK(RxCount == 1 && RxFrames[0].Id == 0x123 && memcmp(RxFrames[0].Data, Frame.Data, 8) == 0);
+	TEST_CHECK(CanSimStep() == 0);
+
+	/* Lower ID wins the arbitration, whichever node loaded it first */
+	RxCount = 0;
+	Frame = TestFrame(0x1F0, 2);
+	TEST_CHECK(CAN_SendFrame(&Tx, &Frame) == 1);
+	Frame = TestFrame(0x10F, 2);
+	TEST_CHECK(HAL_CAN_AddTxMessage(&Tx2, &(CAN_TxHeaderTypeDef){0x10F, 0, CAN_ID_STD, CAN_RTR_DATA, 2, DISABLE},
+									Frame.Data, &Mailbox) == HAL_OK);
+	CanSimRunUntilIdle();
+	TEST_CHECK(RxCount == 2 && RxFrames[0].Id == 0x10F && RxFrames[1].Id == 0x1F0);
+	TEST_CHECK(CanSimGetStats()->ArbitrationLosses == 1);
+
+	/* Frames out of the filter range are not received */
+	RxCount = 0;
+	Frame = TestFrame(0x200, 1);
+	TEST_CHECK(CAN_SendFrame(&Tx, &Frame) == 1);
+	CanSimRunUntilIdle();
+	TEST_CHECK(RxCount == 0 && CanSimGetNodeStats(&Rx)->RxFiltered == 1);
+
+	/* The blocking send runs the bus through CAN_WAIT_TICK and returns with all mailboxes free */
+	RxCount = 0;
+	Ns = CanSimGetTimeNs();
+	for(uint32_t i = 0; i < 10; i++)
+	{
+		Msg.StdID = 0x180 + i;
+		Msg.SizeMsgTx = 8;
+		memset(Msg.TxData, (int)i, sizeof(Msg.TxData));
+		CAN_StdSendMessage(&Tx);
+		TEST_CHECK(HAL_CAN_GetTxMailboxesFreeLevel(&Tx) == 3);
+	}
+	TEST_CHECK(RxCount == 10 && RxFrames[9].Id == 0x189);
+	TEST_CHECK(CanSimGetTimeNs() - Ns >= 10 * 111 * TEST_BIT_NS);
+
+	/* Error-passive node is not throttled: frames go back to back */
+	Tx.Instance->ESR = CAN_ESR_EPVF;
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetBusState(&Tx) == CAN_BUS_STATE_PASSIVE);
+	Frame = TestFrame(0x150, 8);
+	TEST_CHECK(CAN_SendFrame(&Tx, &Frame) == 1 && CAN_SendFrame(&Tx, &Frame) == 1);
+	CanSimRunUntilIdle();
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->Throttled == 0);
+
+	/* Bus errors mask their interrupt after CAN_LEC_IRQ_LIMIT in the window, CAN_Process lifts the mask */
+	for(uint32_t i = 0; i < CAN_LEC_IRQ_LIMIT + 10; i++)
+	{
+		Tx.ErrorCode = HAL_CAN_ERROR_ACK;
+		HAL_CAN_ErrorCallback(&Tx);
+	}
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->IsLecMasked == 1 && CAN_GetErrorStats(&Tx)->LecMasks == 1);
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->IsLecMasked == 1);
+	CanSimAdvance(CAN_LEC_WINDOW_MS * 1000000ULL);
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->IsLecMasked == 0 && CAN_GetErrorStats(&Tx)->LecErrors == 0);
+
+	/* Bus-off without the interrupt: CAN_Process latches it, sends fail until the recovery */
+	for(uint32_t i = 0; i < 8; i++)
+		Batch[i] = TestFrame(0x1A0 + i, 8);
+	TEST_CHECK(CAN_SendBatch(&Tx, Batch, 8) == 8);
+	Tx.Instance->ESR = CAN_ESR_BOFF;
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetBusState(&Tx) == CAN_BUS_STATE_OFF && CAN_GetErrorStats(&Tx)->BusOffs == 1);
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->RecoveryTick == HAL_GetTick() + CAN_RECOVERY_MIN_MS);
+	Msg.StdID = 0x190;
+	TEST_CHECK(CAN_StdSendMessage(&Tx) == 0);
+	TEST_CHECK(CAN_SendFrame(&Tx, &Frame) == 0 && CAN_SendBatch(&Tx, Batch, 8) == 0);
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->Throttled == 2);
+	CanSimAdvance(CAN_RECOVERY_MIN_MS * 1000000ULL);
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetErrorStats(&Tx)->Recoveries == 1);
+
+	/* The frames held since the bus-off are dropped by the recovery */
+	RxCount = 0;
+	CanSimRunUntilIdle();
+	TEST_CHECK(RxCount == 0 && HAL_CAN_GetTxMailboxesFreeLevel(&Tx) == 3);
+	CAN_Process(&Tx);
+	TEST_CHECK(CAN_GetBusState(&Tx) == CAN_BUS_STATE_ACTIVE);
+	TEST_CHECK(CAN_StdSendMessage(&Tx) == 1);
+
+	/* The blocking send waits for the frames queued before it, the order is kept */
+	RxCount = 0;
+	TEST_CHECK(CAN_SendBatch(&Tx, Batch, 8) == 8);
+	Msg.StdID = 0x1F8;
+	TEST_CHECK(CAN_StdSendMessage(&Tx) == 1);
+	TEST_CHECK(RxCount == 9 && RxFrames[7].Id == 0x1A7 && RxFrames[8].Id == 0x1F8);
+
+	/* Change-only send: ID, type and size are part of the change, the saved bits are the simulated ones */
+	CanSimRunUntilIdle();
+	CAN_ResetDeltaStats(&Tx);
+	Cyclic.Frame = TestFrame(0x160, 8);
+	Cyclic.KeepAliveMs = 1000;
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 1);
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 0);
+	Cyclic.Frame.Id = 0x161;
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 1);
+	Cyclic.Frame.RTR = CAN_RTR_REMOTE;
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 1);
+	Cyclic.Frame.RTR = CAN_RTR_DATA;
+	CanSimRunUntilIdle();
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 1);
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 0);
+	TEST_CHECK(CAN_GetDeltaStats(&Tx)->SentFrames == 4 && CAN_GetDeltaStats(&Tx)->SuppressedFrames == 2);
+	TEST_CHECK(CAN_GetDeltaStats(&Rx)->SentFrames == 0 && CAN_GetDeltaStats(&Rx)->SuppressedFrames == 0);
+
+	/* Invalid size above 8 compares the 8 bytes of the buffer only */
+	Cyclic.Frame.Dlc = Cyclic.LastFrame.Dlc = 15;
+	TEST_CHECK(CAN_SendOnChange(&Tx, &Cyclic) == 0);
+	Cyclic.Frame.Dlc = Cyclic.LastFrame.Dlc = 8;
+	CanSimRunUntilIdle();
+
+	/* 1000 suppressed frames in 1 s of the 500 kbit/s bus */
+	CAN_ResetDeltaStats(&Tx);
+	for(uint32_t i = 0; i < 1000; i++)
+		CAN_SendOnChange(&Tx, &Cyclic);
+	CanSimAdvance(1000000000ULL - (CanSimGetTimeNs() % 1000000ULL));
+	Bits = CanSimFrameBits(&Cyclic.Frame);
+	TEST_CHECK(CAN_GetDeltaStats(&Tx)->SavedBits == 1000ULL * Bits);
+	TEST_CHECK(CAN_GetSavedLoad(&Tx, TEST_BIT_RATE) == Bits * 1000 * 10000 / TEST_BIT_RATE);
+
+	printf("CAN simulator: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* CAN_SIM_TEST */
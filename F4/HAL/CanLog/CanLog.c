@@ -0,0 +1,410 @@
+/*!
+ * @file      CanLog.c
+ *
+ * @brief     CAN traffic recorder to the external SPI flash (W25Qxx)
+ *
+ * @author    Anosov Anton
+ */
+
+#include "CanLog.h"
+
+// Pages in one sector of the flash
+#define CANLOG_PAGES_PER_SECTOR		(CANLOG_SECTOR_SIZE / CANLOG_PAGE_SIZE)
+
+// Pages in the log region
+#define CANLOG_TOTAL_PAGES			(CANLOG_SECTOR_COUNT * CANLOG_PAGES_PER_SECTOR)
+
+// Max size of one frame record (header, varint time, ID, data)
+#define CANLOG_RECORD_MAX_SIZE		(1 + 5 + 4 + 8)
+
+// Size of the time sync record
+#define CANLOG_TIME_SYNC_SIZE		5
+
+/* RAM pages: the page at (Tail + Count) is filled, pages from Tail are written */
+static uint8_t Pages[CANLOG_RAM_PAGES][CANLOG_PAGE_SIZE];
+static uint32_t PageNumber[CANLOG_RAM_PAGES];
+static uint8_t Tail;
+static volatile uint8_t Count;
+static uint16_t Fill;
+static uint8_t IsPageOpen;
+
+/* Encoder state */
+static uint32_t EncodePage;
+static uint32_t Sequence;
+static uint32_t PrevTime;
+static uint32_t PrevId;
+static uint8_t PrevIDE;
+static uint8_t IsPrevIdValid;
+
+static CanLogStats_t CanLogStats;
+
+/*!
+ * @brief Put 32-bit value in little endian
+ *
+ * @param pBuff				Pointer to the buffer
+ * @param Value				Value
+ */
+static void CanLogPutLe32(uint8_t *pBuff, uint32_t Value)
+{
+	pBuff[0] = (uint8_t)(Value);
+	pBuff[1] = (uint8_t)(Value >> 8);
+	pBuff[2] = (uint8_t)(Value >> 16);
+	pBuff[3] = (uint8_t)(Value >> 24);
+}
+
+/*!
+ * @brief Get 32-bit value in little endian
+ *
+ * @param pBuff				Pointer to the buffer
+ * @return					Value
+ */
+static uint32_t CanLogGetLe32(const uint8_t *pBuff)
+{
+	return (uint32_t)pBuff[0] | ((uint32_t)pBuff[1] << 8) |
+		   ((uint32_t)pBuff[2] << 16) | ((uint32_t)pBuff[3] << 24);
+}
+
+/*!
+ * @brief Opens the next RAM page (call inside the critical section)
+ *
+ * @param Time				Current time
+ * @return					1 - page is opened, 0 - all RAM pages are busy
+ */
+static uint8_t CanLogOpenPage(uint32_t Time)
+{
+	uint8_t *pPage;
+
+	if(Count >= CANLOG_RAM_PAGES)
+		return 0;
+
+	pPage = Pages[(Tail + Count) % CANLOG_RAM_PAGES];
+	PageNumber[(Tail + Count) % CANLOG_RAM_PAGES] = EncodePage;
+	memset(pPage, CANLOG_HDR_PADDING, CANLOG_PAGE_SIZE);
+	Fill = 0;
+
+	if((EncodePage % CANLOG_PAGES_PER_SECTOR) == 0)
+	{
+		Sequence++;
+		CanLogPutLe32(&pPage[0], CANLOG_SECTOR_MAGIC);
+		CanLogPutLe32(&pPage[4], Sequence);
+		Fill = CANLOG_SECTOR_HEADER_SIZE;
+	}
+
+	/* Each page is decodable on its own */
+	pPage[Fill] = CANLOG_HDR_TIME_SYNC;
+	CanLogPutLe32(&pPage[Fill + 1], Time);
+	Fill += CANLOG_TIME_SYNC_SIZE;
+	PrevTime = Time;
+	IsPrevIdValid = 0;
+
+	IsPageOpen = 1;
+	return 1;
+}
+
+/*!
+ * @brief Closes the filled RAM page (call inside the critical section)
+ */
+static void CanLogClosePage(void)
+{
+	Count++;
+	EncodePage = (EncodePage + 1) % CANLOG_TOTAL_PAGES;
+	IsPageOpen = 0;
+}
+
+/*!
+ * @brief Initialization of the recorder, continues after the last written page
+ */
+void CanLogInit(void)
+{
+	uint8_t Header[CANLOG_SECTOR_HEADER_SIZE];
+	uint8_t IsFound = 0;
+	uint32_t LastSector = 0;
+	uint32_t LastSequence = 0;
+	uint8_t FirstByte;
+
+	Tail = 0;
+	Count = 0;
+	Fill = 0;
+	IsPageOpen = 0;
+	memset(&CanLogStats, 0, sizeof(CanLogStats));
+
+	/* Sector with the highest sequence number is the last written one */
+	for(uint32_t Sector = 0; Sector < CANLOG_SECTOR_COUNT; Sector++)
+	{
+		W25Qxx_ReadData((CANLOG_FIRST_SECTOR + Sector) * CANLOG_PAGES_PER_SECTOR, 0, Header, sizeof(Header));
+		if(CanLogGetLe32(&Header[0]) != CANLOG_SECTOR_MAGIC)
+			continue;
+		if(!IsFound || (int32_t)(CanLogGetLe32(&Header[4]) - LastSequence) > 0)
+		{
+			LastSequence = CanLogGetLe32(&Header[4]);
+			LastSector = Sector;
+			IsFound = 1;
+		}
+	}
+
+	if(!IsFound)
+	{
+		EncodePage = 0;
+		Sequence = 0;
+		return;
+	}
+
+	/* First blank page of the last sector, otherwise the next sector */
+	Sequence = LastSequence;
+	EncodePage = ((LastSector + 1) % CANLOG_SECTOR_COUNT) * CANLOG_PAGES_PER_SECTOR;
+	for(uint32_t Page = 1; Page < CANLOG_PAGES_PER_SECTOR; Page++)
+	{
+		W25Qxx_ReadData((CANLOG_FIRST_SECTOR + LastSector) * CANLOG_PAGES_PER_SECTOR + Page, 0, &FirstByte, 1);
+		if(FirstByte == CANLOG_HDR_PADDING)
+		{
+			EncodePage = LastSector * CANLOG_PAGES_PER_SECTOR + Page;
+			break;
+		}
+	}
+}
+
+/*!
+ * @brief Encodes the frame against the state of the open page
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param Time				Time of the frame
+ * @param pRecord			Pointer to the buffer of CANLOG_RECORD_MAX_SIZE bytes
+ * @return					Size of the record
+ */
+static uint8_t CanLogEncode(const CAN_Frame_t *pFrame, uint32_t Time, uint8_t *pRecord)
+{
+	uint8_t Size = 0;
+	uint8_t Dlc = (pFrame->Dlc > 8) ? 8 : pFrame->Dlc;
+	uint32_t Delta;
+
+	/* Header */
+	pRecord[Size] = Dlc;
+	if(pFrame->IDE == CAN_ID_EXT)
+		pRecord[Size] |= CANLOG_HDR_EXT;
+	if(pFrame->RTR == CAN_RTR_REMOTE)
+		pRecord[Size] |= CANLOG_HDR_RTR;
+	if(IsPrevIdValid && PrevId == pFrame->Id && PrevIDE == pFrame->IDE)
+		pRecord[Size] |= CANLOG_HDR_SAME_ID;
+	Size++;
+
+	/* Delta time */
+	Delta = Time - PrevTime;
+	do
+	{
+		pRecord[Size++] = (uint8_t)((Delta & 0x7F) | ((Delta > 0x7F) ? 0x80 : 0x00));
+		Delta >>= 7;
+	} while(Delta);
+
+	/* ID */
+	if(!(pRecord[0] & CANLOG_HDR_SAME_ID))
+	{
+		pRecord[Size++] = (uint8_t)(pFrame->Id);
+		pRecord[Size++] = (uint8_t)(pFrame->Id >> 8);
+		if(pFrame->IDE == CAN_ID_EXT)
+		{
+			pRecord[Size++] = (uint8_t)(pFrame->Id >> 16);
+			pRecord[Size++] = (uint8_t)(pFrame->Id >> 24);
+		}
+	}
+
+	/* Data */
+	if(pFrame->RTR != CAN_RTR_REMOTE)
+	{
+		memcpy(&pRecord[Size], pFrame->Data, Dlc);
+		Size += Dlc;
+	}
+
+	return Size;
+}
+
+/*!
+ * @brief Put received frame to the log (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void CanLogPutFrame(const CAN_Frame_t *pFrame)
+{
+	uint8_t Record[CANLOG_RECORD_MAX_SIZE];
+	uint8_t Size;
+	uint32_t Time = CANLOG_GET_TIME();
+
+	CANLOG_BEGIN_CRITICAL_SECTION();
+
+	if(!IsPageOpen && !CanLogOpenPage(Time))
+	{
+		CanLogStats.Overruns++;
+		CANLOG_END_CRITICAL_SECTION();
+		return;
+	}
+
+	Size = CanLogEncode(pFrame, Time, Record);
+	if(Fill + Size > CANLOG_PAGE_SIZE)
+	{
+		/* Records never cross a page, the rest of the page stays 0xFF */
+		CanLogClosePage();
+		if(!CanLogOpenPage(Time))
+		{
+			CanLogStats.Overruns++;
+			CANLOG_END_CRITICAL_SECTION();
+			return;
+		}
+
+		/* New page starts with the time sync and without the previous ID, the record always fits */
+		Size = CanLogEncode(pFrame, Time, Record);
+	}
+
+	memcpy(&Pages[(Tail + Count) % CANLOG_RAM_PAGES][Fill], Record, Size);
+	Fill += Size;
+	PrevTime = Time;
+	PrevId = pFrame->Id;
+	PrevIDE = pFrame->IDE;
+	IsPrevIdValid = 1;
+	CanLogStats.Frames++;
+	CanLogStats.Bytes += Size;
+
+	CANLOG_END_CRITICAL_SECTION();
+}
+
+/*!
+ * @brief Writes filled pages to the flash (call from the main loop)
+ */
+void CanLogProcess(void)
+{
+	while(Count > 0)
+	{
+		uint32_t Page = PageNumber[Tail];
+
+		/* Sector is erased when the log enters it */
+		if((Page % CANLOG_PAGES_PER_SECTOR) == 0)
+			W25Qxx_SectorErase(CANLOG_FIRST_SECTOR + Page / CANLOG_PAGES_PER_SECTOR);
+
+		W25Qxx_PageProgram(CANLOG_FIRST_SECTOR * CANLOG_PAGES_PER_SECTOR + Page, 0, Pages[Tail], CANLOG_PAGE_SIZE);
+		CanLogStats.Pages++;
+
+		CANLOG_BEGIN_CRITICAL_SECTION();
+		Tail = (Tail + 1) % CANLOG_RAM_PAGES;
+		Count--;
+		CANLOG_END_CRITICAL_SECTION();
+	}
+}
+
+/*!
+ * @brief Closes the partially filled page and writes it to the flash
+ */
+void CanLogFlush(void)
+{
+	CANLOG_BEGIN_CRITICAL_SECTION();
+	if(IsPageOpen)
+		CanLogClosePage();
+	CANLOG_END_CRITICAL_SECTION();
+
+	CanLogProcess();
+}
+
+/*!
+ * @brief Get statistics of the recorder
+ *
+ * @return					Pointer to the CanLogStats_t
+ */
+const CanLogStats_t* CanLogGetStats(void)
+{
+	return &CanLogStats;
+}
+
+/*!
+ * @brief Decodes one sector of the log (also usable by a host tool on a flash dump)
+ *
+ * @param pSector			Pointer to the sector data (CANLOG_SECTOR_SIZE bytes)
+ * @param pSequence			Pointer to the sequence number of the sector
+ * @param Callback			Callback of the decoded record
+ * @param pContext			User context of the callback
+ * @return					Number of the decoded records, -1 - sector is not a log sector
+ */
+int32_t CanLogDecodeSector(const uint8_t *pSector, uint32_t *pSequence, CanLogEntryCallback_t Callback, void *pContext)
+{
+	CanLogEntry_t Entry;
+	int32_t Records = 0;
+
+	if(CanLogGetLe32(&pSector[0]) != CANLOG_SECTOR_MAGIC)
+		return -1;
+
+	*pSequence = CanLogGetLe32(&pSector[4]);
+
+	for(uint32_t Page = 0; Page < CANLOG_PAGES_PER_SECTOR; Page++)
+	{
+		const uint8_t *pPage = &pSector[Page * CANLOG_PAGE_SIZE];
+		uint16_t Pos = (Page == 0) ? CANLOG_SECTOR_HEADER_SIZE : 0;
+		uint8_t IsIdValid = 0;
+		uint32_t Time = 0;
+
+		while(Pos < CANLOG_PAGE_SIZE)
+		{
+			uint8_t Header = pPage[Pos++];
+			uint8_t Dlc = Header & CANLOG_HDR_DLC_MASK;
+			uint32_t Delta = 0;
+			uint8_t Shift = 0;
+
+			if(Header == CANLOG_HDR_PADDING)
+				break;
+
+			if(Header == CANLOG_HDR_TIME_SYNC)
+			{
+				if(Pos + 4 > CANLOG_PAGE_SIZE)
+					break;
+				Time = CanLogGetLe32(&pPage[Pos]);
+				Pos += 4;
+				IsIdValid = 0;
+				continue;
+			}
+
+			if(Dlc > 8)
+				break;
+
+			do
+			{
+				if(Pos >= CANLOG_PAGE_SIZE || Shift > 28)
+					return Records;
+				Delta |= (uint32_t)(pPage[Pos] & 0x7F) << Shift;
+				Shift += 7;
+			} while(pPage[Pos++] & 0x80);
+			Time += Delta;
+
+			Entry.Frame.IDE = (Header & CANLOG_HDR_EXT) ? CAN_ID_EXT : CAN_ID_STD;
+			Entry.Frame.RTR = (Header & CANLOG_HDR_RTR) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+			Entry.Frame.Dlc = Dlc;
+
+			if(!(Header & CANLOG_HDR_SAME_ID))
+			{
+				uint8_t IdSize = (Entry.Frame.IDE == CAN_ID_EXT) ? 4 : 2;
+
+				if(Pos + IdSize > CANLOG_PAGE_SIZE)
+					break;
+				Entry.Frame.Id = (uint32_t)pPage[Pos] | ((uint32_t)pPage[Pos + 1] << 8);
+				if(IdSize == 4)
+					Entry.Frame.Id |= ((uint32_t)pPage[Pos + 2] << 16) | ((uint32_t)pPage[Pos + 3] << 24);
+				Pos += IdSize;
+				IsIdValid = 1;
+			}
+			else if(!IsIdValid)
+			{
+				break;
+			}
+
+			memset(Entry.Frame.Data, 0, sizeof(Entry.Frame.Data));
+			if(Entry.Frame.RTR == CAN_RTR_DATA)
+			{
+				if(Pos + Dlc > CANLOG_PAGE_SIZE)
+					break;
+				memcpy(Entry.Frame.Data, &pPage[Pos], Dlc);
+				Pos += Dlc;
+			}
+
+			Entry.Time = Time;
+			if(Callback)
+				Callback(&Entry, pContext);
+			Records++;
+		}
+	}
+
+	return Records;
+}
@@ -0,0 +1,152 @@
+/*!
+ * @file      CanLog.h
+ *
+ * @brief     CAN traffic recorder to the external SPI flash (W25Qxx)
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef CANLOG_H_
+#define CANLOG_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include "CAN.h"
+#include "W25Qxx.h"
+
+#define CANLOG_BEGIN_CRITICAL_SECTION()		__disable_irq()
+#define CANLOG_END_CRITICAL_SECTION()		__enable_irq()
+
+/* Configuration */
+#define CANLOG_FIRST_SECTOR					0
+#define CANLOG_SECTOR_COUNT					W25Qxx_SECTOR_COUNT
+#define CANLOG_PAGE_SIZE					W25Qxx_PAGE_SIZE
+#define CANLOG_SECTOR_SIZE					W25Qxx_SECTOR_SIZE
+#define CANLOG_GET_TIME()					HAL_GetTick()
+
+/*!
+ * RAM pages between the RX interrupt and the flash writer.
+ * Must absorb the traffic during one sector erase (~45 ms typical).
+ */
+#define CANLOG_RAM_PAGES					16
+
+/*!
+ * Record format (records never cross a page, the tail of a page is 0xFF)
+ *
+ * Sector start: 'C','L','O','G', sequence (LE 4 bytes), time sync record
+ *
+ * Frame record: header [E R S 0 D D D D]
+ *               E - extended ID, R - remote frame, S - same ID as the previous record,
+ *               D - DLC (0 - 8)
+ *               delta time (LEB128 varint)
+ *               ID (LE 2 or 4 bytes, absent if S is set)
+ *               data (DLC bytes, absent for remote frame)
+ *
+ * Time sync:    0x0F, absolute time (LE 4 bytes)
+ * Padding:      0xFF
+ */
+#define CANLOG_HDR_EXT						0x80
+#define CANLOG_HDR_RTR						0x40
+#define CANLOG_HDR_SAME_ID					0x20
+#define CANLOG_HDR_DLC_MASK					0x0F
+#define CANLOG_HDR_TIME_SYNC				0x0F
+#define CANLOG_HDR_PADDING					0xFF
+#define CANLOG_SECTOR_MAGIC					0x474F4C43		/* "CLOG" */
+#define CANLOG_SECTOR_HEADER_SIZE			8
+
+/*!
+ * Decoded record
+ */
+typedef struct CanLogEntry_s
+{
+	/*!
+	 * Absolute time of the frame
+	 */
+	uint32_t Time;
+
+	/*!
+	 * Frame description
+	 */
+	CAN_Frame_t Frame;
+
+}CanLogEntry_t;
+
+/*!
+ * Callback of the decoded record
+ */
+typedef void (*CanLogEntryCallback_t)(const CanLogEntry_t *pEntry, void *pContext);
+
+/*!
+ * Statistics of the recorder
+ */
+typedef struct CanLogStats_s
+{
+	/*!
+	 * Recorded frames
+	 */
+	uint32_t Frames;
+
+	/*!
+	 * Frames lost because all RAM pages were busy
+	 */
+	uint32_t Overruns;
+
+	/*!
+	 * Bytes of the records (without padding)
+	 */
+	uint32_t Bytes;
+
+	/*!
+	 * Programmed pages
+	 */
+	uint32_t Pages;
+
+}CanLogStats_t;
+
+/*!
+ * @brief Initialization of the recorder, continues after the last written page
+ */
+void CanLogInit(void);
+
+/*!
+ * @brief Put received frame to the log (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void CanLogPutFrame(const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Writes filled pages to the flash (call from the main loop)
+ */
+void CanLogProcess(void);
+
+/*!
+ * @brief Closes the partially filled page and writes it to the flash
+ */
+void CanLogFlush(void);
+
+/*!
+ * @brief Get statistics of the recorder
+ *
+ * @return					Pointer to the CanLogStats_t
+ */
+const CanLogStats_t* CanLogGetStats(void);
+
+/*!
+ * @brief Decodes one sector of the log (also usable by a host tool on a flash dump)
+ *
+ * @param pSector			Pointer to the sector data (CANLOG_SECTOR_SIZE bytes)
+ * @param pSequence			Pointer to the sequence number of the sector
+ * @param Callback			Callback of the decoded record
+ * @param pContext			User context of the callback
+ * @return					Number of the decoded records, -1 - sector is not a log sector
+ */
+int32_t CanLogDecodeSector(const uint8_t *pSector, uint32_t *pSequence, CanLogEntryCallback_t Callback, void *pContext);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CANLOG_H_ */
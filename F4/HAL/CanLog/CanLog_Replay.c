@@ -0,0 +1,215 @@
+/*!
+ * @file      CanLog_Replay.c
+ *
+ * @brief     Decoder of a CanLog flash dump and replay of the frames on the simulated bus
+ *            (host build, CANLOG_REPLAY)
+ *
+ * Build:     gcc -O2 -DCAN_SIMULATION -DCANLOG_REPLAY -DW25Q16 (chip of the dump) -I../Host -I. -I../CAN
+ *            -I../Flash/External_Flash/W25Qxx -ffunction-sections -Wl,--gc-sections CanLog_Replay.c CanLog.c
+ *            ../CAN/CAN.c ../CAN/CAN_Sim.c ../Host/Host_Core.c -o canlog_replay
+ *            (the flash functions of the logger are not linked, the decoder does not use them)
+ *
+ * Usage:     canlog_replay <dump> [-d] [-r <bit rate>]
+ *            -d - print the decoded frames, -r - replay the frames with the logged timing
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef CANLOG_REPLAY
+
+#include "CanLog.h"
+#include "CAN_Sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * Log sector of the dump
+ */
+typedef struct ReplaySector_s
+{
+	const uint8_t *pData;
+	uint32_t Sequence;
+}ReplaySector_t;
+
+/*!
+ * Context of the decoding
+ */
+typedef struct ReplayContext_s
+{
+	uint8_t IsPrint;
+	uint8_t IsReplay;
+	uint8_t IsStarted;
+	uint32_t FirstTime;
+	uint32_t Frames;
+	uint32_t Late;
+	CAN_HandleTypeDef *pTx;
+}ReplayContext_t;
+
+static uint32_t RxFrames;
+
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	(void)pCanHandle;
+	(void)pFrame;
+	RxFrames++;
+}
+
+/*!
+ * @brief Order of the sectors by the sequence number (wraps like CanLogInit)
+ */
+static int ReplayCompare(const void *pA, const void *pB)
+{
+	int32_t Diff = (int32_t)(((const ReplaySector_t*)pA)->Sequence - ((const ReplaySector_t*)pB)->Sequence);
+
+	return (Diff > 0) - (Diff < 0);
+}
+
+/*!
+ * @brief Counts the records of the first pass
+ */
+static void ReplayCount(const CanLogEntry_t *pEntry, void *pContext)
+{
+	(void)pEntry;
+	(*(uint32_t*)pContext)++;
+}
+
+/*!
+ * @brief Prints and replays the decoded record
+ *
+ * @param pEntry			Pointer to the CanLogEntry_t description
+ * @param pContext			Pointer to the ReplayContext_t
+ */
+static void ReplayEntry(const CanLogEntry_t *pEntry, void *pContext)
+{
+	ReplayContext_t *pReplay = (ReplayContext_t*)pContext;
+	const CAN_Frame_t *pFrame = &pEntry->Frame;
+
+	if(!pReplay->IsStarted)
+	{
+		pReplay->FirstTime = pEntry->Time;
+		pReplay->IsStarted = 1;
+	}
+	pReplay->Frames++;
+
+	if(pReplay->IsPrint)
+	{
+		printf("%10.3f  %0*lX  %s[%u]", (double)(pEntry->Time - pReplay->FirstTime) / 1000.0,
+			   (pFrame->IDE == CAN_ID_EXT) ? 8 : 3, (unsigned long)pFrame->Id,
+			   (pFrame->RTR == CAN_RTR_REMOTE) ? "R" : "", pFrame->Dlc);
+		for(uint8_t i = 0; i < pFrame->Dlc && pFrame->RTR == CAN_RTR_DATA; i++)
+			printf(" %02X", pFrame->Data[i]);
+		printf("\n");
+	}
+
+	if(pReplay->IsReplay)
+	{
+		/* Log time is in ms (CANLOG_GET_TIME), the bus runs until the time of the frame */
+		uint64_t Ns = (uint64_t)(pEntry->Time - pReplay->FirstTime) * 1000000ULL;
+
+		if(CanSimGetTimeNs() < Ns)
+			CanSimAdvance(Ns - CanSimGetTimeNs());
+		else if(CanSimGetTimeNs() >= Ns + 1000000ULL)
+			pReplay->Late++;
+
+		while(CAN_SendBatch(pReplay->pTx, pFrame, 1) == 0)
+			CanSimStep();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	ReplayContext_t Replay = {0};
+	ReplaySector_t *pSectors;
+	uint32_t Count = 0, Records = 0, BitRate = 0;
+	CAN_HandleTypeDef Tx = {0}, Rx = {0};
+	CAN_FilterStdId_t Filter = {14, CAN_FILTERSCALE_32BIT, 0, 0, 0, 0};
+	uint8_t *pDump;
+	long Size;
+	FILE *pFile;
+
+	if(argc < 2)
+	{
+		printf("Usage: %s <dump> [-d] [-r <bit rate>]\n", argv[0]);
+		return 1;
+	}
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-d") == 0)
+			Replay.IsPrint = 1;
+		else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			BitRate = (uint32_t)strtoul(argv[++i], NULL, 10);
+	}
+
+	pFile = fopen(argv[1], "rb");
+	if(pFile == NULL)
+	{
+		printf("Can't open %s\n", argv[1]);
+		return 1;
+	}
+	fseek(pFile, 0, SEEK_END);
+	Size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	pDump = malloc((size_t)Size);
+	pSectors = malloc(sizeof(ReplaySector_t) * ((size_t)Size / CANLOG_SECTOR_SIZE + 1));
+	if(pDump == NULL || pSectors == NULL || fread(pDump, 1, (size_t)Size, pFile) != (size_t)Size)
+	{
+		printf("Can't read %s\n", argv[1]);
+		return 1;
+	}
+	fclose(pFile);
+
+	/* First pass: log sectors and their order */
+	for(long Offset = 0; Offset + CANLOG_SECTOR_SIZE <= Size; Offset += CANLOG_SECTOR_SIZE)
+	{
+		uint32_t Sequence;
+
+		if(CanLogDecodeSector(&pDump[Offset], &Sequence, ReplayCount, &Records) < 0)
+			continue;
+		pSectors[Count].pData = &pDump[Offset];
+		pSectors[Count].Sequence = Sequence;
+		Count++;
+	}
+	qsort(pSectors, Count, sizeof(ReplaySector_t), ReplayCompare);
+
+	if(BitRate != 0)
+	{
+		CanSimInit(BitRate);
+		Tx.Instance = CAN1;
+		Rx.Instance = CAN2;
+		CAN_Init(&Tx);
+		CAN_Init(&Rx);
+
+		/* Receiver accepts all frames */
+		CAN_AddRangeFilterStdID(&Rx, &Filter);
+		CAN_Start(&Tx);
+		CAN_Start(&Rx);
+
+		Replay.IsReplay = 1;
+		Replay.pTx = &Tx;
+	}
+
+	/* Second pass: records in the order of the sectors */
+	for(uint32_t i = 0; i < Count; i++)
+	{
+		uint32_t Sequence;
+
+		CanLogDecodeSector(pSectors[i].pData, &Sequence, ReplayEntry, &Replay);
+	}
+
+	printf("%u log sectors, %u records\n", Count, Records);
+
+	if(Replay.IsReplay)
+	{
+		CanSimRunUntilIdle();
+		printf("Replay at %u bit/s: %u frames sent, %u received, %u late by more than 1 ms, bus load %.1f %%\n",
+			   BitRate, Replay.Frames, RxFrames, Replay.Late,
+			   (CanSimGetTimeNs() != 0) ? 100.0 * (double)CanSimGetStats()->BusyNs / (double)CanSimGetTimeNs() : 0.0);
+	}
+
+	free(pSectors);
+	free(pDump);
+	return 0;
+}
+
+#endif /* CANLOG_REPLAY */
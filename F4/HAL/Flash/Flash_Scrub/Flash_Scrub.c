@@ -0,0 +1,184 @@
+/*!
+ * @file      Flash_Scrub.c
+ *
+ * @brief     Background integrity check of the firmware image in flash
+ *
+ * @author    Anosov Anton
+ */
+
+#include "Flash_Scrub.h"
+#include <stddef.h>
+#include <string.h>
+
+/*!
+ * Scrubber context
+ */
+typedef struct FlashScrub_s
+{
+	uint8_t IsRunning;
+	uint8_t IsActiveImage;			/* Region is the active image of Fw_Update */
+	uint8_t IsPause;				/* Pause between the passes */
+	uint32_t Tick;					/* Tick of the last chunk or end of the pass */
+	Crc32Ctx_t Ctx;
+	FlashScrubCallback_t Callback;
+	FlashScrubReport_t Report;
+}FlashScrub_t;
+
+static FlashScrub_t FlashScrub;
+
+/*!
+ * @brief Takes the active image as the region
+ *
+ * @return					FLASH_SCRUB_OK, FLASH_SCRUB_NO_IMAGE - no marker is written
+ */
+static FlashScrubStatus_t FlashScrubLoadActive(void)
+{
+	FwUpdateImage_t Image;
+
+	if(FwUpdateGetActive(&Image) != FW_UPDATE_OK || Image.Size == 0)
+		return FLASH_SCRUB_NO_IMAGE;
+
+	FlashScrub.Report.Address = Image.Address;
+	FlashScrub.Report.Size = Image.Size;
+	FlashScrub.Report.ExpectedCrc = Image.Crc;
+	return FLASH_SCRUB_OK;
+}
+
+/*!
+ * @brief Start of the scrubbing of the region
+ *
+ * @param Address			Start address of the region
+ * @param Size				Size of the region
+ * @param Crc				Expected checksum (ComputeChecksum with CRC_INI_VAL)
+ * @param Callback			Callback of the events (may be NULL)
+ * @return					Status of the operation
+ */
+FlashScrubStatus_t FlashScrubStart(uint32_t Address, uint32_t Size, uint32_t Crc, FlashScrubCallback_t Callback)
+{
+	if(Size == 0)
+		return FLASH_SCRUB_ERROR_PARAM;
+
+	memset(&FlashScrub, 0, sizeof(FlashScrub));
+	FlashScrub.Report.Address = Address;
+	FlashScrub.Report.Size = Size;
+	FlashScrub.Report.ExpectedCrc = Crc;
+	FlashScrub.Callback = Callback;
+	FlashScrub.IsRunning = 1;
+	return FLASH_SCRUB_OK;
+}
+
+/*!
+ * @brief Start of the scrubbing of the active firmware image (from the Fw_Update marker,
+ *        the image is taken again at the start of each pass)
+ *
+ * @param Callback			Callback of the events (may be NULL)
+ * @return					FLASH_SCRUB_OK, FLASH_SCRUB_NO_IMAGE - no marker is written
+ */
+FlashScrubStatus_t FlashScrubStartActive(FlashScrubCallback_t Callback)
+{
+	memset(&FlashScrub, 0, sizeof(FlashScrub));
+
+	if(FlashScrubLoadActive() != FLASH_SCRUB_OK)
+		return FLASH_SCRUB_NO_IMAGE;
+
+	FlashScrub.Callback = Callback;
+	FlashScrub.IsActiveImage = 1;
+	FlashScrub.IsRunning = 1;
+	return FLASH_SCRUB_OK;
+}
+
+/*!
+ * @brief Stop of the scrubbing
+ */
+void FlashScrubStop(void)
+{
+	FlashScrub.IsRunning = 0;
+}
+
+/*!
+ * @brief Checks the next chunk of the region (call from the main loop in idle time)
+ *
+ * @return					1 - chunk is checked, 0 - nothing to do
+ */
+uint8_t FlashScrubProcess(void)
+{
+	FlashScrubReport_t *pReport = &FlashScrub.Report;
+	uint32_t Tick = HAL_GetTick();
+	uint32_t Chunk;
+
+	if(!FlashScrub.IsRunning)
+		return 0;
+
+	if(FlashScrub.IsPause)
+	{
+		if((Tick - FlashScrub.Tick) < FLASH_SCRUB_PASS_INTERVAL_MS)
+			return 0;
+		FlashScrub.IsPause = 0;
+	}
+#if (FLASH_SCRUB_CHUNK_INTERVAL_MS > 0)
+	else if(pReport->Checked != 0 && (Tick - FlashScrub.Tick) < FLASH_SCRUB_CHUNK_INTERVAL_MS)
+	{
+		return 0;
+	}
+#endif
+
+	/* Start of the pass, the active image may be changed by an update */
+	if(pReport->Checked == 0)
+	{
+		if(FlashScrub.IsActiveImage && FlashScrubLoadActive() != FLASH_SCRUB_OK)
+		{
+			FlashScrub.IsPause = 1;
+			FlashScrub.Tick = Tick;
+			return 0;
+		}
+		Crc32Init(&FlashScrub.Ctx);
+	}
+
+	/* The flash is memory-mapped, the checksum runs over it in place */
+	Chunk = pReport->Size - pReport->Checked;
+	if(Chunk > FLASH_SCRUB_CHUNK_SIZE)
+		Chunk = FLASH_SCRUB_CHUNK_SIZE;
+
+	Crc32Update(&FlashScrub.Ctx, (const void*)(uintptr_t)(pReport->Address + pReport->Checked), Chunk);
+	pReport->Checked += Chunk;
+	FlashScrub.Tick = Tick;
+
+	if(pReport->Checked < pReport->Size)
+	{
+		pReport->Event = FLASH_SCRUB_EVENT_PROGRESS;
+	}
+	else
+	{
+		pReport->Crc = Crc32Final(&FlashScrub.Ctx);
+		pReport->Passes++;
+
+		if(pReport->Crc == pReport->ExpectedCrc)
+		{
+			pReport->Event = FLASH_SCRUB_EVENT_PASS;
+		}
+		else
+		{
+			pReport->Event = FLASH_SCRUB_EVENT_MISMATCH;
+			pReport->Mismatches++;
+		}
+		FlashScrub.IsPause = 1;
+	}
+
+	if(FlashScrub.Callback != NULL)
+		FlashScrub.Callback(pReport);
+
+	if(FlashScrub.IsPause)
+		pReport->Checked = 0;
+
+	return 1;
+}
+
+/*!
+ * @brief Get report of the scrubber
+ *
+ * @return					Pointer to the FlashScrubReport_t
+ */
+const FlashScrubReport_t* FlashScrubGetReport(void)
+{
+	return &FlashScrub.Report;
+}
@@ -0,0 +1,158 @@
+/*!
+ * @file      Flash_Scrub.h
+ *
+ * @brief     Background integrity check of the firmware image in flash
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef FLASH_SCRUB_H_
+#define FLASH_SCRUB_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "Internal_Flash.h"
+#include "Fw_Update.h"
+#include "Flash_Scrub_Cfg.h"
+
+/*!
+ * Status of the scrubber
+ */
+typedef enum FlashScrubStatus_e
+{
+	/*!
+	 * No error occurred
+	 */
+	FLASH_SCRUB_OK = 0,
+
+	/*!
+	 * Invalid parameters
+	 */
+	FLASH_SCRUB_ERROR_PARAM,
+
+	/*!
+	 * No image with the known checksum
+	 */
+	FLASH_SCRUB_NO_IMAGE
+
+}FlashScrubStatus_t;
+
+/*!
+ * Event of the scrubber
+ */
+typedef enum FlashScrubEvent_e
+{
+	/*!
+	 * Next chunk is checked
+	 */
+	FLASH_SCRUB_EVENT_PROGRESS = 0,
+
+	/*!
+	 * Pass is finished, the checksum matches
+	 */
+	FLASH_SCRUB_EVENT_PASS,
+
+	/*!
+	 * Pass is finished, the checksum does not match
+	 */
+	FLASH_SCRUB_EVENT_MISMATCH
+
+}FlashScrubEvent_t;
+
+/*!
+ * Report of the scrubber
+ */
+typedef struct FlashScrubReport_s
+{
+	/*!
+	 * Event of the report
+	 */
+	FlashScrubEvent_t Event;
+
+	/*!
+	 * Start address of the region
+	 */
+	uint32_t Address;
+
+	/*!
+	 * Size of the region
+	 */
+	uint32_t Size;
+
+	/*!
+	 * Checked bytes of the current pass
+	 */
+	uint32_t Checked;
+
+	/*!
+	 * Expected checksum (ComputeChecksum with CRC_INI_VAL)
+	 */
+	uint32_t ExpectedCrc;
+
+	/*!
+	 * Checksum of the last finished pass
+	 */
+	uint32_t Crc;
+
+	/*!
+	 * Finished passes
+	 */
+	uint32_t Passes;
+
+	/*!
+	 * Passes with the checksum mismatch
+	 */
+	uint32_t Mismatches;
+
+}FlashScrubReport_t;
+
+/*!
+ * Callback of the scrubber events
+ */
+typedef void (*FlashScrubCallback_t)(const FlashScrubReport_t *pReport);
+
+/*!
+ * @brief Start of the scrubbing of the region
+ *
+ * @param Address			Start address of the region
+ * @param Size				Size of the region
+ * @param Crc				Expected checksum (ComputeChecksum with CRC_INI_VAL)
+ * @param Callback			Callback of the events (may be NULL)
+ * @return					Status of the operation
+ */
+FlashScrubStatus_t FlashScrubStart(uint32_t Address, uint32_t Size, uint32_t Crc, FlashScrubCallback_t Callback);
+
+/*!
+ * @brief Start of the scrubbing of the active firmware image (from the Fw_Update marker,
+ *        the image is taken again at the start of each pass)
+ *
+ * @param Callback			Callback of the events (may be NULL)
+ * @return					FLASH_SCRUB_OK, FLASH_SCRUB_NO_IMAGE - no marker is written
+ */
+FlashScrubStatus_t FlashScrubStartActive(FlashScrubCallback_t Callback);
+
+/*!
+ * @brief Stop of the scrubbing
+ */
+void FlashScrubStop(void);
+
+/*!
+ * @brief Checks the next chunk of the region (call from the main loop in idle time)
+ *
+ * @return					1 - chunk is checked, 0 - nothing to do
+ */
+uint8_t FlashScrubProcess(void);
+
+/*!
+ * @brief Get report of the scrubber
+ *
+ * @return					Pointer to the FlashScrubReport_t
+ */
+const FlashScrubReport_t* FlashScrubGetReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FLASH_SCRUB_H_ */
@@ -0,0 +1,36 @@
+/*!
+ * @file      Flash_Scrub_Cfg.h
+ *
+ * @brief     Flash scrubber configuration
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef FLASH_SCRUB_CFG_H_
+#define FLASH_SCRUB_CFG_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+
+/*!
+ * Bytes checked by one FlashScrubProcess call (about 10 us per KB at 168 MHz)
+ */
+#define FLASH_SCRUB_CHUNK_SIZE				1024
+
+/*!
+ * Minimal time between two chunks (ms, 0 - chunk on each call)
+ */
+#define FLASH_SCRUB_CHUNK_INTERVAL_MS		0
+
+/*!
+ * Pause between the passes over the region (ms, 0 - continuous)
+ */
+#define FLASH_SCRUB_PASS_INTERVAL_MS		1000
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FLASH_SCRUB_CFG_H_ */
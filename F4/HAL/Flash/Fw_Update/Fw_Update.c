@@ -0,0 +1,474 @@
+/*!
+ * @file      Fw_Update.c
+ *
+ * @brief     A/B firmware update: streaming into the inactive slot and switch of the active slot
+ *
+ * @author    Anosov Anton
+ */
+
+#include "Fw_Update.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Areas [Address, Address + Size) must not overlap */
+#define FW_UPDATE_OVERLAP(A, SizeA, B, SizeB)		(((A) < (B) + (SizeB)) && ((B) < (A) + (SizeA)))
+
+#if FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_A_ADDRESS, FW_UPDATE_SLOT_SIZE, FW_UPDATE_SLOT_B_ADDRESS, FW_UPDATE_SLOT_SIZE)
+#error "FW_UPDATE_SLOT_A_ADDRESS/B must not overlap"
+#endif
+
+#if FW_UPDATE_OVERLAP(FW_UPDATE_MARKER_ADDRESS_1, FW_UPDATE_MARKER_AREA_SIZE, FW_UPDATE_MARKER_ADDRESS_2, FW_UPDATE_MARKER_AREA_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_A_ADDRESS, FW_UPDATE_SLOT_SIZE, FW_UPDATE_MARKER_ADDRESS_1, FW_UPDATE_MARKER_AREA_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_A_ADDRESS, FW_UPDATE_SLOT_SIZE, FW_UPDATE_MARKER_ADDRESS_2, FW_UPDATE_MARKER_AREA_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_B_ADDRESS, FW_UPDATE_SLOT_SIZE, FW_UPDATE_MARKER_ADDRESS_1, FW_UPDATE_MARKER_AREA_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_B_ADDRESS, FW_UPDATE_SLOT_SIZE, FW_UPDATE_MARKER_ADDRESS_2, FW_UPDATE_MARKER_AREA_SIZE)
+#error "FW_UPDATE_MARKER_ADDRESS_1/2 must not overlap each other and the slots"
+#endif
+
+// The erase of a slot must not take the internal storage of Wrap_Flash
+#if defined(__has_include)
+#if __has_include("Wrap_Flash_Cfg.h")
+#include "Wrap_Flash_Cfg.h"
+#if FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_A_ADDRESS, FW_UPDATE_SLOT_SIZE, FLASH_STORAGE_INT_ADDRESS_A, FLASH_STORAGE_INT_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_A_ADDRESS, FW_UPDATE_SLOT_SIZE, FLASH_STORAGE_INT_ADDRESS_B, FLASH_STORAGE_INT_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_B_ADDRESS, FW_UPDATE_SLOT_SIZE, FLASH_STORAGE_INT_ADDRESS_A, FLASH_STORAGE_INT_SIZE) || \
+	FW_UPDATE_OVERLAP(FW_UPDATE_SLOT_B_ADDRESS, FW_UPDATE_SLOT_SIZE, FLASH_STORAGE_INT_ADDRESS_B, FLASH_STORAGE_INT_SIZE)
+#error "FW_UPDATE_SLOT_A_ADDRESS/B overlap the Wrap_Flash storage (FLASH_STORAGE_INT_ADDRESS_A/B)"
+#endif
+#endif
+#endif
+
+#define FW_UPDATE_JOB_NONE			0
+#define FW_UPDATE_JOB_ERASE			1
+#define FW_UPDATE_JOB_PROGRAM		2
+
+/*!
+ * Update context
+ */
+typedef struct FwUpdate_s
+{
+	FwUpdateState_t State;
+	FwUpdateStatus_t Error;
+	uint32_t Slot;
+	uint32_t Address;
+	uint32_t Size;
+	uint32_t Crc;
+	uint32_t Received;
+	Crc32Ctx_t Ctx;
+	uint32_t ErasedEnd;				/* Erased area of the slot [Address, ErasedEnd) */
+	uint32_t EraseEnd;				/* End of the sector being erased */
+	uint32_t ProgramAddress;		/* Next address to program */
+	uint8_t Job;
+	uint8_t FillIndex;				/* Buffer receiving the data */
+	uint8_t ProgramIndex;			/* Next buffer to program */
+	uint8_t IsReady[2];				/* Buffer is full and waits for programming */
+	uint32_t Fill[2];
+	uint32_t Stage[2][FW_UPDATE_STAGE_SIZE / 4];
+}FwUpdate_t;
+
+static FwUpdate_t FwUpdate;
+
+/*!
+ * @brief Get start address of the slot
+ *
+ * @param Slot				Slot (0 - A, 1 - B)
+ * @return					Start address
+ */
+static uint32_t FwUpdateSlotAddress(uint32_t Slot)
+{
+	return (Slot == 0) ? FW_UPDATE_SLOT_A_ADDRESS : FW_UPDATE_SLOT_B_ADDRESS;
+}
+
+/*!
+ * @brief Scan of the marker area
+ *
+ * @param Area				Start address of the area
+ * @param pBlank			First blank record of the area, 0 - area is full
+ * @return					Newest valid marker of the area, NULL - no marker
+ */
+static const FwUpdateMarker_t* FwUpdateScanArea(uint32_t Area, uint32_t *pBlank)
+{
+	const FwUpdateMarker_t *pNewest = NULL;
+
+	*pBlank = 0;
+
+	for(uint32_t Record = Area; Record + sizeof(FwUpdateMarker_t) <= Area + FW_UPDATE_MARKER_AREA_SIZE; Record += sizeof(FwUpdateMarker_t))
+	{
+		const FwUpdateMarker_t *pMarker = (const FwUpdateMarker_t*)(uintptr_t)Record;
+		const uint32_t *pWords = (const uint32_t*)(uintptr_t)Record;
+		uint8_t IsBlank = 1;
+
+		for(uint32_t i = 0; i < sizeof(FwUpdateMarker_t) / 4; i++)
+		{
+			if(pWords[i] != 0xFFFFFFFF)
+				IsBlank = 0;
+		}
+
+		if(IsBlank)
+		{
+			*pBlank = Record;
+			break;
+		}
+
+		/* Torn markers have no magic and are skipped */
+		if(pMarker->Magic == FW_UPDATE_MARKER_MAGIC && pMarker->Slot < 2)
+			pNewest = pMarker;
+	}
+
+	return pNewest;
+}
+
+/*!
+ * @brief Search of the newest marker in both areas
+ *
+ * @param pArea				Area of the newest marker
+ * @param pBlank			First blank record of that area, 0 - area is full
+ * @return					Newest valid marker, NULL - no marker
+ */
+static const FwUpdateMarker_t* FwUpdateFindMarker(uint32_t *pArea, uint32_t *pBlank)
+{
+	uint32_t Blank1, Blank2;
+	const FwUpdateMarker_t *pMarker1 = FwUpdateScanArea(FW_UPDATE_MARKER_ADDRESS_1, &Blank1);
+	const FwUpdateMarker_t *pMarker2 = FwUpdateScanArea(FW_UPDATE_MARKER_ADDRESS_2, &Blank2);
+
+	if(pMarker2 != NULL && (pMarker1 == NULL || pMarker2->Sequence > pMarker1->Sequence))
+	{
+		*pArea = FW_UPDATE_MARKER_ADDRESS_2;
+		*pBlank = Blank2;
+		return pMarker2;
+	}
+
+	*pArea = FW_UPDATE_MARKER_ADDRESS_1;
+	*pBlank = Blank1;
+	return pMarker1;
+}
+
+/*!
+ * @brief Append of the marker. When the area of the newest marker is full, the other one
+ *        is erased and used, so a valid marker exists at any time
+ *
+ * @param Slot				Active slot
+ * @param Size				Image size
+ * @param Crc				Image checksum
+ * @return					Status of the operation
+ */
+static FwUpdateStatus_t FwUpdateWriteMarker(uint32_t Slot, uint32_t Size, uint32_t Crc)
+{
+	FwUpdateMarker_t Marker;
+	uint32_t Area, Record;
+	const FwUpdateMarker_t *pNewest = FwUpdateFindMarker(&Area, &Record);
+
+	memset(&Marker, 0xFF, sizeof(Marker));
+	Marker.Slot = Slot;
+	Marker.Size = Size;
+	Marker.Crc = Crc;
+	Marker.Sequence = (pNewest != NULL) ? pNewest->Sequence + 1 : 0;
+	Marker.Magic = FW_UPDATE_MARKER_MAGIC;
+
+	if(Record == 0)
+	{
+		Record = (Area == FW_UPDATE_MARKER_ADDRESS_1) ? FW_UPDATE_MARKER_ADDRESS_2 : FW_UPDATE_MARKER_ADDRESS_1;
+		if(FlashEraseRange(Record, FW_UPDATE_MARKER_AREA_SIZE) != FLASH_STATUS_OK)
+			return FW_UPDATE_ERROR_FLASH;
+	}
+
+	/* The magic is the commit of the marker */
+	if(FlashProgramData(Record, (const uint32_t*)&Marker, offsetof(FwUpdateMarker_t, Magic)) != FLASH_STATUS_OK ||
+	   FlashProgramData(Record + offsetof(FwUpdateMarker_t, Magic), &Marker.Magic, sizeof(Marker.Magic)) != FLASH_STATUS_OK)
+		return FW_UPDATE_ERROR_FLASH;
+
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief Stop of the update with the error
+ *
+ * @param Error				Status of the failed step
+ */
+static void FwUpdateFail(FwUpdateStatus_t Error)
+{
+	FwUpdate.Error = Error;
+	FwUpdate.State = FW_UPDATE_STATE_ERROR;
+}
+
+/*!
+ * @brief Verification of the programmed image and switch of the active slot
+ */
+static void FwUpdateFinish(void)
+{
+	FwUpdateStatus_t Status;
+
+	/* Checksum of the received data, then of the read-back flash */
+	if(Crc32Final(&FwUpdate.Ctx) != FwUpdate.Crc)
+	{
+		FwUpdateFail(FW_UPDATE_ERROR_CRC);
+		return;
+	}
+
+	if(ComputeChecksum(CRC_INI_VAL, (const void*)(uintptr_t)FwUpdate.Address, FwUpdate.Size) != FwUpdate.Crc)
+	{
+		FwUpdateFail(FW_UPDATE_ERROR_FLASH);
+		return;
+	}
+
+	if((Status = FwUpdateWriteMarker(FwUpdate.Slot, FwUpdate.Size, FwUpdate.Crc)) != FW_UPDATE_OK)
+	{
+		FwUpdateFail(Status);
+		return;
+	}
+
+	FwUpdate.State = FW_UPDATE_STATE_DONE;
+}
+
+/*!
+ * @brief Get the active slot from the markers
+ *
+ * @param pImage			Pointer to the FwUpdateImage_t description
+ * @return					FW_UPDATE_OK, FW_UPDATE_NO_MARKER - default slot is reported
+ */
+FwUpdateStatus_t FwUpdateGetActive(FwUpdateImage_t *pImage)
+{
+	uint32_t Area, Blank;
+	const FwUpdateMarker_t *pMarker = FwUpdateFindMarker(&Area, &Blank);
+
+	if(pMarker == NULL)
+	{
+		pImage->Slot = FW_UPDATE_DEFAULT_SLOT;
+		pImage->Address = FwUpdateSlotAddress(FW_UPDATE_DEFAULT_SLOT);
+		pImage->Size = 0;
+		pImage->Crc = 0;
+		return FW_UPDATE_NO_MARKER;
+	}
+
+	pImage->Slot = pMarker->Slot;
+	pImage->Address = FwUpdateSlotAddress(pMarker->Slot);
+	pImage->Size = pMarker->Size;
+	pImage->Crc = pMarker->Crc;
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief Start of the update of the inactive slot, its sectors are erased in the background
+ *
+ * @param Size				Image size
+ * @param Crc				Image checksum (ComputeChecksum with CRC_INI_VAL)
+ * @return					Status of the operation
+ */
+FwUpdateStatus_t FwUpdateBegin(uint32_t Size, uint32_t Crc)
+{
+	FwUpdateImage_t Active;
+
+	if(FwUpdate.State == FW_UPDATE_STATE_RECEIVING || FwUpdate.State == FW_UPDATE_STATE_FINISHING)
+		return FW_UPDATE_ERROR_STATE;
+
+	if(Size == 0 || Size > FW_UPDATE_SLOT_SIZE)
+		return FW_UPDATE_ERROR_PARAM;
+
+	FwUpdateGetActive(&Active);
+
+	memset(&FwUpdate, 0, offsetof(FwUpdate_t, Stage));
+	FwUpdate.Slot = Active.Slot ^ 1;
+	FwUpdate.Address = FwUpdateSlotAddress(FwUpdate.Slot);
+	FwUpdate.Size = Size;
+	FwUpdate.Crc = Crc;
+	FwUpdate.ErasedEnd = FwUpdate.Address;
+	FwUpdate.ProgramAddress = FwUpdate.Address;
+	Crc32Init(&FwUpdate.Ctx);
+	FwUpdate.State = FW_UPDATE_STATE_RECEIVING;
+
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief Next chunk of the image (the whole chunk is accepted or nothing)
+ *
+ * @param pData				Data pointer
+ * @param Size				Data size (up to FW_UPDATE_STAGE_SIZE)
+ * @return					FW_UPDATE_OK, FW_UPDATE_BUSY - repeat later, else error
+ */
+FwUpdateStatus_t FwUpdateWrite(const void *pData, uint32_t Size)
+{
+	const uint8_t *pByte = (const uint8_t*)pData;
+	uint8_t Next = FwUpdate.FillIndex ^ 1;
+	uint32_t Free;
+
+	if(FwUpdate.State != FW_UPDATE_STATE_RECEIVING)
+		return FW_UPDATE_ERROR_STATE;
+
+	if(Size > FW_UPDATE_STAGE_SIZE || FwUpdate.Received + Size > FwUpdate.Size)
+		return FW_UPDATE_ERROR_PARAM;
+
+	Free = FwUpdate.IsReady[FwUpdate.FillIndex] ? 0 : FW_UPDATE_STAGE_SIZE - FwUpdate.Fill[FwUpdate.FillIndex];
+	if(!FwUpdate.IsReady[Next])
+		Free += FW_UPDATE_STAGE_SIZE;
+	if(Size > Free)
+		return FW_UPDATE_BUSY;
+
+	/* The checksum is computed while the data arrives */
+	Crc32Update(&FwUpdate.Ctx, pData, Size);
+	FwUpdate.Received += Size;
+
+	while(Size > 0)
+	{
+		uint8_t Index = FwUpdate.FillIndex;
+		uint32_t Part = FW_UPDATE_STAGE_SIZE - FwUpdate.Fill[Index];
+
+		if(Part > Size)
+			Part = Size;
+
+		memcpy((uint8_t*)FwUpdate.Stage[Index] + FwUpdate.Fill[Index], pByte, Part);
+		FwUpdate.Fill[Index] += Part;
+		pByte += Part;
+		Size -= Part;
+
+		if(FwUpdate.Fill[Index] == FW_UPDATE_STAGE_SIZE)
+		{
+			FwUpdate.IsReady[Index] = 1;
+			FwUpdate.FillIndex ^= 1;
+		}
+	}
+
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief End of the image, the rest is programmed and verified by FwUpdateProcess,
+ *        the slot becomes active in FW_UPDATE_STATE_DONE
+ *
+ * @return					Status of the operation
+ */
+FwUpdateStatus_t FwUpdateEnd(void)
+{
+	uint8_t Index = FwUpdate.FillIndex;
+
+	if(FwUpdate.State != FW_UPDATE_STATE_RECEIVING)
+		return FW_UPDATE_ERROR_STATE;
+
+	if(FwUpdate.Received != FwUpdate.Size)
+		return FW_UPDATE_ERROR_PARAM;
+
+	/* The last buffer is padded to the word by the erased value */
+	if(FwUpdate.Fill[Index] > 0)
+	{
+		while(FwUpdate.Fill[Index] % 4)
+			((uint8_t*)FwUpdate.Stage[Index])[FwUpdate.Fill[Index]++] = 0xFF;
+		FwUpdate.IsReady[Index] = 1;
+		FwUpdate.FillIndex ^= 1;
+	}
+
+	FwUpdate.State = FW_UPDATE_STATE_FINISHING;
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief Abort of the update (the active slot is not changed)
+ *
+ * @return					FW_UPDATE_OK, FW_UPDATE_BUSY - flash job is in progress, repeat later
+ */
+FwUpdateStatus_t FwUpdateAbort(void)
+{
+	if(FwUpdate.Job != FW_UPDATE_JOB_NONE && FlashJobStatus() == FLASH_STATUS_BUSY)
+		return FW_UPDATE_BUSY;
+
+	FwUpdate.Job = FW_UPDATE_JOB_NONE;
+	FwUpdate.State = FW_UPDATE_STATE_IDLE;
+	return FW_UPDATE_OK;
+}
+
+/*!
+ * @brief Erase, program and verification steps (call from the main loop)
+ */
+void FwUpdateProcess(void)
+{
+	FlashStatus_t Status;
+	FlashSectorInfo_t Info;
+	uint8_t Index;
+
+	if(FwUpdate.State != FW_UPDATE_STATE_RECEIVING && FwUpdate.State != FW_UPDATE_STATE_FINISHING)
+		return;
+
+	/* Result of the finished job */
+	if(FwUpdate.Job != FW_UPDATE_JOB_NONE)
+	{
+		if((Status = FlashJobStatus()) == FLASH_STATUS_BUSY)
+			return;
+
+		if(Status != FLASH_STATUS_OK)
+		{
+			FwUpdate.Job = FW_UPDATE_JOB_NONE;
+			FwUpdateFail(FW_UPDATE_ERROR_FLASH);
+			return;
+		}
+
+		if(FwUpdate.Job == FW_UPDATE_JOB_ERASE)
+		{
+			FwUpdate.ErasedEnd = FwUpdate.EraseEnd;
+		}
+		else
+		{
+			Index = FwUpdate.ProgramIndex;
+			FwUpdate.ProgramAddress += FwUpdate.Fill[Index];
+			FwUpdate.Fill[Index] = 0;
+			FwUpdate.IsReady[Index] = 0;
+			FwUpdate.ProgramIndex ^= 1;
+		}
+		FwUpdate.Job = FW_UPDATE_JOB_NONE;
+	}
+
+	/* Programming of the erased area goes first, the erase runs ahead of the data */
+	Index = FwUpdate.ProgramIndex;
+	if(FwUpdate.IsReady[Index] && FwUpdate.ProgramAddress + FwUpdate.Fill[Index] <= FwUpdate.ErasedEnd)
+	{
+		/* The job engine may be used by the other modules, then it is retried */
+		if((Status = FlashProgramAsync(FwUpdate.ProgramAddress, FwUpdate.Stage[Index], FwUpdate.Fill[Index], NULL)) != FLASH_STATUS_OK)
+		{
+			if(Status != FLASH_STATUS_BUSY)
+				FwUpdateFail(FW_UPDATE_ERROR_FLASH);
+			return;
+		}
+		FwUpdate.Job = FW_UPDATE_JOB_PROGRAM;
+		return;
+	}
+
+	if(FwUpdate.ErasedEnd < FwUpdate.Address + FwUpdate.Size)
+	{
+		if(FlashGetSector(FwUpdate.ErasedEnd, &Info) != FLASH_STATUS_OK)
+		{
+			FwUpdateFail(FW_UPDATE_ERROR_FLASH);
+			return;
+		}
+
+		if((Status = FlashEraseSectorAsync(FwUpdate.ErasedEnd, NULL)) != FLASH_STATUS_OK)
+		{
+			if(Status != FLASH_STATUS_BUSY)
+				FwUpdateFail(FW_UPDATE_ERROR_FLASH);
+			return;
+		}
+		FwUpdate.EraseEnd = Info.Start + Info.Size;
+		FwUpdate.Job = FW_UPDATE_JOB_ERASE;
+		return;
+	}
+
+	if(FwUpdate.State == FW_UPDATE_STATE_FINISHING && !FwUpdate.IsReady[0] && !FwUpdate.IsReady[1])
+		FwUpdateFinish();
+}
+
+/*!
+ * @brief Get state of the update
+ *
+ * @return					State of the update
+ */
+FwUpdateState_t FwUpdateGetState(void)
+{
+	return FwUpdate.State;
+}
+
+/*!
+ * @brief Get error of the failed update
+ *
+ * @return					Status of the failed step
+ */
+FwUpdateStatus_t FwUpdateGetError(void)
+{
+	return FwUpdate.Error;
+}
@@ -0,0 +1,225 @@
+/*!
+ * @file      Fw_Update.h
+ *
+ * @brief     A/B firmware update: streaming into the inactive slot and switch of the active slot
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef FW_UPDATE_H_
+#define FW_UPDATE_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "Internal_Flash.h"
+#include "Fw_Update_Cfg.h"
+
+/*!
+ * Marker of the active slot
+ */
+#define FW_UPDATE_MARKER_MAGIC				0x4B52414D		/* "MARK" */
+
+/*!
+ * Status of the update
+ */
+typedef enum FwUpdateStatus_e
+{
+	/*!
+	 * No error occurred
+	 */
+	FW_UPDATE_OK = 0,
+
+	/*!
+	 * Staging buffers are full, repeat after FwUpdateProcess
+	 */
+	FW_UPDATE_BUSY,
+
+	/*!
+	 * Invalid parameters
+	 */
+	FW_UPDATE_ERROR_PARAM,
+
+	/*!
+	 * Call is not allowed in the current state
+	 */
+	FW_UPDATE_ERROR_STATE,
+
+	/*!
+	 * Erase, program or read-back error
+	 */
+	FW_UPDATE_ERROR_FLASH,
+
+	/*!
+	 * Checksum of the received image does not match
+	 */
+	FW_UPDATE_ERROR_CRC,
+
+	/*!
+	 * No marker is written, the default slot is reported
+	 */
+	FW_UPDATE_NO_MARKER
+
+}FwUpdateStatus_t;
+
+/*!
+ * State of the update
+ */
+typedef enum FwUpdateState_e
+{
+	/*!
+	 * No update in progress
+	 */
+	FW_UPDATE_STATE_IDLE = 0,
+
+	/*!
+	 * Receiving and programming of the image
+	 */
+	FW_UPDATE_STATE_RECEIVING,
+
+	/*!
+	 * All data is received, programming of the rest and verification
+	 */
+	FW_UPDATE_STATE_FINISHING,
+
+	/*!
+	 * Image is verified and its slot is active
+	 */
+	FW_UPDATE_STATE_DONE,
+
+	/*!
+	 * Update failed (see FwUpdateGetError)
+	 */
+	FW_UPDATE_STATE_ERROR
+
+}FwUpdateState_t;
+
+/*!
+ * Active-slot marker (append-only, the magic is written last)
+ */
+typedef struct FwUpdateMarker_s
+{
+	/*!
+	 * Active slot (0 - A, 1 - B)
+	 */
+	uint32_t Slot;
+
+	/*!
+	 * Image size
+	 */
+	uint32_t Size;
+
+	/*!
+	 * Image checksum (ComputeChecksum with CRC_INI_VAL)
+	 */
+	uint32_t Crc;
+
+	/*!
+	 * Sequence number, the newest marker has the greatest one
+	 */
+	uint32_t Sequence;
+
+	/*!
+	 * Reserved (left erased)
+	 */
+	uint32_t Reserved[3];
+
+	/*!
+	 * FW_UPDATE_MARKER_MAGIC after the marker is written completely
+	 */
+	uint32_t Magic;
+
+}FwUpdateMarker_t;
+
+/*!
+ * Image description
+ */
+typedef struct FwUpdateImage_s
+{
+	/*!
+	 * Slot (0 - A, 1 - B)
+	 */
+	uint32_t Slot;
+
+	/*!
+	 * Start address of the slot
+	 */
+	uint32_t Address;
+
+	/*!
+	 * Image size (0 - unknown)
+	 */
+	uint32_t Size;
+
+	/*!
+	 * Image checksum
+	 */
+	uint32_t Crc;
+
+}FwUpdateImage_t;
+
+/*!
+ * @brief Get the active slot from the markers
+ *
+ * @param pImage			Pointer to the FwUpdateImage_t description
+ * @return					FW_UPDATE_OK, FW_UPDATE_NO_MARKER - default slot is reported
+ */
+FwUpdateStatus_t FwUpdateGetActive(FwUpdateImage_t *pImage);
+
+/*!
+ * @brief Start of the update of the inactive slot, its sectors are erased in the background
+ *
+ * @param Size				Image size
+ * @param Crc				Image checksum (ComputeChecksum with CRC_INI_VAL)
+ * @return					Status of the operation
+ */
+FwUpdateStatus_t FwUpdateBegin(uint32_t Size, uint32_t Crc);
+
+/*!
+ * @brief Next chunk of the image (the whole chunk is accepted or nothing)
+ *
+ * @param pData				Data pointer
+ * @param Size				Data size (up to FW_UPDATE_STAGE_SIZE)
+ * @return					FW_UPDATE_OK, FW_UPDATE_BUSY - repeat later, else error
+ */
+FwUpdateStatus_t FwUpdateWrite(const void *pData, uint32_t Size);
+
+/*!
+ * @brief End of the image, the rest is programmed and verified by FwUpdateProcess,
+ *        the slot becomes active in FW_UPDATE_STATE_DONE
+ *
+ * @return					Status of the operation
+ */
+FwUpdateStatus_t FwUpdateEnd(void);
+
+/*!
+ * @brief Abort of the update (the active slot is not changed)
+ *
+ * @return					FW_UPDATE_OK, FW_UPDATE_BUSY - flash job is in progress, repeat later
+ */
+FwUpdateStatus_t FwUpdateAbort(void);
+
+/*!
+ * @brief Erase, program and verification steps (call from the main loop)
+ */
+void FwUpdateProcess(void);
+
+/*!
+ * @brief Get state of the update
+ *
+ * @return					State of the update
+ */
+FwUpdateState_t FwUpdateGetState(void);
+
+/*!
+ * @brief Get error of the failed update
+ *
+ * @return					Status of the failed step
+ */
+FwUpdateStatus_t FwUpdateGetError(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FW_UPDATE_H_ */
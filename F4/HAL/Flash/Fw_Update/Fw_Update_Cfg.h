@@ -0,0 +1,66 @@
+/*!
+ * @file      Fw_Update_Cfg.h
+ *
+ * @brief     Firmware update module configuration
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef FW_UPDATE_CFG_H_
+#define FW_UPDATE_CFG_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+
+/*!
+ * Image slots (sectors 8 - 9 and 10 - 11 of the 1 MB parts), the bootloader starts the active one.
+ * The slots must stay out of the code and of the Wrap_Flash storage (sectors 6 and 7)
+ */
+#ifndef FW_UPDATE_SLOT_A_ADDRESS
+#define FW_UPDATE_SLOT_A_ADDRESS			0x08080000
+#endif
+
+#ifndef FW_UPDATE_SLOT_B_ADDRESS
+#define FW_UPDATE_SLOT_B_ADDRESS			0x080C0000
+#endif
+
+#ifndef FW_UPDATE_SLOT_SIZE
+#define FW_UPDATE_SLOT_SIZE					(256 * 1024)
+#endif
+
+/*!
+ * Slot used when no marker is written yet (0 - A, 1 - B)
+ */
+#ifndef FW_UPDATE_DEFAULT_SLOT
+#define FW_UPDATE_DEFAULT_SLOT				0
+#endif
+
+/*!
+ * Two areas of the active-slot markers (sectors 2 and 3), used in turn
+ */
+#ifndef FW_UPDATE_MARKER_ADDRESS_1
+#define FW_UPDATE_MARKER_ADDRESS_1			0x08008000
+#endif
+
+#ifndef FW_UPDATE_MARKER_ADDRESS_2
+#define FW_UPDATE_MARKER_ADDRESS_2			0x0800C000
+#endif
+
+#ifndef FW_UPDATE_MARKER_AREA_SIZE
+#define FW_UPDATE_MARKER_AREA_SIZE			(16 * 1024)
+#endif
+
+/*!
+ * Size of each of the two RAM staging buffers (multiple of 8)
+ */
+#ifndef FW_UPDATE_STAGE_SIZE
+#define FW_UPDATE_STAGE_SIZE				1024
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FW_UPDATE_CFG_H_ */
@@ -0,0 +1,124 @@
+/*!
+ * @file      Fw_Update_Sim_Test.c
+ *
+ * @brief     Checks of the A/B update against the flash simulator: streaming of the 100 KB image, switch of
+ *            the active slot, image with the wrong checksum (host build, FW_UPDATE_SIM_TEST)
+ *
+ * Build:     gcc -O2 -DFLASH_SIMULATION -DFW_UPDATE_SIM_TEST -I../../Host -I. -I../Internal_Flash
+ *            -I../Wrap_Flash Fw_Update_Sim_Test.c Fw_Update.c ../Internal_Flash/Internal_Flash.c
+ *            ../Internal_Flash/Internal_Flash_Sim.c ../../Host/Host_Core.c -o fw_update_sim_test
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef FW_UPDATE_SIM_TEST
+
+#include "Fw_Update.h"
+#include "Internal_Flash_Sim.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_FILE					"fw_update_sim_test.bin"
+#define TEST_IMAGE_SIZE				(100 * 1024)
+#define TEST_CHUNK_SIZE				1000
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+static uint32_t Errors;
+static uint8_t Image[TEST_IMAGE_SIZE];
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(FlashSimGetTimeNs() / 1000000ULL);
+}
+
+/*!
+ * @brief One step of the main loop: the flash runs for 1 ms, then the update goes on
+ */
+static void TestStep(void)
+{
+	FlashSimAdvance(1000000ULL);
+	FwUpdateProcess();
+}
+
+/*!
+ * @brief Streaming of the image in chunks, as from the link
+ *
+ * @param Crc				Image checksum reported to FwUpdateBegin
+ * @return					State of the update at the end
+ */
+static FwUpdateState_t TestUpdate(uint32_t Crc)
+{
+	FwUpdateStatus_t Status;
+	uint32_t Sent = 0, Part;
+
+	TEST_CHECK(FwUpdateBegin(TEST_IMAGE_SIZE, Crc) == FW_UPDATE_OK);
+
+	while(Sent < TEST_IMAGE_SIZE)
+	{
+		Part = (TEST_IMAGE_SIZE - Sent < TEST_CHUNK_SIZE) ? TEST_IMAGE_SIZE - Sent : TEST_CHUNK_SIZE;
+		Status = FwUpdateWrite(&Image[Sent], Part);
+		if(Status == FW_UPDATE_OK)
+			Sent += Part;
+		else if(Status != FW_UPDATE_BUSY)
+			break;
+		TestStep();
+	}
+	TEST_CHECK(Sent == TEST_IMAGE_SIZE);
+
+	TEST_CHECK(FwUpdateEnd() == FW_UPDATE_OK);
+	while(FwUpdateGetState() == FW_UPDATE_STATE_FINISHING)
+		TestStep();
+
+	return FwUpdateGetState();
+}
+
+int main(void)
+{
+	FwUpdateImage_t Active;
+	uint32_t Crc;
+
+	for(uint32_t i = 0; i < TEST_IMAGE_SIZE; i++)
+		Image[i] = (uint8_t)(i * 7 + (i >> 8));
+	Crc = ComputeChecksum(CRC_INI_VAL, Image, TEST_IMAGE_SIZE);
+
+	unlink(TEST_FILE);
+	if(!FlashSimInit(TEST_FILE))
+	{
+		printf("FAIL: flash is not mapped at 0x%08lX\n", (unsigned long)FLASH_BASE);
+		return 1;
+	}
+
+	/* No marker yet: the default slot runs, the update goes to the other one */
+	TEST_CHECK(FwUpdateGetActive(&Active) == FW_UPDATE_NO_MARKER && Active.Slot == FW_UPDATE_DEFAULT_SLOT);
+
+	TEST_CHECK(TestUpdate(Crc) == FW_UPDATE_STATE_DONE);
+	TEST_CHECK(FwUpdateGetActive(&Active) == FW_UPDATE_OK);
+	TEST_CHECK(Active.Slot == (FW_UPDATE_DEFAULT_SLOT ^ 1) && Active.Size == TEST_IMAGE_SIZE && Active.Crc == Crc);
+	TEST_CHECK(memcmp((const void*)(uintptr_t)Active.Address, Image, TEST_IMAGE_SIZE) == 0);
+
+	/* Only the sectors of the image are erased, the storage of Wrap_Flash is not touched */
+	TEST_CHECK(FlashSimGetEraseCount(10) == 1 && FlashSimGetEraseCount(11) == 0);
+	TEST_CHECK(FlashSimGetEraseCount(6) == 0 && FlashSimGetEraseCount(7) == 0);
+
+	/* The image with the wrong checksum does not become active */
+	Image[TEST_IMAGE_SIZE / 2] ^= 0x01;
+	TEST_CHECK(TestUpdate(Crc) == FW_UPDATE_STATE_ERROR);
+	TEST_CHECK(FwUpdateGetError() == FW_UPDATE_ERROR_CRC);
+	TEST_CHECK(FwUpdateGetActive(&Active) == FW_UPDATE_OK);
+	TEST_CHECK(Active.Slot == (FW_UPDATE_DEFAULT_SLOT ^ 1) && Active.Crc == Crc);
+	TEST_CHECK(FlashSimGetEraseCount(8) == 1);
+
+	/* The active slot survives the restart */
+	FlashSimDeInit();
+	TEST_CHECK(FlashSimInit(TEST_FILE));
+	TEST_CHECK(FwUpdateGetActive(&Active) == FW_UPDATE_OK && Active.Slot == (FW_UPDATE_DEFAULT_SLOT ^ 1));
+	FlashSimDeInit();
+	unlink(TEST_FILE);
+
+	printf("Firmware update: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* FW_UPDATE_SIM_TEST */
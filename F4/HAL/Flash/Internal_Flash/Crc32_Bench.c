@@ -0,0 +1,178 @@
+/*!
+ * \file      Crc32_Bench.c
+ *
+ * \brief     Throughput of ComputeChecksum against a bitwise reference, bit-exact checks of ComputeChecksum
+ *            and of Crc32Update on random chunks (host build, CRC32_BENCH)
+ *
+ * Build:     gcc -O2 -DCRC32_BENCH -DFLASH_SIMULATION -DCRC32_SLICE_BY=8 -I../../Host -I.
+ *            Crc32_Bench.c Internal_Flash.c Internal_Flash_Sim.c ../../Host/Host_Core.c -o crc32_bench
+ *            (the variant is selected at compile time, build once per CRC32_SLICE_BY = 1, 4, 8;
+ *            -DCRC32_USE_HW=1 checks the bit reversal and the preload of the CRC unit on the model of the unit)
+ *
+ * \author    Anosov Anton
+ */
+
+#ifdef CRC32_BENCH
+
+#include "Internal_Flash.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_SIZE					(512 * 1024)
+#define BENCH_ROUNDS				20
+#define BENCH_CHECKS				4000
+
+static uint8_t Buffer[BENCH_SIZE + 16];
+
+/*!
+ * Byte table of Internal_Flash.c (used by CRC32_NEXT)
+ */
+extern const uint32_t CRC32_Table[256];
+
+/*!
+ * \brief Reference checksum, one bit at a time (same polynomial, init value and no final XOR)
+ *
+ * \param[IN] Crc  			Current crc value
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		The value of the checksum
+ */
+static uint32_t BenchRefChecksum(uint32_t Crc, const uint8_t *pData, uint32_t Size)
+{
+	while (Size--)
+	{
+		Crc ^= *pData++;
+		for (uint8_t i = 0; i < 8; i++)
+		{
+			Crc = (Crc >> 1) ^ ((Crc & 1) ? 0xEDB88320 : 0);
+		}
+	}
+
+	return Crc;
+}
+
+/*!
+ * \brief Byte table checksum (the CRC32_SLICE_BY = 1 loop), the baseline of the throughput
+ *
+ * \param[IN] Crc  			Current crc value
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		The value of the checksum
+ */
+static uint32_t BenchByteChecksum(uint32_t Crc, const void *pData, uint32_t Size)
+{
+	const uint8_t *pByte = (const uint8_t*)pData;
+
+	while (Size--)
+	{
+		Crc = CRC32_NEXT(Crc, *pByte++);
+	}
+
+	return Crc;
+}
+
+/*!
+ * \brief Time in ns
+ *
+ * \retval           		Monotonic time (ns)
+ */
+static uint64_t BenchNs(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+	return (uint64_t)Ts.tv_sec * 1000000000ULL + (uint64_t)Ts.tv_nsec;
+}
+
+/*!
+ * \brief Throughput of the checksum over the unaligned buffer
+ *
+ * \param[IN] pChecksum  	Checksum function
+ * \param[OUT] pCrc  		Checksum of the last round
+ * \retval           		MB/s
+ */
+static double BenchRun(uint32_t (*pChecksum)(uint32_t, const void*, uint32_t), uint32_t *pCrc)
+{
+	uint64_t Start = BenchNs();
+
+	for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+	{
+		*pCrc = pChecksum(CRC_INI_VAL, &Buffer[1], BENCH_SIZE);
+	}
+
+	return (double)BENCH_ROUNDS * BENCH_SIZE * 1000.0 / (double)(BenchNs() - Start);
+}
+
+int main(void)
+{
+	uint32_t Seed = 12345, Errors = 0, StreamErrors = 0;
+	uint32_t ByteCrc, Crc;
+	double ByteMBs, MBs;
+
+	for (uint32_t i = 0; i < sizeof(Buffer); i++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		Buffer[i] = (uint8_t)(Seed >> 16);
+	}
+
+	/* Bit-exact results on all alignments of the head and the tail */
+	for (uint32_t i = 0; i < BENCH_CHECKS; i++)
+	{
+		uint32_t Offset, Size;
+
+		Seed = Seed * 1103515245 + 12345;
+		Offset = (Seed >> 16) % 16;
+		Seed = Seed * 1103515245 + 12345;
+		Size = (Seed >> 16) % 300;
+
+		if (ComputeChecksum(CRC_INI_VAL, &Buffer[Offset], Size) != BenchRefChecksum(CRC_INI_VAL, &Buffer[Offset], Size))
+			Errors++;
+	}
+	printf("Bit-exact check: %u errors\n", Errors);
+
+	/* Streaming in random chunks: every chunk after the first one starts from a running value (preload of the unit) */
+	for (uint32_t i = 0; i < BENCH_CHECKS; i++)
+	{
+		Crc32Ctx_t Ctx;
+		uint32_t Offset, Size, Done = 0;
+
+		Seed = Seed * 1103515245 + 12345;
+		Offset = (Seed >> 16) % 16;
+		Seed = Seed * 1103515245 + 12345;
+		Size = (Seed >> 16) % 2048;
+
+		Crc32Init(&Ctx);
+		while (Done < Size)
+		{
+			uint32_t Chunk;
+
+			Seed = Seed * 1103515245 + 12345;
+			Chunk = 1 + (Seed >> 16) % 64;
+			if (Chunk > Size - Done)
+				Chunk = Size - Done;
+			Crc32Update(&Ctx, &Buffer[Offset + Done], Chunk);
+			Done += Chunk;
+		}
+
+		if (Crc32Final(&Ctx) != BenchRefChecksum(CRC_INI_VAL, &Buffer[Offset], Size))
+			StreamErrors++;
+	}
+	printf("Streaming check: %u errors\n", StreamErrors);
+	Errors += StreamErrors;
+
+	ByteMBs = BenchRun(BenchByteChecksum, &ByteCrc);
+	MBs = BenchRun(ComputeChecksum, &Crc);
+	if (Crc != ByteCrc)
+		Errors++;
+
+	printf("Byte table:          %.0f MB/s\n", ByteMBs);
+#if (CRC32_USE_HW == 1)
+	printf("CRC unit (model):    %.0f MB/s (x%.1f)\n", MBs, MBs / ByteMBs);
+#else
+	printf("CRC32_SLICE_BY = %d:  %.0f MB/s (x%.1f)\n", CRC32_SLICE_BY, MBs, MBs / ByteMBs);
+#endif
+
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* CRC32_BENCH */
@@ -0,0 +1,140 @@
+/*!
+ * \file      Flash_Job_Test.c
+ *
+ * \brief     Checks of the asynchronous flash job against the simulator: erase of every sector of the
+ *            area, program steps of the parallelism, busy state of the blocking API; alignment of the
+ *            blocking burst program and of the slots (host build, FLASH_JOB_TEST)
+ *
+ * Build:     gcc -O2 -DFLASH_SIMULATION -DFLASH_JOB_TEST -I../../Host -I. Flash_Job_Test.c
+ *            Internal_Flash.c Internal_Flash_Sim.c ../../Host/Host_Core.c -o flash_job_test
+ *            (-DFLASH_SUPPLY_RANGE=FLASH_VOLTAGE_RANGE_4 for the x64 program steps)
+ *
+ * \author    Anosov Anton
+ */
+
+#ifdef FLASH_JOB_TEST
+
+#include "Internal_Flash_Sim.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_FILE					"flash_job_test.bin"
+#define TEST_ADDRESS				0x0803FF00		/* End of sector 5, the data goes on in sector 6 */
+#define TEST_WORDS					128
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+static uint32_t Errors;
+static uint32_t Callbacks;
+static FlashStatus_t CallbackStatus;
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(FlashSimGetTimeNs() / 1000000ULL);
+}
+
+static void TestCallback(FlashStatus_t Status)
+{
+	Callbacks++;
+	CallbackStatus = Status;
+}
+
+/*!
+ * \brief Runs the simulator until the end of the job
+ *
+ * \retval           		Status of the job
+ */
+static FlashStatus_t TestWait(void)
+{
+	while(FlashJobStatus() == FLASH_STATUS_BUSY)
+		FlashSimAdvance(1000000ULL);
+	return FlashJobStatus();
+}
+
+int main(void)
+{
+	static uint32_t Data[TEST_WORDS];
+	static FlashMapData_t Map;
+	uint32_t Word = 0;
+	uint32_t Programs;
+
+	for(uint32_t i = 0; i < TEST_WORDS; i++)
+		Data[i] = 0xA5000000U | i;
+
+	unlink(TEST_FILE);
+	if(!FlashSimInit(TEST_FILE))
+	{
+		printf("FAIL: flash is not mapped at 0x%08lX\n", (unsigned long)FLASH_BASE);
+		return 1;
+	}
+
+	/* Dirty both sectors of the area */
+	TEST_CHECK(FlashProgramData(TEST_ADDRESS, &Word, 4) == FLASH_STATUS_OK);
+	TEST_CHECK(FlashProgramData(0x08040000 + 0x1000, &Word, 4) == FLASH_STATUS_OK);
+	Programs = FlashSimGetStats()->Programs;
+
+	/* The area crosses the sector border: both sectors are erased, one callback at the end */
+	TEST_CHECK(FlashWriteDataAsync(TEST_ADDRESS, Data, sizeof(Data), TestCallback) == FLASH_STATUS_OK);
+	TEST_CHECK(FlashJobStatus() == FLASH_STATUS_BUSY);
+
+	/* The blocking API and a second job wait for the end of the job */
+	TEST_CHECK(FlashWriteDataAsync(TEST_ADDRESS, Data, sizeof(Data), TestCallback) == FLASH_STATUS_BUSY);
+	TEST_CHECK(FlashEraseRange(0x08060000, 4) == FLASH_STATUS_BUSY);
+	TEST_CHECK(FlashProgramData(0x08060000, Data, 4) == FLASH_STATUS_BUSY);
+	TEST_CHECK(FlashWriteData(0x08060000, Data, 4) == FLASH_STATUS_BUSY);
+	TEST_CHECK(FlashSlotWrite(0x08060000, 0x20000, &Map) == FLASH_STATUS_BUSY);
+	TEST_CHECK(FlashSimGetEraseCount(7) == 0);
+
+	TEST_CHECK(TestWait() == FLASH_STATUS_OK);
+	TEST_CHECK(Callbacks == 1 && CallbackStatus == FLASH_STATUS_OK);
+	TEST_CHECK(FlashSimGetEraseCount(5) == 1 && FlashSimGetEraseCount(6) == 1);
+	TEST_CHECK(FlashSimGetEraseCount(4) == 0 && FlashSimGetEraseCount(7) == 0);
+	TEST_CHECK(memcmp((const void*)TEST_ADDRESS, Data, sizeof(Data)) == 0);
+	TEST_CHECK(FlashReadData(0x08040000 + 0x1000) == 0xFFFFFFFFU);
+
+	/* One program step per unit of the parallelism */
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	TEST_CHECK(FlashSimGetStats()->Programs - Programs == sizeof(Data) / 8);
+#else
+	TEST_CHECK(FlashSimGetStats()->Programs - Programs == sizeof(Data) / (1U << (FLASH_PROGRAM_PSIZE >> FLASH_CR_PSIZE_Pos)));
+#endif
+
+	/* Start not aligned to the unit, odd number of words */
+	Programs = FlashSimGetStats()->Programs;
+	TEST_CHECK(FlashProgramAsync(0x08040204, Data, 7 * 4, TestCallback) == FLASH_STATUS_OK);
+	TEST_CHECK(TestWait() == FLASH_STATUS_OK);
+	TEST_CHECK(Callbacks == 2 && memcmp((const void*)0x08040204, Data, 7 * 4) == 0);
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	TEST_CHECK(FlashSimGetStats()->Programs - Programs == 4);
+#endif
+
+	/* The burst keeps the double words aligned: a word first at the address not aligned to 8 */
+	Programs = FlashSimGetStats()->Programs;
+	TEST_CHECK(FlashProgramData(0x08040404, Data, 5 * 4) == FLASH_STATUS_OK);
+	TEST_CHECK(memcmp((const void*)0x08040404, Data, 5 * 4) == 0);
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	TEST_CHECK(FlashSimGetStats()->Programs - Programs == 3);
+#endif
+	TEST_CHECK(FlashSimGetStats()->ProgramErrors == 0);
+
+	/* Header, data and the commit of the slot go through the burst */
+	memset(&Map, 0x5A, sizeof(Map));
+	TEST_CHECK(FlashSlotWrite(0x08060000, 0x20000, &Map) == FLASH_STATUS_OK);
+	TEST_CHECK(FlashReadData(0x08060000 + offsetof(FlashSlotHeader_t, Magic)) == FLASH_SLOT_MAGIC);
+	TEST_CHECK(FlashReadData(0x08060000 + offsetof(FlashSlotHeader_t, Commit)) == FLASH_SLOT_COMMITTED);
+	TEST_CHECK(FlashSimGetStats()->ProgramErrors == 0);
+
+	/* The area out of the flash is refused before the job takes the flash */
+	TEST_CHECK(FlashWriteDataAsync(0x080FFF00, Data, sizeof(Data), TestCallback) == FLASH_STATUS_ERROR_ADDRESS);
+	TEST_CHECK(FlashJobStatus() != FLASH_STATUS_BUSY && Callbacks == 2);
+
+	FlashSimDeInit();
+	unlink(TEST_FILE);
+
+	printf("Flash job: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* FLASH_JOB_TEST */
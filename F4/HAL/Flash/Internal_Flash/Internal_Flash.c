@@ -7,8 +7,82 @@
  */
 
 #include "Internal_Flash.h"
+#include <stddef.h>
+#ifdef FLASH_SIMULATION
+#include "Internal_Flash_Sim.h"
+#endif
 
-static uint8_t FlashMapData_s[FLASH_STRUCT_USER_SIZE];
+/*!
+ * Asynchronous flash job
+ */
+typedef struct FlashJob_s
+{
+	volatile FlashStatus_t Status;
+	volatile uint8_t IsStepDone;
+	uint8_t IsErasing;
+	uint8_t IsError;
+	uint8_t Step;
+	uint32_t EraseAddress;
+	uint32_t EraseEnd;
+	uint32_t Address;
+	const uint8_t *pData;
+	uint32_t Count;
+	FlashJobCallback_t Callback;
+}FlashJob_t;
+
+/*!
+ * Program type and bytes of one step of the asynchronous job (FLASH_SUPPLY_RANGE parallelism)
+ */
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_BYTE)
+#define FLASH_JOB_PROGRAM_TYPE				FLASH_TYPEPROGRAM_BYTE
+#elif (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_HALF_WORD)
+#define FLASH_JOB_PROGRAM_TYPE				FLASH_TYPEPROGRAM_HALFWORD
+#elif (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_WORD)
+#define FLASH_JOB_PROGRAM_TYPE				FLASH_TYPEPROGRAM_WORD
+#else
+#define FLASH_JOB_PROGRAM_TYPE				FLASH_TYPEPROGRAM_DOUBLEWORD
+#endif
+#define FLASH_JOB_PROGRAM_BYTES				(1U << (FLASH_PROGRAM_PSIZE >> FLASH_CR_PSIZE_Pos))
+
+static FlashJob_t FlashJob = {.Status = FLASH_STATUS_OK};
+
+#if (FLASH_RAM_VECTORS == 1)
+/*!
+ * Vector table in RAM (VTOR needs the alignment to the table size rounded up to a power of two)
+ */
+static void (*FlashRamVectors[FLASH_VECTOR_COUNT])(void) __attribute__((aligned(512)));
+#endif
+
+/*!
+ * Result of the comparison of the new data with the flash
+ */
+#define FLASH_COMPARE_EQUAL					0		/* Nothing to write */
+#define FLASH_COMPARE_PROGRAM				1		/* Only 1 -> 0 changes, program without erase */
+#define FLASH_COMPARE_ERASE					2		/* Some bits 0 -> 1, erase is needed */
+
+#define FLASH_PROGRAM_ERRORS				(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+/*!
+ * Sectors of all F4 parts (F401/F405/F407/F411/F429/F446), sorted by the address.
+ * Bank 2 (sectors 12 - 23) exists only on the 2 MB parts, the smaller parts use
+ * the first sectors that fit into FLASH_SIZE_KB
+ */
+static const FlashSectorInfo_t FlashSectorTable[] = {
+	{ 0, 0x08000000,  16 * 1024}, { 1, 0x08004000,  16 * 1024},
+	{ 2, 0x08008000,  16 * 1024}, { 3, 0x0800C000,  16 * 1024},
+	{ 4, 0x08010000,  64 * 1024}, { 5, 0x08020000, 128 * 1024},
+	{ 6, 0x08040000, 128 * 1024}, { 7, 0x08060000, 128 * 1024},
+	{ 8, 0x08080000, 128 * 1024}, { 9, 0x080A0000, 128 * 1024},
+	{10, 0x080C0000, 128 * 1024}, {11, 0x080E0000, 128 * 1024},
+	{12, 0x08100000,  16 * 1024}, {13, 0x08104000,  16 * 1024},
+	{14, 0x08108000,  16 * 1024}, {15, 0x0810C000,  16 * 1024},
+	{16, 0x08110000,  64 * 1024}, {17, 0x08120000, 128 * 1024},
+	{18, 0x08140000, 128 * 1024}, {19, 0x08160000, 128 * 1024},
+	{20, 0x08180000, 128 * 1024}, {21, 0x081A0000, 128 * 1024},
+	{22, 0x081C0000, 128 * 1024}, {23, 0x081E0000, 128 * 1024},
+};
+
+#define FLASH_SECTOR_COUNT					(sizeof(FlashSectorTable) / sizeof(FlashSectorTable[0]))
 
 const uint32_t CRC32_Table[256] = {
   0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
@@ -65,34 +139,452 @@ const uint32_t CRC32_Table[256] = {
   0x2d02ef8dL
 };
 
+#if (CRC32_USE_HW == 0) && (CRC32_SLICE_BY >= 4)
+/*!
+ * Tables of the bytes 1 - 3 of the word (slice-by-4)
+ */
+static const uint32_t CRC32_TableSlice4[3][256] = {
+  {
+    0x00000000L, 0x191b3141L, 0x32366282L, 0x2b2d53c3L, 0x646cc504L,
+    0x7d77f445L, 0x565aa786L, 0x4f4196c7L, 0xc8d98a08L, 0xd1c2bb49L,
+    0xfaefe88aL, 0xe3f4d9cbL, 0xacb54f0cL, 0xb5ae7e4dL, 0x9e832d8eL,
+    0x87981ccfL, 0x4ac21251L, 0x53d92310L, 0x78f470d3L, 0x61ef4192L,
+    0x2eaed755L, 0x37b5e614L, 0x1c98b5d7L, 0x05838496L, 0x821b9859L,
+    0x9b00a918L, 0xb02dfadbL, 0xa936cb9aL, 0xe6775d5dL, 0xff6c6c1cL,
+    0xd4413fdfL, 0xcd5a0e9eL, 0x958424a2L, 0x8c9f15e3L, 0xa7b24620L,
+    0xbea97761L, 0xf1e8e1a6L, 0xe8f3d0e7L, 0xc3de8324L, 0xdac5b265L,
+    0x5d5daeaaL, 0x44469febL, 0x6f6bcc28L, 0x7670fd69L, 0x39316baeL,
+    0x202a5aefL, 0x0b07092cL, 0x121c386dL, 0xdf4636f3L, 0xc65d07b2L,
+    0xed705471L, 0xf46b6530L, 0xbb2af3f7L, 0xa231c2b6L, 0x891c9175L,
+    0x9007a034L, 0x179fbcfbL, 0x0e848dbaL, 0x25a9de79L, 0x3cb2ef38L,
+    0x73f379ffL, 0x6ae848beL, 0x41c51b7dL, 0x58de2a3cL, 0xf0794f05L,
+    0xe9627e44L, 0xc24f2d87L, 0xdb541cc6L, 0x94158a01L, 0x8d0ebb40L,
+    0xa623e883L, 0xbf38d9c2L, 0x38a0c50dL, 0x21bbf44cL, 0x0a96a78fL,
+    0x138d96ceL, 0x5ccc0009L, 0x45d73148L, 0x6efa628bL, 0x77e153caL,
+    0xbabb5d54L, 0xa3a06c15L, 0x888d3fd6L, 0x91960e97L, 0xded79850L,
+    0xc7cca911L, 0xece1fad2L, 0xf5facb93L, 0x7262d75cL, 0x6b79e61dL,
+    0x4054b5deL, 0x594f849fL, 0x160e1258L, 0x0f152319L, 0x243870daL,
+    0x3d23419bL, 0x65fd6ba7L, 0x7ce65ae6L, 0x57cb0925L, 0x4ed03864L,
+    0x0191aea3L, 0x188a9fe2L, 0x33a7cc21L, 0x2abcfd60L, 0xad24e1afL,
+    0xb43fd0eeL, 0x9f12832dL, 0x8609b26cL, 0xc94824abL, 0xd05315eaL,
+    0xfb7e4629L, 0xe2657768L, 0x2f3f79f6L, 0x362448b7L, 0x1d091b74L,
+    0x04122a35L, 0x4b53bcf2L, 0x52488db3L, 0x7965de70L, 0x607eef31L,
+    0xe7e6f3feL, 0xfefdc2bfL, 0xd5d0917cL, 0xcccba03dL, 0x838a36faL,
+    0x9a9107bbL, 0xb1bc5478L, 0xa8a76539L, 0x3b83984bL, 0x2298a90aL,
+    0x09b5fac9L, 0x10aecb88L, 0x5fef5d4fL, 0x46f46c0eL, 0x6dd93fcdL,
+    0x74c20e8cL, 0xf35a1243L, 0xea412302L, 0xc16c70c1L, 0xd8774180L,
+    0x9736d747L, 0x8e2de606L, 0xa500b5c5L, 0xbc1b8484L, 0x71418a1aL,
+    0x685abb5bL, 0x4377e898L, 0x5a6cd9d9L, 0x152d4f1eL, 0x0c367e5fL,
+    0x271b2d9cL, 0x3e001cddL, 0xb9980012L, 0xa0833153L, 0x8bae6290L,
+    0x92b553d1L, 0xddf4c516L, 0xc4eff457L, 0xefc2a794L, 0xf6d996d5L,
+    0xae07bce9L, 0xb71c8da8L, 0x9c31de6bL, 0x852aef2aL, 0xca6b79edL,
+    0xd37048acL, 0xf85d1b6fL, 0xe1462a2eL, 0x66de36e1L, 0x7fc507a0L,
+    0x54e85463L, 0x4df36522L, 0x02b2f3e5L, 0x1ba9c2a4L, 0x30849167L,
+    0x299fa026L, 0xe4c5aeb8L, 0xfdde9ff9L, 0xd6f3cc3aL, 0xcfe8fd7bL,
+    0x80a96bbcL, 0x99b25afdL, 0xb29f093eL, 0xab84387fL, 0x2c1c24b0L,
+    0x350715f1L, 0x1e2a4632L, 0x07317773L, 0x4870e1b4L, 0x516bd0f5L,
+    0x7a468336L, 0x635db277L, 0xcbfad74eL, 0xd2e1e60fL, 0xf9ccb5ccL,
+    0xe0d7848dL, 0xaf96124aL, 0xb68d230bL, 0x9da070c8L, 0x84bb4189L,
+    0x03235d46L, 0x1a386c07L, 0x31153fc4L, 0x280e0e85L, 0x674f9842L,
+    0x7e54a903L, 0x5579fac0L, 0x4c62cb81L, 0x8138c51fL, 0x9823f45eL,
+    0xb30ea79dL, 0xaa1596dcL, 0xe554001bL, 0xfc4f315aL, 0xd7626299L,
+    0xce7953d8L, 0x49e14f17L, 0x50fa7e56L, 0x7bd72d95L, 0x62cc1cd4L,
+    0x2d8d8a13L, 0x3496bb52L, 0x1fbbe891L, 0x06a0d9d0L, 0x5e7ef3ecL,
+    0x4765c2adL, 0x6c48916eL, 0x7553a02fL, 0x3a1236e8L, 0x230907a9L,
+    0x0824546aL, 0x113f652bL, 0x96a779e4L, 0x8fbc48a5L, 0xa4911b66L,
+    0xbd8a2a27L, 0xf2cbbce0L, 0xebd08da1L, 0xc0fdde62L, 0xd9e6ef23L,
+    0x14bce1bdL, 0x0da7d0fcL, 0x268a833fL, 0x3f91b27eL, 0x70d024b9L,
+    0x69cb15f8L, 0x42e6463bL, 0x5bfd777aL, 0xdc656bb5L, 0xc57e5af4L,
+    0xee530937L, 0xf7483876L, 0xb809aeb1L, 0xa1129ff0L, 0x8a3fcc33L,
+    0x9324fd72L
+  },
+  {
+    0x00000000L, 0x01c26a37L, 0x0384d46eL, 0x0246be59L, 0x0709a8dcL,
+    0x06cbc2ebL, 0x048d7cb2L, 0x054f1685L, 0x0e1351b8L, 0x0fd13b8fL,
+    0x0d9785d6L, 0x0c55efe1L, 0x091af964L, 0x08d89353L, 0x0a9e2d0aL,
+    0x0b5c473dL, 0x1c26a370L, 0x1de4c947L, 0x1fa2771eL, 0x1e601d29L,
+    0x1b2f0bacL, 0x1aed619bL, 0x18abdfc2L, 0x1969b5f5L, 0x1235f2c8L,
+    0x13f798ffL, 0x11b126a6L, 0x10734c91L, 0x153c5a14L, 0x14fe3023L,
+    0x16b88e7aL, 0x177ae44dL, 0x384d46e0L, 0x398f2cd7L, 0x3bc9928eL,
+    0x3a0bf8b9L, 0x3f44ee3cL, 0x3e86840bL, 0x3cc03a52L, 0x3d025065L,
+    0x365e1758L, 0x379c7d6fL, 0x35dac336L, 0x3418a901L, 0x3157bf84L,
+    0x3095d5b3L, 0x32d36beaL, 0x331101ddL, 0x246be590L, 0x25a98fa7L,
+    0x27ef31feL, 0x262d5bc9L, 0x23624d4cL, 0x22a0277bL, 0x20e69922L,
+    0x2124f315L, 0x2a78b428L, 0x2bbade1fL, 0x29fc6046L, 0x283e0a71L,
+    0x2d711cf4L, 0x2cb376c3L, 0x2ef5c89aL, 0x2f37a2adL, 0x709a8dc0L,
+    0x7158e7f7L, 0x731e59aeL, 0x72dc3399L, 0x7793251cL, 0x76514f2bL,
+    0x7417f172L, 0x75d59b45L, 0x7e89dc78L, 0x7f4bb64fL, 0x7d0d0816L,
+    0x7ccf6221L, 0x798074a4L, 0x78421e93L, 0x7a04a0caL, 0x7bc6cafdL,
+    0x6cbc2eb0L, 0x6d7e4487L, 0x6f38fadeL, 0x6efa90e9L, 0x6bb5866cL,
+    0x6a77ec5bL, 0x68315202L, 0x69f33835L, 0x62af7f08L, 0x636d153fL,
+    0x612bab66L, 0x60e9c151L, 0x65a6d7d4L, 0x6464bde3L, 0x662203baL,
+    0x67e0698dL, 0x48d7cb20L, 0x4915a117L, 0x4b531f4eL, 0x4a917579L,
+    0x4fde63fcL, 0x4e1c09cbL, 0x4c5ab792L, 0x4d98dda5L, 0x46c49a98L,
+    0x4706f0afL, 0x45404ef6L, 0x448224c1L, 0x41cd3244L, 0x400f5873L,
+    0x4249e62aL, 0x438b8c1dL, 0x54f16850L, 0x55330267L, 0x5775bc3eL,
+    0x56b7d609L, 0x53f8c08cL, 0x523aaabbL, 0x507c14e2L, 0x51be7ed5L,
+    0x5ae239e8L, 0x5b2053dfL, 0x5966ed86L, 0x58a487b1L, 0x5deb9134L,
+    0x5c29fb03L, 0x5e6f455aL, 0x5fad2f6dL, 0xe1351b80L, 0xe0f771b7L,
+    0xe2b1cfeeL, 0xe373a5d9L, 0xe63cb35cL, 0xe7fed96bL, 0xe5b86732L,
+    0xe47a0d05L, 0xef264a38L, 0xeee4200fL, 0xeca29e56L, 0xed60f461L,
+    0xe82fe2e4L, 0xe9ed88d3L, 0xebab368aL, 0xea695cbdL, 0xfd13b8f0L,
+    0xfcd1d2c7L, 0xfe976c9eL, 0xff5506a9L, 0xfa1a102cL, 0xfbd87a1bL,
+    0xf99ec442L, 0xf85cae75L, 0xf300e948L, 0xf2c2837fL, 0xf0843d26L,
+    0xf1465711L, 0xf4094194L, 0xf5cb2ba3L, 0xf78d95faL, 0xf64fffcdL,
+    0xd9785d60L, 0xd8ba3757L, 0xdafc890eL, 0xdb3ee339L, 0xde71f5bcL,
+    0xdfb39f8bL, 0xddf521d2L, 0xdc374be5L, 0xd76b0cd8L, 0xd6a966efL,
+    0xd4efd8b6L, 0xd52db281L, 0xd062a404L, 0xd1a0ce33L, 0xd3e6706aL,
+    0xd2241a5dL, 0xc55efe10L, 0xc49c9427L, 0xc6da2a7eL, 0xc7184049L,
+    0xc25756ccL, 0xc3953cfbL, 0xc1d382a2L, 0xc011e895L, 0xcb4dafa8L,
+    0xca8fc59fL, 0xc8c97bc6L, 0xc90b11f1L, 0xcc440774L, 0xcd866d43L,
+    0xcfc0d31aL, 0xce02b92dL, 0x91af9640L, 0x906dfc77L, 0x922b422eL,
+    0x93e92819L, 0x96a63e9cL, 0x976454abL, 0x9522eaf2L, 0x94e080c5L,
+    0x9fbcc7f8L, 0x9e7eadcfL, 0x9c381396L, 0x9dfa79a1L, 0x98b56f24L,
+    0x99770513L, 0x9b31bb4aL, 0x9af3d17dL, 0x8d893530L, 0x8c4b5f07L,
+    0x8e0de15eL, 0x8fcf8b69L, 0x8a809decL, 0x8b42f7dbL, 0x89044982L,
+    0x88c623b5L, 0x839a6488L, 0x82580ebfL, 0x801eb0e6L, 0x81dcdad1L,
+    0x8493cc54L, 0x8551a663L, 0x8717183aL, 0x86d5720dL, 0xa9e2d0a0L,
+    0xa820ba97L, 0xaa6604ceL, 0xaba46ef9L, 0xaeeb787cL, 0xaf29124bL,
+    0xad6fac12L, 0xacadc625L, 0xa7f18118L, 0xa633eb2fL, 0xa4755576L,
+    0xa5b73f41L, 0xa0f829c4L, 0xa13a43f3L, 0xa37cfdaaL, 0xa2be979dL,
+    0xb5c473d0L, 0xb40619e7L, 0xb640a7beL, 0xb782cd89L, 0xb2cddb0cL,
+    0xb30fb13bL, 0xb1490f62L, 0xb08b6555L, 0xbbd72268L, 0xba15485fL,
+    0xb853f606L, 0xb9919c31L, 0xbcde8ab4L, 0xbd1ce083L, 0xbf5a5edaL,
+    0xbe9834edL
+  },
+  {
+    0x00000000L, 0xb8bc6765L, 0xaa09c88bL, 0x12b5afeeL, 0x8f629757L,
+    0x37def032L, 0x256b5fdcL, 0x9dd738b9L, 0xc5b428efL, 0x7d084f8aL,
+    0x6fbde064L, 0xd7018701L, 0x4ad6bfb8L, 0xf26ad8ddL, 0xe0df7733L,
+    0x58631056L, 0x5019579fL, 0xe8a530faL, 0xfa109f14L, 0x42acf871L,
+    0xdf7bc0c8L, 0x67c7a7adL, 0x75720843L, 0xcdce6f26L, 0x95ad7f70L,
+    0x2d111815L, 0x3fa4b7fbL, 0x8718d09eL, 0x1acfe827L, 0xa2738f42L,
+    0xb0c620acL, 0x087a47c9L, 0xa032af3eL, 0x188ec85bL, 0x0a3b67b5L,
+    0xb28700d0L, 0x2f503869L, 0x97ec5f0cL, 0x8559f0e2L, 0x3de59787L,
+    0x658687d1L, 0xdd3ae0b4L, 0xcf8f4f5aL, 0x7733283fL, 0xeae41086L,
+    0x525877e3L, 0x40edd80dL, 0xf851bf68L, 0xf02bf8a1L, 0x48979fc4L,
+    0x5a22302aL, 0xe29e574fL, 0x7f496ff6L, 0xc7f50893L, 0xd540a77dL,
+    0x6dfcc018L, 0x359fd04eL, 0x8d23b72bL, 0x9f9618c5L, 0x272a7fa0L,
+    0xbafd4719L, 0x0241207cL, 0x10f48f92L, 0xa848e8f7L, 0x9b14583dL,
+    0x23a83f58L, 0x311d90b6L, 0x89a1f7d3L, 0x1476cf6aL, 0xaccaa80fL,
+    0xbe7f07e1L, 0x06c36084L, 0x5ea070d2L, 0xe61c17b7L, 0xf4a9b859L,
+    0x4c15df3cL, 0xd1c2e785L, 0x697e80e0L, 0x7bcb2f0eL, 0xc377486bL,
+    0xcb0d0fa2L, 0x73b168c7L, 0x6104c729L, 0xd9b8a04cL, 0x446f98f5L,
+    0xfcd3ff90L, 0xee66507eL, 0x56da371bL, 0x0eb9274dL, 0xb6054028L,
+    0xa4b0efc6L, 0x1c0c88a3L, 0x81dbb01aL, 0x3967d77fL, 0x2bd27891L,
+    0x936e1ff4L, 0x3b26f703L, 0x839a9066L, 0x912f3f88L, 0x299358edL,
+    0xb4446054L, 0x0cf80731L, 0x1e4da8dfL, 0xa6f1cfbaL, 0xfe92dfecL,
+    0x462eb889L, 0x549b1767L, 0xec277002L, 0x71f048bbL, 0xc94c2fdeL,
+    0xdbf98030L, 0x6345e755L, 0x6b3fa09cL, 0xd383c7f9L, 0xc1366817L,
+    0x798a0f72L, 0xe45d37cbL, 0x5ce150aeL, 0x4e54ff40L, 0xf6e89825L,
+    0xae8b8873L, 0x1637ef16L, 0x048240f8L, 0xbc3e279dL, 0x21e91f24L,
+    0x99557841L, 0x8be0d7afL, 0x335cb0caL, 0xed59b63bL, 0x55e5d15eL,
+    0x47507eb0L, 0xffec19d5L, 0x623b216cL, 0xda874609L, 0xc832e9e7L,
+    0x708e8e82L, 0x28ed9ed4L, 0x9051f9b1L, 0x82e4565fL, 0x3a58313aL,
+    0xa78f0983L, 0x1f336ee6L, 0x0d86c108L, 0xb53aa66dL, 0xbd40e1a4L,
+    0x05fc86c1L, 0x1749292fL, 0xaff54e4aL, 0x322276f3L, 0x8a9e1196L,
+    0x982bbe78L, 0x2097d91dL, 0x78f4c94bL, 0xc048ae2eL, 0xd2fd01c0L,
+    0x6a4166a5L, 0xf7965e1cL, 0x4f2a3979L, 0x5d9f9697L, 0xe523f1f2L,
+    0x4d6b1905L, 0xf5d77e60L, 0xe762d18eL, 0x5fdeb6ebL, 0xc2098e52L,
+    0x7ab5e937L, 0x680046d9L, 0xd0bc21bcL, 0x88df31eaL, 0x3063568fL,
+    0x22d6f961L, 0x9a6a9e04L, 0x07bda6bdL, 0xbf01c1d8L, 0xadb46e36L,
+    0x15080953L, 0x1d724e9aL, 0xa5ce29ffL, 0xb77b8611L, 0x0fc7e174L,
+    0x9210d9cdL, 0x2aacbea8L, 0x38191146L, 0x80a57623L, 0xd8c66675L,
+    0x607a0110L, 0x72cfaefeL, 0xca73c99bL, 0x57a4f122L, 0xef189647L,
+    0xfdad39a9L, 0x45115eccL, 0x764dee06L, 0xcef18963L, 0xdc44268dL,
+    0x64f841e8L, 0xf92f7951L, 0x41931e34L, 0x5326b1daL, 0xeb9ad6bfL,
+    0xb3f9c6e9L, 0x0b45a18cL, 0x19f00e62L, 0xa14c6907L, 0x3c9b51beL,
+    0x842736dbL, 0x96929935L, 0x2e2efe50L, 0x2654b999L, 0x9ee8defcL,
+    0x8c5d7112L, 0x34e11677L, 0xa9362eceL, 0x118a49abL, 0x033fe645L,
+    0xbb838120L, 0xe3e09176L, 0x5b5cf613L, 0x49e959fdL, 0xf1553e98L,
+    0x6c820621L, 0xd43e6144L, 0xc68bceaaL, 0x7e37a9cfL, 0xd67f4138L,
+    0x6ec3265dL, 0x7c7689b3L, 0xc4caeed6L, 0x591dd66fL, 0xe1a1b10aL,
+    0xf3141ee4L, 0x4ba87981L, 0x13cb69d7L, 0xab770eb2L, 0xb9c2a15cL,
+    0x017ec639L, 0x9ca9fe80L, 0x241599e5L, 0x36a0360bL, 0x8e1c516eL,
+    0x866616a7L, 0x3eda71c2L, 0x2c6fde2cL, 0x94d3b949L, 0x090481f0L,
+    0xb1b8e695L, 0xa30d497bL, 0x1bb12e1eL, 0x43d23e48L, 0xfb6e592dL,
+    0xe9dbf6c3L, 0x516791a6L, 0xccb0a91fL, 0x740cce7aL, 0x66b96194L,
+    0xde0506f1L
+  }
+};
+#endif
+
+#if (CRC32_USE_HW == 0) && (CRC32_SLICE_BY == 8)
+/*!
+ * Tables of the bytes 4 - 7 of the double word (slice-by-8)
+ */
+static const uint32_t CRC32_TableSlice8[4][256] = {
+  {
+    0x00000000L, 0x3d6029b0L, 0x7ac05360L, 0x47a07ad0L, 0xf580a6c0L,
+    0xc8e08f70L, 0x8f40f5a0L, 0xb220dc10L, 0x30704bc1L, 0x0d106271L,
+    0x4ab018a1L, 0x77d03111L, 0xc5f0ed01L, 0xf890c4b1L, 0xbf30be61L,
+    0x825097d1L, 0x60e09782L, 0x5d80be32L, 0x1a20c4e2L, 0x2740ed52L,
+    0x95603142L, 0xa80018f2L, 0xefa06222L, 0xd2c04b92L, 0x5090dc43L,
+    0x6df0f5f3L, 0x2a508f23L, 0x1730a693L, 0xa5107a83L, 0x98705333L,
+    0xdfd029e3L, 0xe2b00053L, 0xc1c12f04L, 0xfca106b4L, 0xbb017c64L,
+    0x866155d4L, 0x344189c4L, 0x0921a074L, 0x4e81daa4L, 0x73e1f314L,
+    0xf1b164c5L, 0xccd14d75L, 0x8b7137a5L, 0xb6111e15L, 0x0431c205L,
+    0x3951ebb5L, 0x7ef19165L, 0x4391b8d5L, 0xa121b886L, 0x9c419136L,
+    0xdbe1ebe6L, 0xe681c256L, 0x54a11e46L, 0x69c137f6L, 0x2e614d26L,
+    0x13016496L, 0x9151f347L, 0xac31daf7L, 0xeb91a027L, 0xd6f18997L,
+    0x64d15587L, 0x59b17c37L, 0x1e1106e7L, 0x23712f57L, 0x58f35849L,
+    0x659371f9L, 0x22330b29L, 0x1f532299L, 0xad73fe89L, 0x9013d739L,
+    0xd7b3ade9L, 0xead38459L, 0x68831388L, 0x55e33a38L, 0x124340e8L,
+    0x2f236958L, 0x9d03b548L, 0xa0639cf8L, 0xe7c3e628L, 0xdaa3cf98L,
+    0x3813cfcbL, 0x0573e67bL, 0x42d39cabL, 0x7fb3b51bL, 0xcd93690bL,
+    0xf0f340bbL, 0xb7533a6bL, 0x8a3313dbL, 0x0863840aL, 0x3503adbaL,
+    0x72a3d76aL, 0x4fc3fedaL, 0xfde322caL, 0xc0830b7aL, 0x872371aaL,
+    0xba43581aL, 0x9932774dL, 0xa4525efdL, 0xe3f2242dL, 0xde920d9dL,
+    0x6cb2d18dL, 0x51d2f83dL, 0x167282edL, 0x2b12ab5dL, 0xa9423c8cL,
+    0x9422153cL, 0xd3826fecL, 0xeee2465cL, 0x5cc29a4cL, 0x61a2b3fcL,
+    0x2602c92cL, 0x1b62e09cL, 0xf9d2e0cfL, 0xc4b2c97fL, 0x8312b3afL,
+    0xbe729a1fL, 0x0c52460fL, 0x31326fbfL, 0x7692156fL, 0x4bf23cdfL,
+    0xc9a2ab0eL, 0xf4c282beL, 0xb362f86eL, 0x8e02d1deL, 0x3c220dceL,
+    0x0142247eL, 0x46e25eaeL, 0x7b82771eL, 0xb1e6b092L, 0x8c869922L,
+    0xcb26e3f2L, 0xf646ca42L, 0x44661652L, 0x79063fe2L, 0x3ea64532L,
+    0x03c66c82L, 0x8196fb53L, 0xbcf6d2e3L, 0xfb56a833L, 0xc6368183L,
+    0x74165d93L, 0x49767423L, 0x0ed60ef3L, 0x33b62743L, 0xd1062710L,
+    0xec660ea0L, 0xabc67470L, 0x96a65dc0L, 0x248681d0L, 0x19e6a860L,
+    0x5e46d2b0L, 0x6326fb00L, 0xe1766cd1L, 0xdc164561L, 0x9bb63fb1L,
+    0xa6d61601L, 0x14f6ca11L, 0x2996e3a1L, 0x6e369971L, 0x5356b0c1L,
+    0x70279f96L, 0x4d47b626L, 0x0ae7ccf6L, 0x3787e546L, 0x85a73956L,
+    0xb8c710e6L, 0xff676a36L, 0xc2074386L, 0x4057d457L, 0x7d37fde7L,
+    0x3a978737L, 0x07f7ae87L, 0xb5d77297L, 0x88b75b27L, 0xcf1721f7L,
+    0xf2770847L, 0x10c70814L, 0x2da721a4L, 0x6a075b74L, 0x576772c4L,
+    0xe547aed4L, 0xd8278764L, 0x9f87fdb4L, 0xa2e7d404L, 0x20b743d5L,
+    0x1dd76a65L, 0x5a7710b5L, 0x67173905L, 0xd537e515L, 0xe857cca5L,
+    0xaff7b675L, 0x92979fc5L, 0xe915e8dbL, 0xd475c16bL, 0x93d5bbbbL,
+    0xaeb5920bL, 0x1c954e1bL, 0x21f567abL, 0x66551d7bL, 0x5b3534cbL,
+    0xd965a31aL, 0xe4058aaaL, 0xa3a5f07aL, 0x9ec5d9caL, 0x2ce505daL,
+    0x11852c6aL, 0x562556baL, 0x6b457f0aL, 0x89f57f59L, 0xb49556e9L,
+    0xf3352c39L, 0xce550589L, 0x7c75d999L, 0x4115f029L, 0x06b58af9L,
+    0x3bd5a349L, 0xb9853498L, 0x84e51d28L, 0xc34567f8L, 0xfe254e48L,
+    0x4c059258L, 0x7165bbe8L, 0x36c5c138L, 0x0ba5e888L, 0x28d4c7dfL,
+    0x15b4ee6fL, 0x521494bfL, 0x6f74bd0fL, 0xdd54611fL, 0xe03448afL,
+    0xa794327fL, 0x9af41bcfL, 0x18a48c1eL, 0x25c4a5aeL, 0x6264df7eL,
+    0x5f04f6ceL, 0xed242adeL, 0xd044036eL, 0x97e479beL, 0xaa84500eL,
+    0x4834505dL, 0x755479edL, 0x32f4033dL, 0x0f942a8dL, 0xbdb4f69dL,
+    0x80d4df2dL, 0xc774a5fdL, 0xfa148c4dL, 0x78441b9cL, 0x4524322cL,
+    0x028448fcL, 0x3fe4614cL, 0x8dc4bd5cL, 0xb0a494ecL, 0xf704ee3cL,
+    0xca64c78cL
+  },
+  {
+    0x00000000L, 0xcb5cd3a5L, 0x4dc8a10bL, 0x869472aeL, 0x9b914216L,
+    0x50cd91b3L, 0xd659e31dL, 0x1d0530b8L, 0xec53826dL, 0x270f51c8L,
+    0xa19b2366L, 0x6ac7f0c3L, 0x77c2c07bL, 0xbc9e13deL, 0x3a0a6170L,
+    0xf156b2d5L, 0x03d6029bL, 0xc88ad13eL, 0x4e1ea390L, 0x85427035L,
+    0x9847408dL, 0x531b9328L, 0xd58fe186L, 0x1ed33223L, 0xef8580f6L,
+    0x24d95353L, 0xa24d21fdL, 0x6911f258L, 0x7414c2e0L, 0xbf481145L,
+    0x39dc63ebL, 0xf280b04eL, 0x07ac0536L, 0xccf0d693L, 0x4a64a43dL,
+    0x81387798L, 0x9c3d4720L, 0x57619485L, 0xd1f5e62bL, 0x1aa9358eL,
+    0xebff875bL, 0x20a354feL, 0xa6372650L, 0x6d6bf5f5L, 0x706ec54dL,
+    0xbb3216e8L, 0x3da66446L, 0xf6fab7e3L, 0x047a07adL, 0xcf26d408L,
+    0x49b2a6a6L, 0x82ee7503L, 0x9feb45bbL, 0x54b7961eL, 0xd223e4b0L,
+    0x197f3715L, 0xe82985c0L, 0x23755665L, 0xa5e124cbL, 0x6ebdf76eL,
+    0x73b8c7d6L, 0xb8e41473L, 0x3e7066ddL, 0xf52cb578L, 0x0f580a6cL,
+    0xc404d9c9L, 0x4290ab67L, 0x89cc78c2L, 0x94c9487aL, 0x5f959bdfL,
+    0xd901e971L, 0x125d3ad4L, 0xe30b8801L, 0x28575ba4L, 0xaec3290aL,
+    0x659ffaafL, 0x789aca17L, 0xb3c619b2L, 0x35526b1cL, 0xfe0eb8b9L,
+    0x0c8e08f7L, 0xc7d2db52L, 0x4146a9fcL, 0x8a1a7a59L, 0x971f4ae1L,
+    0x5c439944L, 0xdad7ebeaL, 0x118b384fL, 0xe0dd8a9aL, 0x2b81593fL,
+    0xad152b91L, 0x6649f834L, 0x7b4cc88cL, 0xb0101b29L, 0x36846987L,
+    0xfdd8ba22L, 0x08f40f5aL, 0xc3a8dcffL, 0x453cae51L, 0x8e607df4L,
+    0x93654d4cL, 0x58399ee9L, 0xdeadec47L, 0x15f13fe2L, 0xe4a78d37L,
+    0x2ffb5e92L, 0xa96f2c3cL, 0x6233ff99L, 0x7f36cf21L, 0xb46a1c84L,
+    0x32fe6e2aL, 0xf9a2bd8fL, 0x0b220dc1L, 0xc07ede64L, 0x46eaaccaL,
+    0x8db67f6fL, 0x90b34fd7L, 0x5bef9c72L, 0xdd7beedcL, 0x16273d79L,
+    0xe7718facL, 0x2c2d5c09L, 0xaab92ea7L, 0x61e5fd02L, 0x7ce0cdbaL,
+    0xb7bc1e1fL, 0x31286cb1L, 0xfa74bf14L, 0x1eb014d8L, 0xd5ecc77dL,
+    0x5378b5d3L, 0x98246676L, 0x852156ceL, 0x4e7d856bL, 0xc8e9f7c5L,
+    0x03b52460L, 0xf2e396b5L, 0x39bf4510L, 0xbf2b37beL, 0x7477e41bL,
+    0x6972d4a3L, 0xa22e0706L, 0x24ba75a8L, 0xefe6a60dL, 0x1d661643L,
+    0xd63ac5e6L, 0x50aeb748L, 0x9bf264edL, 0x86f75455L, 0x4dab87f0L,
+    0xcb3ff55eL, 0x006326fbL, 0xf135942eL, 0x3a69478bL, 0xbcfd3525L,
+    0x77a1e680L, 0x6aa4d638L, 0xa1f8059dL, 0x276c7733L, 0xec30a496L,
+    0x191c11eeL, 0xd240c24bL, 0x54d4b0e5L, 0x9f886340L, 0x828d53f8L,
+    0x49d1805dL, 0xcf45f2f3L, 0x04192156L, 0xf54f9383L, 0x3e134026L,
+    0xb8873288L, 0x73dbe12dL, 0x6eded195L, 0xa5820230L, 0x2316709eL,
+    0xe84aa33bL, 0x1aca1375L, 0xd196c0d0L, 0x5702b27eL, 0x9c5e61dbL,
+    0x815b5163L, 0x4a0782c6L, 0xcc93f068L, 0x07cf23cdL, 0xf6999118L,
+    0x3dc542bdL, 0xbb513013L, 0x700de3b6L, 0x6d08d30eL, 0xa65400abL,
+    0x20c07205L, 0xeb9ca1a0L, 0x11e81eb4L, 0xdab4cd11L, 0x5c20bfbfL,
+    0x977c6c1aL, 0x8a795ca2L, 0x41258f07L, 0xc7b1fda9L, 0x0ced2e0cL,
+    0xfdbb9cd9L, 0x36e74f7cL, 0xb0733dd2L, 0x7b2fee77L, 0x662adecfL,
+    0xad760d6aL, 0x2be27fc4L, 0xe0beac61L, 0x123e1c2fL, 0xd962cf8aL,
+    0x5ff6bd24L, 0x94aa6e81L, 0x89af5e39L, 0x42f38d9cL, 0xc467ff32L,
+    0x0f3b2c97L, 0xfe6d9e42L, 0x35314de7L, 0xb3a53f49L, 0x78f9ececL,
+    0x65fcdc54L, 0xaea00ff1L, 0x28347d5fL, 0xe368aefaL, 0x16441b82L,
+    0xdd18c827L, 0x5b8cba89L, 0x90d0692cL, 0x8dd55994L, 0x46898a31L,
+    0xc01df89fL, 0x0b412b3aL, 0xfa1799efL, 0x314b4a4aL, 0xb7df38e4L,
+    0x7c83eb41L, 0x6186dbf9L, 0xaada085cL, 0x2c4e7af2L, 0xe712a957L,
+    0x15921919L, 0xdececabcL, 0x585ab812L, 0x93066bb7L, 0x8e035b0fL,
+    0x455f88aaL, 0xc3cbfa04L, 0x089729a1L, 0xf9c19b74L, 0x329d48d1L,
+    0xb4093a7fL, 0x7f55e9daL, 0x6250d962L, 0xa90c0ac7L, 0x2f987869L,
+    0xe4c4abccL
+  },
+  {
+    0x00000000L, 0xa6770bb4L, 0x979f1129L, 0x31e81a9dL, 0xf44f2413L,
+    0x52382fa7L, 0x63d0353aL, 0xc5a73e8eL, 0x33ef4e67L, 0x959845d3L,
+    0xa4705f4eL, 0x020754faL, 0xc7a06a74L, 0x61d761c0L, 0x503f7b5dL,
+    0xf64870e9L, 0x67de9cceL, 0xc1a9977aL, 0xf0418de7L, 0x56368653L,
+    0x9391b8ddL, 0x35e6b369L, 0x040ea9f4L, 0xa279a240L, 0x5431d2a9L,
+    0xf246d91dL, 0xc3aec380L, 0x65d9c834L, 0xa07ef6baL, 0x0609fd0eL,
+    0x37e1e793L, 0x9196ec27L, 0xcfbd399cL, 0x69ca3228L, 0x582228b5L,
+    0xfe552301L, 0x3bf21d8fL, 0x9d85163bL, 0xac6d0ca6L, 0x0a1a0712L,
+    0xfc5277fbL, 0x5a257c4fL, 0x6bcd66d2L, 0xcdba6d66L, 0x081d53e8L,
+    0xae6a585cL, 0x9f8242c1L, 0x39f54975L, 0xa863a552L, 0x0e14aee6L,
+    0x3ffcb47bL, 0x998bbfcfL, 0x5c2c8141L, 0xfa5b8af5L, 0xcbb39068L,
+    0x6dc49bdcL, 0x9b8ceb35L, 0x3dfbe081L, 0x0c13fa1cL, 0xaa64f1a8L,
+    0x6fc3cf26L, 0xc9b4c492L, 0xf85cde0fL, 0x5e2bd5bbL, 0x440b7579L,
+    0xe27c7ecdL, 0xd3946450L, 0x75e36fe4L, 0xb044516aL, 0x16335adeL,
+    0x27db4043L, 0x81ac4bf7L, 0x77e43b1eL, 0xd19330aaL, 0xe07b2a37L,
+    0x460c2183L, 0x83ab1f0dL, 0x25dc14b9L, 0x14340e24L, 0xb2430590L,
+    0x23d5e9b7L, 0x85a2e203L, 0xb44af89eL, 0x123df32aL, 0xd79acda4L,
+    0x71edc610L, 0x4005dc8dL, 0xe672d739L, 0x103aa7d0L, 0xb64dac64L,
+    0x87a5b6f9L, 0x21d2bd4dL, 0xe47583c3L, 0x42028877L, 0x73ea92eaL,
+    0xd59d995eL, 0x8bb64ce5L, 0x2dc14751L, 0x1c295dccL, 0xba5e5678L,
+    0x7ff968f6L, 0xd98e6342L, 0xe86679dfL, 0x4e11726bL, 0xb8590282L,
+    0x1e2e0936L, 0x2fc613abL, 0x89b1181fL, 0x4c162691L, 0xea612d25L,
+    0xdb8937b8L, 0x7dfe3c0cL, 0xec68d02bL, 0x4a1fdb9fL, 0x7bf7c102L,
+    0xdd80cab6L, 0x1827f438L, 0xbe50ff8cL, 0x8fb8e511L, 0x29cfeea5L,
+    0xdf879e4cL, 0x79f095f8L, 0x48188f65L, 0xee6f84d1L, 0x2bc8ba5fL,
+    0x8dbfb1ebL, 0xbc57ab76L, 0x1a20a0c2L, 0x8816eaf2L, 0x2e61e146L,
+    0x1f89fbdbL, 0xb9fef06fL, 0x7c59cee1L, 0xda2ec555L, 0xebc6dfc8L,
+    0x4db1d47cL, 0xbbf9a495L, 0x1d8eaf21L, 0x2c66b5bcL, 0x8a11be08L,
+    0x4fb68086L, 0xe9c18b32L, 0xd82991afL, 0x7e5e9a1bL, 0xefc8763cL,
+    0x49bf7d88L, 0x78576715L, 0xde206ca1L, 0x1b87522fL, 0xbdf0599bL,
+    0x8c184306L, 0x2a6f48b2L, 0xdc27385bL, 0x7a5033efL, 0x4bb82972L,
+    0xedcf22c6L, 0x28681c48L, 0x8e1f17fcL, 0xbff70d61L, 0x198006d5L,
+    0x47abd36eL, 0xe1dcd8daL, 0xd034c247L, 0x7643c9f3L, 0xb3e4f77dL,
+    0x1593fcc9L, 0x247be654L, 0x820cede0L, 0x74449d09L, 0xd23396bdL,
+    0xe3db8c20L, 0x45ac8794L, 0x800bb91aL, 0x267cb2aeL, 0x1794a833L,
+    0xb1e3a387L, 0x20754fa0L, 0x86024414L, 0xb7ea5e89L, 0x119d553dL,
+    0xd43a6bb3L, 0x724d6007L, 0x43a57a9aL, 0xe5d2712eL, 0x139a01c7L,
+    0xb5ed0a73L, 0x840510eeL, 0x22721b5aL, 0xe7d525d4L, 0x41a22e60L,
+    0x704a34fdL, 0xd63d3f49L, 0xcc1d9f8bL, 0x6a6a943fL, 0x5b828ea2L,
+    0xfdf58516L, 0x3852bb98L, 0x9e25b02cL, 0xafcdaab1L, 0x09baa105L,
+    0xfff2d1ecL, 0x5985da58L, 0x686dc0c5L, 0xce1acb71L, 0x0bbdf5ffL,
+    0xadcafe4bL, 0x9c22e4d6L, 0x3a55ef62L, 0xabc30345L, 0x0db408f1L,
+    0x3c5c126cL, 0x9a2b19d8L, 0x5f8c2756L, 0xf9fb2ce2L, 0xc813367fL,
+    0x6e643dcbL, 0x982c4d22L, 0x3e5b4696L, 0x0fb35c0bL, 0xa9c457bfL,
+    0x6c636931L, 0xca146285L, 0xfbfc7818L, 0x5d8b73acL, 0x03a0a617L,
+    0xa5d7ada3L, 0x943fb73eL, 0x3248bc8aL, 0xf7ef8204L, 0x519889b0L,
+    0x6070932dL, 0xc6079899L, 0x304fe870L, 0x9638e3c4L, 0xa7d0f959L,
+    0x01a7f2edL, 0xc400cc63L, 0x6277c7d7L, 0x539fdd4aL, 0xf5e8d6feL,
+    0x647e3ad9L, 0xc209316dL, 0xf3e12bf0L, 0x55962044L, 0x90311ecaL,
+    0x3646157eL, 0x07ae0fe3L, 0xa1d90457L, 0x579174beL, 0xf1e67f0aL,
+    0xc00e6597L, 0x66796e23L, 0xa3de50adL, 0x05a95b19L, 0x34414184L,
+    0x92364a30L
+  },
+  {
+    0x00000000L, 0xccaa009eL, 0x4225077dL, 0x8e8f07e3L, 0x844a0efaL,
+    0x48e00e64L, 0xc66f0987L, 0x0ac50919L, 0xd3e51bb5L, 0x1f4f1b2bL,
+    0x91c01cc8L, 0x5d6a1c56L, 0x57af154fL, 0x9b0515d1L, 0x158a1232L,
+    0xd92012acL, 0x7cbb312bL, 0xb01131b5L, 0x3e9e3656L, 0xf23436c8L,
+    0xf8f13fd1L, 0x345b3f4fL, 0xbad438acL, 0x767e3832L, 0xaf5e2a9eL,
+    0x63f42a00L, 0xed7b2de3L, 0x21d12d7dL, 0x2b142464L, 0xe7be24faL,
+    0x69312319L, 0xa59b2387L, 0xf9766256L, 0x35dc62c8L, 0xbb53652bL,
+    0x77f965b5L, 0x7d3c6cacL, 0xb1966c32L, 0x3f196bd1L, 0xf3b36b4fL,
+    0x2a9379e3L, 0xe639797dL, 0x68b67e9eL, 0xa41c7e00L, 0xaed97719L,
+    0x62737787L, 0xecfc7064L, 0x205670faL, 0x85cd537dL, 0x496753e3L,
+    0xc7e85400L, 0x0b42549eL, 0x01875d87L, 0xcd2d5d19L, 0x43a25afaL,
+    0x8f085a64L, 0x562848c8L, 0x9a824856L, 0x140d4fb5L, 0xd8a74f2bL,
+    0xd2624632L, 0x1ec846acL, 0x9047414fL, 0x5ced41d1L, 0x299dc2edL,
+    0xe537c273L, 0x6bb8c590L, 0xa712c50eL, 0xadd7cc17L, 0x617dcc89L,
+    0xeff2cb6aL, 0x2358cbf4L, 0xfa78d958L, 0x36d2d9c6L, 0xb85dde25L,
+    0x74f7debbL, 0x7e32d7a2L, 0xb298d73cL, 0x3c17d0dfL, 0xf0bdd041L,
+    0x5526f3c6L, 0x998cf358L, 0x1703f4bbL, 0xdba9f425L, 0xd16cfd3cL,
+    0x1dc6fda2L, 0x9349fa41L, 0x5fe3fadfL, 0x86c3e873L, 0x4a69e8edL,
+    0xc4e6ef0eL, 0x084cef90L, 0x0289e689L, 0xce23e617L, 0x40ace1f4L,
+    0x8c06e16aL, 0xd0eba0bbL, 0x1c41a025L, 0x92cea7c6L, 0x5e64a758L,
+    0x54a1ae41L, 0x980baedfL, 0x1684a93cL, 0xda2ea9a2L, 0x030ebb0eL,
+    0xcfa4bb90L, 0x412bbc73L, 0x8d81bcedL, 0x8744b5f4L, 0x4beeb56aL,
+    0xc561b289L, 0x09cbb217L, 0xac509190L, 0x60fa910eL, 0xee7596edL,
+    0x22df9673L, 0x281a9f6aL, 0xe4b09ff4L, 0x6a3f9817L, 0xa6959889L,
+    0x7fb58a25L, 0xb31f8abbL, 0x3d908d58L, 0xf13a8dc6L, 0xfbff84dfL,
+    0x37558441L, 0xb9da83a2L, 0x7570833cL, 0x533b85daL, 0x9f918544L,
+    0x111e82a7L, 0xddb48239L, 0xd7718b20L, 0x1bdb8bbeL, 0x95548c5dL,
+    0x59fe8cc3L, 0x80de9e6fL, 0x4c749ef1L, 0xc2fb9912L, 0x0e51998cL,
+    0x04949095L, 0xc83e900bL, 0x46b197e8L, 0x8a1b9776L, 0x2f80b4f1L,
+    0xe32ab46fL, 0x6da5b38cL, 0xa10fb312L, 0xabcaba0bL, 0x6760ba95L,
+    0xe9efbd76L, 0x2545bde8L, 0xfc65af44L, 0x30cfafdaL, 0xbe40a839L,
+    0x72eaa8a7L, 0x782fa1beL, 0xb485a120L, 0x3a0aa6c3L, 0xf6a0a65dL,
+    0xaa4de78cL, 0x66e7e712L, 0xe868e0f1L, 0x24c2e06fL, 0x2e07e976L,
+    0xe2ade9e8L, 0x6c22ee0bL, 0xa088ee95L, 0x79a8fc39L, 0xb502fca7L,
+    0x3b8dfb44L, 0xf727fbdaL, 0xfde2f2c3L, 0x3148f25dL, 0xbfc7f5beL,
+    0x736df520L, 0xd6f6d6a7L, 0x1a5cd639L, 0x94d3d1daL, 0x5879d144L,
+    0x52bcd85dL, 0x9e16d8c3L, 0x1099df20L, 0xdc33dfbeL, 0x0513cd12L,
+    0xc9b9cd8cL, 0x4736ca6fL, 0x8b9ccaf1L, 0x8159c3e8L, 0x4df3c376L,
+    0xc37cc495L, 0x0fd6c40bL, 0x7aa64737L, 0xb60c47a9L, 0x3883404aL,
+    0xf42940d4L, 0xfeec49cdL, 0x32464953L, 0xbcc94eb0L, 0x70634e2eL,
+    0xa9435c82L, 0x65e95c1cL, 0xeb665bffL, 0x27cc5b61L, 0x2d095278L,
+    0xe1a352e6L, 0x6f2c5505L, 0xa386559bL, 0x061d761cL, 0xcab77682L,
+    0x44387161L, 0x889271ffL, 0x825778e6L, 0x4efd7878L, 0xc0727f9bL,
+    0x0cd87f05L, 0xd5f86da9L, 0x19526d37L, 0x97dd6ad4L, 0x5b776a4aL,
+    0x51b26353L, 0x9d1863cdL, 0x1397642eL, 0xdf3d64b0L, 0x83d02561L,
+    0x4f7a25ffL, 0xc1f5221cL, 0x0d5f2282L, 0x079a2b9bL, 0xcb302b05L,
+    0x45bf2ce6L, 0x89152c78L, 0x50353ed4L, 0x9c9f3e4aL, 0x121039a9L,
+    0xdeba3937L, 0xd47f302eL, 0x18d530b0L, 0x965a3753L, 0x5af037cdL,
+    0xff6b144aL, 0x33c114d4L, 0xbd4e1337L, 0x71e413a9L, 0x7b211ab0L,
+    0xb78b1a2eL, 0x39041dcdL, 0xf5ae1d53L, 0x2c8e0fffL, 0xe0240f61L,
+    0x6eab0882L, 0xa201081cL, 0xa8c40105L, 0x646e019bL, 0xeae10678L,
+    0x264b06e6L
+  }
+};
+#endif
+
 /*!
- * \brief Get the sector number at the address
+ * \brief Check of the 1 MB dual-bank mode (bank 2 starts at START_ADDRESS_BANK_2_DB1M)
  *
- * \param[IN] Address  		Base address
- * \retval           		Get number sector
+ * \retval           		1 - dual-bank mode
+ */
+static uint8_t FlashIsDualBank1M(void)
+{
+#ifdef FLASH_OPTCR_DB1M
+	return (FLASH_SIZE_KB == 1024) && (FLASH->OPTCR & FLASH_OPTCR_DB1M);
+#else
+	return 0;
+#endif
+}
+
+/*!
+ * \brief Get geometry of the sector at the address
+ *
+ * \param[IN] Address  		Address inside the sector
+ * \param[OUT] pInfo  		Sector geometry
+ * \retval           		Status of the operation
  */
-static uint32_t GetNumSector(uint32_t Address)
+FlashStatus_t FlashGetSector(uint32_t Address, FlashSectorInfo_t *pInfo)
 {
-	uint32_t Sector = 0;
+	uint32_t End = START_ADDRESS_BANK_1 + (uint32_t)FLASH_SIZE_KB * 1024;
+	uint32_t Offset = 0;
+	uint32_t Low = 0;
+	uint32_t High = FLASH_SECTOR_COUNT;
+
+	if(Address < START_ADDRESS_BANK_1 || Address >= End)
+		return FLASH_STATUS_ERROR_ADDRESS;
+
+	/* Sectors 12 - 19 follow sector 7 */
+	if(Address >= START_ADDRESS_BANK_2_DB1M && FlashIsDualBank1M())
+		Offset = START_ADDRESS_BANK_2 - START_ADDRESS_BANK_2_DB1M;
+
+	Address += Offset;
+
+	while(High - Low > 1)
+	{
+		uint32_t Mid = (Low + High) / 2;
 
-	if(Address >= START_ADDRESS_SECTOR_0 && Address < START_ADDRESS_SECTOR_1)
-		Sector = FLASH_SECTOR_0;
-	else if(Address >= START_ADDRESS_SECTOR_1 && Address < START_ADDRESS_SECTOR_2)
-		Sector = FLASH_SECTOR_1;
-	else if(Address >= START_ADDRESS_SECTOR_2 && Address < START_ADDRESS_SECTOR_3)
-		Sector = FLASH_SECTOR_2;
-	else if(Address >= START_ADDRESS_SECTOR_3 && Address < START_ADDRESS_SECTOR_4)
-		Sector = FLASH_SECTOR_3;
-	else if(Address >= START_ADDRESS_SECTOR_4 && Address < START_ADDRESS_SECTOR_5)
-		Sector = FLASH_SECTOR_4;
-	else if(Address >= START_ADDRESS_SECTOR_5 && Address < START_ADDRESS_SECTOR_6)
-		Sector = FLASH_SECTOR_5;
-	else if(Address >= START_ADDRESS_SECTOR_6 && Address < START_ADDRESS_SECTOR_7)
-		Sector = FLASH_SECTOR_6;
-	else if(Address >= START_ADDRESS_SECTOR_7 && Address < END_ADDRESS_BANK_1)
-		Sector = FLASH_SECTOR_7;
+		if(Address < FlashSectorTable[Mid].Start)
+			High = Mid;
+		else
+			Low = Mid;
+	}
+
+	pInfo->Number = FlashSectorTable[Low].Number;
+	pInfo->Start = FlashSectorTable[Low].Start - Offset;
+	pInfo->Size = FlashSectorTable[Low].Size;
 
-	return Sector;
+	return FLASH_STATUS_OK;
 }
 
 /*!
@@ -103,7 +595,15 @@ static uint32_t GetNumSector(uint32_t Address)
 FlashStatus_t FlashInit(void)
 {
 	FlashStatus_t ErrCode = FLASH_STATUS_OK;
-	uint32_t CoreHCKL;
+	FlashProfile_t Profile;
+
+	Profile.Latency = FlashGetLatency(HAL_RCC_GetHCLKFreq(), FLASH_SUPPLY_MV);
+	Profile.Prefetch = (FLASH_PREFETCH_ENABLE && FLASH_SUPPLY_MV >= 2100);
+	Profile.ICache = FLASH_ICACHE_ENABLE;
+	Profile.DCache = FLASH_DCACHE_ENABLE;
+
+	if((ErrCode = FlashSetProfile(&Profile)) != FLASH_STATUS_OK)
+		return ErrCode;
 
 	if(HAL_FLASH_Unlock() != HAL_OK)
 	{
@@ -111,26 +611,13 @@ FlashStatus_t FlashInit(void)
 		return ErrCode;
 	}
 
-	CoreHCKL = HAL_RCC_GetHCLKFreq();
-
-	if(CoreHCKL > 0 && CoreHCKL <= 30000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_0);
-	else if(CoreHCKL > 30000000 && CoreHCKL <= 60000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_1);
-	else if(CoreHCKL > 60000000 && CoreHCKL <= 90000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_2);
-	else if(CoreHCKL > 90000000 && CoreHCKL <= 120000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_3);
-	else if(CoreHCKL > 120000000 && CoreHCKL <= 150000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_4);
-	else if(CoreHCKL > 150000000 && CoreHCKL <= 180000000)
-		__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_5);
-
-	__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
-
 	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
 			FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
 
+#if (FLASH_RAM_VECTORS == 1)
+	FlashRelocateVectors();
+#endif
+
 	if(HAL_FLASH_Lock() != HAL_OK)
 	{
 		ErrCode = FLASH_STATUS_ERROR_LOCK;
@@ -140,6 +627,192 @@ FlashStatus_t FlashInit(void)
 	return ErrCode;
 }
 
+/*!
+ * \brief Minimum wait states for the clock and supply voltage (30, 24, 22 or 20 MHz per wait state
+ * for 2.7 - 3.6 V, 2.4 - 2.7 V, 2.1 - 2.4 V and 1.8 - 2.1 V)
+ *
+ * \param[IN] HclkHz  		HCLK frequency (Hz)
+ * \param[IN] SupplyMv  	Lowest supply voltage (mV)
+ * \retval           		Wait states (FLASH_LATENCY_x)
+ */
+uint32_t FlashGetLatency(uint32_t HclkHz, uint32_t SupplyMv)
+{
+	uint32_t StepHz, Latency;
+
+	if(SupplyMv >= 2700)
+		StepHz = 30000000;
+	else if(SupplyMv >= 2400)
+		StepHz = 24000000;
+	else if(SupplyMv >= 2100)
+		StepHz = 22000000;
+	else
+		StepHz = 20000000;
+
+	Latency = (HclkHz == 0) ? 0 : (HclkHz - 1) / StepHz;
+	if(Latency > FLASH_ACR_LATENCY)
+		Latency = FLASH_ACR_LATENCY;
+
+	return Latency;
+}
+
+/*!
+ * \brief Set of the performance profile, the caches are reset before they are enabled.
+ * Raise the wait states before HCLK and lower them after it
+ *
+ * \param[IN] pProfile  	Profile pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSetProfile(const FlashProfile_t *pProfile)
+{
+	uint32_t Acr;
+
+	if(pProfile->Latency > FLASH_ACR_LATENCY ||
+	   pProfile->Latency < FlashGetLatency(HAL_RCC_GetHCLKFreq(), FLASH_SUPPLY_MV))
+		return FLASH_STATUS_ERROR_LATENCY;
+
+	/* A cache is reset only while it is disabled, the wait states stay as they are meanwhile */
+	FLASH->ACR &= ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+	FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+	FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+
+	Acr = FLASH->ACR & ~(FLASH_ACR_LATENCY | FLASH_ACR_PRFTEN);
+	Acr |= pProfile->Latency;
+	if(pProfile->Prefetch)
+		Acr |= FLASH_ACR_PRFTEN;
+	if(pProfile->ICache)
+		Acr |= FLASH_ACR_ICEN;
+	if(pProfile->DCache)
+		Acr |= FLASH_ACR_DCEN;
+	FLASH->ACR = Acr;
+
+	/* The new wait states are in effect when they are read back */
+	if((FLASH->ACR & FLASH_ACR_LATENCY) != pProfile->Latency)
+		return FLASH_STATUS_ERROR_LATENCY;
+
+	return FLASH_STATUS_OK;
+}
+
+/*!
+ * \brief Get of the current performance profile
+ *
+ * \param[OUT] pProfile  	Profile pointer
+ */
+void FlashGetProfile(FlashProfile_t *pProfile)
+{
+	uint32_t Acr = FLASH->ACR;
+
+	pProfile->Latency = Acr & FLASH_ACR_LATENCY;
+	pProfile->Prefetch = (Acr & FLASH_ACR_PRFTEN) ? 1 : 0;
+	pProfile->ICache = (Acr & FLASH_ACR_ICEN) ? 1 : 0;
+	pProfile->DCache = (Acr & FLASH_ACR_DCEN) ? 1 : 0;
+}
+
+/*!
+ * \brief Loop of the self-benchmark: table lookups exercise the instruction fetch and the data reads of the flash
+ *
+ * \param[IN] Crc  			Start value
+ * \retval           		Result (keeps the loop from being optimized out)
+ */
+static uint32_t __attribute__((noinline)) FlashBenchmarkLoop(uint32_t Crc)
+{
+	for(uint32_t i = 0; i < FLASH_BENCH_ITERATIONS; i++)
+		Crc = CRC32_NEXT(Crc, (uint8_t)i);
+
+	return Crc;
+}
+
+/*!
+ * \brief Self-benchmark: DWT cycles of a flash-resident loop under the profile (the current
+ * profile is restored)
+ *
+ * \param[IN] pProfile  	Profile pointer
+ * \retval           		Cycles of FLASH_BENCH_ITERATIONS iterations, 0 - profile is not accepted
+ */
+uint32_t FlashBenchmark(const FlashProfile_t *pProfile)
+{
+	FlashProfile_t Saved;
+	volatile uint32_t Result;
+	uint32_t Cycles, Primask;
+
+	FlashGetProfile(&Saved);
+	if(FlashSetProfile(pProfile) != FLASH_STATUS_OK)
+	{
+		FlashSetProfile(&Saved);
+		return 0;
+	}
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	Primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* The first run fills the caches just reset, the second one is measured */
+	Result = FlashBenchmarkLoop(CRC_INI_VAL);
+	Cycles = DWT->CYCCNT;
+	Result = FlashBenchmarkLoop(Result);
+	Cycles = DWT->CYCCNT - Cycles;
+
+	__set_PRIMASK(Primask);
+	(void)Result;
+
+	FlashSetProfile(&Saved);
+	return Cycles;
+}
+
+/*!
+ * \brief Self-benchmark of all prefetch/cache combinations at the minimum wait states
+ *
+ * \param[OUT] pCycles  	Cycles of FLASH_BENCH_PROFILES profiles, index - Prefetch | ICache << 1 | DCache << 2
+ */
+void FlashBenchmarkAll(uint32_t *pCycles)
+{
+	FlashProfile_t Profile;
+
+	Profile.Latency = FlashGetLatency(HAL_RCC_GetHCLKFreq(), FLASH_SUPPLY_MV);
+
+	for(uint32_t i = 0; i < FLASH_BENCH_PROFILES; i++)
+	{
+		Profile.Prefetch = i & 1;
+		Profile.ICache = (i >> 1) & 1;
+		Profile.DCache = (i >> 2) & 1;
+		pCycles[i] = FlashBenchmark(&Profile);
+	}
+}
+
+#if (FLASH_RAM_VECTORS == 1)
+/*!
+ * \brief Copy of the current vector table to RAM and switch of VTOR to it
+ */
+void FlashRelocateVectors(void)
+{
+	const uint32_t *pVectors = (const uint32_t*)SCB->VTOR;
+
+	if(SCB->VTOR == (uint32_t)FlashRamVectors)
+		return;
+
+	for(uint32_t i = 0; i < FLASH_VECTOR_COUNT; i++)
+		FlashRamVectors[i] = (void (*)(void))pVectors[i];
+
+	SCB->VTOR = (uint32_t)FlashRamVectors;
+	__DSB();
+}
+
+/*!
+ * \brief Install of the interrupt handler to the vector table in RAM
+ *
+ * \param[IN] IRQn  		Interrupt number
+ * \param[IN] Handler  		Handler (placed in RAM by FLASH_RAM_FUNC to run during erase and program)
+ */
+void FlashSetIRQHandler(IRQn_Type IRQn, void (*Handler)(void))
+{
+	FlashRelocateVectors();
+
+	FlashRamVectors[16 + IRQn] = Handler;
+	__DSB();
+}
+#endif
+
 /*!
  * \brief Reads data at the specified address
  *
@@ -148,26 +821,32 @@ FlashStatus_t FlashInit(void)
  */
 uint32_t FlashReadData(uint32_t Address)
 {
-	return (*(__IO uint32_t *)Address);
+	return (*(__IO uint32_t *)(uintptr_t)Address);
 }
 
 /*!
- * \brief Reads structe data at the specified address
+ * \brief Reads structe data at the specified address (zero-copy, the flash is memory-mapped)
  *
  * \param[IN] Address  		Base address
- * \retval           		Data structe pointer
+ * \retval           		Data structe pointer into the flash
  */
-FlashMapData_t* FlashReadStructe(uint32_t Address)
+const FlashMapData_t* FlashReadStructe(uint32_t Address)
 {
-	uint32_t *pData = (uint32_t*)FlashMapData_s;
+	return (const FlashMapData_t*)(uintptr_t)Address;
+}
 
-	for(uint32_t i = 0; i < FLASH_STRUCT_USER_SIZE; i += 4)
-	{
-		*pData = FlashReadData(Address + i);
-		pData++;
-	}
+/*!
+ * \brief Copies structe data at the specified address
+ *
+ * \param[IN] Address  		Base address
+ * \param[OUT] pStruct  		Data structe pointer
+ * \retval           		Data structe pointer
+ */
+FlashMapData_t* FlashCopyStructe(uint32_t Address, FlashMapData_t *pStruct)
+{
+	*pStruct = *FlashReadStructe(Address);
 
-	return (FlashMapData_t*)FlashMapData_s;
+	return pStruct;
 }
 
 /*!
@@ -178,52 +857,107 @@ FlashMapData_t* FlashReadStructe(uint32_t Address)
  */
 FlashStatus_t FlashEraseSector(uint32_t Address)
 {
-	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	return FlashEraseRange(Address, 1);
+}
+
+/*!
+ * \brief Erase of the sectors on the registers (the flash must be unlocked).
+ * It runs from RAM, so the interrupts with the RAM vectors and handlers are served during the erase
+ *
+ * \param[IN] Sector  		First sector number
+ * \param[IN] NbSectors  	Number of the sectors
+ * \retval           		Status of the operation
+ */
+FLASH_RAM_FUNC static FlashStatus_t FlashEraseBurst(uint32_t Sector, uint32_t NbSectors)
+{
+#ifdef FLASH_SIMULATION
 	FLASH_EraseInitTypeDef FlashErase_s;
 	uint32_t SectorError;
 
-	if(HAL_FLASH_Unlock() != HAL_OK)
+	FlashErase_s.TypeErase = FLASH_TYPEERASE_SECTORS;
+	FlashErase_s.VoltageRange = FLASH_SUPPLY_RANGE;
+	FlashErase_s.Sector = Sector;
+	FlashErase_s.NbSectors = NbSectors;
+
+	if(HAL_FLASHEx_Erase(&FlashErase_s, &SectorError) != HAL_OK)
+		return FLASH_STATUS_ERROR_ERASE;
+
+	return FLASH_STATUS_OK;
+#else
+	while(FLASH->SR & FLASH_SR_BSY);
+
+	FLASH->SR = FLASH_FLAG_EOP | FLASH_PROGRAM_ERRORS;
+
+	for(; NbSectors > 0 && !(FLASH->SR & FLASH_PROGRAM_ERRORS); NbSectors--, Sector++)
 	{
-		ErrCode = FLASH_STATUS_ERROR_UNLOCK;
-		return ErrCode;
+		/* Sectors of bank 2 are numbered from 16 in SNB */
+		uint32_t Snb = (Sector > 11) ? Sector + 4 : Sector;
+
+		FLASH->CR = (FLASH->CR & ~(FLASH_CR_PSIZE | FLASH_CR_SNB)) | FLASH_PROGRAM_PSIZE | FLASH_CR_SER | (Snb << FLASH_CR_SNB_Pos);
+		FLASH->CR |= FLASH_CR_STRT;
+		while(FLASH->SR & FLASH_SR_BSY);
 	}
 
-	FlashErase_s.VoltageRange = FLASH_VOLTAGE_RANGE_3;
-	FlashErase_s.Sector = GetNumSector(Address);
-	FlashErase_s.NbSectors = 1;
-	FlashErase_s.TypeErase = FLASH_TYPEERASE_SECTORS;
+	FLASH->CR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
 
-	while(FLASH_WaitForLastOperation((uint32_t)MAX_FLASH_TIMEOUT) != HAL_OK);
+	if(FLASH->SR & FLASH_PROGRAM_ERRORS)
+		return FLASH_STATUS_ERROR_ERASE;
 
-	if(HAL_FLASHEx_Erase(&FlashErase_s, &SectorError) != HAL_OK)
+	return FLASH_STATUS_OK;
+#endif
+}
+
+/*!
+ * \brief Reset of the instruction and data caches after the erase and program (stale lines of the changed area)
+ */
+static void FlashResetCaches(void)
+{
+#ifndef FLASH_SIMULATION
+	if(FLASH->ACR & FLASH_ACR_ICEN)
 	{
-		ErrCode = FLASH_STATUS_ERROR_ERASE;
-		return ErrCode;
+		FLASH->ACR &= ~FLASH_ACR_ICEN;
+		FLASH->ACR |= FLASH_ACR_ICRST;
+		FLASH->ACR &= ~FLASH_ACR_ICRST;
+		FLASH->ACR |= FLASH_ACR_ICEN;
 	}
 
-	if(HAL_FLASH_Lock() != HAL_OK)
+	if(FLASH->ACR & FLASH_ACR_DCEN)
 	{
-		ErrCode = FLASH_STATUS_ERROR_LOCK;
-		return ErrCode;
+		FLASH->ACR &= ~FLASH_ACR_DCEN;
+		FLASH->ACR |= FLASH_ACR_DCRST;
+		FLASH->ACR &= ~FLASH_ACR_DCRST;
+		FLASH->ACR |= FLASH_ACR_DCEN;
 	}
-
-	return ErrCode;
+#endif
 }
 
 /*!
- * \brief Write data to flash
+ * \brief Erase all sectors of the area with one erase request
  *
- * \param[IN] Address  		Base address
- * \param[IN] pData  		Data pointer
- * \param[IN] Size  		Data size
+ * \param[IN] Address  		Start address of the area
+ * \param[IN] Size  		Size of the area
  * \retval           		Status of the operation
  */
-FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size)
+FlashStatus_t FlashEraseRange(uint32_t Address, uint32_t Size)
 {
 	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	FlashSectorInfo_t Info;
+	uint32_t End = Address + Size;
+	uint32_t Sector, NbSectors = 0;
+	uint8_t IsLast;
+
+	if(Size == 0)
+		return ErrCode;
 
-	if((ErrCode = FlashEraseSector(Address)) != FLASH_STATUS_OK)
+	/* The asynchronous job owns the flash until its end */
+	if(FlashJob.Status == FLASH_STATUS_BUSY)
+		return FLASH_STATUS_BUSY;
+
+	if(FlashGetSector(End - 1, &Info) != FLASH_STATUS_OK || FlashGetSector(Address, &Info) != FLASH_STATUS_OK)
+	{
+		ErrCode = FLASH_STATUS_ERROR_ADDRESS;
 		return ErrCode;
+	}
 
 	if(HAL_FLASH_Unlock() != HAL_OK)
 	{
@@ -231,15 +965,33 @@ FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size)
 		return ErrCode;
 	}
 
-	for(uint32_t i = 0; i < Size; i += 4)
+	Sector = Info.Number;
+
+	/* One request per run of the consecutive sector numbers (the 1 MB dual-bank parts jump from 7 to 12) */
+	do
 	{
-		if(HAL_FLASH_Program(TYPEPROGRAM_WORD, Address + i, *(pData)) != HAL_OK)
+		NbSectors++;
+		Address = Info.Start + Info.Size;
+		IsLast = (Address >= End);
+
+		if(!IsLast)
+			FlashGetSector(Address, &Info);
+
+		if(IsLast || Info.Number != Sector + NbSectors)
 		{
-			ErrCode = FLASH_STATUS_ERROR_WRITE;
-			return ErrCode;
+			ErrCode = FlashEraseBurst(Sector, NbSectors);
+			FlashResetCaches();
+
+			if(ErrCode != FLASH_STATUS_OK)
+			{
+				HAL_FLASH_Lock();
+				return ErrCode;
+			}
+
+			Sector = Info.Number;
+			NbSectors = 0;
 		}
-		pData++;
-	}
+	}while(!IsLast);
 
 	if(HAL_FLASH_Lock() != HAL_OK)
 	{
@@ -251,19 +1003,121 @@ FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size)
 }
 
 /*!
- * \brief Writes structe data at the specified address
+ * \brief Burst program of the erased area on the registers (the flash must be unlocked).
+ * It runs from RAM, so the busy wait does not stall on the instruction fetch.
+ * x64: a word first at the address not aligned to 8, a word for the odd word at the end
  *
  * \param[IN] Address  		Base address
- * \param[IN] pStruct  		Data structe pointer
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
  * \retval           		Status of the operation
  */
-FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct)
+FLASH_RAM_FUNC static FlashStatus_t FlashProgramBurst(uint32_t Address, const uint32_t *pData, uint32_t Size)
+{
+	uint32_t Count = (Size + 3) / 4;
+
+#ifdef FLASH_SIMULATION
+	/* The simulation models the HAL calls only, in the same steps */
+	while(Count > 0)
+	{
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+		if(!(Address & 7) && Count >= 2)
+		{
+			if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, Address, pData[0] | ((uint64_t)pData[1] << 32)) != HAL_OK)
+				return FLASH_STATUS_ERROR_WRITE;
+			Count -= 2;
+			Address += 8;
+			pData += 2;
+			continue;
+		}
+#endif
+		if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, Address, *pData) != HAL_OK)
+			return FLASH_STATUS_ERROR_WRITE;
+		Count--;
+		Address += 4;
+		pData++;
+	}
+
+	return FLASH_STATUS_OK;
+#else
+	while(FLASH->SR & FLASH_SR_BSY);
+
+	FLASH->SR = FLASH_FLAG_EOP | FLASH_PROGRAM_ERRORS;
+
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	/* Double word goes only to the address aligned to 8 */
+	if((Address & 7) && Count > 0)
+	{
+		FLASH->CR = (FLASH->CR & ~FLASH_CR_PSIZE) | FLASH_PSIZE_WORD | FLASH_CR_PG;
+		*(__IO uint32_t*)(uintptr_t)Address = *pData;
+		while(FLASH->SR & FLASH_SR_BSY);
+		Address += 4;
+		pData++;
+		Count--;
+	}
+#endif
+
+	FLASH->CR = (FLASH->CR & ~FLASH_CR_PSIZE) | FLASH_PROGRAM_PSIZE | FLASH_CR_PG;
+
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	for(; Count >= 2 && !(FLASH->SR & FLASH_PROGRAM_ERRORS); Count -= 2)
+	{
+		*(__IO uint32_t*)(uintptr_t)Address = pData[0];
+		__ISB();
+		*(__IO uint32_t*)(uintptr_t)(Address + 4) = pData[1];
+		while(FLASH->SR & FLASH_SR_BSY);
+		Address += 8;
+		pData += 2;
+	}
+
+	/* Odd word at the end */
+	FLASH->CR = (FLASH->CR & ~FLASH_CR_PSIZE) | FLASH_PSIZE_WORD | FLASH_CR_PG;
+#endif
+
+	for(; Count > 0 && !(FLASH->SR & FLASH_PROGRAM_ERRORS); Count--)
+	{
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_BYTE)
+		for(uint32_t i = 0; i < 4; i++)
+		{
+			*(__IO uint8_t*)(uintptr_t)(Address + i) = (uint8_t)(*pData >> (8 * i));
+			while(FLASH->SR & FLASH_SR_BSY);
+		}
+#elif (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_HALF_WORD)
+		*(__IO uint16_t*)(uintptr_t)Address = (uint16_t)*pData;
+		while(FLASH->SR & FLASH_SR_BSY);
+		*(__IO uint16_t*)(uintptr_t)(Address + 2) = (uint16_t)(*pData >> 16);
+		while(FLASH->SR & FLASH_SR_BSY);
+#else
+		*(__IO uint32_t*)(uintptr_t)Address = *pData;
+		while(FLASH->SR & FLASH_SR_BSY);
+#endif
+		Address += 4;
+		pData++;
+	}
+
+	FLASH->CR &= ~FLASH_CR_PG;
+
+	if(FLASH->SR & FLASH_PROGRAM_ERRORS)
+		return FLASH_STATUS_ERROR_WRITE;
+
+	return FLASH_STATUS_OK;
+#endif
+}
+
+/*!
+ * \brief Program data to the erased area (burst, FLASH_SUPPLY_RANGE parallelism)
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashProgramData(uint32_t Address, const uint32_t *pData, uint32_t Size)
 {
 	FlashStatus_t ErrCode = FLASH_STATUS_OK;
-	uint32_t *pData = (uint32_t*)pStruct;
 
-	if((ErrCode = FlashEraseSector(Address)) != FLASH_STATUS_OK)
-		return ErrCode;
+	if(FlashJob.Status == FLASH_STATUS_BUSY)
+		return FLASH_STATUS_BUSY;
 
 	if(HAL_FLASH_Unlock() != HAL_OK)
 	{
@@ -271,16 +1125,13 @@ FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct)
 		return ErrCode;
 	}
 
-	pStruct->Checksum = ComputeChecksum((uint32_t)CRC_INI_VAL, pStruct, FLASH_STRUCT_USER_SIZE - 4);
+	ErrCode = FlashProgramBurst(Address, pData, Size);
+	FlashResetCaches();
 
-	for(uint32_t i = 0; i < FLASH_STRUCT_USER_SIZE; i += 4)
+	if(ErrCode != FLASH_STATUS_OK)
 	{
-		if(HAL_FLASH_Program(TYPEPROGRAM_WORD, Address + i, *(pData)) != HAL_OK)
-		{
-			ErrCode = FLASH_STATUS_ERROR_WRITE;
-			return ErrCode;
-		}
-		pData++;
+		HAL_FLASH_Lock();
+		return ErrCode;
 	}
 
 	if(HAL_FLASH_Lock() != HAL_OK)
@@ -293,37 +1144,881 @@ FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct)
 }
 
 /*!
- * \brief Calculating the checksum (CRC32)
- * using the polynomial x^32 + x^26 + x^23 + x^22 + x^16 + x^12 + x^11 + x^10 + x^8 + x^7 + x^5 + x^4 + x^2 + x + 1
+ * \brief Comparison of the new data with the memory-mapped flash
  *
- * \param[IN] Crc  			Default crc ini val
+ * \param[IN] Address  		Base address
  * \param[IN] pData  		Data pointer
  * \param[IN] Size  		Data size
- * \retval           		The value of the checksum
+ * \retval           		FLASH_COMPARE_EQUAL, FLASH_COMPARE_PROGRAM or FLASH_COMPARE_ERASE
  */
-uint32_t ComputeChecksum(uint32_t Crc, const void *pData, uint32_t Size)
+static uint32_t FlashCompare(uint32_t Address, const uint32_t *pData, uint32_t Size)
 {
-	while (Size--)
+	const uint32_t *pFlash = (const uint32_t*)(uintptr_t)Address;
+	uint32_t Result = FLASH_COMPARE_EQUAL;
+
+	for(uint32_t i = 0; i < (Size + 3) / 4; i++)
 	{
-		Crc = CRC32_NEXT(Crc, *(uint8_t*)pData++);
+		if(pFlash[i] == pData[i])
+			continue;
+
+		if((pFlash[i] & pData[i]) != pData[i])
+			return FLASH_COMPARE_ERASE;
+
+		Result = FLASH_COMPARE_PROGRAM;
 	}
-	
-	return Crc;
+
+	return Result;
 }
 
 /*!
- * \brief Check integrities structe with use checksum
+ * \brief Program of the changed words only, in runs (the flash must be unlocked)
  *
- * \param[IN] pStruct  		Data structe pointer
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
  * \retval           		Status of the operation
  */
-FlashStatus_t CheckIntegritiesStructe(FlashMapData_t *pStruct)
+static FlashStatus_t FlashProgramChanged(uint32_t Address, const uint32_t *pData, uint32_t Size)
 {
-	FlashStatus_t ErrCode = FLASH_STATUS_OK;
-	uint32_t Crc = CRC_INI_VAL;
+	const uint32_t *pFlash = (const uint32_t*)(uintptr_t)Address;
+	uint32_t Count = (Size + 3) / 4;
+	uint32_t i = 0, First;
+
+	while(i < Count)
+	{
+		if(pFlash[i] == pData[i])
+		{
+			i++;
+			continue;
+		}
 
-	if((Crc = ComputeChecksum((uint32_t)CRC_INI_VAL, (void*) pStruct, FLASH_STRUCT_USER_SIZE)))
-		ErrCode = FLASH_STATUS_ERROR_CRC;
+		First = i;
+		while(i < Count && pFlash[i] != pData[i])
+			i++;
 
-	return ErrCode;
+		if(FlashProgramBurst(Address + First * 4, &pData[First], (i - First) * 4) != FLASH_STATUS_OK)
+			return FLASH_STATUS_ERROR_WRITE;
+	}
+
+	return FLASH_STATUS_OK;
+}
+
+/*!
+ * \brief Write of the area with the comparison: nothing is done for the same data,
+ * only 1 -> 0 changes are programmed without erase, the area is erased only when needed
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		Status of the operation
+ */
+static FlashStatus_t FlashUpdateData(uint32_t Address, const uint32_t *pData, uint32_t Size)
+{
+	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	uint32_t Compare;
+
+	/* The flash may change under the comparison while the job runs */
+	if(FlashJob.Status == FLASH_STATUS_BUSY)
+		return FLASH_STATUS_BUSY;
+
+	Compare = FlashCompare(Address, pData, Size);
+	if(Compare == FLASH_COMPARE_EQUAL)
+		return ErrCode;
+
+	if(Compare == FLASH_COMPARE_ERASE && (ErrCode = FlashEraseRange(Address, Size)) != FLASH_STATUS_OK)
+		return ErrCode;
+
+	if(HAL_FLASH_Unlock() != HAL_OK)
+	{
+		ErrCode = FLASH_STATUS_ERROR_UNLOCK;
+		return ErrCode;
+	}
+
+	/* After the erase the blank words of the data are skipped as well */
+	ErrCode = FlashProgramChanged(Address, pData, Size);
+	FlashResetCaches();
+
+	if(ErrCode != FLASH_STATUS_OK)
+	{
+		HAL_FLASH_Lock();
+		return ErrCode;
+	}
+
+	if(HAL_FLASH_Lock() != HAL_OK)
+	{
+		ErrCode = FLASH_STATUS_ERROR_LOCK;
+		return ErrCode;
+	}
+
+	return ErrCode;
+}
+
+/*!
+ * \brief Write data to flash (skipped for the same data, without erase for 1 -> 0 changes only)
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size)
+{
+	return FlashUpdateData(Address, pData, Size);
+}
+
+/*!
+ * \brief End of the asynchronous job
+ *
+ * \param[IN] Status  		Result of the job
+ */
+static void FlashJobFinish(FlashStatus_t Status)
+{
+	FlashResetCaches();
+
+	if(HAL_FLASH_Lock() != HAL_OK && Status == FLASH_STATUS_OK)
+		Status = FLASH_STATUS_ERROR_LOCK;
+
+	FlashJob.Status = Status;
+	if(FlashJob.Callback)
+		FlashJob.Callback(Status);
+}
+
+/*!
+ * \brief Erase request of the next run of the consecutive sectors of the job (as FlashEraseRange)
+ *
+ * \retval           		Status of the HAL request
+ */
+static HAL_StatusTypeDef FlashJobErase(void)
+{
+	FLASH_EraseInitTypeDef FlashErase_s;
+	FlashSectorInfo_t Info;
+	uint32_t Address;
+
+	if(FlashGetSector(FlashJob.EraseAddress, &Info) != FLASH_STATUS_OK)
+		return HAL_ERROR;
+
+	FlashErase_s.TypeErase = FLASH_TYPEERASE_SECTORS;
+	FlashErase_s.VoltageRange = FLASH_SUPPLY_RANGE;
+	FlashErase_s.Sector = Info.Number;
+	FlashErase_s.NbSectors = 0;
+
+	do
+	{
+		FlashErase_s.NbSectors++;
+		Address = Info.Start + Info.Size;
+	}while(Address < FlashJob.EraseEnd && FlashGetSector(Address, &Info) == FLASH_STATUS_OK &&
+		   Info.Number == FlashErase_s.Sector + FlashErase_s.NbSectors);
+
+	FlashJob.EraseAddress = Address;
+
+	return HAL_FLASHEx_Erase_IT(&FlashErase_s);
+}
+
+/*!
+ * \brief Program request of the next step of the job (FLASH_SUPPLY_RANGE parallelism,
+ * x64 falls back to a word at an address not aligned to 8 and at the odd last word)
+ *
+ * \retval           		Status of the HAL request
+ */
+static HAL_StatusTypeDef FlashJobProgram(void)
+{
+	uint32_t TypeProgram = FLASH_JOB_PROGRAM_TYPE;
+	uint64_t Data = 0;
+
+	FlashJob.Step = FLASH_JOB_PROGRAM_BYTES;
+
+#if (FLASH_PROGRAM_PSIZE == FLASH_PSIZE_DOUBLE_WORD)
+	if((FlashJob.Address & 7) || FlashJob.Count < 8)
+	{
+		TypeProgram = FLASH_TYPEPROGRAM_WORD;
+		FlashJob.Step = 4;
+	}
+#endif
+
+	for(uint8_t i = 0; i < FlashJob.Step; i++)
+		Data |= (uint64_t)FlashJob.pData[i] << (8 * i);
+
+	return HAL_FLASH_Program_IT(TypeProgram, FlashJob.Address, Data);
+}
+
+/*!
+ * \brief Next step of the asynchronous job (after the HAL released the flash)
+ */
+static void FlashJobNext(void)
+{
+	if(FlashJob.IsError)
+	{
+		FlashJobFinish(FlashJob.IsErasing ? FLASH_STATUS_ERROR_ERASE : FLASH_STATUS_ERROR_WRITE);
+		return;
+	}
+
+	if(FlashJob.IsErasing && FlashJob.EraseAddress < FlashJob.EraseEnd)
+	{
+		if(FlashJobErase() != HAL_OK)
+			FlashJobFinish(FLASH_STATUS_ERROR_ERASE);
+		return;
+	}
+
+	FlashJob.IsErasing = 0;
+	if(FlashJob.Count == 0)
+	{
+		FlashJobFinish(FLASH_STATUS_OK);
+		return;
+	}
+
+	if(FlashJobProgram() != HAL_OK)
+		FlashJobFinish(FLASH_STATUS_ERROR_WRITE);
+}
+
+/*!
+ * \brief Start of the asynchronous job
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \param[IN] IsErase  		Erase all sectors of the area first (the sector of the address for Size = 0)
+ * \param[IN] Callback  		Callback of the end of the job
+ * \retval           		Status of the start
+ */
+static FlashStatus_t FlashJobStart(uint32_t Address, const uint32_t *pData, uint32_t Size, uint8_t IsErase, FlashJobCallback_t Callback)
+{
+	uint32_t End = Address + ((Size != 0) ? Size : 1);
+	FlashSectorInfo_t Info;
+	uint32_t Primask;
+
+	if(FlashGetSector(Address, &Info) != FLASH_STATUS_OK || FlashGetSector(End - 1, &Info) != FLASH_STATUS_OK)
+		return FLASH_STATUS_ERROR_ADDRESS;
+
+	/* A job of an interrupt must not start between the check and the set */
+	Primask = __get_PRIMASK();
+	__disable_irq();
+	if(FlashJob.Status == FLASH_STATUS_BUSY)
+	{
+		__set_PRIMASK(Primask);
+		return FLASH_STATUS_BUSY;
+	}
+	FlashJob.Status = FLASH_STATUS_BUSY;
+	__set_PRIMASK(Primask);
+
+	if(HAL_FLASH_Unlock() != HAL_OK)
+	{
+		FlashJob.Status = FLASH_STATUS_ERROR_UNLOCK;
+		return FLASH_STATUS_ERROR_UNLOCK;
+	}
+
+	FlashJob.IsStepDone = 0;
+	FlashJob.IsErasing = IsErase;
+	FlashJob.IsError = 0;
+	FlashJob.EraseAddress = Address;
+	FlashJob.EraseEnd = End;
+	FlashJob.Address = Address;
+	FlashJob.pData = (const uint8_t*)pData;
+	FlashJob.Count = (Size + 3) & ~3U;
+	FlashJob.Callback = Callback;
+
+	HAL_NVIC_SetPriority(FLASH_IRQn, FLASH_JOB_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(FLASH_IRQn);
+
+	if(!IsErase)
+	{
+		if(FlashJob.Count == 0 || FlashJobProgram() != HAL_OK)
+		{
+			/* Failed start is reported only by the return value */
+			if(FlashJob.Count != 0)
+				FlashJob.Callback = NULL;
+			FlashJobFinish(FlashJob.Count ? FLASH_STATUS_ERROR_WRITE : FLASH_STATUS_OK);
+			return FlashJob.Status;
+		}
+		return FLASH_STATUS_OK;
+	}
+
+	if(FlashJobErase() != HAL_OK)
+	{
+		FlashJob.Callback = NULL;
+		FlashJobFinish(FLASH_STATUS_ERROR_ERASE);
+		return FLASH_STATUS_ERROR_ERASE;
+	}
+
+	return FLASH_STATUS_OK;
+}
+
+/*!
+ * \brief Start of the asynchronous sector erase
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashEraseSectorAsync(uint32_t Address, FlashJobCallback_t Callback)
+{
+	return FlashJobStart(Address, NULL, 0, 1, Callback);
+}
+
+/*!
+ * \brief Start of the asynchronous program of the erased area
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer (must stay valid until the end of the job)
+ * \param[IN] Size  		Data size
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashProgramAsync(uint32_t Address, const uint32_t *pData, uint32_t Size, FlashJobCallback_t Callback)
+{
+	return FlashJobStart(Address, pData, Size, 0, Callback);
+}
+
+/*!
+ * \brief Start of the asynchronous erase of all sectors of [Address, Address + Size) and program of the data
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer (must stay valid until the end of the job)
+ * \param[IN] Size  		Data size
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashWriteDataAsync(uint32_t Address, const uint32_t *pData, uint32_t Size, FlashJobCallback_t Callback)
+{
+	return FlashJobStart(Address, pData, Size, 1, Callback);
+}
+
+/*!
+ * \brief Status of the asynchronous job
+ *
+ * \retval           		FLASH_STATUS_BUSY - job is in progress, else result of the last job
+ */
+FlashStatus_t FlashJobStatus(void)
+{
+	return FlashJob.Status;
+}
+
+/*!
+ * \brief Flash interrupt handler of the asynchronous jobs (call from FLASH_IRQHandler
+ * instead of HAL_FLASH_IRQHandler)
+ */
+void FlashIRQHandler(void)
+{
+	HAL_FLASH_IRQHandler();
+
+	/* The HAL keeps the flash locked inside its callbacks, the next step starts here */
+	if(FlashJob.IsStepDone)
+	{
+		FlashJob.IsStepDone = 0;
+		FlashJobNext();
+	}
+}
+
+/*!
+ * \brief End of the flash operation (HAL callback)
+ *
+ * \param[IN] ReturnValue  	Sector of the erase (0xFFFFFFFF - last one) or address of the program
+ */
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+	if(FlashJob.Status != FLASH_STATUS_BUSY)
+		return;
+
+	if(FlashJob.IsErasing)
+	{
+		if(ReturnValue == 0xFFFFFFFFU)
+			FlashJob.IsStepDone = 1;
+		return;
+	}
+
+	FlashJob.Address += FlashJob.Step;
+	FlashJob.pData += FlashJob.Step;
+	FlashJob.Count -= FlashJob.Step;
+	FlashJob.IsStepDone = 1;
+}
+
+/*!
+ * \brief Error of the flash operation (HAL callback)
+ *
+ * \param[IN] ReturnValue  	Sector of the erase or address of the program
+ */
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+	(void)ReturnValue;
+
+	if(FlashJob.Status != FLASH_STATUS_BUSY)
+		return;
+
+	FlashJob.IsError = 1;
+	FlashJob.IsStepDone = 1;
+}
+
+/*!
+ * \brief Writes structe data at the specified address (skipped for the same data, without erase for 1 -> 0 changes only)
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct)
+{
+	pStruct->Checksum = ComputeChecksum((uint32_t)CRC_INI_VAL, pStruct, FLASH_STRUCT_USER_SIZE - 4);
+
+	return FlashUpdateData(Address, (const uint32_t*)pStruct, FLASH_STRUCT_USER_SIZE);
+}
+
+/*!
+ * \brief Scan of the slots of the sector
+ *
+ * \param[IN] Address  		Base address of the sector
+ * \param[IN] SectorSize  	Size of the sector
+ * \param[OUT] pNewest  		Address of the newest valid slot, 0 - no valid slot
+ * \param[OUT] pSequence  	Sequence number of the newest valid slot
+ * \retval           		Address of the first blank slot, 0 - sector is full
+ */
+static uint32_t FlashSlotScan(uint32_t Address, uint32_t SectorSize, uint32_t *pNewest, uint32_t *pSequence)
+{
+	uint32_t Blank = 0;
+
+	*pNewest = 0;
+	*pSequence = 0;
+
+	for(uint32_t Slot = Address; Slot + FLASH_SLOT_SIZE <= Address + SectorSize; Slot += FLASH_SLOT_SIZE)
+	{
+		const FlashSlotHeader_t *pHeader = (const FlashSlotHeader_t*)(uintptr_t)Slot;
+
+		if(pHeader->Magic == 0xFFFFFFFF && pHeader->Sequence == 0xFFFFFFFF && pHeader->Commit == 0xFFFFFFFF)
+		{
+			/* Slots are used in order, everything after the first blank one is blank */
+			Blank = Slot;
+			break;
+		}
+
+		/* Torn writes are not committed and are skipped */
+		if(pHeader->Magic != FLASH_SLOT_MAGIC || pHeader->Commit != FLASH_SLOT_COMMITTED)
+			continue;
+
+		if((*pNewest == 0 || pHeader->Sequence > *pSequence) &&
+		   CheckIntegritiesStructe(FlashReadStructe(Slot + sizeof(FlashSlotHeader_t))) == FLASH_STATUS_OK)
+		{
+			*pNewest = Slot;
+			*pSequence = pHeader->Sequence;
+		}
+	}
+
+	return Blank;
+}
+
+/*!
+ * \brief Program of the blank slot
+ *
+ * \param[IN] Slot  			Address of the slot
+ * \param[IN] Sequence  		Sequence number of the slot
+ * \param[IN] pData  		Data structe pointer (with the checksum)
+ * \retval           		Status of the operation
+ */
+static FlashStatus_t FlashSlotProgram(uint32_t Slot, uint32_t Sequence, const uint32_t *pData)
+{
+	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	const uint32_t Header[2] = {FLASH_SLOT_MAGIC, Sequence};
+	const uint32_t Commit = FLASH_SLOT_COMMITTED;
+
+	if(FlashJob.Status == FLASH_STATUS_BUSY)
+		return FLASH_STATUS_BUSY;
+
+	if(HAL_FLASH_Unlock() != HAL_OK)
+	{
+		ErrCode = FLASH_STATUS_ERROR_UNLOCK;
+		return ErrCode;
+	}
+
+	/* Header, data and the commit word last: a torn write is never taken as valid */
+	if(FlashProgramBurst(Slot + offsetof(FlashSlotHeader_t, Magic), Header, sizeof(Header)) != FLASH_STATUS_OK)
+	{
+		HAL_FLASH_Lock();
+		return FLASH_STATUS_ERROR_WRITE;
+	}
+
+	if(FlashProgramBurst(Slot + sizeof(FlashSlotHeader_t), pData, FLASH_STRUCT_USER_SIZE) != FLASH_STATUS_OK ||
+	   FlashProgramBurst(Slot + offsetof(FlashSlotHeader_t, Commit), &Commit, sizeof(Commit)) != FLASH_STATUS_OK)
+	{
+		FlashResetCaches();
+		HAL_FLASH_Lock();
+		return FLASH_STATUS_ERROR_WRITE;
+	}
+
+	FlashResetCaches();
+
+	if(HAL_FLASH_Lock() != HAL_OK)
+	{
+		ErrCode = FLASH_STATUS_ERROR_LOCK;
+		return ErrCode;
+	}
+
+	return ErrCode;
+}
+
+/*!
+ * \brief Writes structe data to the next blank slot of the sector (skipped when the newest slot is the same),
+ * the sector is erased only when all slots are used
+ *
+ * \param[IN] Address  		Base address of the sector
+ * \param[IN] SectorSize  	Size of the sector
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSlotWrite(uint32_t Address, uint32_t SectorSize, FlashMapData_t *pStruct)
+{
+	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	uint32_t *pData = (uint32_t*)pStruct;
+	uint32_t Newest, Sequence, Slot;
+
+	pStruct->Checksum = ComputeChecksum((uint32_t)CRC_INI_VAL, pStruct, FLASH_STRUCT_USER_SIZE - 4);
+
+	Slot = FlashSlotScan(Address, SectorSize, &Newest, &Sequence);
+
+	/* The newest copy is the same, no new slot is used */
+	if(Newest != 0 && FlashCompare(Newest + sizeof(FlashSlotHeader_t), pData, FLASH_STRUCT_USER_SIZE) == FLASH_COMPARE_EQUAL)
+		return ErrCode;
+
+	if(Slot == 0)
+	{
+		if((ErrCode = FlashEraseSector(Address)) != FLASH_STATUS_OK)
+			return ErrCode;
+		Slot = Address;
+	}
+
+	return FlashSlotProgram(Slot, Sequence + 1, pData);
+}
+
+/*!
+ * \brief Writes structe data to the slots of two sectors used in turn (skipped when the newest slot is the same).
+ * The slot goes after the newest copy, when its sector is full the other sector is erased and used:
+ * the newest copy is never erased, the sequence number continues over both sectors
+ *
+ * \param[IN] AddressA  		Base address of the first sector
+ * \param[IN] AddressB  		Base address of the second sector
+ * \param[IN] SectorSize  	Size of the sectors
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSlotWritePair(uint32_t AddressA, uint32_t AddressB, uint32_t SectorSize, FlashMapData_t *pStruct)
+{
+	FlashStatus_t ErrCode = FLASH_STATUS_OK;
+	uint32_t *pData = (uint32_t*)pStruct;
+	uint32_t NewestA, SequenceA, BlankA;
+	uint32_t NewestB, SequenceB, BlankB;
+	uint32_t Newest, Sequence, Slot, Other;
+
+	pStruct->Checksum = ComputeChecksum((uint32_t)CRC_INI_VAL, pStruct, FLASH_STRUCT_USER_SIZE - 4);
+
+	BlankA = FlashSlotScan(AddressA, SectorSize, &NewestA, &SequenceA);
+	BlankB = FlashSlotScan(AddressB, SectorSize, &NewestB, &SequenceB);
+
+	/* Active sector holds the newest copy (the first one while both are empty) */
+	if(NewestB != 0 && (NewestA == 0 || SequenceB > SequenceA))
+	{
+		Newest = NewestB;
+		Sequence = SequenceB;
+		Slot = BlankB;
+		Other = AddressA;
+	}
+	else
+	{
+		Newest = NewestA;
+		Sequence = SequenceA;
+		Slot = BlankA;
+		Other = AddressB;
+	}
+
+	if(Newest != 0 && FlashCompare(Newest + sizeof(FlashSlotHeader_t), pData, FLASH_STRUCT_USER_SIZE) == FLASH_COMPARE_EQUAL)
+		return ErrCode;
+
+	/* The active sector is full: the other one holds older copies only */
+	if(Slot == 0)
+	{
+		if(Newest == 0)
+			Other = AddressA;
+
+		if((ErrCode = FlashEraseSector(Other)) != FLASH_STATUS_OK)
+			return ErrCode;
+		Slot = Other;
+	}
+
+	return FlashSlotProgram(Slot, Sequence + 1, pData);
+}
+
+/*!
+ * \brief Reads the newest valid structe from the slots of two sectors
+ *
+ * \param[IN] AddressA  		Base address of the first sector
+ * \param[IN] AddressB  		Base address of the second sector
+ * \param[IN] SectorSize  	Size of the sectors
+ * \retval           		Data structe pointer into the flash, NULL - no valid slot
+ */
+const FlashMapData_t* FlashSlotReadPair(uint32_t AddressA, uint32_t AddressB, uint32_t SectorSize)
+{
+	uint32_t NewestA, SequenceA;
+	uint32_t NewestB, SequenceB;
+
+	FlashSlotScan(AddressA, SectorSize, &NewestA, &SequenceA);
+	FlashSlotScan(AddressB, SectorSize, &NewestB, &SequenceB);
+
+	if(NewestB != 0 && (NewestA == 0 || SequenceB > SequenceA))
+		NewestA = NewestB;
+
+	if(NewestA == 0)
+		return NULL;
+
+	return FlashReadStructe(NewestA + sizeof(FlashSlotHeader_t));
+}
+
+/*!
+ * \brief Reads the newest valid structe from the slots of the sector
+ *
+ * \param[IN] Address  		Base address of the sector
+ * \param[IN] SectorSize  	Size of the sector
+ * \retval           		Data structe pointer, NULL - no valid slot
+ */
+const FlashMapData_t* FlashSlotRead(uint32_t Address, uint32_t SectorSize)
+{
+	uint32_t Newest, Sequence;
+
+	FlashSlotScan(Address, SectorSize, &Newest, &Sequence);
+	if(Newest == 0)
+		return NULL;
+
+	return FlashReadStructe(Newest + sizeof(FlashSlotHeader_t));
+}
+
+#if (CRC32_USE_HW == 1)
+/*!
+ * Access to the CRC unit (the simulation has a model of the unit)
+ */
+#ifdef FLASH_SIMULATION
+#define CRC_HW_RESET()						FlashSimCrcReset()
+#define CRC_HW_WRITE(Word)					FlashSimCrcWrite(Word)
+#define CRC_HW_READ()						FlashSimCrcRead()
+#else
+#define CRC_HW_RESET()						(CRC->CR = CRC_CR_RESET)
+#define CRC_HW_WRITE(Word)					(CRC->DR = (Word))
+#define CRC_HW_READ()						(CRC->DR)
+#endif
+
+/*!
+ * \brief Word to write after the reset of the CRC unit to load the state
+ * (the unit has no init register, the shift of one word is reverted)
+ *
+ * \param[IN] State  		Required state of the unit
+ * \retval           		Word to write to the data register
+ */
+static uint32_t ComputeChecksumHwPreload(uint32_t State)
+{
+	for (uint8_t i = 0; i < 32; i++)
+	{
+		State = (State & 1) ? (((State ^ CRC32_HW_POLY) >> 1) | 0x80000000) : (State >> 1);
+	}
+
+	return State ^ CRC_INI_VAL;
+}
+
+/*!
+ * \brief Calculating the checksum of the words by the CRC unit
+ * The unit shifts MSB first, the table CRC is reflected: the words and the result are bit reversed
+ *
+ * \param[IN] Crc  			Current crc value
+ * \param[IN] pWord  		Aligned data pointer
+ * \param[IN] Count  		Number of words
+ * \retval           		The value of the checksum
+ */
+static uint32_t ComputeChecksumHw(uint32_t Crc, const uint32_t *pWord, uint32_t Count)
+{
+	if (Count == 0)
+		return Crc;
+
+	__HAL_RCC_CRC_CLK_ENABLE();
+	CRC_HW_RESET();
+
+	if (Crc != CRC_INI_VAL)
+		CRC_HW_WRITE(ComputeChecksumHwPreload(__RBIT(Crc)));
+
+	while (Count--)
+	{
+		CRC_HW_WRITE(__RBIT(*pWord++));
+	}
+
+	return __RBIT(CRC_HW_READ());
+}
+#endif
+
+/*!
+ * \brief Calculating the checksum (CRC32)
+ * using the polynomial x^32 + x^26 + x^23 + x^22 + x^16 + x^12 + x^11 + x^10 + x^8 + x^7 + x^5 + x^4 + x^2 + x + 1
+ *
+ * \param[IN] Crc  			Default crc ini val
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		The value of the checksum
+ */
+uint32_t ComputeChecksum(uint32_t Crc, const void *pData, uint32_t Size)
+{
+	const uint8_t *pByte = (const uint8_t*)pData;
+
+#if (CRC32_USE_HW == 1) || (CRC32_SLICE_BY >= 4)
+	const uint32_t *pWord;
+
+	/* Head bytes up to the word boundary */
+	while (Size && ((uintptr_t)pByte & 0x3))
+	{
+		Crc = CRC32_NEXT(Crc, *pByte++);
+		Size--;
+	}
+
+	pWord = (const uint32_t*)pByte;
+
+#if (CRC32_USE_HW == 1)
+	Crc = ComputeChecksumHw(Crc, pWord, Size / 4);
+	pWord += Size / 4;
+	Size &= 0x3;
+#else
+#if (CRC32_SLICE_BY == 8)
+	while (Size >= 8)
+	{
+		uint32_t One = *pWord++ ^ Crc;
+		uint32_t Two = *pWord++;
+
+		Crc = CRC32_TableSlice8[3][One & 0xFF] ^ CRC32_TableSlice8[2][(One >> 8) & 0xFF] ^
+			  CRC32_TableSlice8[1][(One >> 16) & 0xFF] ^ CRC32_TableSlice8[0][One >> 24] ^
+			  CRC32_TableSlice4[2][Two & 0xFF] ^ CRC32_TableSlice4[1][(Two >> 8) & 0xFF] ^
+			  CRC32_TableSlice4[0][(Two >> 16) & 0xFF] ^ CRC32_Table[Two >> 24];
+		Size -= 8;
+	}
+#endif
+
+	while (Size >= 4)
+	{
+		uint32_t One = *pWord++ ^ Crc;
+
+		Crc = CRC32_TableSlice4[2][One & 0xFF] ^ CRC32_TableSlice4[1][(One >> 8) & 0xFF] ^
+			  CRC32_TableSlice4[0][(One >> 16) & 0xFF] ^ CRC32_Table[One >> 24];
+		Size -= 4;
+	}
+#endif
+
+	pByte = (const uint8_t*)pWord;
+#endif
+
+	while (Size--)
+	{
+		Crc = CRC32_NEXT(Crc, *pByte++);
+	}
+	
+	return Crc;
+}
+
+/*!
+ * \brief Multiplication of the polynomials modulo CRC32 polynomial (reflected, x^0 in bit 31)
+ *
+ * \param[IN] A  			First polynomial
+ * \param[IN] B  			Second polynomial
+ * \retval           		Product
+ */
+static uint32_t Crc32MultModP(uint32_t A, uint32_t B)
+{
+	uint32_t Product = 0;
+
+	for (uint32_t Mask = 0x80000000; Mask && A; Mask >>= 1)
+	{
+		if (A & Mask)
+		{
+			Product ^= B;
+			A &= ~Mask;
+		}
+		B = (B & 1) ? ((B >> 1) ^ 0xEDB88320) : (B >> 1);
+	}
+
+	return Product;
+}
+
+/*!
+ * \brief Start of the streaming checksum
+ *
+ * \param[IN] pCtx  		Context pointer
+ */
+void Crc32Init(Crc32Ctx_t *pCtx)
+{
+	pCtx->Crc = CRC_INI_VAL;
+	pCtx->Size = 0;
+}
+
+/*!
+ * \brief Adding the next chunk to the streaming checksum
+ *
+ * \param[IN] pCtx  		Context pointer
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ */
+void Crc32Update(Crc32Ctx_t *pCtx, const void *pData, uint32_t Size)
+{
+	pCtx->Crc = ComputeChecksum(pCtx->Crc, pData, Size);
+	pCtx->Size += Size;
+}
+
+/*!
+ * \brief End of the streaming checksum (same value as ComputeChecksum with CRC_INI_VAL)
+ *
+ * \param[IN] pCtx  		Context pointer
+ * \retval           		The value of the checksum
+ */
+uint32_t Crc32Final(const Crc32Ctx_t *pCtx)
+{
+	return pCtx->Crc;
+}
+
+/*!
+ * \brief Checksum of the concatenation A + B from the checksums of A and B
+ * (both started with CRC_INI_VAL)
+ *
+ * \param[IN] CrcA  		Checksum of the first block
+ * \param[IN] CrcB  		Checksum of the second block
+ * \param[IN] SizeB  		Size of the second block
+ * \retval           		The value of the checksum
+ */
+uint32_t Crc32Combine(uint32_t CrcA, uint32_t CrcB, uint32_t SizeB)
+{
+	uint32_t Shift = 0x80000000;		/* x^0 */
+	uint32_t Power = 0x00800000;		/* x^8, one zero byte */
+
+	/* crc(A + B) = (crcA ^ INI) * x^(8 * SizeB) ^ crcB, without final xor the init value does not cancel */
+	while (SizeB)
+	{
+		if (SizeB & 1)
+			Shift = Crc32MultModP(Power, Shift);
+		SizeB >>= 1;
+		if (SizeB)
+			Power = Crc32MultModP(Power, Power);
+	}
+
+	return Crc32MultModP(Shift, CrcA ^ CRC_INI_VAL) ^ CrcB;
+}
+
+/*!
+ * \brief Check integrities data block with use checksum (checksum is the last 4 bytes of the block)
+ *
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Size of the block with checksum
+ * \retval           		Status of the operation
+ */
+FlashStatus_t CheckIntegritiesData(const void *pData, uint32_t Size)
+{
+	/* Checksum over the data and its own checksum is zero */
+	if (ComputeChecksum((uint32_t)CRC_INI_VAL, pData, Size))
+		return FLASH_STATUS_ERROR_CRC;
+
+	return FLASH_STATUS_OK;
+}
+
+/*!
+ * \brief Check integrities structe with use checksum
+ *
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t CheckIntegritiesStructe(const FlashMapData_t *pStruct)
+{
+	return CheckIntegritiesData(pStruct, FLASH_STRUCT_USER_SIZE);
 }
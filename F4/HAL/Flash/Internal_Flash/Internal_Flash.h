@@ -20,11 +20,121 @@
  */
 #define CRC_INI_VAL 						0xFFFFFFFFL
 
+/*!
+ * CRC32 engine: 1 - byte table (1 KB), 4 - slice-by-4 (4 KB), 8 - slice-by-8 (8 KB)
+ */
+#ifndef CRC32_SLICE_BY
+#define CRC32_SLICE_BY						8
+#endif
+
+#if (CRC32_SLICE_BY != 1) && (CRC32_SLICE_BY != 4) && (CRC32_SLICE_BY != 8)
+#error "CRC32_SLICE_BY must be 1, 4 or 8"
+#endif
+
+/*!
+ * CRC32 by the CRC unit (words, 1 - enabled), head and tail bytes use the table.
+ * The unit is not locked: do not use it from interrupts and the main loop at the same time
+ */
+#ifndef CRC32_USE_HW
+#define CRC32_USE_HW						0
+#endif
+
+/*!
+ * Polynomial of the CRC unit (MSB first)
+ */
+#define CRC32_HW_POLY						0x04C11DB7
+
 /*!
  * Getting the table value of the checksum
  */
 #define CRC32_NEXT(CRC, c) 					(CRC32_Table[(CRC ^ c) & 0xFF] ^ (CRC >> 8))
 
+/*!
+ * Supply voltage range of the device, it selects the program and erase parallelism:
+ * FLASH_VOLTAGE_RANGE_1 - x8 (1.8 - 2.1 V), FLASH_VOLTAGE_RANGE_2 - x16 (2.1 - 2.7 V),
+ * FLASH_VOLTAGE_RANGE_3 - x32 (2.7 - 3.6 V), FLASH_VOLTAGE_RANGE_4 - x64 (external VPP)
+ */
+#ifndef FLASH_SUPPLY_RANGE
+#define FLASH_SUPPLY_RANGE					FLASH_VOLTAGE_RANGE_3
+#endif
+
+#if (FLASH_SUPPLY_RANGE == FLASH_VOLTAGE_RANGE_1)
+#define FLASH_PROGRAM_PSIZE					FLASH_PSIZE_BYTE
+#elif (FLASH_SUPPLY_RANGE == FLASH_VOLTAGE_RANGE_2)
+#define FLASH_PROGRAM_PSIZE					FLASH_PSIZE_HALF_WORD
+#elif (FLASH_SUPPLY_RANGE == FLASH_VOLTAGE_RANGE_3)
+#define FLASH_PROGRAM_PSIZE					FLASH_PSIZE_WORD
+#else
+#define FLASH_PROGRAM_PSIZE					FLASH_PSIZE_DOUBLE_WORD
+#endif
+
+/*!
+ * Lowest supply voltage of the device (mV) for the wait states, by default the bottom of FLASH_SUPPLY_RANGE
+ */
+#ifndef FLASH_SUPPLY_MV
+#if (FLASH_SUPPLY_RANGE == FLASH_VOLTAGE_RANGE_1)
+#define FLASH_SUPPLY_MV						1800
+#elif (FLASH_SUPPLY_RANGE == FLASH_VOLTAGE_RANGE_2)
+#define FLASH_SUPPLY_MV						2100
+#else
+#define FLASH_SUPPLY_MV						2700
+#endif
+#endif
+
+/*!
+ * ART accelerator setup of FlashInit (1 - enabled), the prefetch is not available below 2.1 V
+ */
+#ifndef FLASH_PREFETCH_ENABLE
+#define FLASH_PREFETCH_ENABLE				1
+#endif
+
+#ifndef FLASH_ICACHE_ENABLE
+#define FLASH_ICACHE_ENABLE					1
+#endif
+
+#ifndef FLASH_DCACHE_ENABLE
+#define FLASH_DCACHE_ENABLE					1
+#endif
+
+/*!
+ * Self-benchmark of the flash profile: iterations of the loop and number of the prefetch/cache combinations
+ */
+#define FLASH_BENCH_ITERATIONS				1024
+#define FLASH_BENCH_PROFILES				8
+
+/*!
+ * Placement of the erase and program routines in RAM (the .RamFunc section of the startup code),
+ * define it empty to keep them in the flash
+ */
+#ifndef FLASH_RAM_FUNC
+#define FLASH_RAM_FUNC						__attribute__((section(".RamFunc"), noinline))
+#endif
+
+/*!
+ * Vector table in RAM (1 - enabled, 512 bytes), the interrupts installed by FlashSetIRQHandler
+ * keep running while the flash is erased or programmed
+ */
+#ifndef FLASH_RAM_VECTORS
+#define FLASH_RAM_VECTORS					0
+#endif
+
+/*!
+ * Number of the vectors (16 system + interrupts of the largest F4 part)
+ */
+#define FLASH_VECTOR_COUNT					(16 + 98)
+
+/*!
+ * Priority of the flash interrupt of the asynchronous jobs
+ */
+#define FLASH_JOB_IRQ_PRIORITY				15
+
+/*!
+ * Slots of the structe in the sector
+ */
+#define FLASH_SLOT_MAGIC					0x544F4C53		/* "SLOT" */
+#define FLASH_SLOT_COMMITTED				0x00000000
+#define FLASH_SLOT_SIZE						(sizeof(FlashSlotHeader_t) + FLASH_STRUCT_USER_SIZE)
+
 /*!
  * Flash timeout
  */
@@ -43,6 +153,25 @@
 #define START_ADDRESS_SECTOR_6 				0x08040000
 #define START_ADDRESS_SECTOR_7 				0x08060000
 #define END_ADDRESS_BANK_1					0x08080000
+#define START_ADDRESS_BANK_2				0x08100000
+#define START_ADDRESS_BANK_2_DB1M			0x08080000		/* Bank 2 of the 1 MB dual-bank parts (DB1M = 1) */
+
+/*!
+ * Size of the flash (KB), by default it is read from the flash size register
+ * (1 MB in the host simulation, FLASH_SIMULATION)
+ */
+#ifndef FLASH_SIZE_KB
+#ifdef FLASH_SIMULATION
+#define FLASH_SIZE_KB						1024
+#else
+#define FLASH_SIZE_KB						(*(const volatile uint16_t*)FLASHSIZE_BASE)
+#endif
+#endif
+
+/*!
+ * Sector number of the address outside the flash
+ */
+#define FLASH_SECTOR_INVALID				0xFFFFFFFF
 
  /*!
   * Flash structe user size
@@ -66,6 +195,99 @@ typedef struct FlashMapData_s
 
 }FlashMapData_t;
 
+/*!
+ * Geometry of the flash sector
+ */
+typedef struct FlashSectorInfo_s
+{
+    /*!
+     * Sector number (FLASH_SECTOR_x of the HAL)
+     */
+	uint32_t Number;
+
+    /*!
+     * Start address of the sector
+     */
+	uint32_t Start;
+
+    /*!
+     * Size of the sector
+     */
+	uint32_t Size;
+
+}FlashSectorInfo_t;
+
+/*!
+ * Performance profile of the flash (wait states and ART accelerator)
+ */
+typedef struct FlashProfile_s
+{
+    /*!
+     * Wait states (FLASH_LATENCY_x)
+     */
+	uint32_t Latency;
+
+    /*!
+     * Prefetch buffer (1 - enabled)
+     */
+	uint8_t Prefetch;
+
+    /*!
+     * Instruction cache (1 - enabled)
+     */
+	uint8_t ICache;
+
+    /*!
+     * Data cache (1 - enabled)
+     */
+	uint8_t DCache;
+
+}FlashProfile_t;
+
+/*!
+ * Context of the streaming checksum
+ */
+typedef struct Crc32Ctx_s
+{
+    /*!
+     * Current crc value
+     */
+	uint32_t Crc;
+
+    /*!
+     * Number of processed bytes
+     */
+	uint32_t Size;
+
+}Crc32Ctx_t;
+
+/*!
+ * Header of the slot of the structe in the sector (append-only storage)
+ */
+typedef struct FlashSlotHeader_s
+{
+    /*!
+     * FLASH_SLOT_MAGIC, 0xFFFFFFFF - slot is blank
+     */
+	uint32_t Magic;
+
+    /*!
+     * Sequence number of the copy, the newest one has the greatest number
+     */
+	uint32_t Sequence;
+
+    /*!
+     * Reserved (left erased)
+     */
+	uint32_t Reserved;
+
+    /*!
+     * FLASH_SLOT_COMMITTED after the structe is written completely
+     */
+	uint32_t Commit;
+
+}FlashSlotHeader_t;
+
 /*!
  * Flash status enum
  */
@@ -99,10 +321,30 @@ typedef enum FlashStatus_e
     /*!
      * Checksum of the data block does not match.
      */
-	FLASH_STATUS_ERROR_CRC
+	FLASH_STATUS_ERROR_CRC,
+
+    /*!
+     * Address is outside the flash
+     */
+	FLASH_STATUS_ERROR_ADDRESS,
+
+    /*!
+     * Wait states are too few for HCLK or are not accepted
+     */
+	FLASH_STATUS_ERROR_LATENCY,
+
+    /*!
+     * Asynchronous job is in progress
+     */
+	FLASH_STATUS_BUSY
 
 }FlashStatus_t;
 
+/*!
+ * Callback of the finished asynchronous job (called from the flash interrupt)
+ */
+typedef void (*FlashJobCallback_t)(FlashStatus_t Status);
+
 /*!
  * \brief Initialization flash
  *
@@ -110,6 +352,21 @@ typedef enum FlashStatus_e
  */
 FlashStatus_t FlashInit(void);
 
+#if (FLASH_RAM_VECTORS == 1)
+/*!
+ * \brief Copy of the current vector table to RAM and switch of VTOR to it (called by FlashInit)
+ */
+void FlashRelocateVectors(void);
+
+/*!
+ * \brief Install of the interrupt handler to the vector table in RAM
+ *
+ * \param[IN] IRQn  		Interrupt number
+ * \param[IN] Handler  		Handler (placed in RAM by FLASH_RAM_FUNC to run during erase and program)
+ */
+void FlashSetIRQHandler(IRQn_Type IRQn, void (*Handler)(void));
+#endif
+
 /*!
  * \brief Reads data at the specified address
  *
@@ -119,12 +376,21 @@ FlashStatus_t FlashInit(void);
 uint32_t FlashReadData(uint32_t Address);
 
 /*!
- * \brief Reads structe data at the specified address
+ * \brief Reads structe data at the specified address (zero-copy, the flash is memory-mapped)
+ *
+ * \param[IN] Address  		Base address
+ * \retval           		Data structe pointer into the flash
+ */
+const FlashMapData_t* FlashReadStructe(uint32_t Address);
+
+/*!
+ * \brief Copies structe data at the specified address
  *
  * \param[IN] Address  		Base address
+ * \param[OUT] pStruct  		Data structe pointer
  * \retval           		Data structe pointer
  */
-FlashMapData_t* FlashReadStructe(uint32_t Address);
+FlashMapData_t* FlashCopyStructe(uint32_t Address, FlashMapData_t *pStruct);
 
 /*!
  * \brief Erase sector flash
@@ -135,7 +401,77 @@ FlashMapData_t* FlashReadStructe(uint32_t Address);
 FlashStatus_t FlashEraseSector(uint32_t Address);
 
 /*!
- * \brief Write data to flash
+ * \brief Erase all sectors of the area with one erase request
+ *
+ * \param[IN] Address  		Start address of the area
+ * \param[IN] Size  		Size of the area
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashEraseRange(uint32_t Address, uint32_t Size);
+
+/*!
+ * \brief Get geometry of the sector at the address
+ *
+ * \param[IN] Address  		Address inside the sector
+ * \param[OUT] pInfo  		Sector geometry
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashGetSector(uint32_t Address, FlashSectorInfo_t *pInfo);
+
+/*!
+ * \brief Minimum wait states for the clock and supply voltage (30, 24, 22 or 20 MHz per wait state
+ * for 2.7 - 3.6 V, 2.4 - 2.7 V, 2.1 - 2.4 V and 1.8 - 2.1 V)
+ *
+ * \param[IN] HclkHz  		HCLK frequency (Hz)
+ * \param[IN] SupplyMv  	Lowest supply voltage (mV)
+ * \retval           		Wait states (FLASH_LATENCY_x)
+ */
+uint32_t FlashGetLatency(uint32_t HclkHz, uint32_t SupplyMv);
+
+/*!
+ * \brief Set of the performance profile, the caches are reset before they are enabled.
+ * Raise the wait states before HCLK and lower them after it
+ *
+ * \param[IN] pProfile  	Profile pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSetProfile(const FlashProfile_t *pProfile);
+
+/*!
+ * \brief Get of the current performance profile
+ *
+ * \param[OUT] pProfile  	Profile pointer
+ */
+void FlashGetProfile(FlashProfile_t *pProfile);
+
+/*!
+ * \brief Self-benchmark: DWT cycles of a flash-resident loop under the profile (the current
+ * profile is restored)
+ *
+ * \param[IN] pProfile  	Profile pointer
+ * \retval           		Cycles of FLASH_BENCH_ITERATIONS iterations, 0 - profile is not accepted
+ */
+uint32_t FlashBenchmark(const FlashProfile_t *pProfile);
+
+/*!
+ * \brief Self-benchmark of all prefetch/cache combinations at the minimum wait states
+ *
+ * \param[OUT] pCycles  	Cycles of FLASH_BENCH_PROFILES profiles, index - Prefetch | ICache << 1 | DCache << 2
+ */
+void FlashBenchmarkAll(uint32_t *pCycles);
+
+/*!
+ * \brief Program data to the erased area (burst, FLASH_SUPPLY_RANGE parallelism)
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashProgramData(uint32_t Address, const uint32_t *pData, uint32_t Size);
+
+/*!
+ * \brief Write data to flash (skipped for the same data, without erase for 1 -> 0 changes only)
  *
  * \param[IN] Address  		Base address
  * \param[IN] pData  		Data pointer
@@ -145,7 +481,7 @@ FlashStatus_t FlashEraseSector(uint32_t Address);
 FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size);
 
 /*!
- * \brief Writes structe data at the specified address
+ * \brief Writes structe data at the specified address (skipped for the same data, without erase for 1 -> 0 changes only)
  *
  * \param[IN] Address  		Base address
  * \param[IN] pStruct  		Data structe pointer
@@ -153,6 +489,93 @@ FlashStatus_t FlashWriteData(uint32_t Address, uint32_t *pData, uint32_t Size);
  */
 FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct);
 
+/*!
+ * \brief Writes structe data to the next blank slot of the sector (skipped when the newest slot is the same),
+ * the sector is erased only when all slots are used
+ *
+ * \param[IN] Address  		Base address of the sector
+ * \param[IN] SectorSize  	Size of the sector
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSlotWrite(uint32_t Address, uint32_t SectorSize, FlashMapData_t *pStruct);
+
+/*!
+ * \brief Reads the newest valid structe from the slots of the sector
+ *
+ * \param[IN] Address  		Base address of the sector
+ * \param[IN] SectorSize  	Size of the sector
+ * \retval           		Data structe pointer into the flash, NULL - no valid slot
+ */
+const FlashMapData_t* FlashSlotRead(uint32_t Address, uint32_t SectorSize);
+
+/*!
+ * \brief Writes structe data to the slots of two sectors used in turn (skipped when the newest slot is the same).
+ * The slot goes after the newest copy, when its sector is full the other sector is erased and used:
+ * the newest copy is never erased, the sequence number continues over both sectors
+ *
+ * \param[IN] AddressA  		Base address of the first sector
+ * \param[IN] AddressB  		Base address of the second sector
+ * \param[IN] SectorSize  	Size of the sectors
+ * \param[IN] pStruct  		Data structe pointer
+ * \retval           		Status of the operation
+ */
+FlashStatus_t FlashSlotWritePair(uint32_t AddressA, uint32_t AddressB, uint32_t SectorSize, FlashMapData_t *pStruct);
+
+/*!
+ * \brief Reads the newest valid structe from the slots of two sectors
+ *
+ * \param[IN] AddressA  		Base address of the first sector
+ * \param[IN] AddressB  		Base address of the second sector
+ * \param[IN] SectorSize  	Size of the sectors
+ * \retval           		Data structe pointer into the flash, NULL - no valid slot
+ */
+const FlashMapData_t* FlashSlotReadPair(uint32_t AddressA, uint32_t AddressB, uint32_t SectorSize);
+
+/*!
+ * \brief Start of the asynchronous sector erase
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashEraseSectorAsync(uint32_t Address, FlashJobCallback_t Callback);
+
+/*!
+ * \brief Start of the asynchronous program of the erased area
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer (must stay valid until the end of the job)
+ * \param[IN] Size  		Data size
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashProgramAsync(uint32_t Address, const uint32_t *pData, uint32_t Size, FlashJobCallback_t Callback);
+
+/*!
+ * \brief Start of the asynchronous erase of all sectors of [Address, Address + Size) and program of the data
+ *
+ * \param[IN] Address  		Base address
+ * \param[IN] pData  		Data pointer (must stay valid until the end of the job)
+ * \param[IN] Size  		Data size
+ * \param[IN] Callback  		Callback of the end of the job (may be NULL, use FlashJobStatus)
+ * \retval           		Status of the start
+ */
+FlashStatus_t FlashWriteDataAsync(uint32_t Address, const uint32_t *pData, uint32_t Size, FlashJobCallback_t Callback);
+
+/*!
+ * \brief Status of the asynchronous job
+ *
+ * \retval           		FLASH_STATUS_BUSY - job is in progress, else result of the last job
+ */
+FlashStatus_t FlashJobStatus(void);
+
+/*!
+ * \brief Flash interrupt handler of the asynchronous jobs (call from FLASH_IRQHandler
+ * instead of HAL_FLASH_IRQHandler)
+ */
+void FlashIRQHandler(void);
+
 /*!
  * \brief Calculating the checksum (CRC32)
  * using the polynomial x^32 + x^26 + x^23 + x^22 + x^16 + x^12 + x^11 + x^10 + x^8 + x^7 + x^5 + x^4 + x^2 + x + 1
@@ -164,13 +587,57 @@ FlashStatus_t FlashWriteStructe(uint32_t Address, FlashMapData_t *pStruct);
  */
 uint32_t ComputeChecksum(uint32_t Crc, const void *pData, uint32_t Size);
 
+/*!
+ * \brief Start of the streaming checksum
+ *
+ * \param[IN] pCtx  		Context pointer
+ */
+void Crc32Init(Crc32Ctx_t *pCtx);
+
+/*!
+ * \brief Adding the next chunk to the streaming checksum
+ *
+ * \param[IN] pCtx  		Context pointer
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Data size
+ */
+void Crc32Update(Crc32Ctx_t *pCtx, const void *pData, uint32_t Size);
+
+/*!
+ * \brief End of the streaming checksum (same value as ComputeChecksum with CRC_INI_VAL)
+ *
+ * \param[IN] pCtx  		Context pointer
+ * \retval           		The value of the checksum
+ */
+uint32_t Crc32Final(const Crc32Ctx_t *pCtx);
+
+/*!
+ * \brief Checksum of the concatenation A + B from the checksums of A and B
+ * (both started with CRC_INI_VAL)
+ *
+ * \param[IN] CrcA  		Checksum of the first block
+ * \param[IN] CrcB  		Checksum of the second block
+ * \param[IN] SizeB  		Size of the second block
+ * \retval           		The value of the checksum
+ */
+uint32_t Crc32Combine(uint32_t CrcA, uint32_t CrcB, uint32_t SizeB);
+
+/*!
+ * \brief Check integrities data block with use checksum (checksum is the last 4 bytes of the block)
+ *
+ * \param[IN] pData  		Data pointer
+ * \param[IN] Size  		Size of the block with checksum
+ * \retval           		Status of the operation
+ */
+FlashStatus_t CheckIntegritiesData(const void *pData, uint32_t Size);
+
 /*!
  * \brief Check integrities structe with use checksum
  *
  * \param[IN] pStruct  		Data structe pointer
  * \retval           		Status of the operation
  */
-FlashStatus_t CheckIntegritiesStructe(FlashMapData_t *pStruct);
+FlashStatus_t CheckIntegritiesStructe(const FlashMapData_t *pStruct);
 
 #ifdef __cplusplus
 }
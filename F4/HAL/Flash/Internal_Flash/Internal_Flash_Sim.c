@@ -0,0 +1,507 @@
+/*!
+ * \file      Internal_Flash_Sim.c
+ *
+ * \brief     Simulated internal flash behind the HAL_FLASH calls (host build, FLASH_SIMULATION)
+ *
+ * \author    Anosov Anton
+ */
+
+/* ftruncate, MAP_FIXED_NOREPLACE: before any system header */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "Internal_Flash_Sim.h"
+
+#ifdef FLASH_SIMULATION
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*!
+ * Older C libraries have no MAP_FIXED_NOREPLACE: the address is a hint then,
+ * the mapping is checked against FLASH_BASE in FlashSimInit
+ */
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE			0
+#endif
+
+/*!
+ * Operation in progress of the interrupt API
+ */
+#define FLASHSIM_OP_NONE			0
+#define FLASHSIM_OP_PROGRAM			1
+#define FLASHSIM_OP_ERASE			2
+
+/*!
+ * Bytes programmed by one unit of the parallelism
+ */
+#define FLASHSIM_PROGRAM_UNIT		(1U << (FLASH_PROGRAM_PSIZE >> FLASH_CR_PSIZE_Pos))
+
+/*!
+ * Sector erase time (ms, datasheet typical values) by the voltage range: x8, x16, x32, x64 (VPP)
+ */
+static const uint32_t FlashSimErase16KMs[4]  = { 400,  300,  250, 230};
+static const uint32_t FlashSimErase64KMs[4]  = {1200,  700,  550, 490};
+static const uint32_t FlashSimErase128KMs[4] = {2000, 1300, 1000, 875};
+
+/*!
+ * Interrupt operation
+ */
+typedef struct FlashSimOp_s
+{
+	uint8_t Type;
+	uint32_t Address;
+	uint64_t Data;
+	uint32_t Bytes;
+	uint32_t Sector;
+	uint32_t NbSectors;
+	uint32_t VoltageRange;
+	uint64_t EndNs;
+}FlashSimOp_t;
+
+static uint8_t *pFlashMem;
+static uint32_t FlashMemSize;
+static int FlashFd = -1;
+static uint8_t IsLocked = 1;
+static uint64_t NowNs;
+static uint64_t BusyUntilNs;
+static FlashSimOp_t PendingOp;
+static FlashSimStats_t Stats;
+static uint32_t EraseCount[FLASHSIM_SECTOR_COUNT];
+static uint32_t CrcState = 0xFFFFFFFFU;
+
+/*!
+ * \brief Get start address and size of the sector
+ *
+ * \param[IN] Sector  		Sector number
+ * \param[OUT] pAddress  	Start address
+ * \param[OUT] pSize  		Size
+ * \retval           		1 - OK, 0 - sector is out of the flash
+ */
+static uint8_t FlashSimSectorGeometry(uint32_t Sector, uint32_t *pAddress, uint32_t *pSize)
+{
+	uint32_t Address = FLASH_BASE;
+	uint32_t Index = Sector;
+
+	if(Sector >= FLASHSIM_SECTOR_COUNT)
+		return 0;
+
+	if(Index >= 12)
+	{
+		Address = START_ADDRESS_BANK_2;
+		Index -= 12;
+	}
+
+	if(Index < 4)
+	{
+		*pAddress = Address + Index * 16 * 1024;
+		*pSize = 16 * 1024;
+	}
+	else if(Index == 4)
+	{
+		*pAddress = Address + 64 * 1024;
+		*pSize = 64 * 1024;
+	}
+	else
+	{
+		*pAddress = Address + (Index - 4) * 128 * 1024;
+		*pSize = 128 * 1024;
+	}
+
+	return (*pAddress - FLASH_BASE + *pSize <= FlashMemSize);
+}
+
+/*!
+ * \brief Erase time of the sector
+ *
+ * \param[IN] Size  		Sector size
+ * \param[IN] VoltageRange  FLASH_VOLTAGE_RANGE_x
+ * \retval           		Time (ns)
+ */
+static uint64_t FlashSimEraseNs(uint32_t Size, uint32_t VoltageRange)
+{
+	if(VoltageRange > 3)
+		VoltageRange = 3;
+
+	if(Size == 16 * 1024)
+		return FlashSimErase16KMs[VoltageRange] * 1000000ULL;
+
+	if(Size == 64 * 1024)
+		return FlashSimErase64KMs[VoltageRange] * 1000000ULL;
+
+	return FlashSimErase128KMs[VoltageRange] * 1000000ULL;
+}
+
+/*!
+ * \brief Occupies the flash for the operation
+ *
+ * \param[IN] Ns  			Time of the operation (ns)
+ * \retval           		End of the operation (ns)
+ */
+static uint64_t FlashSimBusy(uint64_t Ns)
+{
+	uint64_t Start = (BusyUntilNs > NowNs) ? BusyUntilNs : NowNs;
+
+	BusyUntilNs = Start + Ns;
+	Stats.BusyNs += Ns;
+
+	return BusyUntilNs;
+}
+
+/*!
+ * \brief Number of bytes of the program type
+ *
+ * \param[IN] TypeProgram  	FLASH_TYPEPROGRAM_x
+ * \retval           		Number of bytes, 0 - unknown type
+ */
+static uint32_t FlashSimProgramBytes(uint32_t TypeProgram)
+{
+	switch(TypeProgram)
+	{
+		case FLASH_TYPEPROGRAM_BYTE:		return 1;
+		case FLASH_TYPEPROGRAM_HALFWORD:	return 2;
+		case FLASH_TYPEPROGRAM_WORD:		return 4;
+		case FLASH_TYPEPROGRAM_DOUBLEWORD:	return 8;
+		default:							return 0;
+	}
+}
+
+/*!
+ * \brief Checks the program operation (the flash can only change bits from 1 to 0)
+ *
+ * \param[IN] Address  		Address
+ * \param[IN] Data  		Data
+ * \param[IN] Bytes  		Number of bytes
+ * \retval           		HAL_OK - operation is allowed
+ */
+static HAL_StatusTypeDef FlashSimCheckProgram(uint32_t Address, uint64_t Data, uint32_t Bytes)
+{
+	if(pFlashMem == NULL || IsLocked || Bytes == 0 || (Address % Bytes) != 0 ||
+	   Address < FLASH_BASE || Address - FLASH_BASE + Bytes > FlashMemSize)
+	{
+		Stats.ProgramErrors++;
+		return HAL_ERROR;
+	}
+
+	for(uint32_t i = 0; i < Bytes; i++)
+	{
+		uint8_t New = (uint8_t)(Data >> (8 * i));
+
+		if((pFlashMem[Address - FLASH_BASE + i] & New) != New)
+		{
+			Stats.ProgramErrors++;
+			return HAL_ERROR;
+		}
+	}
+
+	return HAL_OK;
+}
+
+/*!
+ * \brief Program of the checked data, returns the program time
+ *
+ * \param[IN] Address  		Address
+ * \param[IN] Data  		Data
+ * \param[IN] Bytes  		Number of bytes
+ * \retval           		Time (ns)
+ */
+static uint64_t FlashSimProgram(uint32_t Address, uint64_t Data, uint32_t Bytes)
+{
+	for(uint32_t i = 0; i < Bytes; i++)
+		pFlashMem[Address - FLASH_BASE + i] &= (uint8_t)(Data >> (8 * i));
+
+	Stats.Programs++;
+	Stats.ProgrammedBytes += Bytes;
+
+	return (uint64_t)FLASHSIM_PROGRAM_NS * Bytes / FLASHSIM_PROGRAM_UNIT;
+}
+
+/*!
+ * \brief Erase of the sector, returns the erase time
+ *
+ * \param[IN] Sector  		Sector number
+ * \param[IN] VoltageRange  FLASH_VOLTAGE_RANGE_x
+ * \retval           		Time (ns), 0 - sector is out of the flash
+ */
+static uint64_t FlashSimErase(uint32_t Sector, uint32_t VoltageRange)
+{
+	uint32_t Address, Size;
+
+	if(!FlashSimSectorGeometry(Sector, &Address, &Size))
+		return 0;
+
+	memset(&pFlashMem[Address - FLASH_BASE], 0xFF, Size);
+	EraseCount[Sector]++;
+	Stats.Erases++;
+
+	return FlashSimEraseNs(Size, VoltageRange);
+}
+
+uint8_t FlashSimInit(const char *pPath)
+{
+	struct stat FileStat;
+	void *pMap;
+
+	FlashSimDeInit();
+
+	FlashMemSize = FLASH_SIZE_KB * 1024;
+	FlashFd = open(pPath, O_RDWR | O_CREAT, 0644);
+	if(FlashFd < 0)
+		return 0;
+
+	if(fstat(FlashFd, &FileStat) != 0 ||
+	   ((uint32_t)FileStat.st_size < FlashMemSize && ftruncate(FlashFd, FlashMemSize) != 0))
+	{
+		close(FlashFd);
+		FlashFd = -1;
+		return 0;
+	}
+
+	pMap = mmap((void*)FLASH_BASE, FlashMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, FlashFd, 0);
+	if(pMap != (void*)FLASH_BASE)
+	{
+		if(pMap != MAP_FAILED)
+			munmap(pMap, FlashMemSize);
+		close(FlashFd);
+		FlashFd = -1;
+		return 0;
+	}
+
+	pFlashMem = pMap;
+
+	/* New or extended part of the file is erased flash */
+	if((uint32_t)FileStat.st_size < FlashMemSize)
+		memset(&pFlashMem[FileStat.st_size], 0xFF, FlashMemSize - FileStat.st_size);
+
+	IsLocked = 1;
+	NowNs = 0;
+	BusyUntilNs = 0;
+	PendingOp.Type = FLASHSIM_OP_NONE;
+	FlashSimResetStats();
+
+	return 1;
+}
+
+void FlashSimDeInit(void)
+{
+	if(pFlashMem != NULL)
+	{
+		msync(pFlashMem, FlashMemSize, MS_SYNC);
+		munmap(pFlashMem, FlashMemSize);
+		pFlashMem = NULL;
+	}
+
+	if(FlashFd >= 0)
+	{
+		close(FlashFd);
+		FlashFd = -1;
+	}
+
+	PendingOp.Type = FLASHSIM_OP_NONE;
+}
+
+void FlashSimAdvance(uint64_t Ns)
+{
+	uint64_t EndNs = NowNs + Ns;
+
+	/* The callbacks of FlashIRQHandler can start the next operation */
+	while(PendingOp.Type != FLASHSIM_OP_NONE && PendingOp.EndNs <= EndNs)
+	{
+		NowNs = PendingOp.EndNs;
+		FlashIRQHandler();
+	}
+
+	if(EndNs > NowNs)
+		NowNs = EndNs;
+}
+
+void FlashSimRunUntilIdle(void)
+{
+	while(PendingOp.Type != FLASHSIM_OP_NONE)
+		FlashSimAdvance(PendingOp.EndNs - NowNs);
+}
+
+uint64_t FlashSimGetTimeNs(void)
+{
+	return NowNs;
+}
+
+const FlashSimStats_t* FlashSimGetStats(void)
+{
+	return &Stats;
+}
+
+uint32_t FlashSimGetEraseCount(uint32_t Sector)
+{
+	return (Sector < FLASHSIM_SECTOR_COUNT) ? EraseCount[Sector] : 0;
+}
+
+void FlashSimResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+	memset(EraseCount, 0, sizeof(EraseCount));
+}
+
+/* CRC unit ------------------------------------------------------------------ */
+
+void FlashSimCrcReset(void)
+{
+	CrcState = 0xFFFFFFFFU;
+}
+
+void FlashSimCrcWrite(uint32_t Word)
+{
+	/* Whole word at once, bit 31 first, as the unit of the F4 (RM0090, CRC calculation unit) */
+	CrcState ^= Word;
+	for(uint8_t i = 0; i < 32; i++)
+		CrcState = (CrcState & 0x80000000U) ? ((CrcState << 1) ^ CRC32_HW_POLY) : (CrcState << 1);
+}
+
+uint32_t FlashSimCrcRead(void)
+{
+	return CrcState;
+}
+
+/* HAL_FLASH calls ---------------------------------------------------------- */
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	IsLocked = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	IsLocked = 1;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint32_t Bytes = FlashSimProgramBytes(TypeProgram);
+
+	/* The HAL process lock is held by the interrupt operation */
+	if(PendingOp.Type != FLASHSIM_OP_NONE)
+		return HAL_BUSY;
+
+	if(FlashSimCheckProgram(Address, Data, Bytes) != HAL_OK)
+		return HAL_ERROR;
+
+	/* Blocking call: the CPU waits for the end of the operation */
+	NowNs = FlashSimBusy(FlashSimProgram(Address, Data, Bytes));
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+	uint64_t Ns;
+
+	*SectorError = 0xFFFFFFFFU;
+
+	if(PendingOp.Type != FLASHSIM_OP_NONE)
+		return HAL_BUSY;
+
+	if(pFlashMem == NULL || IsLocked || pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS)
+		return HAL_ERROR;
+
+	for(uint32_t i = 0; i < pEraseInit->NbSectors; i++)
+	{
+		Ns = FlashSimErase(pEraseInit->Sector + i, pEraseInit->VoltageRange);
+		if(Ns == 0)
+		{
+			*SectorError = pEraseInit->Sector + i;
+			return HAL_ERROR;
+		}
+
+		NowNs = FlashSimBusy(Ns);
+	}
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint32_t Bytes = FlashSimProgramBytes(TypeProgram);
+
+	if(PendingOp.Type != FLASHSIM_OP_NONE)
+		return HAL_BUSY;
+
+	if(FlashSimCheckProgram(Address, Data, Bytes) != HAL_OK)
+		return HAL_ERROR;
+
+	/* The content changes at the end of the operation */
+	PendingOp.Type = FLASHSIM_OP_PROGRAM;
+	PendingOp.Address = Address;
+	PendingOp.Data = Data;
+	PendingOp.Bytes = Bytes;
+	PendingOp.EndNs = FlashSimBusy((uint64_t)FLASHSIM_PROGRAM_NS * Bytes / FLASHSIM_PROGRAM_UNIT);
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit)
+{
+	uint32_t Address, Size;
+
+	if(PendingOp.Type != FLASHSIM_OP_NONE)
+		return HAL_BUSY;
+
+	if(pFlashMem == NULL || IsLocked || pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS ||
+	   pEraseInit->NbSectors == 0 || !FlashSimSectorGeometry(pEraseInit->Sector, &Address, &Size))
+		return HAL_ERROR;
+
+	PendingOp.Type = FLASHSIM_OP_ERASE;
+	PendingOp.Sector = pEraseInit->Sector;
+	PendingOp.NbSectors = pEraseInit->NbSectors;
+	PendingOp.VoltageRange = pEraseInit->VoltageRange;
+	PendingOp.EndNs = FlashSimBusy(FlashSimEraseNs(Size, pEraseInit->VoltageRange));
+
+	return HAL_OK;
+}
+
+void HAL_FLASH_IRQHandler(void)
+{
+	uint32_t Address, Size;
+	uint32_t Sector;
+
+	if(PendingOp.Type == FLASHSIM_OP_NONE || PendingOp.EndNs > NowNs)
+		return;
+
+	if(PendingOp.Type == FLASHSIM_OP_PROGRAM)
+	{
+		PendingOp.Type = FLASHSIM_OP_NONE;
+		(void)FlashSimProgram(PendingOp.Address, PendingOp.Data, PendingOp.Bytes);
+		HAL_FLASH_EndOfOperationCallback(PendingOp.Address);
+		return;
+	}
+
+	/* The same order of the callbacks as in the HAL: each sector, the last one as 0xFFFFFFFF */
+	Sector = PendingOp.Sector;
+	(void)FlashSimErase(Sector, PendingOp.VoltageRange);
+
+	if(--PendingOp.NbSectors == 0)
+	{
+		PendingOp.Type = FLASHSIM_OP_NONE;
+		HAL_FLASH_EndOfOperationCallback(0xFFFFFFFFU);
+		return;
+	}
+
+	HAL_FLASH_EndOfOperationCallback(Sector);
+
+	PendingOp.Sector++;
+	if(!FlashSimSectorGeometry(PendingOp.Sector, &Address, &Size))
+	{
+		PendingOp.Type = FLASHSIM_OP_NONE;
+		HAL_FLASH_OperationErrorCallback(PendingOp.Sector);
+		return;
+	}
+
+	PendingOp.EndNs = FlashSimBusy(FlashSimEraseNs(Size, PendingOp.VoltageRange));
+}
+
+#endif /* FLASH_SIMULATION */
@@ -0,0 +1,135 @@
+/*!
+ * \file      Internal_Flash_Sim.h
+ *
+ * \brief     Simulated internal flash behind the HAL_FLASH calls (host build, FLASH_SIMULATION)
+ *
+ * \author    Anosov Anton
+ */
+
+#ifndef INTERNAL_FLASH_SIM_H_
+#define INTERNAL_FLASH_SIM_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include "Internal_Flash.h"
+
+/*!
+ * Program time of one unit of the parallelism (ns, datasheet typical value)
+ */
+#define FLASHSIM_PROGRAM_NS					16000
+
+/*!
+ * Number of the sectors with the erase counters
+ */
+#define FLASHSIM_SECTOR_COUNT				24
+
+/*!
+ * Statistics of the flash
+ */
+typedef struct FlashSimStats_s
+{
+	/*!
+	 * Successful program operations
+	 */
+	uint32_t Programs;
+
+	/*!
+	 * Programmed bytes
+	 */
+	uint64_t ProgrammedBytes;
+
+	/*!
+	 * Rejected program operations (locked flash, alignment, 0 -> 1 bits)
+	 */
+	uint32_t ProgramErrors;
+
+	/*!
+	 * Erased sectors
+	 */
+	uint32_t Erases;
+
+	/*!
+	 * Time the flash was busy (ns)
+	 */
+	uint64_t BusyNs;
+
+}FlashSimStats_t;
+
+/*!
+ * \brief Maps the flash image file at FLASH_BASE (a new file is filled with 0xFF)
+ *
+ * \param[IN] pPath  		Path of the image file
+ * \retval           		1 - OK, 0 - file or mapping error
+ */
+uint8_t FlashSimInit(const char *pPath);
+
+/*!
+ * \brief Unmaps the flash image (the content stays in the file)
+ */
+void FlashSimDeInit(void);
+
+/*!
+ * \brief Runs the flash for the specified time, finished interrupt operations call FlashIRQHandler
+ *
+ * \param[IN] Ns  			Time (ns)
+ */
+void FlashSimAdvance(uint64_t Ns);
+
+/*!
+ * \brief Runs the flash until the interrupt operations are finished
+ */
+void FlashSimRunUntilIdle(void);
+
+/*!
+ * \brief Get time of the simulation (blocking operations advance it at once)
+ *
+ * \retval           		Time (ns)
+ */
+uint64_t FlashSimGetTimeNs(void);
+
+/*!
+ * \brief Get statistics of the flash
+ *
+ * \retval           		Pointer to the FlashSimStats_t
+ */
+const FlashSimStats_t* FlashSimGetStats(void);
+
+/*!
+ * \brief Get number of the erases of the sector
+ *
+ * \param[IN] Sector  		Sector number (0 - 23)
+ * \retval           		Number of the erases
+ */
+uint32_t FlashSimGetEraseCount(uint32_t Sector);
+
+/*!
+ * \brief Reset of the statistics and erase counters
+ */
+void FlashSimResetStats(void);
+
+/*!
+ * \brief Reset of the CRC unit model (CRC_CR_RESET: state 0xFFFFFFFF)
+ */
+void FlashSimCrcReset(void);
+
+/*!
+ * \brief Write to the data register of the CRC unit model (CRC32_HW_POLY, MSB first, no reflection)
+ *
+ * \param[IN] Word  		Data word
+ */
+void FlashSimCrcWrite(uint32_t Word);
+
+/*!
+ * \brief Read of the data register of the CRC unit model
+ *
+ * \retval           		State of the unit
+ */
+uint32_t FlashSimCrcRead(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* INTERNAL_FLASH_SIM_H_ */
@@ -0,0 +1,84 @@
+/*!
+ * \file      Internal_Flash_Sim_Test.c
+ *
+ * \brief     Checks of the flash simulator: erase before write, timing, wear counters and the file
+ *            behind the flash (host build, FLASH_SIM_TEST)
+ *
+ * Build:     gcc -O2 -DFLASH_SIMULATION -DFLASH_SIM_TEST -I../../Host -I. Internal_Flash_Sim_Test.c
+ *            Internal_Flash.c Internal_Flash_Sim.c ../../Host/Host_Core.c -o flash_sim_test
+ *
+ * \author    Anosov Anton
+ */
+
+#ifdef FLASH_SIM_TEST
+
+#include "Internal_Flash_Sim.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_FILE					"flash_sim_test.bin"
+#define TEST_ADDRESS				0x08020000		/* Sector 5, 128 KB */
+#define TEST_WORDS					256
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+static uint32_t Errors;
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(FlashSimGetTimeNs() / 1000000ULL);
+}
+
+int main(void)
+{
+	static uint32_t Data[TEST_WORDS];
+	uint64_t Ns;
+
+	for(uint32_t i = 0; i < TEST_WORDS; i++)
+		Data[i] = i * 0x01010101U;
+
+	unlink(TEST_FILE);
+	if(!FlashSimInit(TEST_FILE))
+	{
+		printf("FAIL: flash is not mapped at 0x%08lX\n", (unsigned long)FLASH_BASE);
+		return 1;
+	}
+
+	/* New file is erased flash */
+	TEST_CHECK(FlashReadData(TEST_ADDRESS) == 0xFFFFFFFFU);
+
+	/* Erase takes the datasheet time of the 128 KB sector and counts the wear */
+	Ns = FlashSimGetTimeNs();
+	TEST_CHECK(FlashEraseRange(TEST_ADDRESS, sizeof(Data)) == FLASH_STATUS_OK);
+	TEST_CHECK(FlashSimGetTimeNs() - Ns >= 500000000ULL);
+	TEST_CHECK(FlashSimGetEraseCount(5) == 1);
+	TEST_CHECK(FlashSimGetEraseCount(4) == 0 && FlashSimGetEraseCount(6) == 0);
+
+	TEST_CHECK(FlashProgramData(TEST_ADDRESS, Data, sizeof(Data)) == FLASH_STATUS_OK);
+	TEST_CHECK(memcmp((const void*)TEST_ADDRESS, Data, sizeof(Data)) == 0);
+	TEST_CHECK(FlashSimGetStats()->ProgrammedBytes == sizeof(Data));
+
+	/* Bits go only from 1 to 0 without an erase */
+	HAL_FLASH_Unlock();
+	TEST_CHECK(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, TEST_ADDRESS + 4, 0xFFFFFFFFU) == HAL_ERROR);
+	TEST_CHECK(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, TEST_ADDRESS + 4, 0) == HAL_OK);
+	TEST_CHECK(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, TEST_ADDRESS + 2, 0) == HAL_ERROR);
+	HAL_FLASH_Lock();
+	TEST_CHECK(FlashSimGetStats()->ProgramErrors == 2);
+	TEST_CHECK(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, TEST_ADDRESS + 8, 0) == HAL_ERROR);
+
+	/* Contents survive the restart */
+	FlashSimDeInit();
+	TEST_CHECK(FlashSimInit(TEST_FILE));
+	TEST_CHECK(FlashReadData(TEST_ADDRESS) == Data[0]);
+	TEST_CHECK(FlashReadData(TEST_ADDRESS + 4) == 0);
+	TEST_CHECK(FlashReadData(TEST_ADDRESS + 8) == Data[2]);
+	FlashSimDeInit();
+	unlink(TEST_FILE);
+
+	printf("Flash simulator: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* FLASH_SIM_TEST */
@@ -8,12 +8,22 @@
 
 #include "Wrap_Flash.h"
 
+// Sectors 8 and above are absent on the 512 KB parts
+#if ((FLASH_STORAGE_INT_ADDRESS_A + FLASH_STORAGE_INT_SIZE) > END_ADDRESS_BANK_1) || \
+	((FLASH_STORAGE_INT_ADDRESS_B + FLASH_STORAGE_INT_SIZE) > END_ADDRESS_BANK_1)
+#error "FLASH_STORAGE_INT_ADDRESS_A/B must be in the sectors 0 - 7"
+#endif
+
+#if (FLASH_STORAGE_INT_ADDRESS_A < FLASH_STORAGE_INT_ADDRESS_B + FLASH_STORAGE_INT_SIZE) && \
+	(FLASH_STORAGE_INT_ADDRESS_B < FLASH_STORAGE_INT_ADDRESS_A + FLASH_STORAGE_INT_SIZE)
+#error "FLASH_STORAGE_INT_ADDRESS_A/B must be two different sectors"
+#endif
+
 #define FLASH_EXT_BUFF_SIZE			256
-#define FLASH_STORAGE_INT_ADDRESS	0x08060000
 
 uint8_t FlashExtBuff[FLASH_EXT_BUFF_SIZE];
 FlashMapData_t GlobalStorage;
-static FlashStorage_t StorageDescr = {&GlobalStorage, 1, 1};
+static FlashStorage_t StorageDescr = {&GlobalStorage, 1, 1, 0, 0, 0, 0};
 
 //#define USE_EXTERNAL_FLASH
 
@@ -46,16 +56,29 @@ static uint8_t WriteToExternalStorage(const FlashMapData_t *pStorage)
  */
 static uint8_t WriteToInternalStorage(const FlashMapData_t *pStorage)
 {
-	FlashMapData_t *pTmpStorage;
+	const FlashMapData_t *pTmpStorage;
 
-	FlashWriteStructe(FLASH_STORAGE_INT_ADDRESS, pStorage);
-	pTmpStorage = (FlashMapData_t*) FlashReadStructe(FLASH_STORAGE_INT_ADDRESS);
-	if (CheckIntegritiesStructe(pTmpStorage) != FLASH_STATUS_ERROR_CRC)
+	FlashSlotWritePair(FLASH_STORAGE_INT_ADDRESS_A, FLASH_STORAGE_INT_ADDRESS_B, FLASH_STORAGE_INT_SIZE, (FlashMapData_t*) pStorage);
+	pTmpStorage = FlashSlotReadPair(FLASH_STORAGE_INT_ADDRESS_A, FLASH_STORAGE_INT_ADDRESS_B, FLASH_STORAGE_INT_SIZE);
+	if (pTmpStorage != NULL && pTmpStorage->Checksum == pStorage->Checksum)
 		return true;
 	else
 		return false;
 }
 
+/*!
+ * @brief Checking the sector of the internal storage on this part
+ *
+ * @param Address  			Start address of the sector
+ * @return true - sector exists and holds the whole copy
+ */
+static bool IsStorageSectorValid(uint32_t Address)
+{
+	FlashSectorInfo_t Info;
+
+	return FlashGetSector(Address, &Info) == FLASH_STATUS_OK && Info.Start == Address && Info.Size >= FLASH_STORAGE_INT_SIZE;
+}
+
 /*!
  * @brief Function that checks the storage for empty space
  *
@@ -121,11 +144,24 @@ static uint8_t CheckExternalFlash(void)
 FlashStorageErr_t FlashStorageInit(void)
 {
 	FlashStorageErr_t ErrCode = FLASH_STORAGE_OK;
-	FlashMapData_t* ExtStorage = NULL;
-	FlashMapData_t* IntStorage = NULL;
+	const FlashMapData_t* ExtStorage = NULL;
+	const FlashMapData_t* IntStorage = NULL;
 	uint8_t IsStorageIntOk = 0, IsStorageExtOk = 0;
 
-	IntStorage = (FlashMapData_t*) FlashReadStructe(FLASH_STORAGE_INT_ADDRESS);
+	if (!IsStorageSectorValid(FLASH_STORAGE_INT_ADDRESS_A) || !IsStorageSectorValid(FLASH_STORAGE_INT_ADDRESS_B))
+	{
+		// ERROR! The sectors of the internal storage are not on this part, nothing is written there
+		StorageDescr.IsIntStorageOk = 0;
+		return FLASH_STORAGE_UNEXP_BHVR_ERR;
+	}
+
+	// The newest valid copy of both sectors
+	IntStorage = FlashSlotReadPair(FLASH_STORAGE_INT_ADDRESS_A, FLASH_STORAGE_INT_ADDRESS_B, FLASH_STORAGE_INT_SIZE);
+	if (IntStorage == NULL)
+	{
+		// No slot is written yet, the structure of the old format is at the start of the first sector
+		IntStorage = FlashReadStructe(FLASH_STORAGE_INT_ADDRESS_A);
+	}
 
 #ifdef USE_EXTERNAL_FLASH
 	if(CheckExternalFlash() != true)
@@ -138,7 +174,7 @@ FlashStorageErr_t FlashStorageInit(void)
 	{
 		// IMPLEMENTATION
 		// Reading structure from external Flash to FlashExtBuff
-		ExtStorage = (FlashMapData_t*) FlashExtBuff;
+		ExtStorage = (const FlashMapData_t*) FlashExtBuff;
 	}
 #endif
 
@@ -333,18 +369,18 @@ FlashStorageErr_t FlashStorageInit(void)
 }
 
 /*!
- * @brief Function that writes the structure of the global store into memory
+ * @brief Function that writes the structure of the global store into the storages
  *
  * @return FlashStorageErr_t - status operation
  */
-FlashStorageErr_t GlobalStorageWrite(void)
+static FlashStorageErr_t GlobalStorageCommit(void)
 {
 	FlashStorageErr_t ErrCode = FLASH_STORAGE_OK;
 	uint32_t crc = CRC_INI_VAL;
 
 	StorageDescr.pGlobalStorage->Checksum = ComputeChecksum(crc, (void*) StorageDescr.pGlobalStorage, FLASH_STRUCT_USER_SIZE - 4);
 
-	if (WriteToInternalStorage(StorageDescr.pGlobalStorage) != 1)
+	if (StorageDescr.IsIntStorageOk != 1 || WriteToInternalStorage(StorageDescr.pGlobalStorage) != 1)
 	{
 		ErrCode |= FLASH_STORAGE_INT_STRG_WRITE_ERR;
 	}
@@ -364,6 +400,110 @@ FlashStorageErr_t GlobalStorageWrite(void)
 	return ErrCode;
 }
 
+/*!
+ * @brief Write of the changed global storage. The flag is cleared before the commit, so a change
+ * made during the commit stays pending; on error it is restored and the retry is counted
+ *
+ * @return FlashStorageErr_t - status operation
+ */
+static FlashStorageErr_t GlobalStorageFlush(void)
+{
+	FlashStorageErr_t ErrCode;
+
+	StorageDescr.IsDirty = 0;
+	ErrCode = GlobalStorageCommit();
+
+	if(ErrCode & FLASH_STORAGE_INT_STRG_WRITE_ERR)
+	{
+		// Without the internal storage a retry cannot succeed
+		if(StorageDescr.IsIntStorageOk != 1)
+			StorageDescr.Retries = FLASH_STORAGE_MAX_RETRIES;
+		else if(StorageDescr.Retries < FLASH_STORAGE_MAX_RETRIES)
+			StorageDescr.Retries++;
+
+		StorageDescr.FirstChangeTick = StorageDescr.LastChangeTick = HAL_GetTick();
+		StorageDescr.IsDirty = 1;
+		return ErrCode;
+	}
+
+	StorageDescr.Retries = 0;
+	return ErrCode;
+}
+
+/*!
+ * @brief Function that writes the structure of the global store into memory
+ * (with FLASH_STORAGE_DEFERRED_WRITE it only marks the storage as changed)
+ *
+ * @return FlashStorageErr_t - status operation
+ */
+FlashStorageErr_t GlobalStorageWrite(void)
+{
+#if (FLASH_STORAGE_DEFERRED_WRITE == 1)
+	uint32_t Tick = HAL_GetTick();
+
+	// Changes are coalesced, the deadline runs from the first one
+	if(StorageDescr.IsDirty != 1)
+	{
+		StorageDescr.FirstChangeTick = Tick;
+		StorageDescr.IsDirty = 1;
+	}
+	StorageDescr.LastChangeTick = Tick;
+
+	return FLASH_STORAGE_OK;
+#else
+	return GlobalStorageCommit();
+#endif
+}
+
+/*!
+ * @brief Deferred write of the changed global storage after the quiet period or the deadline
+ * (call from the main loop, in the same context as GlobalStorageWrite)
+ *
+ * @return FlashStorageErr_t - status operation of the write, FLASH_STORAGE_OK - nothing to write,
+ * FLASH_STORAGE_INT_STRG_WRITE_ERR - the write failed FLASH_STORAGE_MAX_RETRIES times and is not retried
+ */
+FlashStorageErr_t GlobalStorageProcess(void)
+{
+	uint32_t Tick = HAL_GetTick();
+
+	if(StorageDescr.IsDirty != 1)
+		return FLASH_STORAGE_OK;
+
+	if(StorageDescr.Retries >= FLASH_STORAGE_MAX_RETRIES)
+		return FLASH_STORAGE_INT_STRG_WRITE_ERR;
+
+	// The quiet period is doubled on each failure, the deadline limits it
+	if((Tick - StorageDescr.LastChangeTick) < ((uint32_t)FLASH_STORAGE_QUIET_MS << StorageDescr.Retries) &&
+	   (Tick - StorageDescr.FirstChangeTick) < FLASH_STORAGE_DEADLINE_MS)
+		return FLASH_STORAGE_OK;
+
+	return GlobalStorageFlush();
+}
+
+/*!
+ * @brief Immediate write of the changed global storage (before shutdown or reset),
+ * it is tried also after GlobalStorageProcess stopped the retries
+ *
+ * @return FlashStorageErr_t - status operation, FLASH_STORAGE_OK - nothing to write
+ */
+FlashStorageErr_t GlobalStorageSync(void)
+{
+	if(StorageDescr.IsDirty != 1)
+		return FLASH_STORAGE_OK;
+
+	return GlobalStorageFlush();
+}
+
+/*!
+ * @brief Checking for the changes that are not written yet
+ *
+ * @return true - global storage is changed and is not written yet
+ */
+bool GlobalStorageIsDirty(void)
+{
+	return (StorageDescr.IsDirty == 1);
+}
+
 /*!
  * @brief Reading the global storage
  *
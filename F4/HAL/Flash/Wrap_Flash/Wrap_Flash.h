@@ -48,6 +48,26 @@ typedef struct FlashStorage_s
 	 */
 	uint8_t IsIntStorageOk:1;
 
+	/*!
+	 * Global storage is changed and is not written yet (deferred write)
+	 */
+	volatile uint8_t IsDirty;
+
+	/*!
+	 * Failed writes since the last successful one
+	 */
+	uint8_t Retries;
+
+	/*!
+	 * Tick of the first change after the last write
+	 */
+	uint32_t FirstChangeTick;
+
+	/*!
+	 * Tick of the last change
+	 */
+	uint32_t LastChangeTick;
+
 }FlashStorage_t;
 
 /*!
@@ -59,11 +79,36 @@ FlashStorageErr_t FlashStorageInit(void);
 
 /*!
  * @brief Function that writes the structure of the global store into memory
+ * (with FLASH_STORAGE_DEFERRED_WRITE it only marks the storage as changed)
  *
  * @return FlashStorageErr_t - status operation
  */
 FlashStorageErr_t GlobalStorageWrite(void);
 
+/*!
+ * @brief Deferred write of the changed global storage after the quiet period or the deadline
+ * (call from the main loop, in the same context as GlobalStorageWrite)
+ *
+ * @return FlashStorageErr_t - status operation of the write, FLASH_STORAGE_OK - nothing to write,
+ * FLASH_STORAGE_INT_STRG_WRITE_ERR - the write failed FLASH_STORAGE_MAX_RETRIES times and is not retried
+ */
+FlashStorageErr_t GlobalStorageProcess(void);
+
+/*!
+ * @brief Immediate write of the changed global storage (before shutdown or reset),
+ * it is tried also after GlobalStorageProcess stopped the retries
+ *
+ * @return FlashStorageErr_t - status operation, FLASH_STORAGE_OK - nothing to write
+ */
+FlashStorageErr_t GlobalStorageSync(void);
+
+/*!
+ * @brief Checking for the changes that are not written yet
+ *
+ * @return true - global storage is changed and is not written yet
+ */
+bool GlobalStorageIsDirty(void);
+
 /*!
  * @brief Reading the global storage
  *
@@ -17,6 +17,47 @@
 
 /* IMPLEMENTATION ------------------------------------------------------------------*/
 
+/*!
+ * Two sectors of the internal storage used in turn (sectors 7 and 6 by default), the newest copy is never erased.
+ * Both exist on the 512 KB parts (no sector 8); the sectors 0 - 4 hold the code, the Fw_Update slots
+ * must stay out of both sectors
+ */
+#ifndef FLASH_STORAGE_INT_ADDRESS_A
+#define FLASH_STORAGE_INT_ADDRESS_A			0x08060000
+#endif
+
+#ifndef FLASH_STORAGE_INT_ADDRESS_B
+#define FLASH_STORAGE_INT_ADDRESS_B			0x08040000
+#endif
+
+#ifndef FLASH_STORAGE_INT_SIZE
+#define FLASH_STORAGE_INT_SIZE				(128 * 1024)
+#endif
+
+/*!
+ * Deferred write (1 - enabled): GlobalStorageWrite only marks the storage as changed, GlobalStorageProcess
+ * writes it once after the quiet period since the last change or the deadline since the first one
+ */
+#ifndef FLASH_STORAGE_DEFERRED_WRITE
+#define FLASH_STORAGE_DEFERRED_WRITE		0
+#endif
+
+#ifndef FLASH_STORAGE_QUIET_MS
+#define FLASH_STORAGE_QUIET_MS				2000
+#endif
+
+#ifndef FLASH_STORAGE_DEADLINE_MS
+#define FLASH_STORAGE_DEADLINE_MS			30000
+#endif
+
+/*!
+ * Failed deferred writes are retried after the quiet period doubled on each failure (up to the deadline),
+ * GlobalStorageProcess stops after this number of failures and reports FLASH_STORAGE_INT_STRG_WRITE_ERR
+ */
+#ifndef FLASH_STORAGE_MAX_RETRIES
+#define FLASH_STORAGE_MAX_RETRIES			5
+#endif
+
 
 #ifdef __cplusplus
 }
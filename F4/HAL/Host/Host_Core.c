@@ -0,0 +1,116 @@
+/*!
+ * @file      Host_Core.c
+ *
+ * @brief     Register objects, core and board functions of the host build (everything outside of
+ *            CAN_Sim and Internal_Flash_Sim the modules reach for), linked into every host program
+ *
+ * @author    Anosov Anton
+ */
+
+#include "stm32f4xx.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*!
+ * Frequency of the core reported by HAL_RCC_GetHCLKFreq
+ */
+#ifndef HOST_HCLK_HZ
+#define HOST_HCLK_HZ						168000000UL
+#endif
+
+static SCB_Type HostScb;
+static DWT_Type HostDwt;
+static CoreDebug_Type HostCoreDebug;
+static CRC_TypeDef HostCrc;
+static FLASH_TypeDef HostFlash;
+static CAN_TypeDef HostCan1, HostCan2;
+static GPIO_TypeDef HostGpioA, HostGpioB;
+
+SCB_Type *SCB = &HostScb;
+DWT_Type *DWT = &HostDwt;
+CoreDebug_Type *CoreDebug = &HostCoreDebug;
+CRC_TypeDef *CRC = &HostCrc;
+FLASH_TypeDef *FLASH = &HostFlash;
+CAN_TypeDef *CAN1 = &HostCan1, *CAN2 = &HostCan2;
+GPIO_TypeDef *GPIOA = &HostGpioA, *GPIOB = &HostGpioB;
+
+static uint32_t Primask;
+
+void __disable_irq(void)
+{
+	Primask = 1;
+}
+
+void __enable_irq(void)
+{
+	Primask = 0;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return Primask;
+}
+
+void __set_PRIMASK(uint32_t priMask)
+{
+	Primask = priMask & 1;
+}
+
+/*!
+ * @brief The modules reset the MCU only on fatal errors, the test must fail
+ */
+void NVIC_SystemReset(void)
+{
+	fprintf(stderr, "NVIC_SystemReset\n");
+	abort();
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+	(void)GPIOx;
+	(void)GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+	(void)GPIOx;
+	(void)GPIO_Pin;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if(PinState == GPIO_PIN_SET)
+		GPIOx->ODR |= GPIO_Pin;
+	else
+		GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+	return HOST_HCLK_HZ;
+}
+
+/*!
+ * @brief Delays take no time on the host (HAL_GetTick comes from CAN_Sim or from the program)
+ */
+__weak void HAL_Delay(uint32_t Delay)
+{
+	(void)Delay;
+}
@@ -0,0 +1,100 @@
+#!/bin/sh
+#
+# Host build of the simulators, tests and benchmarks (Linux, gcc)
+#
+# Usage:     F4/HAL/Host/build.sh [--bench]
+#            builds into $HOST_BUILD_DIR (default F4/HAL/_host_build), runs the tests,
+#            --bench also runs the benchmarks; exit code is nonzero if a build or a test fails
+#
+# Author:    Anosov Anton
+#
+
+set -e
+
+HOST=$(cd "$(dirname "$0")" && pwd)
+HAL=$(dirname "$HOST")
+OUT=${HOST_BUILD_DIR:-$HAL/_host_build}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O2 -std=gnu11 -Wall -Wextra"}
+
+FLASH=$HAL/Flash/Internal_Flash
+FW_UPDATE=$HAL/Flash/Fw_Update
+
+mkdir -p "$OUT"
+
+# build <output> <flags and sources...>
+build()
+{
+	Name=$1
+	shift
+	echo "CC  $Name"
+	$CC $CFLAGS -I"$HOST" "$@" "$HOST/Host_Core.c" -o "$OUT/$Name"
+}
+
+# run <program> [arguments...], from the output directory (the tests create their files there)
+run()
+{
+	echo "RUN $*"
+	(cd "$OUT" && "./$@")
+}
+
+# CAN --------------------------------------------------------------------------
+build can_signal_bench -DCAN_SIGNAL_BENCH "$HAL/CAN/CAN_Signal_Bench.c"
+
+build can_batch_bench -DCAN_SIMULATION -DCAN_BATCH_BENCH -I"$HAL/CAN" \
+	"$HAL/CAN/CAN_Batch_Bench.c" "$HAL/CAN/CAN.c" "$HAL/CAN/CAN_Sim.c"
+
+build can_sim_test -DCAN_SIMULATION -DCAN_SIM_TEST -I"$HAL/CAN" \
+	"$HAL/CAN/CAN_Sim_Test.c" "$HAL/CAN/CAN.c" "$HAL/CAN/CAN_Sim.c"
+
+# J1939 ------------------------------------------------------------------------
+build j1939_sim_test -DCAN_SIMULATION -DJ1939_SIM_TEST -I"$HAL/CAN" -I"$HAL/J1939" \
+	"$HAL/J1939/J1939_Sim_Test.c" "$HAL/J1939/J1939.c" "$HAL/CAN/CAN.c" "$HAL/CAN/CAN_Sim.c"
+
+# SLCAN ------------------------------------------------------------------------
+build slcan_pty_test -DCAN_SIMULATION -DSLCAN_PTY_TEST -I"$HAL/CAN" -I"$HAL/Fifo" -I"$HAL/DebugPrint" -I"$HAL/Slcan" \
+	"$HAL/Slcan/Slcan_Pty_Test.c" "$HAL/Slcan/Slcan.c" "$HAL/Fifo/Fifo.c" "$HAL/CAN/CAN.c" "$HAL/CAN/CAN_Sim.c"
+
+# CAN log ----------------------------------------------------------------------
+# The decoder links without the W25Qxx driver: the flash functions of the logger are dropped by --gc-sections
+build canlog_replay -DCAN_SIMULATION -DCANLOG_REPLAY -DW25Q16 -I"$HAL/CAN" -I"$HAL/CanLog" \
+	-I"$HAL/Flash/External_Flash/W25Qxx" -ffunction-sections -Wl,--gc-sections \
+	"$HAL/CanLog/CanLog_Replay.c" "$HAL/CanLog/CanLog.c" "$HAL/CAN/CAN.c" "$HAL/CAN/CAN_Sim.c"
+
+# Internal flash ---------------------------------------------------------------
+build flash_sim_test -DFLASH_SIMULATION -DFLASH_SIM_TEST -I"$FLASH" \
+	"$FLASH/Internal_Flash_Sim_Test.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+
+build flash_job_test -DFLASH_SIMULATION -DFLASH_JOB_TEST -I"$FLASH" \
+	"$FLASH/Flash_Job_Test.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+build flash_job_test_x64 -DFLASH_SIMULATION -DFLASH_JOB_TEST -DFLASH_SUPPLY_RANGE=FLASH_VOLTAGE_RANGE_4 -I"$FLASH" \
+	"$FLASH/Flash_Job_Test.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+
+for Slice in 1 4 8; do
+	build crc32_bench_$Slice -DFLASH_SIMULATION -DCRC32_BENCH -DCRC32_SLICE_BY=$Slice -I"$FLASH" \
+		"$FLASH/Crc32_Bench.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+done
+build crc32_bench_hw -DFLASH_SIMULATION -DCRC32_BENCH -DCRC32_USE_HW=1 -I"$FLASH" \
+	"$FLASH/Crc32_Bench.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+
+# Firmware update --------------------------------------------------------------
+build fw_update_sim_test -DFLASH_SIMULATION -DFW_UPDATE_SIM_TEST -I"$FLASH" -I"$FW_UPDATE" -I"$HAL/Flash/Wrap_Flash" \
+	"$FW_UPDATE/Fw_Update_Sim_Test.c" "$FW_UPDATE/Fw_Update.c" "$FLASH/Internal_Flash.c" "$FLASH/Internal_Flash_Sim.c"
+
+# Tests ------------------------------------------------------------------------
+run can_sim_test
+run j1939_sim_test
+run slcan_pty_test
+run flash_sim_test
+run flash_job_test
+run flash_job_test_x64
+run fw_update_sim_test
+for Crc in 1 4 8 hw; do
+	run crc32_bench_$Crc
+done
+
+# Benchmarks -------------------------------------------------------------------
+if [ "$1" = "--bench" ]; then
+	run can_signal_bench
+	run can_batch_bench
+fi
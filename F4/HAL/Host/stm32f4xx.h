@@ -0,0 +1,501 @@
+/*!
+ * @file      stm32f4xx.h
+ *
+ * @brief     Host stand-in of the STM32F4 HAL and CMSIS headers: the types, registers and constants
+ *            used by the modules, so they build on Linux against CAN_Sim and Internal_Flash_Sim
+ *            (host build only, never on the target)
+ *
+ * The register objects and the core functions are in Host_Core.c, the bxCAN and FLASH HAL calls
+ * in the simulators. Values of the constants follow the ST headers where the modules depend on them.
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef HOST_STM32F4XX_H_
+#define HOST_STM32F4XX_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Core ----------------------------------------------------------------------*/
+#define __IO								volatile
+#define __weak								__attribute__((weak))
+#define ENABLE								1
+#define DISABLE								0
+#define assert_param(expr)					((void)0)
+
+typedef enum
+{
+	HAL_OK									= 0x00,
+	HAL_ERROR								= 0x01,
+	HAL_BUSY								= 0x02,
+	HAL_TIMEOUT								= 0x03
+}HAL_StatusTypeDef;
+
+typedef enum
+{
+	CAN1_TX_IRQn							= 19,
+	CAN1_RX0_IRQn							= 20,
+	CAN1_SCE_IRQn							= 22,
+	USART1_IRQn								= 37,
+	CAN2_TX_IRQn							= 63,
+	CAN2_RX0_IRQn							= 64,
+	CAN2_SCE_IRQn							= 66,
+	FLASH_IRQn								= 4
+}IRQn_Type;
+
+/*!
+ * Interrupt mask of the host build: __disable_irq/__set_PRIMASK only track the state,
+ * the simulators call the "interrupt" callbacks from the thread of the program
+ */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void NVIC_SystemReset(void);
+
+static inline uint32_t __RBIT(uint32_t Value)
+{
+	uint32_t Result = 0;
+
+	for(uint8_t i = 0; i < 32; i++)
+	{
+		Result = (Result << 1) | (Value & 1);
+		Value >>= 1;
+	}
+	return Result;
+}
+
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __ISB(void) { __sync_synchronize(); }
+static inline void __DMB(void) { __sync_synchronize(); }
+static inline void __NOP(void) {}
+
+typedef struct
+{
+	__IO uint32_t VTOR;
+}SCB_Type;
+
+typedef struct
+{
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT;
+}DWT_Type;
+
+typedef struct
+{
+	__IO uint32_t DEMCR;
+}CoreDebug_Type;
+
+extern SCB_Type *SCB;
+extern DWT_Type *DWT;
+extern CoreDebug_Type *CoreDebug;
+
+#define CoreDebug_DEMCR_TRCENA_Msk			(1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk				(1UL << 0)
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+/* RCC -----------------------------------------------------------------------*/
+#define __HAL_RCC_GPIOA_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_CAN1_CLK_ENABLE()			((void)0)
+#define __HAL_RCC_CAN2_CLK_ENABLE()			((void)0)
+#define __HAL_RCC_CAN1_CLK_DISABLE()		((void)0)
+#define __HAL_RCC_CAN2_CLK_DISABLE()		((void)0)
+#define __HAL_RCC_CRC_CLK_ENABLE()			((void)0)
+
+uint32_t HAL_RCC_GetHCLKFreq(void);
+
+/* GPIO ----------------------------------------------------------------------*/
+typedef struct
+{
+	__IO uint32_t MODER;
+	__IO uint32_t IDR;
+	__IO uint32_t ODR;
+	__IO uint32_t BSRR;
+}GPIO_TypeDef;
+
+typedef struct
+{
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+}GPIO_InitTypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET							= 0,
+	GPIO_PIN_SET
+}GPIO_PinState;
+
+extern GPIO_TypeDef *GPIOA, *GPIOB;
+
+#define GPIO_PIN_0							0x0001U
+#define GPIO_PIN_5							0x0020U
+#define GPIO_PIN_6							0x0040U
+#define GPIO_PIN_11							0x0800U
+#define GPIO_PIN_12							0x1000U
+#define GPIO_MODE_AF_PP						0x00000002U
+#define GPIO_NOPULL							0x00000000U
+#define GPIO_SPEED_FREQ_VERY_HIGH			0x00000003U
+#define GPIO_AF9_CAN1						0x09U
+#define GPIO_AF9_CAN2						0x09U
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+/* CRC -----------------------------------------------------------------------*/
+typedef struct
+{
+	__IO uint32_t DR;
+	__IO uint32_t IDR;
+	__IO uint32_t CR;
+}CRC_TypeDef;
+
+extern CRC_TypeDef *CRC;
+
+#define CRC_CR_RESET						(1UL << 0)
+
+/* UART, SPI -----------------------------------------------------------------*/
+typedef struct
+{
+	void *Instance;
+}UART_HandleTypeDef;
+
+typedef struct
+{
+	void *Instance;
+}SPI_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+
+/* bxCAN ---------------------------------------------------------------------*/
+typedef struct
+{
+	__IO uint32_t TIR;
+	__IO uint32_t TDTR;
+	__IO uint32_t TDLR;
+	__IO uint32_t TDHR;
+}CAN_TxMailBox_TypeDef;
+
+typedef struct
+{
+	__IO uint32_t RIR;
+	__IO uint32_t RDTR;
+	__IO uint32_t RDLR;
+	__IO uint32_t RDHR;
+}CAN_FIFOMailBox_TypeDef;
+
+typedef struct
+{
+	__IO uint32_t MCR;
+	__IO uint32_t MSR;
+	__IO uint32_t TSR;
+	__IO uint32_t RF0R;
+	__IO uint32_t RF1R;
+	__IO uint32_t IER;
+	__IO uint32_t ESR;
+	__IO uint32_t BTR;
+	CAN_TxMailBox_TypeDef sTxMailBox[3];
+	CAN_FIFOMailBox_TypeDef sFIFOMailBox[2];
+}CAN_TypeDef;
+
+extern CAN_TypeDef *CAN1, *CAN2;
+
+typedef struct
+{
+	uint32_t Prescaler;
+	uint32_t Mode;
+	uint32_t SyncJumpWidth;
+	uint32_t TimeSeg1;
+	uint32_t TimeSeg2;
+	uint32_t TimeTriggeredMode;
+	uint32_t AutoBusOff;
+	uint32_t AutoWakeUp;
+	uint32_t AutoRetransmission;
+	uint32_t ReceiveFifoLocked;
+	uint32_t TransmitFifoPriority;
+}CAN_InitTypeDef;
+
+typedef enum
+{
+	HAL_CAN_STATE_RESET						= 0x00U,
+	HAL_CAN_STATE_READY						= 0x01U,
+	HAL_CAN_STATE_LISTENING					= 0x02U,
+	HAL_CAN_STATE_SLEEP_PENDING				= 0x03U,
+	HAL_CAN_STATE_SLEEP_ACTIVE				= 0x04U,
+	HAL_CAN_STATE_ERROR						= 0x05U
+}HAL_CAN_StateTypeDef;
+
+typedef struct __CAN_HandleTypeDef
+{
+	CAN_TypeDef *Instance;
+	CAN_InitTypeDef Init;
+	__IO HAL_CAN_StateTypeDef State;
+	__IO uint32_t ErrorCode;
+}CAN_HandleTypeDef;
+
+typedef struct
+{
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	uint32_t TransmitGlobalTime;
+}CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	uint32_t Timestamp;
+	uint32_t FilterMatchIndex;
+}CAN_RxHeaderTypeDef;
+
+typedef struct
+{
+	uint32_t FilterIdHigh;
+	uint32_t FilterIdLow;
+	uint32_t FilterMaskIdHigh;
+	uint32_t FilterMaskIdLow;
+	uint32_t FilterFIFOAssignment;
+	uint32_t FilterBank;
+	uint32_t FilterMode;
+	uint32_t FilterScale;
+	uint32_t FilterActivation;
+	uint32_t SlaveStartFilterBank;
+}CAN_FilterTypeDef;
+
+#define CAN_ID_STD							0x00000000U
+#define CAN_ID_EXT							0x00000004U
+#define CAN_RTR_DATA						0x00000000U
+#define CAN_RTR_REMOTE						0x00000002U
+#define CAN_RX_FIFO0						0x00000000U
+#define CAN_FILTERMODE_IDMASK				0x00000000U
+#define CAN_FILTERMODE_IDLIST				0x00000001U
+#define CAN_FILTERSCALE_16BIT				0x00000000U
+#define CAN_FILTERSCALE_32BIT				0x00000001U
+#define CAN_TX_MAILBOX0						0x00000001U
+#define CAN_TX_MAILBOX1						0x00000002U
+#define CAN_TX_MAILBOX2						0x00000004U
+
+#define CAN_IT_TX_MAILBOX_EMPTY				(1UL << 0)
+#define CAN_IT_RX_FIFO0_MSG_PENDING			(1UL << 1)
+#define CAN_IT_ERROR_WARNING				(1UL << 8)
+#define CAN_IT_ERROR_PASSIVE				(1UL << 9)
+#define CAN_IT_BUSOFF						(1UL << 10)
+#define CAN_IT_LAST_ERROR_CODE				(1UL << 11)
+#define CAN_IT_ERROR						(1UL << 15)
+
+#define HAL_CAN_ERROR_NONE					0x00000000U
+#define HAL_CAN_ERROR_EWG					0x00000001U
+#define HAL_CAN_ERROR_EPV					0x00000002U
+#define HAL_CAN_ERROR_BOF					0x00000004U
+#define HAL_CAN_ERROR_STF					0x00000008U
+#define HAL_CAN_ERROR_FOR					0x00000010U
+#define HAL_CAN_ERROR_ACK					0x00000020U
+#define HAL_CAN_ERROR_BR					0x00000040U
+#define HAL_CAN_ERROR_BD					0x00000080U
+#define HAL_CAN_ERROR_CRC					0x00000100U
+#define HAL_CAN_ERROR_RX_FOV0				0x00000200U
+#define HAL_CAN_ERROR_TX_ALST0				0x00000800U
+#define HAL_CAN_ERROR_TX_TERR0				0x00001000U
+#define HAL_CAN_ERROR_TIMEOUT				0x00020000U
+#define HAL_CAN_ERROR_NOT_INITIALIZED		0x00040000U
+#define HAL_CAN_ERROR_NOT_READY				0x00080000U
+#define HAL_CAN_ERROR_NOT_STARTED			0x00100000U
+#define HAL_CAN_ERROR_PARAM					0x00200000U
+
+#define CAN_ESR_EWGF						(1UL << 0)
+#define CAN_ESR_EPVF						(1UL << 1)
+#define CAN_ESR_BOFF						(1UL << 2)
+#define CAN_ESR_TEC_Pos						16U
+#define CAN_ESR_TEC_Msk						(0xFFUL << CAN_ESR_TEC_Pos)
+#define CAN_ESR_REC_Pos						24U
+#define CAN_ESR_REC_Msk						(0xFFUL << CAN_ESR_REC_Pos)
+
+#define CAN_RF0R_FMP0						(3UL << 0)
+#define CAN_RF0R_RFOM0						(1UL << 5)
+#define CAN_RI0R_RTR						(1UL << 1)
+#define CAN_RI0R_IDE						(1UL << 2)
+#define CAN_RI0R_EXID_Pos					3U
+#define CAN_RI0R_EXID						(0x3FFFFUL << CAN_RI0R_EXID_Pos)
+#define CAN_RI0R_STID_Pos					21U
+#define CAN_RI0R_STID						(0x7FFUL << CAN_RI0R_STID_Pos)
+#define CAN_TI0R_STID_Pos					21U
+#define CAN_RDT0R_DLC_Pos					0U
+#define CAN_RDT0R_DLC						(0xFUL << CAN_RDT0R_DLC_Pos)
+#define CAN_RDT0R_FMI_Pos					8U
+#define CAN_RDT0R_FMI						(0xFFUL << CAN_RDT0R_FMI_Pos)
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_DeInit(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t InactiveITs);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox);
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+HAL_CAN_StateTypeDef HAL_CAN_GetState(CAN_HandleTypeDef *hcan);
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan);
+
+/* FLASH ---------------------------------------------------------------------*/
+typedef struct
+{
+	__IO uint32_t ACR;
+	__IO uint32_t KEYR;
+	__IO uint32_t OPTKEYR;
+	__IO uint32_t SR;
+	__IO uint32_t CR;
+	__IO uint32_t OPTCR;
+}FLASH_TypeDef;
+
+extern FLASH_TypeDef *FLASH;
+
+typedef struct
+{
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t Sector;
+	uint32_t NbSectors;
+	uint32_t VoltageRange;
+}FLASH_EraseInitTypeDef;
+
+#ifndef FLASH_BASE
+#define FLASH_BASE							0x08000000UL
+#endif
+#define FLASHSIZE_BASE						0x1FFF7A22UL
+
+#define FLASH_TYPEERASE_SECTORS				0x00000000U
+#define FLASH_TYPEERASE_MASSERASE			0x00000001U
+#define FLASH_VOLTAGE_RANGE_1				0x00000000U
+#define FLASH_VOLTAGE_RANGE_2				0x00000001U
+#define FLASH_VOLTAGE_RANGE_3				0x00000002U
+#define FLASH_VOLTAGE_RANGE_4				0x00000003U
+#define FLASH_TYPEPROGRAM_BYTE				0x00000000U
+#define FLASH_TYPEPROGRAM_HALFWORD			0x00000001U
+#define FLASH_TYPEPROGRAM_WORD				0x00000002U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD		0x00000003U
+#define TYPEPROGRAM_WORD					FLASH_TYPEPROGRAM_WORD
+
+#define FLASH_SECTOR_0						0U
+#define FLASH_SECTOR_1						1U
+#define FLASH_SECTOR_2						2U
+#define FLASH_SECTOR_3						3U
+#define FLASH_SECTOR_4						4U
+#define FLASH_SECTOR_5						5U
+#define FLASH_SECTOR_6						6U
+#define FLASH_SECTOR_7						7U
+
+#define FLASH_LATENCY_0						0U
+#define FLASH_LATENCY_1						1U
+#define FLASH_LATENCY_2						2U
+#define FLASH_LATENCY_3						3U
+#define FLASH_LATENCY_4						4U
+#define FLASH_LATENCY_5						5U
+#define FLASH_LATENCY_6						6U
+#define FLASH_LATENCY_7						7U
+
+#define FLASH_FLAG_EOP						(1UL << 0)
+#define FLASH_FLAG_OPERR					(1UL << 1)
+#define FLASH_FLAG_WRPERR					(1UL << 4)
+#define FLASH_FLAG_PGAERR					(1UL << 5)
+#define FLASH_FLAG_PGPERR					(1UL << 6)
+#define FLASH_FLAG_PGSERR					(1UL << 7)
+#define FLASH_FLAG_BSY						(1UL << 16)
+#define FLASH_SR_EOP						FLASH_FLAG_EOP
+#define FLASH_SR_BSY						FLASH_FLAG_BSY
+
+#define FLASH_CR_PG							(1UL << 0)
+#define FLASH_CR_SER						(1UL << 1)
+#define FLASH_CR_SNB_Pos					3U
+#define FLASH_CR_SNB_Msk					(0x1FUL << FLASH_CR_SNB_Pos)
+#define FLASH_CR_SNB						FLASH_CR_SNB_Msk
+#define FLASH_CR_PSIZE_Pos					8U
+#define FLASH_CR_PSIZE_Msk					(3UL << FLASH_CR_PSIZE_Pos)
+#define FLASH_CR_PSIZE						FLASH_CR_PSIZE_Msk
+#define FLASH_CR_STRT						(1UL << 16)
+#define FLASH_CR_EOPIE						(1UL << 24)
+#define FLASH_CR_ERRIE						(1UL << 25)
+#define FLASH_CR_LOCK						(1UL << 31)
+
+#define FLASH_ACR_LATENCY_Msk				0xFUL
+#define FLASH_ACR_LATENCY					FLASH_ACR_LATENCY_Msk
+#define FLASH_ACR_PRFTEN					(1UL << 8)
+#define FLASH_ACR_ICEN						(1UL << 9)
+#define FLASH_ACR_DCEN						(1UL << 10)
+#define FLASH_ACR_ICRST						(1UL << 11)
+#define FLASH_ACR_DCRST						(1UL << 12)
+
+#define FLASH_PSIZE_BYTE					0x00000000U
+#define FLASH_PSIZE_HALF_WORD				0x00000100U
+#define FLASH_PSIZE_WORD					0x00000200U
+#define FLASH_PSIZE_DOUBLE_WORD				0x00000300U
+
+#define FLASH_IT_EOP						FLASH_CR_EOPIE
+#define FLASH_IT_ERR						FLASH_CR_ERRIE
+
+#define __HAL_FLASH_SET_LATENCY(Latency)	((void)(Latency))
+#define __HAL_FLASH_GET_LATENCY()			(0U)
+#define __HAL_FLASH_PREFETCH_BUFFER_ENABLE()	((void)0)
+#define __HAL_FLASH_PREFETCH_BUFFER_DISABLE()	((void)0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_ENABLE()	((void)0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_DISABLE()	((void)0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_RESET()	((void)0)
+#define __HAL_FLASH_DATA_CACHE_ENABLE()		((void)0)
+#define __HAL_FLASH_DATA_CACHE_DISABLE()	((void)0)
+#define __HAL_FLASH_DATA_CACHE_RESET()		((void)0)
+#define __HAL_FLASH_CLEAR_FLAG(Flag)		((void)(Flag))
+#define __HAL_FLASH_GET_FLAG(Flag)			(0U)
+#define __HAL_FLASH_ENABLE_IT(Interrupt)	((void)(Interrupt))
+#define __HAL_FLASH_DISABLE_IT(Interrupt)	((void)(Interrupt))
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError);
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit);
+HAL_StatusTypeDef FLASH_WaitForLastOperation(uint32_t Timeout);
+uint32_t HAL_FLASH_GetError(void);
+void HAL_FLASH_IRQHandler(void);
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue);
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* HOST_STM32F4XX_H_ */
@@ -0,0 +1,893 @@
+/*!
+ * @file      J1939.c
+ *
+ * @brief     SAE J1939 network layer (PGN addressing, address claim, BAM and RTS/CTS transport)
+ *
+ * @author    Anosov Anton
+ */
+
+#include "J1939.h"
+#include <string.h>
+
+// Transport protocol control bytes
+#define J1939_TP_RTS				16
+#define J1939_TP_CTS				17
+#define J1939_TP_EOM				19
+#define J1939_TP_BAM				32
+#define J1939_TP_ABORT				255
+
+// Abort reasons
+#define J1939_ABORT_BUSY			1
+#define J1939_ABORT_RESOURCES		2
+#define J1939_ABORT_TIMEOUT			3
+#define J1939_ABORT_SIZE			9		/* Message size is greater than 1785 bytes */
+#define J1939_ABORT_OTHER			250		/* Reason not listed (size and number of packets disagree) */
+
+// Timeouts of the transport protocol (ms)
+#define J1939_T1					750		/* Receiver: gap between data packets */
+#define J1939_T2					1250	/* Receiver: data after CTS */
+#define J1939_T3					1250	/* Sender: CTS or EOM after the last packet */
+#define J1939_T4					1050	/* Sender: next CTS after a hold (CTS with 0 packets) */
+#define J1939_CLAIM_TIME			250		/* Address is in use after this time without contention */
+
+// Bytes in one data packet
+#define J1939_DT_SIZE				7
+
+// Transmit mailboxes of bxCAN
+#define J1939_CAN_MAILBOXES			3
+
+/*!
+ * Session states
+ */
+typedef enum J1939_SessionState_e
+{
+	J1939_SESSION_FREE = 0,
+	J1939_SESSION_TX_BAM,
+	J1939_SESSION_TX_WAIT_CTS,
+	J1939_SESSION_TX_HOLD,
+	J1939_SESSION_TX_SENDING,
+	J1939_SESSION_TX_WAIT_EOM,
+	J1939_SESSION_RX_BAM,
+	J1939_SESSION_RX_RTS
+}J1939_SessionState_t;
+
+/*!
+ * Transport session (data is sent from / received into the user buffer directly)
+ */
+typedef struct J1939_Session_s
+{
+	J1939_SessionState_t State;
+	uint32_t Pgn;
+	uint8_t Peer;
+	uint8_t Priority;
+	uint8_t *pData;
+	uint16_t Size;
+	uint8_t Packets;
+	uint8_t Window;
+	uint16_t Next;
+	uint16_t WindowEnd;
+	uint32_t Tick;
+}J1939_Session_t;
+
+/*!
+ * Address claim states
+ */
+typedef enum J1939_ClaimState_e
+{
+	J1939_CLAIM_IDLE = 0,
+	J1939_CLAIM_PENDING,
+	J1939_CLAIM_DONE,
+	J1939_CLAIM_FAILED
+}J1939_ClaimState_t;
+
+static CAN_HandleTypeDef *pJ1939Can;
+static uint64_t NodeName;
+static uint8_t Address;
+static J1939_ClaimState_t ClaimState;
+static uint32_t ClaimTick;
+static uint8_t IsClaimPending;
+
+static J1939_Session_t TxSessions[J1939_MAX_TX_SESSIONS];
+static J1939_Session_t RxSessions[J1939_MAX_RX_SESSIONS];
+
+/* Frames from the RX interrupt */
+static CAN_Frame_t RxQueue[J1939_RX_QUEUE_SIZE];
+static volatile uint8_t RxHead;
+static volatile uint8_t RxCount;
+
+/* Frames waiting for a free mailbox */
+static CAN_Frame_t TxQueue[J1939_TX_QUEUE_SIZE];
+static uint8_t TxHead;
+static uint8_t TxCount;
+
+/*!
+ * @brief Build 29-bit identifier
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @return					Extended CAN ID
+ */
+uint32_t J1939_EncodeId(const J1939_Id_t *pId)
+{
+	uint32_t Pgn = pId->Pgn & 0x3FFFF;
+
+	/* PDU1 format carries the destination address in PS */
+	if(((Pgn >> 8) & 0xFF) < 240)
+		Pgn = (Pgn & 0x3FF00) | pId->Da;
+
+	return ((uint32_t)(pId->Priority & 0x7) << 26) | (Pgn << 8) | pId->Sa;
+}
+
+/*!
+ * @brief Parse 29-bit identifier
+ *
+ * @param CanId				Extended CAN ID
+ * @param pId				Pointer to the J1939_Id_t description
+ */
+void J1939_DecodeId(uint32_t CanId, J1939_Id_t *pId)
+{
+	uint32_t Pgn = (CanId >> 8) & 0x3FFFF;
+
+	pId->Priority = (CanId >> 26) & 0x7;
+	pId->Sa = CanId & 0xFF;
+
+	if(((Pgn >> 8) & 0xFF) < 240)
+	{
+		pId->Da = Pgn & 0xFF;
+		pId->Pgn = Pgn & 0x3FF00;
+	}
+	else
+	{
+		pId->Da = J1939_ADDRESS_GLOBAL;
+		pId->Pgn = Pgn;
+	}
+}
+
+/*!
+ * @brief Transmit frame, queues it if no mailbox is free
+ *
+ * @param Priority			Priority
+ * @param Pgn				Parameter group number
+ * @param Sa				Source address
+ * @param Da				Destination address
+ * @param pData				Data pointer
+ * @param Size				Data size (0 - 8)
+ * @return					1 - frame is sent or queued, 0 - queue is full
+ */
+static uint8_t J1939_Transmit(uint8_t Priority, uint32_t Pgn, uint8_t Sa, uint8_t Da, const uint8_t *pData, uint8_t Size)
+{
+	J1939_Id_t Id = {Priority, Pgn, Da, Sa};
+	CAN_Frame_t Frame;
+
+	Frame.Id = J1939_EncodeId(&Id);
+	Frame.IDE = CAN_ID_EXT;
+	Frame.RTR = CAN_RTR_DATA;
+	Frame.Dlc = Size;
+	memcpy(Frame.Data, pData, Size);
+
+	/* Order of the queued frames is kept */
+	if(TxCount == 0 && CAN_SendFrame(pJ1939Can, &Frame))
+		return 1;
+
+	if(TxCount >= J1939_TX_QUEUE_SIZE)
+		return 0;
+
+	TxQueue[(TxHead + TxCount) % J1939_TX_QUEUE_SIZE] = Frame;
+	TxCount++;
+	return 1;
+}
+
+/*!
+ * @brief Transmit connection management frame
+ *
+ * @param Da				Destination address
+ * @param Control			Control byte
+ * @param pParams			Bytes 1 - 4 of the frame
+ * @param Pgn				Parameter group number of the transported message
+ * @return					1 - frame is sent or queued, 0 - queue is full
+ */
+static uint8_t J1939_SendCm(uint8_t Da, uint8_t Control, const uint8_t *pParams, uint32_t Pgn)
+{
+	uint8_t Data[8];
+
+	Data[0] = Control;
+	memcpy(&Data[1], pParams, 4);
+	Data[5] = (uint8_t)(Pgn);
+	Data[6] = (uint8_t)(Pgn >> 8);
+	Data[7] = (uint8_t)(Pgn >> 16);
+
+	return J1939_Transmit(J1939_PRIORITY_TP, J1939_PGN_TP_CM, Address, Da, Data, sizeof(Data));
+}
+
+/*!
+ * @brief Transmit abort of the session
+ *
+ * @param Da				Destination address
+ * @param Reason			Abort reason
+ * @param Pgn				Parameter group number of the transported message
+ */
+static void J1939_SendAbort(uint8_t Da, uint8_t Reason, uint32_t Pgn)
+{
+	const uint8_t Params[4] = {Reason, 0xFF, 0xFF, 0xFF};
+	J1939_SendCm(Da, J1939_TP_ABORT, Params, Pgn);
+}
+
+/*!
+ * @brief Transmit CTS for the next window of the receive session. The window is moved only when
+ *        the CTS is queued, J1939_Process repeats it otherwise
+ *
+ * @param pSession			Pointer to the session
+ * @return					1 - CTS is sent or queued, 0 - queue is full
+ */
+static uint8_t J1939_SendCts(J1939_Session_t *pSession)
+{
+	uint16_t Window = pSession->Packets - pSession->Next + 1;
+	uint8_t Params[4];
+
+	if(Window > pSession->Window)
+		Window = pSession->Window;
+
+	Params[0] = (uint8_t)Window;
+	Params[1] = (uint8_t)pSession->Next;
+	Params[2] = 0xFF;
+	Params[3] = 0xFF;
+	if(!J1939_SendCm(pSession->Peer, J1939_TP_CTS, Params, pSession->Pgn))
+		return 0;
+
+	pSession->WindowEnd = pSession->Next + Window - 1;
+	return 1;
+}
+
+/*!
+ * @brief Transmit EOM of the complete receive session and pass the message to the application.
+ *        The session stays open if the EOM is not queued, J1939_Process repeats it
+ *
+ * @param pSession			Pointer to the session
+ */
+static void J1939_FinishRx(J1939_Session_t *pSession)
+{
+	J1939_Id_t MsgId = {pSession->Priority, pSession->Pgn,
+						(pSession->State == J1939_SESSION_RX_BAM) ? J1939_ADDRESS_GLOBAL : Address, pSession->Peer};
+
+	if(pSession->State == J1939_SESSION_RX_RTS)
+	{
+		const uint8_t Params[4] = {(uint8_t)pSession->Size, (uint8_t)(pSession->Size >> 8), pSession->Packets, 0xFF};
+		if(!J1939_SendCm(pSession->Peer, J1939_TP_EOM, Params, pSession->Pgn))
+			return;
+	}
+
+	pSession->State = J1939_SESSION_FREE;
+	J1939_RxCallback(&MsgId, pSession->pData, pSession->Size);
+}
+
+/*!
+ * @brief Transmit data packet of the session without queuing
+ *
+ * @param pSession			Pointer to the session
+ * @param Da				Destination address
+ * @return					1 - packet is sent, 0 - no free mailbox
+ */
+static uint8_t J1939_SendDt(J1939_Session_t *pSession, uint8_t Da)
+{
+	J1939_Id_t Id = {J1939_PRIORITY_TP, J1939_PGN_TP_DT, Da, Address};
+	uint16_t Offset = (pSession->Next - 1) * J1939_DT_SIZE;
+	uint16_t Size = pSession->Size - Offset;
+	CAN_Frame_t Frame;
+
+	if(TxCount != 0)
+		return 0;
+
+	if(Size > J1939_DT_SIZE)
+		Size = J1939_DT_SIZE;
+
+	Frame.Id = J1939_EncodeId(&Id);
+	Frame.IDE = CAN_ID_EXT;
+	Frame.RTR = CAN_RTR_DATA;
+	Frame.Dlc = 8;
+	Frame.Data[0] = (uint8_t)pSession->Next;
+	memset(&Frame.Data[1], 0xFF, J1939_DT_SIZE);
+	memcpy(&Frame.Data[1], &pSession->pData[Offset], Size);
+
+	if(!CAN_SendFrame(pJ1939Can, &Frame))
+		return 0;
+
+	pSession->Next++;
+	return 1;
+}
+
+/*!
+ * @brief Transmit address claimed (or cannot claim) message, J1939_Process repeats it if the queue is full
+ *
+ * @return					1 - frame is sent or queued, 0 - queue is full
+ */
+static uint8_t J1939_SendClaim(void)
+{
+	uint8_t Data[8];
+
+	for(uint8_t i = 0; i < 8; i++)
+		Data[i] = (uint8_t)(NodeName >> (8 * i));
+
+	IsClaimPending = !J1939_Transmit(J1939_PRIORITY_DEFAULT, J1939_PGN_ADDRESS_CLAIMED, Address, J1939_ADDRESS_GLOBAL, Data, sizeof(Data));
+	return !IsClaimPending;
+}
+
+/*!
+ * @brief Find the session
+ *
+ * @param pSessions			Pointer to the session table
+ * @param Count				Size of the session table
+ * @param Peer				Address of the peer
+ * @param Pgn				Parameter group number, 0xFFFFFFFF - any
+ * @return					Pointer to the session, NULL - session is not found
+ */
+static J1939_Session_t* J1939_FindSession(J1939_Session_t *pSessions, uint8_t Count, uint8_t Peer, uint32_t Pgn)
+{
+	for(uint8_t i = 0; i < Count; i++)
+	{
+		if(pSessions[i].State != J1939_SESSION_FREE && pSessions[i].Peer == Peer &&
+		   (Pgn == 0xFFFFFFFF || pSessions[i].Pgn == Pgn))
+			return &pSessions[i];
+	}
+	return NULL;
+}
+
+/*!
+ * @brief Find the receive session. A peer may run one BAM and one RTS/CTS session at the same time,
+ *        the data packets tell them apart by the destination address
+ *
+ * @param Peer				Address of the peer
+ * @param State				J1939_SESSION_RX_BAM or J1939_SESSION_RX_RTS
+ * @return					Pointer to the session, NULL - session is not found
+ */
+static J1939_Session_t* J1939_FindRxSession(uint8_t Peer, J1939_SessionState_t State)
+{
+	for(uint8_t i = 0; i < J1939_MAX_RX_SESSIONS; i++)
+	{
+		if(RxSessions[i].State == State && RxSessions[i].Peer == Peer)
+			return &RxSessions[i];
+	}
+	return NULL;
+}
+
+/*!
+ * @brief Allocate the session
+ *
+ * @param pSessions			Pointer to the session table
+ * @param Count				Size of the session table
+ * @return					Pointer to the session, NULL - no free session
+ */
+static J1939_Session_t* J1939_AllocSession(J1939_Session_t *pSessions, uint8_t Count)
+{
+	for(uint8_t i = 0; i < Count; i++)
+	{
+		if(pSessions[i].State == J1939_SESSION_FREE)
+			return &pSessions[i];
+	}
+	return NULL;
+}
+
+/*!
+ * @brief Finish the transmit session
+ *
+ * @param pSession			Pointer to the session
+ * @param Status			Status of the transmission
+ */
+static void J1939_FinishTx(J1939_Session_t *pSession, J1939_Status_t Status)
+{
+	uint8_t Da = (pSession->State == J1939_SESSION_TX_BAM) ? J1939_ADDRESS_GLOBAL : pSession->Peer;
+
+	pSession->State = J1939_SESSION_FREE;
+	J1939_TxDoneCallback(pSession->Pgn, Da, Status);
+}
+
+/*!
+ * @brief Address claimed message of the other node
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param pFrame			Pointer to the frame
+ */
+static void J1939_HandleClaim(const J1939_Id_t *pId, const CAN_Frame_t *pFrame)
+{
+	uint64_t OtherName = 0;
+
+	if(pId->Sa != Address || ClaimState == J1939_CLAIM_IDLE || ClaimState == J1939_CLAIM_FAILED)
+		return;
+
+	for(uint8_t i = 0; i < 8; i++)
+		OtherName |= (uint64_t)pFrame->Data[i] << (8 * i);
+
+	/* Lower NAME has the higher priority */
+	if(NodeName < OtherName)
+	{
+		J1939_SendClaim();
+		return;
+	}
+
+	/* Arbitrary address capable node looks for another address */
+	if(NodeName >> 63)
+	{
+		Address = (Address >= J1939_ADDRESS_ARBITRARY_FIRST && Address < J1939_ADDRESS_ARBITRARY_LAST) ?
+				  Address + 1 : J1939_ADDRESS_ARBITRARY_FIRST;
+		ClaimState = J1939_CLAIM_PENDING;
+		ClaimTick = HAL_GetTick();
+		J1939_SendClaim();
+		return;
+	}
+
+	Address = J1939_ADDRESS_NULL;
+	ClaimState = J1939_CLAIM_FAILED;
+	J1939_SendClaim();
+	J1939_AddressCallback(J1939_ADDRESS_NULL);
+}
+
+/*!
+ * @brief Connection management frame
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param pFrame			Pointer to the frame
+ */
+static void J1939_HandleCm(const J1939_Id_t *pId, const CAN_Frame_t *pFrame)
+{
+	const uint8_t *pData = pFrame->Data;
+	uint32_t Pgn = (uint32_t)pData[5] | ((uint32_t)pData[6] << 8) | ((uint32_t)pData[7] << 16);
+	uint16_t Size = (uint16_t)pData[1] | ((uint16_t)pData[2] << 8);
+	J1939_Id_t MsgId = {pId->Priority, Pgn, pId->Da, pId->Sa};
+	J1939_Session_t *pSession;
+
+	switch(pData[0])
+	{
+		case J1939_TP_BAM:
+		case J1939_TP_RTS:
+		{
+			uint8_t IsBam = (pData[0] == J1939_TP_BAM);
+			J1939_SessionState_t State = IsBam ? J1939_SESSION_RX_BAM : J1939_SESSION_RX_RTS;
+
+			if(IsBam != (pId->Da == J1939_ADDRESS_GLOBAL))
+				return;
+
+			if(Size <= 8 || Size > J1939_MAX_SIZE || pData[3] != (Size + J1939_DT_SIZE - 1) / J1939_DT_SIZE)
+			{
+				if(!IsBam)
+					J1939_SendAbort(pId->Sa, (Size > J1939_MAX_SIZE) ? J1939_ABORT_SIZE : J1939_ABORT_OTHER, Pgn);
+				return;
+			}
+
+			/* A new announcement of the same PGN restarts the session. The peer runs one RTS/CTS session
+			   with us at a time, the RTS of another PGN is refused; a new BAM means the old one is abandoned */
+			pSession = J1939_FindRxSession(pId->Sa, State);
+			if(pSession != NULL && !IsBam && pSession->Pgn != Pgn)
+			{
+				J1939_SendAbort(pId->Sa, J1939_ABORT_BUSY, Pgn);
+				return;
+			}
+			if(pSession == NULL)
+				pSession = J1939_AllocSession(RxSessions, J1939_MAX_RX_SESSIONS);
+
+			if(pSession == NULL || (pSession->pData = J1939_RxBufferCallback(&MsgId, Size)) == NULL)
+			{
+				if(pSession)
+					pSession->State = J1939_SESSION_FREE;
+				if(!IsBam)
+					J1939_SendAbort(pId->Sa, J1939_ABORT_RESOURCES, Pgn);
+				return;
+			}
+
+			pSession->State = State;
+			pSession->Pgn = Pgn;
+			pSession->Peer = pId->Sa;
+			pSession->Priority = pId->Priority;
+			pSession->Size = Size;
+			pSession->Packets = pData[3];
+			pSession->Next = 1;
+			pSession->WindowEnd = 0;
+			pSession->Tick = HAL_GetTick();
+
+			/* Window of the CTS: the limit of the sender (0xFF - no limit) and ours */
+			pSession->Window = (pData[4] != 0 && pData[4] < J1939_CTS_MAX_PACKETS) ? pData[4] : J1939_CTS_MAX_PACKETS;
+
+			if(!IsBam)
+				J1939_SendCts(pSession);
+			break;
+		}
+		case J1939_TP_CTS:
+		{
+			pSession = J1939_FindSession(TxSessions, J1939_MAX_TX_SESSIONS, pId->Sa, Pgn);
+			if(pSession == NULL || pSession->State == J1939_SESSION_TX_BAM)
+				return;
+
+			pSession->Tick = HAL_GetTick();
+			if(pData[1] == 0)
+			{
+				/* Hold the connection open */
+				pSession->State = J1939_SESSION_TX_HOLD;
+				return;
+			}
+
+			/* Retransmission is requested by a lower packet number */
+			pSession->Next = pData[2];
+			pSession->WindowEnd = pData[2] + pData[1] - 1;
+			if(pSession->Next == 0 || pSession->Next > pSession->Packets)
+			{
+				J1939_SendAbort(pId->Sa, J1939_ABORT_RESOURCES, Pgn);
+				J1939_FinishTx(pSession, J1939_STATUS_ABORTED);
+				return;
+			}
+			if(pSession->WindowEnd > pSession->Packets)
+				pSession->WindowEnd = pSession->Packets;
+			pSession->State = J1939_SESSION_TX_SENDING;
+			break;
+		}
+		case J1939_TP_EOM:
+		{
+			pSession = J1939_FindSession(TxSessions, J1939_MAX_TX_SESSIONS, pId->Sa, Pgn);
+			if(pSession != NULL && pSession->State == J1939_SESSION_TX_WAIT_EOM)
+				J1939_FinishTx(pSession, J1939_STATUS_OK);
+			break;
+		}
+		case J1939_TP_ABORT:
+		{
+			pSession = J1939_FindSession(TxSessions, J1939_MAX_TX_SESSIONS, pId->Sa, Pgn);
+			if(pSession != NULL && pSession->State != J1939_SESSION_TX_BAM)
+				J1939_FinishTx(pSession, J1939_STATUS_ABORTED);
+
+			pSession = J1939_FindRxSession(pId->Sa, J1939_SESSION_RX_RTS);
+			if(pSession != NULL && pSession->Pgn == Pgn)
+				pSession->State = J1939_SESSION_FREE;
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/*!
+ * @brief Data transfer frame, the packet is copied directly into the user buffer
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param pFrame			Pointer to the frame
+ */
+static void J1939_HandleDt(const J1939_Id_t *pId, const CAN_Frame_t *pFrame)
+{
+	J1939_Session_t *pSession = J1939_FindRxSession(pId->Sa, (pId->Da == J1939_ADDRESS_GLOBAL) ?
+													J1939_SESSION_RX_BAM : J1939_SESSION_RX_RTS);
+	uint8_t Sequence = pFrame->Data[0];
+	uint16_t Offset, Size;
+
+	if(pSession == NULL || pFrame->Dlc < 8 || pSession->Next > pSession->Packets)
+		return;
+
+	if(Sequence != pSession->Next)
+	{
+		if(pSession->State == J1939_SESSION_RX_BAM)
+			pSession->State = J1939_SESSION_FREE;		/* Lost packet, BAM can not be repeated */
+		else if(Sequence > pSession->Next)
+			J1939_SendCts(pSession);					/* Request retransmission from the missing packet */
+		return;
+	}
+
+	Offset = (Sequence - 1) * J1939_DT_SIZE;
+	Size = pSession->Size - Offset;
+	if(Size > J1939_DT_SIZE)
+		Size = J1939_DT_SIZE;
+	memcpy(&pSession->pData[Offset], &pFrame->Data[1], Size);
+
+	pSession->Next++;
+	pSession->Tick = HAL_GetTick();
+
+	if(pSession->Next > pSession->Packets)
+	{
+		J1939_FinishRx(pSession);
+	}
+	else if(pSession->State == J1939_SESSION_RX_RTS && pSession->Next > pSession->WindowEnd)
+	{
+		J1939_SendCts(pSession);
+	}
+}
+
+/*!
+ * @brief Received frame processing
+ *
+ * @param pFrame			Pointer to the frame
+ */
+static void J1939_HandleFrame(const CAN_Frame_t *pFrame)
+{
+	J1939_Id_t Id;
+
+	if(pFrame->IDE != CAN_ID_EXT || pFrame->RTR != CAN_RTR_DATA)
+		return;
+
+	J1939_DecodeId(pFrame->Id, &Id);
+
+	if(Id.Da != J1939_ADDRESS_GLOBAL && Id.Da != Address)
+		return;
+
+	switch(Id.Pgn)
+	{
+		case J1939_PGN_ADDRESS_CLAIMED:
+			J1939_HandleClaim(&Id, pFrame);
+			break;
+		case J1939_PGN_REQUEST:
+			if(pFrame->Dlc >= 3 && ((uint32_t)pFrame->Data[0] | ((uint32_t)pFrame->Data[1] << 8) |
+			   ((uint32_t)pFrame->Data[2] << 16)) == J1939_PGN_ADDRESS_CLAIMED)
+				J1939_SendClaim();
+			else
+				J1939_RxCallback(&Id, pFrame->Data, pFrame->Dlc);
+			break;
+		case J1939_PGN_TP_CM:
+			if(pFrame->Dlc == 8)
+				J1939_HandleCm(&Id, pFrame);
+			break;
+		case J1939_PGN_TP_DT:
+			J1939_HandleDt(&Id, pFrame);
+			break;
+		default:
+			J1939_RxCallback(&Id, pFrame->Data, pFrame->Dlc);
+			break;
+	}
+}
+
+/*!
+ * @brief Initialization of the node and start of the address claim. With TransmitFifoPriority of the
+ *        CAN handle enabled the data packets fill all mailboxes, otherwise a burst waits for the empty ones
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param Name				64-bit NAME of the node
+ * @param PreferredAddress	Preferred source address
+ */
+void J1939_Init(CAN_HandleTypeDef *pCanHandle, uint64_t Name, uint8_t PreferredAddress)
+{
+	pJ1939Can = pCanHandle;
+	NodeName = Name;
+	Address = PreferredAddress;
+	IsClaimPending = 0;
+	RxHead = 0;
+	RxCount = 0;
+	TxHead = 0;
+	TxCount = 0;
+	memset(TxSessions, 0, sizeof(TxSessions));
+	memset(RxSessions, 0, sizeof(RxSessions));
+
+	ClaimState = J1939_CLAIM_PENDING;
+	ClaimTick = HAL_GetTick();
+	J1939_SendClaim();
+}
+
+/*!
+ * @brief Put received frame (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void J1939_PutFrame(const CAN_Frame_t *pFrame)
+{
+	if(pFrame->IDE != CAN_ID_EXT)
+		return;
+
+	J1939_BEGIN_CRITICAL_SECTION();
+	if(RxCount < J1939_RX_QUEUE_SIZE)
+	{
+		RxQueue[(RxHead + RxCount) % J1939_RX_QUEUE_SIZE] = *pFrame;
+		RxCount++;
+	}
+	J1939_END_CRITICAL_SECTION();
+}
+
+/*!
+ * @brief Processing of the received frames, sessions and timeouts (call from the main loop)
+ */
+void J1939_Process(void)
+{
+	uint32_t Tick = HAL_GetTick();
+	CAN_Frame_t Frame;
+
+	/* Received frames */
+	while(RxCount > 0)
+	{
+		Frame = RxQueue[RxHead];
+		J1939_BEGIN_CRITICAL_SECTION();
+		RxHead = (RxHead + 1) % J1939_RX_QUEUE_SIZE;
+		RxCount--;
+		J1939_END_CRITICAL_SECTION();
+		J1939_HandleFrame(&Frame);
+	}
+
+	/* Queued frames */
+	while(TxCount > 0 && CAN_SendFrame(pJ1939Can, &TxQueue[TxHead]))
+	{
+		TxHead = (TxHead + 1) % J1939_TX_QUEUE_SIZE;
+		TxCount--;
+	}
+
+	/* Address claim */
+	if(IsClaimPending)
+		J1939_SendClaim();
+	if(ClaimState == J1939_CLAIM_PENDING && (Tick - ClaimTick) >= J1939_CLAIM_TIME)
+	{
+		ClaimState = J1939_CLAIM_DONE;
+		J1939_AddressCallback(Address);
+	}
+
+	/* Transmit sessions: data packets fill the free mailboxes */
+	for(uint8_t i = 0; i < J1939_MAX_TX_SESSIONS; i++)
+	{
+		J1939_Session_t *pSession = &TxSessions[i];
+
+		switch(pSession->State)
+		{
+			case J1939_SESSION_TX_BAM:
+				if((Tick - pSession->Tick) >= J1939_BAM_INTERVAL_MS && J1939_SendDt(pSession, J1939_ADDRESS_GLOBAL))
+				{
+					pSession->Tick = Tick;
+					if(pSession->Next > pSession->Packets)
+						J1939_FinishTx(pSession, J1939_STATUS_OK);
+				}
+				break;
+			case J1939_SESSION_TX_SENDING:
+				/* The data packets have the same identifier. Without the transmit FIFO priority the lowest
+				   mailbox goes first, so the packets are loaded only into the empty mailboxes, in one go */
+				if(pJ1939Can->Init.TransmitFifoPriority == ENABLE)
+				{
+					while(pSession->Next <= pSession->WindowEnd && J1939_SendDt(pSession, pSession->Peer)) {}
+				}
+				else if(HAL_CAN_GetTxMailboxesFreeLevel(pJ1939Can) == J1939_CAN_MAILBOXES)
+				{
+					J1939_BEGIN_CRITICAL_SECTION();
+					while(pSession->Next <= pSession->WindowEnd && J1939_SendDt(pSession, pSession->Peer)) {}
+					J1939_END_CRITICAL_SECTION();
+				}
+				if(pSession->Next > pSession->WindowEnd)
+				{
+					pSession->State = (pSession->Next > pSession->Packets) ? J1939_SESSION_TX_WAIT_EOM : J1939_SESSION_TX_WAIT_CTS;
+					pSession->Tick = Tick;
+				}
+				break;
+			case J1939_SESSION_TX_WAIT_CTS:
+			case J1939_SESSION_TX_WAIT_EOM:
+			case J1939_SESSION_TX_HOLD:
+				if((Tick - pSession->Tick) >= ((pSession->State == J1939_SESSION_TX_HOLD) ? J1939_T4 : J1939_T3))
+				{
+					J1939_SendAbort(pSession->Peer, J1939_ABORT_TIMEOUT, pSession->Pgn);
+					J1939_FinishTx(pSession, J1939_STATUS_TIMEOUT);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* Receive sessions: CTS and EOM refused by the full queue, timeouts */
+	for(uint8_t i = 0; i < J1939_MAX_RX_SESSIONS; i++)
+	{
+		J1939_Session_t *pSession = &RxSessions[i];
+
+		if(pSession->State == J1939_SESSION_RX_RTS && pSession->Next > pSession->Packets)
+			J1939_FinishRx(pSession);
+		else if(pSession->State == J1939_SESSION_RX_RTS && pSession->Next > pSession->WindowEnd)
+			J1939_SendCts(pSession);
+
+		if(pSession->State == J1939_SESSION_RX_BAM && (Tick - pSession->Tick) >= J1939_T1)
+		{
+			pSession->State = J1939_SESSION_FREE;
+		}
+		else if(pSession->State == J1939_SESSION_RX_RTS && (Tick - pSession->Tick) >= J1939_T2)
+		{
+			J1939_SendAbort(pSession->Peer, J1939_ABORT_TIMEOUT, pSession->Pgn);
+			pSession->State = J1939_SESSION_FREE;
+		}
+	}
+}
+
+/*!
+ * @brief Send parameter group. Messages longer than 8 bytes are sent by BAM (global)
+ *        or RTS/CTS (specific destination). The data must stay valid until J1939_TxDoneCallback
+ *
+ * @param Pgn				Parameter group number
+ * @param Priority			Priority (0 - 7)
+ * @param Da				Destination address
+ * @param pData				Data pointer
+ * @param Size				Data size (0 - J1939_MAX_SIZE)
+ * @return					Status of the operation
+ */
+J1939_Status_t J1939_Send(uint32_t Pgn, uint8_t Priority, uint8_t Da, const uint8_t *pData, uint16_t Size)
+{
+	J1939_Session_t *pSession;
+	uint8_t IsBam = (Da == J1939_ADDRESS_GLOBAL);
+	uint8_t Params[4];
+
+	if(ClaimState != J1939_CLAIM_DONE)
+		return J1939_STATUS_NOT_CLAIMED;
+
+	if(Size > J1939_MAX_SIZE || (Size > 0 && pData == NULL))
+		return J1939_STATUS_ERROR_PARAM;
+
+	if(Size <= 8)
+		return J1939_Transmit(Priority, Pgn, Address, Da, pData, (uint8_t)Size) ? J1939_STATUS_OK : J1939_STATUS_BUSY;
+
+	/* One session per destination (one BAM per source) */
+	if(J1939_FindSession(TxSessions, J1939_MAX_TX_SESSIONS, Da, 0xFFFFFFFF) != NULL ||
+	   (pSession = J1939_AllocSession(TxSessions, J1939_MAX_TX_SESSIONS)) == NULL)
+		return J1939_STATUS_BUSY;
+
+	pSession->State = IsBam ? J1939_SESSION_TX_BAM : J1939_SESSION_TX_WAIT_CTS;
+	pSession->Pgn = Pgn;
+	pSession->Peer = Da;
+	pSession->Priority = Priority;
+	pSession->pData = (uint8_t*)pData;
+	pSession->Size = Size;
+	pSession->Packets = (uint8_t)((Size + J1939_DT_SIZE - 1) / J1939_DT_SIZE);
+	pSession->Next = 1;
+	pSession->WindowEnd = 0;
+	pSession->Tick = HAL_GetTick();
+
+	Params[0] = (uint8_t)Size;
+	Params[1] = (uint8_t)(Size >> 8);
+	Params[2] = pSession->Packets;
+	Params[3] = 0xFF;		/* No limit of packets per CTS */
+	if(!J1939_SendCm(Da, IsBam ? J1939_TP_BAM : J1939_TP_RTS, Params, Pgn))
+	{
+		pSession->State = J1939_SESSION_FREE;
+		return J1939_STATUS_BUSY;
+	}
+
+	return J1939_STATUS_OK;
+}
+
+/*!
+ * @brief Get claimed address of the node
+ *
+ * @return					Source address, J1939_ADDRESS_NULL - address is not claimed
+ */
+uint8_t J1939_GetAddress(void)
+{
+	return (ClaimState == J1939_CLAIM_DONE) ? Address : J1939_ADDRESS_NULL;
+}
+
+/*!
+ * @brief Callback of the received parameter group
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param pData				Data pointer
+ * @param Size				Data size
+ */
+__weak void J1939_RxCallback(const J1939_Id_t *pId, const uint8_t *pData, uint16_t Size)
+{
+	(void)pId;
+	(void)pData;
+	(void)Size;
+}
+
+/*!
+ * @brief Callback requesting a buffer for the multi-packet message, the packets are written directly into it
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param Size				Message size
+ * @return					Buffer pointer, NULL - reject the message
+ */
+__weak uint8_t* J1939_RxBufferCallback(const J1939_Id_t *pId, uint16_t Size)
+{
+	(void)pId;
+	(void)Size;
+	return NULL;
+}
+
+/*!
+ * @brief Callback of the finished multi-packet transmission
+ *
+ * @param Pgn				Parameter group number
+ * @param Da				Destination address
+ * @param Status			Status of the transmission
+ */
+__weak void J1939_TxDoneCallback(uint32_t Pgn, uint8_t Da, J1939_Status_t Status)
+{
+	(void)Pgn;
+	(void)Da;
+	(void)Status;
+}
+
+/*!
+ * @brief Callback of the address claim result
+ *
+ * @param Address			Claimed address, J1939_ADDRESS_NULL - cannot claim
+ */
+__weak void J1939_AddressCallback(uint8_t Address)
+{
+	(void)Address;
+}
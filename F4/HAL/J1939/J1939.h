@@ -0,0 +1,206 @@
+/*!
+ * @file      J1939.h
+ *
+ * @brief     SAE J1939 network layer (PGN addressing, address claim, BAM and RTS/CTS transport)
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef J1939_H_
+#define J1939_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include "CAN.h"
+
+#define J1939_BEGIN_CRITICAL_SECTION()		__disable_irq()
+#define J1939_END_CRITICAL_SECTION()		__enable_irq()
+
+/* Configuration */
+#define J1939_MAX_TX_SESSIONS				4
+#define J1939_MAX_RX_SESSIONS				4
+#define J1939_RX_QUEUE_SIZE					32		/* Frames between the RX interrupt and J1939_Process */
+#define J1939_TX_QUEUE_SIZE					16		/* Frames waiting for a free mailbox */
+#define J1939_BAM_INTERVAL_MS				50		/* Min gap between BAM data packets (J1939-21) */
+#define J1939_CTS_MAX_PACKETS				255		/* Packets granted by one CTS */
+
+/* Addresses */
+#define J1939_ADDRESS_GLOBAL				255
+#define J1939_ADDRESS_NULL					254
+#define J1939_ADDRESS_ARBITRARY_FIRST		128
+#define J1939_ADDRESS_ARBITRARY_LAST		247
+
+/* Parameter group numbers */
+#define J1939_PGN_REQUEST					0x0EA00
+#define J1939_PGN_ADDRESS_CLAIMED			0x0EE00
+#define J1939_PGN_TP_CM						0x0EC00
+#define J1939_PGN_TP_DT						0x0EB00
+
+/* Limits */
+#define J1939_MAX_SIZE						1785	/* 255 packets x 7 bytes */
+#define J1939_PRIORITY_DEFAULT				6
+#define J1939_PRIORITY_TP					7
+
+/*!
+ * Parameters of the J1939 frame
+ */
+typedef struct J1939_Id_s
+{
+	/*!
+	 * Priority (0 - 7)
+	 */
+	uint8_t Priority;
+
+	/*!
+	 * Parameter group number (18 bits, PS = 0 for PDU1 format)
+	 */
+	uint32_t Pgn;
+
+	/*!
+	 * Destination address (J1939_ADDRESS_GLOBAL for PDU2 format)
+	 */
+	uint8_t Da;
+
+	/*!
+	 * Source address
+	 */
+	uint8_t Sa;
+
+}J1939_Id_t;
+
+/*!
+ * J1939 status enum
+ */
+typedef enum J1939_Status_e
+{
+	/*!
+	 * No error occurred
+	 */
+	J1939_STATUS_OK = 0,
+
+	/*!
+	 * No free session or queue
+	 */
+	J1939_STATUS_BUSY,
+
+	/*!
+	 * Invalid parameters
+	 */
+	J1939_STATUS_ERROR_PARAM,
+
+	/*!
+	 * Address is not claimed yet
+	 */
+	J1939_STATUS_NOT_CLAIMED,
+
+	/*!
+	 * Session is aborted by the peer
+	 */
+	J1939_STATUS_ABORTED,
+
+	/*!
+	 * Session timeout
+	 */
+	J1939_STATUS_TIMEOUT
+
+}J1939_Status_t;
+
+/*!
+ * @brief Build 29-bit identifier
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @return					Extended CAN ID
+ */
+uint32_t J1939_EncodeId(const J1939_Id_t *pId);
+
+/*!
+ * @brief Parse 29-bit identifier
+ *
+ * @param CanId				Extended CAN ID
+ * @param pId				Pointer to the J1939_Id_t description
+ */
+void J1939_DecodeId(uint32_t CanId, J1939_Id_t *pId);
+
+/*!
+ * @brief Initialization of the node and start of the address claim. With TransmitFifoPriority of the
+ *        CAN handle enabled the data packets fill all mailboxes, otherwise a burst waits for the empty ones
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param Name				64-bit NAME of the node
+ * @param PreferredAddress	Preferred source address
+ */
+void J1939_Init(CAN_HandleTypeDef *pCanHandle, uint64_t Name, uint8_t PreferredAddress);
+
+/*!
+ * @brief Put received frame (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void J1939_PutFrame(const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Processing of the received frames, sessions and timeouts (call from the main loop)
+ */
+void J1939_Process(void);
+
+/*!
+ * @brief Send parameter group. Messages longer than 8 bytes are sent by BAM (global)
+ *        or RTS/CTS (specific destination). The data must stay valid until J1939_TxDoneCallback
+ *
+ * @param Pgn				Parameter group number
+ * @param Priority			Priority (0 - 7)
+ * @param Da				Destination address
+ * @param pData				Data pointer
+ * @param Size				Data size (0 - J1939_MAX_SIZE)
+ * @return					Status of the operation
+ */
+J1939_Status_t J1939_Send(uint32_t Pgn, uint8_t Priority, uint8_t Da, const uint8_t *pData, uint16_t Size);
+
+/*!
+ * @brief Get claimed address of the node
+ *
+ * @return					Source address, J1939_ADDRESS_NULL - address is not claimed
+ */
+uint8_t J1939_GetAddress(void);
+
+/*!
+ * @brief Callback of the received parameter group
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param pData				Data pointer
+ * @param Size				Data size
+ */
+void J1939_RxCallback(const J1939_Id_t *pId, const uint8_t *pData, uint16_t Size);
+
+/*!
+ * @brief Callback requesting a buffer for the multi-packet message, the packets are written directly into it
+ *
+ * @param pId				Pointer to the J1939_Id_t description
+ * @param Size				Message size
+ * @return					Buffer pointer, NULL - reject the message
+ */
+uint8_t* J1939_RxBufferCallback(const J1939_Id_t *pId, uint16_t Size);
+
+/*!
+ * @brief Callback of the finished multi-packet transmission
+ *
+ * @param Pgn				Parameter group number
+ * @param Da				Destination address
+ * @param Status			Status of the transmission
+ */
+void J1939_TxDoneCallback(uint32_t Pgn, uint8_t Da, J1939_Status_t Status);
+
+/*!
+ * @brief Callback of the address claim result
+ *
+ * @param Address			Claimed address, J1939_ADDRESS_NULL - cannot claim
+ */
+void J1939_AddressCallback(uint8_t Address);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* J1939_H_ */
@@ -0,0 +1,422 @@
+/*!
+ * @file      J1939_Sim_Test.c
+ *
+ * @brief     Checks of the J1939 transport on the simulated bus: 1785-byte RTS/CTS and BAM in both
+ *            directions at the full rate, window of the CTS, BAM and RTS/CTS of one peer at the same time,
+ *            aborts of the refused RTS, full TX queue (host build, J1939_SIM_TEST)
+ *
+ * Build:     gcc -O2 -DCAN_SIMULATION -DJ1939_SIM_TEST -I../Host -I../CAN -I. J1939_Sim_Test.c J1939.c
+ *            ../CAN/CAN.c ../CAN/CAN_Sim.c ../Host/Host_Core.c -o j1939_sim_test
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef J1939_SIM_TEST
+
+#include "J1939.h"
+#include "CAN_Sim.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BIT_RATE				250000
+#define TEST_STEP_NS				100000ULL		/* Main loop period */
+#define TEST_NAME					0x0000000000001234ULL
+#define TEST_ADDRESS				0x25			/* Address of the node under test */
+#define TEST_PEER					0x30			/* Address of the peer played by the test */
+#define TEST_PGN					0x0EF00			/* Proprietary A */
+#define TEST_PGN_BAM				0x0FF00			/* Proprietary B */
+#define TEST_SIZE					J1939_MAX_SIZE
+#define TEST_PACKETS				255
+#define TEST_PEER_WINDOW			16				/* Packets per CTS the peer asks for */
+#define TEST_PEER_QUEUE				64
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+static uint32_t Errors;
+static CAN_HandleTypeDef Node, Peer;
+
+/* Frames received by the peer */
+static CAN_Frame_t PeerQueue[TEST_PEER_QUEUE];
+static uint32_t PeerHead, PeerCount, PeerLost;
+
+/* Messages of the node */
+static uint8_t TxData[TEST_SIZE];
+static uint8_t BamData[TEST_SIZE];
+static uint8_t RtsBuffer[TEST_SIZE];
+static uint8_t BamBuffer[TEST_SIZE];
+static uint8_t Received[TEST_SIZE];
+static uint32_t RtsDone, BamDone;
+static J1939_Id_t RtsId, BamId;
+static uint16_t RtsSize, BamSize;
+static uint32_t TxDone;
+static J1939_Status_t TxStatus;
+static uint8_t ClaimedAddress = J1939_ADDRESS_NULL;
+
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	if(pCanHandle == &Node)
+	{
+		J1939_PutFrame(pFrame);
+		return;
+	}
+
+	if(PeerCount >= TEST_PEER_QUEUE)
+	{
+		PeerLost++;
+		return;
+	}
+	PeerQueue[(PeerHead + PeerCount) % TEST_PEER_QUEUE] = *pFrame;
+	PeerCount++;
+}
+
+uint8_t* J1939_RxBufferCallback(const J1939_Id_t *pId, uint16_t Size)
+{
+	(void)Size;
+	return (pId->Da == J1939_ADDRESS_GLOBAL) ? BamBuffer : RtsBuffer;
+}
+
+void J1939_RxCallback(const J1939_Id_t *pId, const uint8_t *pData, uint16_t Size)
+{
+	if(pData == BamBuffer)
+	{
+		BamId = *pId;
+		BamSize = Size;
+		BamDone++;
+	}
+	else if(pData == RtsBuffer)
+	{
+		RtsId = *pId;
+		RtsSize = Size;
+		RtsDone++;
+	}
+}
+
+void J1939_TxDoneCallback(uint32_t Pgn, uint8_t Da, J1939_Status_t Status)
+{
+	(void)Pgn;
+	(void)Da;
+	TxStatus = Status;
+	TxDone++;
+}
+
+void J1939_AddressCallback(uint8_t Address)
+{
+	ClaimedAddress = Address;
+}
+
+/*!
+ * @brief One period of the main loop: the bus runs, then the node processes its frames
+ */
+static void TestStep(void)
+{
+	CanSimAdvance(TEST_STEP_NS);
+	J1939_Process();
+}
+
+/*!
+ * @brief Runs the main loop for the specified time
+ *
+ * @param Ms				Time (ms)
+ */
+static void TestRun(uint32_t Ms)
+{
+	for(uint32_t i = 0; i < Ms * (1000000ULL / TEST_STEP_NS); i++)
+		TestStep();
+}
+
+/*!
+ * @brief Next frame received by the peer
+ *
+ * @param pFrame			Pointer to the frame
+ * @param pId				Pointer to the decoded identifier
+ * @param TimeoutMs			Time to wait (ms)
+ * @return					1 - frame is received, 0 - timeout
+ */
+static uint8_t PeerReceive(CAN_Frame_t *pFrame, J1939_Id_t *pId, uint32_t TimeoutMs)
+{
+	uint64_t EndNs = CanSimGetTimeNs() + TimeoutMs * 1000000ULL;
+
+	while(PeerCount == 0)
+	{
+		if(CanSimGetTimeNs() >= EndNs)
+			return 0;
+		TestStep();
+	}
+
+	*pFrame = PeerQueue[PeerHead];
+	PeerHead = (PeerHead + 1) % TEST_PEER_QUEUE;
+	PeerCount--;
+	J1939_DecodeId(pFrame->Id, pId);
+	return 1;
+}
+
+/*!
+ * @brief Drops the frames received by the peer
+ */
+static void PeerFlush(void)
+{
+	CanSimRunUntilIdle();
+	J1939_Process();
+	CanSimRunUntilIdle();
+	PeerHead = 0;
+	PeerCount = 0;
+}
+
+/*!
+ * @brief Frame of the peer, waits for a free mailbox
+ *
+ * @param Pgn				Parameter group number
+ * @param Da				Destination address
+ * @param pData				Data (8 bytes)
+ */
+static void PeerSend(uint32_t Pgn, uint8_t Da, const uint8_t *pData)
+{
+	J1939_Id_t Id = {J1939_PRIORITY_TP, Pgn, Da, TEST_PEER};
+	CAN_Frame_t Frame = {J1939_EncodeId(&Id), CAN_ID_EXT, CAN_RTR_DATA, 8, {0}};
+
+	memcpy(Frame.Data, pData, 8);
+	while(!CAN_SendFrame(&Peer, &Frame))
+		TestStep();
+}
+
+/*!
+ * @brief Connection management frame of the peer
+ *
+ * @param Da				Destination address
+ * @param Control			Control byte
+ * @param Size				Bytes 1 - 2
+ * @param Byte3				Byte 3
+ * @param Byte4				Byte 4
+ * @param Pgn				Parameter group number of the transported message
+ */
+static void PeerCm(uint8_t Da, uint8_t Control, uint16_t Size, uint8_t Byte3, uint8_t Byte4, uint32_t Pgn)
+{
+	const uint8_t Data[8] = {Control, (uint8_t)Size, (uint8_t)(Size >> 8), Byte3, Byte4,
+							 (uint8_t)Pgn, (uint8_t)(Pgn >> 8), (uint8_t)(Pgn >> 16)};
+	PeerSend(J1939_PGN_TP_CM, Da, Data);
+}
+
+/*!
+ * @brief Data packet of the peer
+ *
+ * @param Da				Destination address
+ * @param pData				Message
+ * @param Sequence			Number of the packet (1 - 255)
+ */
+static void PeerDt(uint8_t Da, const uint8_t *pData, uint8_t Sequence)
+{
+	uint8_t Data[8];
+	uint16_t Offset = (Sequence - 1) * 7;
+	uint16_t Size = (TEST_SIZE - Offset < 7) ? TEST_SIZE - Offset : 7;
+
+	Data[0] = Sequence;
+	memset(&Data[1], 0xFF, 7);
+	memcpy(&Data[1], &pData[Offset], Size);
+	PeerSend(J1939_PGN_TP_DT, Da, Data);
+}
+
+/*!
+ * @brief Waits for the connection management frame sent to the peer
+ *
+ * @param pFrame			Pointer to the frame
+ * @return					Control byte, 0 - no frame
+ */
+static uint8_t PeerWaitCm(CAN_Frame_t *pFrame)
+{
+	J1939_Id_t Id;
+
+	while(PeerReceive(pFrame, &Id, 2000))
+	{
+		if(Id.Pgn == J1939_PGN_TP_CM && Id.Sa == TEST_ADDRESS)
+			return pFrame->Data[0];
+	}
+	return 0;
+}
+
+/*!
+ * @brief Collects the data packets from the node into the message
+ *
+ * @param pData				Message
+ * @param First				Number of the first packet
+ * @param Count				Number of packets
+ * @param pTimes			Times of the packets (ns), NULL - not needed
+ * @return					Number of the packets received in order
+ */
+static uint32_t PeerCollect(uint8_t *pData, uint32_t First, uint32_t Count, uint64_t *pTimes)
+{
+	CAN_Frame_t Frame;
+	J1939_Id_t Id;
+	uint32_t Packets = 0;
+
+	while(Packets < Count && PeerReceive(&Frame, &Id, 2000))
+	{
+		uint16_t Offset;
+
+		if(Id.Pgn != J1939_PGN_TP_DT || Frame.Data[0] != First + Packets)
+			break;
+
+		Offset = (Frame.Data[0] - 1) * 7;
+		memcpy(&pData[Offset], &Frame.Data[1], (TEST_SIZE - Offset < 7) ? TEST_SIZE - Offset : 7);
+		if(pTimes)
+			pTimes[Packets] = CanSimGetTimeNs();
+		Packets++;
+	}
+	return Packets;
+}
+
+int main(void)
+{
+	static uint64_t Times[TEST_PACKETS];
+	CAN_FilterExtId_t NodeFilter = {0, 0, 0, 0, 0};
+	CAN_FilterExtId_t PeerFilter = {CAN_FILTER_SLAVE_START, 0, 0, 0, 0};
+	CAN_Frame_t Frame;
+	J1939_Id_t Id;
+	uint64_t Ns, BusyNs;
+	uint32_t Packets, Cts, Next;
+
+	for(uint32_t i = 0; i < TEST_SIZE; i++)
+	{
+		TxData[i] = (uint8_t)(i * 13 + (i >> 8));
+		BamData[i] = (uint8_t)~TxData[i];
+	}
+
+	CanSimInit(TEST_BIT_RATE);
+	Node.Instance = CAN1;
+	Peer.Instance = CAN2;
+	CAN_Init(&Node);
+	CAN_Init(&Peer);
+
+	/* Frames of the same identifier leave in the order of the requests */
+	Node.Init.TransmitFifoPriority = ENABLE;
+	Peer.Init.TransmitFifoPriority = ENABLE;
+
+	/* Both nodes accept all extended frames */
+	CAN_AddRangeFilterExtID(&Node, &NodeFilter);
+	CAN_AddRangeFilterExtID(&Peer, &PeerFilter);
+	CAN_Start(&Node);
+	CAN_Start(&Peer);
+
+	/* Address claim without contention */
+	J1939_Init(&Node, TEST_NAME, TEST_ADDRESS);
+	TEST_CHECK(PeerReceive(&Frame, &Id, 10) && Id.Pgn == J1939_PGN_ADDRESS_CLAIMED && Id.Sa == TEST_ADDRESS);
+	TEST_CHECK(J1939_Send(TEST_PGN, 6, TEST_PEER, TxData, TEST_SIZE) == J1939_STATUS_NOT_CLAIMED);
+	TestRun(300);
+	TEST_CHECK(ClaimedAddress == TEST_ADDRESS && J1939_GetAddress() == TEST_ADDRESS);
+
+	/* RTS/CTS of 1785 bytes to the peer: the whole window goes back to back */
+	PeerFlush();
+	memset(Received, 0, sizeof(Received));
+	TEST_CHECK(J1939_Send(TEST_PGN, 6, TEST_PEER, TxData, TEST_SIZE) == J1939_STATUS_OK);
+	TEST_CHECK(PeerWaitCm(&Frame) == 16);
+	TEST_CHECK((Frame.Data[1] | (Frame.Data[2] << 8)) == TEST_SIZE && Frame.Data[3] == TEST_PACKETS);
+	PeerCm(TEST_ADDRESS, 17, TEST_PACKETS | (1 << 8), 0xFF, 0xFF, TEST_PGN);
+	Ns = CanSimGetTimeNs();
+	BusyNs = CanSimGetStats()->BusyNs;
+	TEST_CHECK(PeerCollect(Received, 1, TEST_PACKETS, NULL) == TEST_PACKETS);
+	TEST_CHECK((CanSimGetStats()->BusyNs - BusyNs) * 100 >= (CanSimGetTimeNs() - Ns) * 95);
+	TEST_CHECK(memcmp(Received, TxData, TEST_SIZE) == 0);
+	TEST_CHECK(TxDone == 0);
+	PeerCm(TEST_ADDRESS, 19, TEST_SIZE, TEST_PACKETS, 0xFF, TEST_PGN);
+	TestRun(5);
+	TEST_CHECK(TxDone == 1 && TxStatus == J1939_STATUS_OK);
+
+	/* Without the transmit FIFO priority the packets still keep their order */
+	Node.Init.TransmitFifoPriority = DISABLE;
+	PeerFlush();
+	memset(Received, 0, sizeof(Received));
+	TEST_CHECK(J1939_Send(TEST_PGN, 6, TEST_PEER, TxData, TEST_SIZE) == J1939_STATUS_OK);
+	TEST_CHECK(PeerWaitCm(&Frame) == 16);
+	PeerCm(TEST_ADDRESS, 17, TEST_PACKETS | (1 << 8), 0xFF, 0xFF, TEST_PGN);
+	TEST_CHECK(PeerCollect(Received, 1, TEST_PACKETS, NULL) == TEST_PACKETS);
+	TEST_CHECK(memcmp(Received, TxData, TEST_SIZE) == 0);
+	PeerCm(TEST_ADDRESS, 19, TEST_SIZE, TEST_PACKETS, 0xFF, TEST_PGN);
+	TestRun(5);
+	TEST_CHECK(TxDone == 2 && TxStatus == J1939_STATUS_OK);
+	Node.Init.TransmitFifoPriority = ENABLE;
+
+	/* BAM of 1785 bytes: one packet per J1939_BAM_INTERVAL_MS */
+	PeerFlush();
+	memset(Received, 0, sizeof(Received));
+	TEST_CHECK(J1939_Send(TEST_PGN_BAM, 6, J1939_ADDRESS_GLOBAL, BamData, TEST_SIZE) == J1939_STATUS_OK);
+	TEST_CHECK(PeerWaitCm(&Frame) == 32);
+	TEST_CHECK((Frame.Data[1] | (Frame.Data[2] << 8)) == TEST_SIZE && Frame.Data[3] == TEST_PACKETS);
+	TEST_CHECK(PeerCollect(Received, 1, TEST_PACKETS, Times) == TEST_PACKETS);
+	TEST_CHECK(memcmp(Received, BamData, TEST_SIZE) == 0);
+	for(uint32_t i = 1; i < TEST_PACKETS; i++)
+		TEST_CHECK(Times[i] - Times[i - 1] >= (J1939_BAM_INTERVAL_MS - 1) * 1000000ULL);
+	TEST_CHECK(Times[TEST_PACKETS - 1] - Times[0] <= (TEST_PACKETS - 1) * (J1939_BAM_INTERVAL_MS + 1) * 1000000ULL);
+	TestRun(5);
+	TEST_CHECK(TxDone == 3 && TxStatus == J1939_STATUS_OK);
+
+	/* RTS/CTS of 1785 bytes from the peer: the CTS windows keep the limit of the RTS */
+	PeerFlush();
+	PeerCm(TEST_ADDRESS, 16, TEST_SIZE, TEST_PACKETS, TEST_PEER_WINDOW, TEST_PGN);
+	Next = 1;
+	Cts = 0;
+	while(PeerWaitCm(&Frame) == 17)
+	{
+		TEST_CHECK(Frame.Data[1] >= 1 && Frame.Data[1] <= TEST_PEER_WINDOW && Frame.Data[2] == Next);
+		for(uint32_t i = 0; i < Frame.Data[1]; i++)
+			PeerDt(TEST_ADDRESS, TxData, (uint8_t)Next++);
+		Cts++;
+	}
+	TEST_CHECK(Frame.Data[0] == 19 && (Frame.Data[1] | (Frame.Data[2] << 8)) == TEST_SIZE);
+	TEST_CHECK(Next == TEST_PACKETS + 1 && Cts == (TEST_PACKETS + TEST_PEER_WINDOW - 1) / TEST_PEER_WINDOW);
+	TEST_CHECK(RtsDone == 1 && RtsSize == TEST_SIZE && RtsId.Pgn == TEST_PGN);
+	TEST_CHECK(RtsId.Sa == TEST_PEER && RtsId.Da == TEST_ADDRESS);
+	TEST_CHECK(memcmp(RtsBuffer, TxData, TEST_SIZE) == 0);
+
+	/* BAM and RTS/CTS of the same peer at the same time, the packets are interleaved */
+	PeerFlush();
+	memset(RtsBuffer, 0, sizeof(RtsBuffer));
+	PeerCm(J1939_ADDRESS_GLOBAL, 32, TEST_SIZE, TEST_PACKETS, 0xFF, TEST_PGN_BAM);
+	PeerCm(TEST_ADDRESS, 16, TEST_SIZE, TEST_PACKETS, 0xFF, TEST_PGN);
+	TEST_CHECK(PeerWaitCm(&Frame) == 17 && Frame.Data[1] == TEST_PACKETS && Frame.Data[2] == 1);
+	for(uint32_t i = 1; i <= TEST_PACKETS; i++)
+	{
+		PeerDt(J1939_ADDRESS_GLOBAL, BamData, (uint8_t)i);
+		PeerDt(TEST_ADDRESS, TxData, (uint8_t)i);
+	}
+	TEST_CHECK(PeerWaitCm(&Frame) == 19);
+	TEST_CHECK(BamDone == 1 && BamSize == TEST_SIZE && BamId.Pgn == TEST_PGN_BAM && BamId.Da == J1939_ADDRESS_GLOBAL);
+	TEST_CHECK(memcmp(BamBuffer, BamData, TEST_SIZE) == 0);
+	TEST_CHECK(RtsDone == 2 && memcmp(RtsBuffer, TxData, TEST_SIZE) == 0);
+
+	/* The refused RTS is aborted: size over the limit, packets disagree with the size, second PGN */
+	PeerFlush();
+	PeerCm(TEST_ADDRESS, 16, TEST_SIZE + 1, TEST_PACKETS, 0xFF, TEST_PGN);
+	TEST_CHECK(PeerWaitCm(&Frame) == 255 && Frame.Data[1] == 9);
+	PeerCm(TEST_ADDRESS, 16, 100, 20, 0xFF, TEST_PGN);
+	TEST_CHECK(PeerWaitCm(&Frame) == 255 && Frame.Data[1] == 250);
+	TEST_CHECK((Frame.Data[5] | (Frame.Data[6] << 8) | ((uint32_t)Frame.Data[7] << 16)) == TEST_PGN);
+
+	PeerCm(TEST_ADDRESS, 16, 100, 15, 0xFF, TEST_PGN);
+	TEST_CHECK(PeerWaitCm(&Frame) == 17);
+	PeerCm(TEST_ADDRESS, 16, 100, 15, 0xFF, TEST_PGN_BAM);
+	TEST_CHECK(PeerWaitCm(&Frame) == 255 && Frame.Data[1] == 1 && Frame.Data[6] == (uint8_t)(TEST_PGN_BAM >> 8));
+	PeerCm(TEST_ADDRESS, 255, 0xFF03, 0xFF, 0xFF, TEST_PGN);
+	TestRun(5);
+	TEST_CHECK(RtsDone == 2);
+
+	/* Full TX queue: the message is refused and no session is left behind */
+	PeerFlush();
+	Packets = 0;
+	while(J1939_Send(TEST_PGN_BAM, 6, J1939_ADDRESS_GLOBAL, TxData, 8) == J1939_STATUS_OK)
+		Packets++;
+	TEST_CHECK(Packets == 3 + J1939_TX_QUEUE_SIZE);
+	TEST_CHECK(J1939_Send(TEST_PGN, 6, TEST_PEER, TxData, TEST_SIZE) == J1939_STATUS_BUSY);
+	TEST_CHECK(J1939_Send(TEST_PGN_BAM, 6, J1939_ADDRESS_GLOBAL, TxData, TEST_SIZE) == J1939_STATUS_BUSY);
+	PeerFlush();
+	TEST_CHECK(J1939_Send(TEST_PGN, 6, TEST_PEER, TxData, TEST_SIZE) == J1939_STATUS_OK);
+	TEST_CHECK(PeerWaitCm(&Frame) == 16);
+	PeerCm(TEST_ADDRESS, 255, 0xFF01, 0xFF, 0xFF, TEST_PGN);
+	TestRun(5);
+	TEST_CHECK(TxDone == 4 && TxStatus == J1939_STATUS_ABORTED);
+
+	TEST_CHECK(PeerLost == 0 && CanSimGetNodeStats(&Node)->RxLost == 0);
+
+	printf("J1939: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* J1939_SIM_TEST */
@@ -0,0 +1,469 @@
+/*!
+ * @file      Slcan.c
+ *
+ * @brief     SLCAN (Lawicel) serial bridge of the CAN bus
+ *
+ * @author    Anosov Anton
+ */
+
+#include "Slcan.h"
+
+// Max size of one encoded frame
+#define SLCAN_FRAME_MAX_SIZE		32
+
+// Max size of one command line
+#define SLCAN_CMD_MAX_SIZE			32
+
+// Timestamp range of the Lawicel protocol (ms)
+#define SLCAN_TIMESTAMP_RANGE		60000
+
+#define SLCAN_CR					'\r'
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+static CAN_HandleTypeDef *pSlcanCan;
+static SlcanMode_t SlcanMode;
+static SlcanStats_t SlcanStats;
+static uint8_t IsBusOpen;
+static uint8_t IsTimestampOn;
+
+/* Double buffered DMA chunks */
+static uint8_t Batch[2][SLCAN_BATCH_SIZE];
+static uint16_t BatchLen[2];
+static uint8_t FillIndex;
+static uint32_t FillTick;
+static volatile uint8_t IsDmaBusy;
+
+/* Commands from the host */
+static Fifo_t CmdFifo;
+static uint8_t CmdFifoBuff[SLCAN_RX_FIFO_SIZE];
+static char CmdLine[SLCAN_CMD_MAX_SIZE];
+static uint8_t CmdLen;
+static uint8_t IsCmdDiscard;
+
+/*!
+ * @brief Start DMA of the filled chunk (call inside the critical section)
+ */
+static void SlcanKick(void)
+{
+	uint8_t SendIndex = FillIndex;
+
+	if(IsDmaBusy || BatchLen[SendIndex] == 0)
+		return;
+
+	IsDmaBusy = 1;
+	FillIndex ^= 1;
+	BatchLen[FillIndex] = 0;
+
+	if(HAL_UART_Transmit_DMA(&SLCAN_UART, Batch[SendIndex], BatchLen[SendIndex]) != HAL_OK)
+	{
+		/* UART is busy, retry on the next process */
+		IsDmaBusy = 0;
+		FillIndex = SendIndex;
+	}
+}
+
+/*!
+ * @brief Append bytes to the filled chunk
+ *
+ * @param pData				Data pointer
+ * @param Size				Data size
+ * @return					1 - appended, 0 - both chunks are busy
+ */
+static uint8_t SlcanAppend(const uint8_t *pData, uint16_t Size)
+{
+	uint8_t IsAppended = 0;
+
+	SLCAN_BEGIN_CRITICAL_SECTION();
+
+	if(BatchLen[FillIndex] + Size > SLCAN_BATCH_SIZE)
+		SlcanKick();
+
+	if(BatchLen[FillIndex] + Size <= SLCAN_BATCH_SIZE)
+	{
+		if(BatchLen[FillIndex] == 0)
+			FillTick = HAL_GetTick();
+		memcpy(&Batch[FillIndex][BatchLen[FillIndex]], pData, Size);
+		BatchLen[FillIndex] += Size;
+		IsAppended = 1;
+	}
+
+	SLCAN_END_CRITICAL_SECTION();
+
+	return IsAppended;
+}
+
+/*!
+ * @brief Append hex digits of the value
+ *
+ * @param pBuff				Pointer to the buffer
+ * @param Value				Value
+ * @param Digits			Number of digits
+ * @return					Number of the appended bytes
+ */
+static uint8_t SlcanPutHex(uint8_t *pBuff, uint32_t Value, uint8_t Digits)
+{
+	for(uint8_t i = 0; i < Digits; i++)
+	{
+		pBuff[i] = HexDigits[(Value >> ((Digits - 1 - i) * 4)) & 0x0F];
+	}
+	return Digits;
+}
+
+/*!
+ * @brief Parse hex digits
+ *
+ * @param pStr				Pointer to the string
+ * @param Digits			Number of digits
+ * @param pValue			Pointer to the value
+ * @return					1 - successful parse, 0 - syntax error
+ */
+static uint8_t SlcanGetHex(const char *pStr, uint8_t Digits, uint32_t *pValue)
+{
+	uint32_t Value = 0;
+
+	for(uint8_t i = 0; i < Digits; i++)
+	{
+		char Ch = pStr[i];
+
+		Value <<= 4;
+		if(Ch >= '0' && Ch <= '9')
+			Value |= (uint32_t)(Ch - '0');
+		else if(Ch >= 'A' && Ch <= 'F')
+			Value |= (uint32_t)(Ch - 'A' + 10);
+		else if(Ch >= 'a' && Ch <= 'f')
+			Value |= (uint32_t)(Ch - 'a' + 10);
+		else
+			return 0;
+	}
+
+	*pValue = Value;
+	return 1;
+}
+
+/*!
+ * @brief Encode frame into the Lawicel ASCII format
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param pBuff				Pointer to the buffer
+ * @return					Size of the encoded frame
+ */
+static uint16_t SlcanEncodeAscii(const CAN_Frame_t *pFrame, uint8_t *pBuff)
+{
+	uint16_t Size = 0;
+
+	if(pFrame->IDE == CAN_ID_EXT)
+	{
+		pBuff[Size++] = (pFrame->RTR == CAN_RTR_REMOTE) ? 'R' : 'T';
+		Size += SlcanPutHex(&pBuff[Size], pFrame->Id, 8);
+	}
+	else
+	{
+		pBuff[Size++] = (pFrame->RTR == CAN_RTR_REMOTE) ? 'r' : 't';
+		Size += SlcanPutHex(&pBuff[Size], pFrame->Id, 3);
+	}
+
+	pBuff[Size++] = HexDigits[pFrame->Dlc & 0x0F];
+
+	if(pFrame->RTR != CAN_RTR_REMOTE)
+	{
+		for(uint8_t i = 0; i < pFrame->Dlc; i++)
+		{
+			Size += SlcanPutHex(&pBuff[Size], pFrame->Data[i], 2);
+		}
+	}
+
+	if(IsTimestampOn)
+		Size += SlcanPutHex(&pBuff[Size], HAL_GetTick() % SLCAN_TIMESTAMP_RANGE, 4);
+
+	pBuff[Size++] = SLCAN_CR;
+
+	return Size;
+}
+
+/*!
+ * @brief Encode frame into the compact binary format
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ * @param pBuff				Pointer to the buffer
+ * @return					Size of the encoded frame
+ */
+static uint16_t SlcanEncodeBinary(const CAN_Frame_t *pFrame, uint8_t *pBuff)
+{
+	uint16_t Size = 0;
+	uint16_t Timestamp = (uint16_t)(HAL_GetTick() % SLCAN_TIMESTAMP_RANGE);
+
+	pBuff[Size] = SLCAN_BIN_MARKER | (pFrame->Dlc & 0x0F);
+	if(pFrame->RTR == CAN_RTR_REMOTE)
+		pBuff[Size] |= SLCAN_BIN_RTR;
+
+	if(pFrame->IDE == CAN_ID_EXT)
+	{
+		pBuff[Size++] |= SLCAN_BIN_EXT;
+		pBuff[Size++] = (uint8_t)(pFrame->Id);
+		pBuff[Size++] = (uint8_t)(pFrame->Id >> 8);
+		pBuff[Size++] = (uint8_t)(pFrame->Id >> 16);
+		pBuff[Size++] = (uint8_t)(pFrame->Id >> 24);
+	}
+	else
+	{
+		Size++;
+		pBuff[Size++] = (uint8_t)(pFrame->Id);
+		pBuff[Size++] = (uint8_t)(pFrame->Id >> 8);
+	}
+
+	pBuff[Size++] = (uint8_t)(Timestamp);
+	pBuff[Size++] = (uint8_t)(Timestamp >> 8);
+
+	if(pFrame->RTR != CAN_RTR_REMOTE)
+	{
+		memcpy(&pBuff[Size], pFrame->Data, pFrame->Dlc);
+		Size += pFrame->Dlc;
+	}
+
+	return Size;
+}
+
+/*!
+ * @brief Send reply to the host
+ *
+ * @param pReply			Pointer to the string
+ */
+static void SlcanReply(const char *pReply)
+{
+	SlcanAppend((const uint8_t*)pReply, strlen(pReply));
+}
+
+/*!
+ * @brief Transmit command (tiiiLDD.., TiiiiiiiiLDD.., riiiL, RiiiiiiiiL)
+ *
+ * @param pLine				Pointer to the command line
+ * @param Len				Length of the command line
+ * @return					1 - frame is sent, 0 - error
+ */
+static uint8_t SlcanTransmitCommand(const char *pLine, uint8_t Len)
+{
+	CAN_Frame_t Frame = {0};
+	uint8_t IdDigits;
+	uint8_t Pos = 1;
+	uint32_t Value;
+
+	Frame.IDE = (pLine[0] == 'T' || pLine[0] == 'R') ? CAN_ID_EXT : CAN_ID_STD;
+	Frame.RTR = (pLine[0] == 'r' || pLine[0] == 'R') ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+	IdDigits = (Frame.IDE == CAN_ID_EXT) ? 8 : 3;
+
+	if(Len < Pos + IdDigits + 1 || !SlcanGetHex(&pLine[Pos], IdDigits, &Frame.Id))
+		return 0;
+	Pos += IdDigits;
+
+	if(!SlcanGetHex(&pLine[Pos++], 1, &Value) || Value > 8)
+		return 0;
+	Frame.Dlc = (uint8_t)Value;
+
+	if(Frame.RTR == CAN_RTR_DATA)
+	{
+		if(Len < Pos + Frame.Dlc * 2)
+			return 0;
+		for(uint8_t i = 0; i < Frame.Dlc; i++, Pos += 2)
+		{
+			if(!SlcanGetHex(&pLine[Pos], 2, &Value))
+				return 0;
+			Frame.Data[i] = (uint8_t)Value;
+		}
+	}
+
+	if(!IsBusOpen)
+		return 0;
+
+	return CAN_SendFrame(pSlcanCan, &Frame);
+}
+
+/*!
+ * @brief Execute the command line of the host
+ *
+ * @param pLine				Pointer to the command line
+ * @param Len				Length of the command line
+ */
+static void SlcanExecute(const char *pLine, uint8_t Len)
+{
+	if(Len == 0)
+		return;
+
+	switch(pLine[0])
+	{
+		case 'O':
+			IsBusOpen = 1;
+			SlcanReply("\r");
+			break;
+		case 'C':
+			IsBusOpen = 0;
+			SlcanReply("\r");
+			break;
+		case 'V':
+			SlcanReply("V1013\r");
+			break;
+		case 'N':
+			SlcanReply("N" SLCAN_SERIAL "\r");
+			break;
+		case 'F':
+			SlcanReply("F00\r");
+			break;
+		case 'Z':
+			IsTimestampOn = (Len > 1 && pLine[1] == '1');
+			SlcanReply("\r");
+			break;
+		case 'Y':
+			// Extension: Y1 - binary framing, Y0 - ASCII framing
+			SlcanMode = (Len > 1 && pLine[1] == '1') ? SLCAN_MODE_BINARY : SLCAN_MODE_ASCII;
+			SlcanReply("\r");
+			break;
+		case 't':
+		case 'T':
+		case 'r':
+		case 'R':
+			if(SlcanTransmitCommand(pLine, Len))
+			{
+				SlcanStats.TxFrames++;
+				SlcanReply((pLine[0] == 't' || pLine[0] == 'r') ? "z\r" : "Z\r");
+			}
+			else
+			{
+				SlcanStats.TxErrors++;
+				SlcanReply("\a");
+			}
+			break;
+		default:
+			// Also 'L' (listen-only) and 'S'/'s' (bit rate): the mode and bit rate are set by CAN_Init
+			SlcanStats.TxErrors++;
+			SlcanReply("\a");
+			break;
+	}
+}
+
+/*!
+ * @brief Initialization of the bridge
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param Mode				Framing of the frames
+ */
+void SlcanInit(CAN_HandleTypeDef *pCanHandle, SlcanMode_t Mode)
+{
+	pSlcanCan = pCanHandle;
+	SlcanMode = Mode;
+	IsBusOpen = 0;
+	IsTimestampOn = 0;
+	IsDmaBusy = 0;
+	FillIndex = 0;
+	BatchLen[0] = 0;
+	BatchLen[1] = 0;
+	CmdLen = 0;
+	IsCmdDiscard = 0;
+	memset(&SlcanStats, 0, sizeof(SlcanStats));
+
+	FifoInit(&CmdFifo, CmdFifoBuff, SLCAN_RX_FIFO_SIZE);
+}
+
+/*!
+ * @brief Put received frame to the batch (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void SlcanPutFrame(const CAN_Frame_t *pFrame)
+{
+	uint8_t Buff[SLCAN_FRAME_MAX_SIZE];
+	uint16_t Size;
+
+	if(!IsBusOpen)
+		return;
+
+	if(SlcanMode == SLCAN_MODE_BINARY)
+		Size = SlcanEncodeBinary(pFrame, Buff);
+	else
+		Size = SlcanEncodeAscii(pFrame, Buff);
+
+	if(SlcanAppend(Buff, Size))
+		SlcanStats.RxFrames++;
+	else
+		SlcanStats.RxOverruns++;
+}
+
+/*!
+ * @brief Put received command byte (call from the UART RX interrupt)
+ *
+ * @param Ch				Received byte
+ */
+void SlcanPutCommandChar(uint8_t Ch)
+{
+	FifoPutChar(&CmdFifo, Ch);
+}
+
+/*!
+ * @brief Handler of the DMA transfer complete (call from HAL_UART_TxCpltCallback)
+ *
+ * @param pUart				Pointer to the UART_HandleTypeDef description
+ */
+void SlcanTxCpltHandler(UART_HandleTypeDef *pUart)
+{
+	if(pUart != &SLCAN_UART)
+		return;
+
+	SLCAN_BEGIN_CRITICAL_SECTION();
+
+	/* Frames collected during the previous transfer form the next chunk */
+	IsDmaBusy = 0;
+	SlcanKick();
+
+	SLCAN_END_CRITICAL_SECTION();
+}
+
+/*!
+ * @brief Processing of the commands and flushing of the batch (call from the main loop)
+ */
+void SlcanProcess(void)
+{
+	uint8_t Ch;
+
+	while(FifoGetChar(&CmdFifo, &Ch) == FIFO_STATUS_OK)
+	{
+		if(Ch == SLCAN_CR)
+		{
+			if(!IsCmdDiscard)
+				SlcanExecute(CmdLine, CmdLen);
+			IsCmdDiscard = 0;
+			CmdLen = 0;
+		}
+		else if(IsCmdDiscard)
+		{
+			/* Rest of the too long line up to CR */
+		}
+		else if(CmdLen < SLCAN_CMD_MAX_SIZE)
+		{
+			CmdLine[CmdLen++] = (char)Ch;
+		}
+		else
+		{
+			/* Line is too long, the whole line is dropped */
+			IsCmdDiscard = 1;
+			CmdLen = 0;
+			SlcanStats.TxErrors++;
+			SlcanReply("\a");
+		}
+	}
+
+	SLCAN_BEGIN_CRITICAL_SECTION();
+
+	if(BatchLen[FillIndex] != 0 && (HAL_GetTick() - FillTick) >= SLCAN_FLUSH_TIMEOUT)
+		SlcanKick();
+
+	SLCAN_END_CRITICAL_SECTION();
+}
+
+/*!
+ * @brief Get statistics of the bridge
+ *
+ * @return					Pointer to the SlcanStats_t
+ */
+const SlcanStats_t* SlcanGetStats(void)
+{
+	return &SlcanStats;
+}
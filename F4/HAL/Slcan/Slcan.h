@@ -0,0 +1,157 @@
+/*!
+ * @file      Slcan.h
+ *
+ * @brief     SLCAN (Lawicel) serial bridge of the CAN bus
+ *
+ * @author    Anosov Anton
+ */
+
+#ifndef SLCAN_H_
+#define SLCAN_H_
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include "CAN.h"
+#include "Fifo.h"
+#include "DebugPrint.h"
+
+#define SLCAN_BEGIN_CRITICAL_SECTION()		__disable_irq()
+#define SLCAN_END_CRITICAL_SECTION()		__enable_irq()
+
+/*!
+ * UART of the bridge. The default is the UART of DebugPrint: the blocking DebugPrint would break
+ * into the DMA chunks, so it must be off (NO_DEBUGPRINT) or the bridge gets its own UART
+ */
+#ifndef SLCAN_UART
+#define SLCAN_UART							DEBUG_UART
+#if !defined(NO_DEBUGPRINT) && defined(DEBUGPRINT)
+#error "Slcan shares DEBUG_UART with DebugPrint: define SLCAN_UART (e.g. huart2) or NO_DEBUGPRINT"
+#endif
+#endif
+
+extern UART_HandleTypeDef SLCAN_UART;
+
+/*!
+ * Size of one DMA chunk. Two chunks are used: one is sent by DMA,
+ * the other is filled from the CAN RX interrupt.
+ * At 1 Mbit/s full load (~8000 frames/s) the binary mode needs ~110 KB/s
+ * and the ASCII mode with timestamps ~210 KB/s on the UART.
+ */
+#define SLCAN_BATCH_SIZE					512
+
+/*!
+ * Partially filled chunk is sent after this time (ms)
+ */
+#define SLCAN_FLUSH_TIMEOUT					2
+
+/*!
+ * Serial number reported by the N command (4 characters)
+ */
+#ifndef SLCAN_SERIAL
+#define SLCAN_SERIAL						"F407"
+#endif
+
+/*!
+ * Size of the command FIFO
+ */
+#define SLCAN_RX_FIFO_SIZE					128
+
+/*!
+ * Marker of the binary frame: 0b10ERDDDD (E - extended ID, R - remote frame, D - DLC)
+ */
+#define SLCAN_BIN_MARKER					0x80
+#define SLCAN_BIN_EXT						0x20
+#define SLCAN_BIN_RTR						0x10
+
+/*!
+ * Framing of the frames sent to the host
+ */
+typedef enum SlcanMode_e
+{
+	/*!
+	 * Lawicel ASCII (tiiiLDD..[TTTT]\r)
+	 */
+	SLCAN_MODE_ASCII = 0,
+
+	/*!
+	 * Compact binary (marker, ID LE 2/4 bytes, timestamp LE 2 bytes, data)
+	 */
+	SLCAN_MODE_BINARY
+
+}SlcanMode_t;
+
+/*!
+ * Statistics of the bridge
+ */
+typedef struct SlcanStats_s
+{
+	/*!
+	 * Frames sent to the host
+	 */
+	uint32_t RxFrames;
+
+	/*!
+	 * Frames lost because both chunks were busy
+	 */
+	uint32_t RxOverruns;
+
+	/*!
+	 * Frames transmitted on command of the host
+	 */
+	uint32_t TxFrames;
+
+	/*!
+	 * Commands rejected (syntax error, bus closed, no free mailbox)
+	 */
+	uint32_t TxErrors;
+
+}SlcanStats_t;
+
+/*!
+ * @brief Initialization of the bridge
+ *
+ * @param pCanHandle		Pointer to the CAN_HandleTypeDef description
+ * @param Mode				Framing of the frames
+ */
+void SlcanInit(CAN_HandleTypeDef *pCanHandle, SlcanMode_t Mode);
+
+/*!
+ * @brief Put received frame to the batch (call from CAN_RxFrameCallback)
+ *
+ * @param pFrame			Pointer to the CAN_Frame_t description
+ */
+void SlcanPutFrame(const CAN_Frame_t *pFrame);
+
+/*!
+ * @brief Put received command byte (call from the UART RX interrupt)
+ *
+ * @param Ch				Received byte
+ */
+void SlcanPutCommandChar(uint8_t Ch);
+
+/*!
+ * @brief Handler of the DMA transfer complete (call from HAL_UART_TxCpltCallback)
+ *
+ * @param pUart				Pointer to the UART_HandleTypeDef description
+ */
+void SlcanTxCpltHandler(UART_HandleTypeDef *pUart);
+
+/*!
+ * @brief Processing of the commands and flushing of the batch (call from the main loop)
+ */
+void SlcanProcess(void);
+
+/*!
+ * @brief Get statistics of the bridge
+ *
+ * @return					Pointer to the SlcanStats_t
+ */
+const SlcanStats_t* SlcanGetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SLCAN_H_ */
@@ -0,0 +1,506 @@
+/*!
+ * @file      Slcan_Pty_Test.c
+ *
+ * @brief     Checks of the bridge through a pseudo-terminal: the UART DMA of the bridge writes into the PTY
+ *            master at the baud rate, the test plays the PC on the slave side. Commands of the host, then
+ *            1 s of the full load of the 1 Mbit/s bus in the ASCII (with timestamps) and the binary framing:
+ *            every frame must reach the PC in order (host build, SLCAN_PTY_TEST)
+ *
+ *            --serve keeps the bridge on the PTY in real time for a PC tool (slcand -o, python-can),
+ *            the simulated bus carries 100 frames/s
+ *
+ * Build:     gcc -O2 -DCAN_SIMULATION -DSLCAN_PTY_TEST -I../Host -I../CAN -I../Fifo -I../DebugPrint -I.
+ *            Slcan_Pty_Test.c Slcan.c ../Fifo/Fifo.c ../CAN/CAN.c ../CAN/CAN_Sim.c ../Host/Host_Core.c
+ *            -o slcan_pty_test
+ *
+ * @author    Anosov Anton
+ */
+
+#ifdef SLCAN_PTY_TEST
+
+#define _GNU_SOURCE
+#include "Slcan.h"
+#include "CAN_Sim.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define TEST_BIT_RATE				1000000
+#define TEST_UART_BAUD				3000000			/* 10 bits per byte on the wire */
+#define TEST_STEP_NS				20000ULL		/* Main loop period */
+#define TEST_LOAD_NS				1000000000ULL	/* Time of the full load */
+#define TEST_SERVE_PERIOD_MS		10				/* Frame period of --serve */
+
+#define TEST_CHECK(Cond)			do { if(!(Cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #Cond); Errors++; } } while(0)
+
+UART_HandleTypeDef huart1;
+
+static uint32_t Errors;
+static CAN_HandleTypeDef Gen, Bridge;
+static int Master = -1, Slave = -1;
+
+/* DMA transfer of the UART */
+static const uint8_t *pDmaData;
+static uint16_t DmaSize;
+static uint64_t DmaEndNs;
+static uint8_t IsDmaActive;
+static uint64_t UartBytes;
+
+/* Frames of the generator node */
+static uint32_t GenSent;
+static uint32_t GenRxCount;
+static CAN_Frame_t GenRxFrame;
+
+/* PC side of the PTY */
+static uint8_t PcRecord[32];
+static uint8_t PcRecordLen, PcRecordNeed;
+static char PcLine[64];
+static uint8_t PcLineLen;
+static char PcReply[64];
+static uint32_t PcReplies;
+static uint32_t PcFrames;
+static uint32_t PcMismatches;
+
+/*!
+ * @brief Frame number i of the generator: standard and extended 8-byte, empty and remote frames in turn
+ *
+ * @param i					Number of the frame
+ * @return					Frame
+ */
+static CAN_Frame_t TestFrame(uint32_t i)
+{
+	CAN_Frame_t Frame = {i & 0x7FF, CAN_ID_STD, CAN_RTR_DATA, 8, {0}};
+
+	switch(i % 4)
+	{
+		case 1:
+			Frame.Id = (0x10000000 | i) & 0x1FFFFFFF;
+			Frame.IDE = CAN_ID_EXT;
+			break;
+		case 2:
+			Frame.Dlc = 0;
+			break;
+		case 3:
+			Frame.RTR = CAN_RTR_REMOTE;
+			Frame.Dlc = i % 9;
+			break;
+		default:
+			break;
+	}
+
+	if(Frame.RTR == CAN_RTR_DATA)
+	{
+		for(uint8_t k = 0; k < Frame.Dlc; k++)
+			Frame.Data[k] = (uint8_t)((i >> k) ^ (k * 0x35));
+	}
+	return Frame;
+}
+
+/*!
+ * @brief Check of the frame decoded by the PC against the generator
+ *
+ * @param pFrame			Pointer to the decoded frame
+ */
+static void PcCheckFrame(const CAN_Frame_t *pFrame)
+{
+	CAN_Frame_t Expected = TestFrame(PcFrames++);
+
+	if(pFrame->Id != Expected.Id || pFrame->IDE != Expected.IDE || pFrame->RTR != Expected.RTR ||
+	   pFrame->Dlc != Expected.Dlc || (pFrame->RTR == CAN_RTR_DATA && memcmp(pFrame->Data, Expected.Data, pFrame->Dlc) != 0))
+		PcMismatches++;
+}
+
+/*!
+ * @brief Parse hex digits of the ASCII frame
+ *
+ * @param pStr				Pointer to the string
+ * @param Digits			Number of digits
+ * @return					Value
+ */
+static uint32_t PcHex(const char *pStr, uint8_t Digits)
+{
+	char Buff[9] = {0};
+
+	memcpy(Buff, pStr, Digits);
+	return (uint32_t)strtoul(Buff, NULL, 16);
+}
+
+/*!
+ * @brief Line of the ASCII protocol: frame (tiiiLDD..[TTTT]) or reply to the command
+ */
+static void PcLineDone(void)
+{
+	char Type = (PcLineLen > 0) ? PcLine[0] : 0;
+
+	if(Type == 't' || Type == 'T' || Type == 'r' || Type == 'R')
+	{
+		CAN_Frame_t Frame = {0};
+		uint8_t Digits = (Type == 'T' || Type == 'R') ? 8 : 3;
+		uint8_t Pos = 1 + Digits + 1;
+
+		Frame.IDE = (Digits == 8) ? CAN_ID_EXT : CAN_ID_STD;
+		Frame.RTR = (Type == 'r' || Type == 'R') ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+		Frame.Id = PcHex(&PcLine[1], Digits);
+		Frame.Dlc = (uint8_t)PcHex(&PcLine[1 + Digits], 1);
+		if(Frame.RTR == CAN_RTR_DATA)
+		{
+			for(uint8_t i = 0; i < Frame.Dlc && i < 8; i++, Pos += 2)
+				Frame.Data[i] = (uint8_t)PcHex(&PcLine[Pos], 2);
+		}
+		if(PcLineLen != Pos && PcLineLen != Pos + 4)
+			PcMismatches++;
+		PcCheckFrame(&Frame);
+	}
+	else
+	{
+		memcpy(PcReply, PcLine, PcLineLen);
+		PcReply[PcLineLen] = 0;
+		PcReplies++;
+	}
+	PcLineLen = 0;
+}
+
+/*!
+ * @brief Record of the binary framing (marker, ID LE 2/4 bytes, timestamp LE 2 bytes, data)
+ */
+static void PcRecordDone(void)
+{
+	CAN_Frame_t Frame = {0};
+	uint8_t Marker = PcRecord[0];
+	uint8_t Pos = 1;
+
+	Frame.IDE = (Marker & SLCAN_BIN_EXT) ? CAN_ID_EXT : CAN_ID_STD;
+	Frame.RTR = (Marker & SLCAN_BIN_RTR) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+	Frame.Dlc = Marker & 0x0F;
+	Frame.Id = PcRecord[Pos] | (PcRecord[Pos + 1] << 8);
+	Pos += 2;
+	if(Frame.IDE == CAN_ID_EXT)
+	{
+		Frame.Id |= ((uint32_t)PcRecord[Pos] << 16) | ((uint32_t)PcRecord[Pos + 1] << 24);
+		Pos += 2;
+	}
+	Pos += 2;
+	if(Frame.RTR == CAN_RTR_DATA)
+		memcpy(Frame.Data, &PcRecord[Pos], Frame.Dlc);
+
+	PcCheckFrame(&Frame);
+	PcRecordLen = 0;
+}
+
+/*!
+ * @brief PC reads the slave side of the PTY: binary records start with the marker bit,
+ *        everything else is ASCII up to CR (or a single BEL)
+ */
+static void PcRead(void)
+{
+	uint8_t Buff[256];
+	ssize_t Size;
+
+	while((Size = read(Slave, Buff, sizeof(Buff))) > 0)
+	{
+		for(ssize_t i = 0; i < Size; i++)
+		{
+			uint8_t Ch = Buff[i];
+
+			if(PcRecordLen > 0 || (PcLineLen == 0 && (Ch & SLCAN_BIN_MARKER)))
+			{
+				if(PcRecordLen == 0)
+					PcRecordNeed = 1 + ((Ch & SLCAN_BIN_EXT) ? 4 : 2) + 2 + ((Ch & SLCAN_BIN_RTR) ? 0 : (Ch & 0x0F));
+				PcRecord[PcRecordLen++] = Ch;
+				if(PcRecordLen == PcRecordNeed)
+					PcRecordDone();
+			}
+			else if(Ch == '\r')
+			{
+				PcLineDone();
+			}
+			else if(Ch == '\a' && PcLineLen == 0)
+			{
+				PcLine[PcLineLen++] = (char)Ch;
+				PcLineDone();
+			}
+			else if(PcLineLen < sizeof(PcLine) - 1)
+			{
+				PcLine[PcLineLen++] = (char)Ch;
+			}
+		}
+	}
+}
+
+/*!
+ * @brief Bytes on the wire of the UART into the PTY master
+ *
+ * @param pData				Data pointer
+ * @param Size				Data size
+ */
+static void PtyWrite(const uint8_t *pData, uint16_t Size)
+{
+	uint16_t Written = 0;
+
+	while(Written < Size)
+	{
+		ssize_t Result = write(Master, &pData[Written], Size - Written);
+
+		if(Result > 0)
+			Written += (uint16_t)Result;
+		else if(Result < 0 && errno == EAGAIN && Slave >= 0)
+			PcRead();
+		else
+			break;		/* Nobody on the slave side (--serve): the bytes are lost as on an open line */
+	}
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if(huart != &huart1 || IsDmaActive)
+		return HAL_BUSY;
+
+	pDmaData = pData;
+	DmaSize = Size;
+	DmaEndNs = CanSimGetTimeNs() + (uint64_t)Size * 10 * 1000000000ULL / TEST_UART_BAUD;
+	IsDmaActive = 1;
+	return HAL_OK;
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	SlcanTxCpltHandler(huart);
+}
+
+void CAN_RxFrameCallback(CAN_HandleTypeDef *pCanHandle, const CAN_Frame_t *pFrame)
+{
+	if(pCanHandle == &Bridge)
+	{
+		SlcanPutFrame(pFrame);
+		return;
+	}
+	GenRxFrame = *pFrame;
+	GenRxCount++;
+}
+
+/*!
+ * @brief UART of the bridge: end of the DMA transfer at the baud rate, received bytes of the commands
+ */
+static void UartProcess(void)
+{
+	uint8_t Buff[64];
+	ssize_t Size;
+
+	if(IsDmaActive && CanSimGetTimeNs() >= DmaEndNs)
+	{
+		PtyWrite(pDmaData, DmaSize);
+		UartBytes += DmaSize;
+		IsDmaActive = 0;
+		HAL_UART_TxCpltCallback(&huart1);
+	}
+
+	while((Size = read(Master, Buff, sizeof(Buff))) > 0)
+	{
+		for(ssize_t i = 0; i < Size; i++)
+			SlcanPutCommandChar(Buff[i]);
+	}
+}
+
+/*!
+ * @brief One period of the main loop
+ *
+ * @param IsLoad			1 - the generator keeps its mailboxes full
+ */
+static void TestStep(uint8_t IsLoad)
+{
+	CAN_Frame_t Frame;
+
+	while(IsLoad && (Frame = TestFrame(GenSent), CAN_SendFrame(&Gen, &Frame)))
+		GenSent++;
+
+	CanSimAdvance(TEST_STEP_NS);
+	UartProcess();
+	SlcanProcess();
+	if(Slave >= 0)
+		PcRead();
+}
+
+/*!
+ * @brief Command of the PC, waits for the reply
+ *
+ * @param pCommand			Command with CR
+ * @param pReply			Expected reply without CR
+ * @return					1 - the reply is as expected
+ */
+static uint8_t PcCommand(const char *pCommand, const char *pReply)
+{
+	uint32_t Replies = PcReplies;
+
+	if(write(Slave, pCommand, strlen(pCommand)) != (ssize_t)strlen(pCommand))
+		return 0;
+
+	for(uint32_t i = 0; i < 10000000ULL / TEST_STEP_NS && PcReplies == Replies; i++)
+		TestStep(0);
+
+	return PcReplies == Replies + 1 && strcmp(PcReply, pReply) == 0;
+}
+
+/*!
+ * @brief 1 s of the full load of the bus, every frame must reach the PC
+ *
+ * @param pName				Name of the framing
+ */
+static void TestLoad(const char *pName)
+{
+	const CanSimNodeStats_t *pBridge = CanSimGetNodeStats(&Bridge);
+	uint64_t StartNs = CanSimGetTimeNs();
+	uint64_t BusyNs = CanSimGetStats()->BusyNs;
+	uint64_t Bytes = UartBytes;
+	uint32_t RxFrames = pBridge->RxFrames;
+	uint64_t Ns;
+
+	GenSent = 0;
+	PcFrames = 0;
+	PcMismatches = 0;
+
+	while(CanSimGetTimeNs() - StartNs < TEST_LOAD_NS)
+		TestStep(1);
+	Ns = CanSimGetTimeNs() - StartNs;
+	BusyNs = CanSimGetStats()->BusyNs - BusyNs;
+	Bytes = UartBytes - Bytes;
+
+	/* The rest of the frames and the last chunk */
+	CanSimRunUntilIdle();
+	for(uint32_t i = 0; i < 10000000ULL / TEST_STEP_NS; i++)
+		TestStep(0);
+
+	printf("%-22s %6u frames/s, bus load %5.1f %%, UART %6.1f KB/s (%5.1f %% of %u baud), %u overruns\n",
+		   pName, (unsigned)((uint64_t)GenSent * 1000000000ULL / Ns), BusyNs * 100.0 / Ns,
+		   Bytes * 1e6 / Ns, Bytes * 10 * 1e11 / Ns / TEST_UART_BAUD, TEST_UART_BAUD, SlcanGetStats()->RxOverruns);
+
+	TEST_CHECK(BusyNs * 100 >= Ns * 99);
+	TEST_CHECK(pBridge->RxFrames - RxFrames == GenSent && pBridge->RxLost == 0);
+	TEST_CHECK(PcFrames == GenSent && PcMismatches == 0);
+	TEST_CHECK(SlcanGetStats()->RxOverruns == 0);
+}
+
+/*!
+ * @brief Opens the PTY pair, both ends raw and non-blocking
+ *
+ * @return					1 - PTY is open
+ */
+static uint8_t PtyOpen(void)
+{
+	struct termios Termios;
+
+	Master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(Master < 0 || grantpt(Master) != 0 || unlockpt(Master) != 0)
+		return 0;
+
+	Slave = open(ptsname(Master), O_RDWR | O_NOCTTY);
+	if(Slave < 0 || tcgetattr(Slave, &Termios) != 0)
+		return 0;
+	cfmakeraw(&Termios);
+	if(tcsetattr(Slave, TCSANOW, &Termios) != 0)
+		return 0;
+
+	fcntl(Master, F_SETFL, fcntl(Master, F_GETFL) | O_NONBLOCK);
+	fcntl(Slave, F_SETFL, fcntl(Slave, F_GETFL) | O_NONBLOCK);
+	return 1;
+}
+
+/*!
+ * @brief Bridge on the PTY in real time for a PC tool, until the program is killed
+ */
+static void Serve(void)
+{
+	CAN_Frame_t Frame;
+	uint32_t Ms = 0;
+
+	printf("Bridge on %s (slcand -o %s slcan0), Ctrl+C to stop\n", ptsname(Master), ptsname(Master));
+	fflush(stdout);
+	close(Slave);
+	Slave = -1;
+
+	for(;;)
+	{
+		if(Ms++ % TEST_SERVE_PERIOD_MS == 0)
+		{
+			Frame = TestFrame(GenSent++);
+			CAN_SendFrame(&Gen, &Frame);
+		}
+		for(uint32_t i = 0; i < 1000000ULL / TEST_STEP_NS; i++)
+			TestStep(0);
+		usleep(1000);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	CAN_FilterTypeDef Filter = {0};
+
+	if(!PtyOpen())
+	{
+		printf("FAIL: no pseudo-terminal (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	CanSimInit(TEST_BIT_RATE);
+	Gen.Instance = CAN1;
+	Bridge.Instance = CAN2;
+	CAN_Init(&Gen);
+	CAN_Init(&Bridge);
+	Gen.Init.TransmitFifoPriority = ENABLE;
+
+	/* Both nodes receive everything */
+	Filter.FilterFIFOAssignment = CAN_RX_FIFO0;
+	Filter.FilterMode = CAN_FILTERMODE_IDMASK;
+	Filter.FilterScale = CAN_FILTERSCALE_32BIT;
+	Filter.FilterActivation = ENABLE;
+	Filter.SlaveStartFilterBank = CAN_FILTER_SLAVE_START;
+	HAL_CAN_ConfigFilter(&Gen, &Filter);
+	Filter.FilterBank = CAN_FILTER_SLAVE_START;
+	HAL_CAN_ConfigFilter(&Bridge, &Filter);
+	CAN_Start(&Gen);
+	CAN_Start(&Bridge);
+
+	SlcanInit(&Bridge, SLCAN_MODE_ASCII);
+
+	if(argc > 1 && strcmp(argv[1], "--serve") == 0)
+		Serve();
+
+	/* Commands of the host */
+	TEST_CHECK(PcCommand("V\r", "V1013"));
+	TEST_CHECK(PcCommand("N\r", "N" SLCAN_SERIAL));
+	TEST_CHECK(PcCommand("t1232AABB\r", "\a"));					/* Bus is closed */
+	TEST_CHECK(PcCommand("O\r", ""));
+	TEST_CHECK(PcCommand("t1232AABB\r", "z"));
+	TEST_CHECK(GenRxCount == 1 && GenRxFrame.Id == 0x123 && GenRxFrame.IDE == CAN_ID_STD && GenRxFrame.Dlc == 2);
+	TEST_CHECK(GenRxFrame.Data[0] == 0xAA && GenRxFrame.Data[1] == 0xBB);
+	TEST_CHECK(PcCommand("R01ABCDEF3\r", "Z"));
+	TEST_CHECK(GenRxCount == 2 && GenRxFrame.Id == 0x1ABCDEF && GenRxFrame.IDE == CAN_ID_EXT && GenRxFrame.RTR == CAN_RTR_REMOTE);
+	TEST_CHECK(PcCommand("t12\r", "\a"));
+	TEST_CHECK(PcCommand("S6\r", "\a"));
+	TEST_CHECK(SlcanGetStats()->TxFrames == 2 && SlcanGetStats()->TxErrors == 3);
+
+	/* Full load of the 1 Mbit/s bus */
+	TEST_CHECK(PcCommand("Z1\r", ""));
+	TestLoad("ASCII with timestamps");
+	TEST_CHECK(PcCommand("Y1\r", ""));
+	TestLoad("Binary");
+
+	/* Closed bus forwards nothing */
+	TEST_CHECK(PcCommand("C\r", ""));
+	PcFrames = 0;
+	GenSent = 0;
+	for(uint32_t i = 0; i < 1000; i++)
+		TestStep(1);
+	TEST_CHECK(GenSent > 0 && PcFrames == 0);
+
+	close(Slave);
+	close(Master);
+
+	printf("SLCAN over PTY: %u errors\n", Errors);
+	return (Errors == 0) ? 0 : 1;
+}
+
+#endif /* SLCAN_PTY_TEST */